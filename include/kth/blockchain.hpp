@@ -24,11 +24,31 @@
 #include <kth/blockchain/interface/block_chain.hpp>
 #include <kth/blockchain/interface/fast_chain.hpp>
 #include <kth/blockchain/interface/safe_chain.hpp>
+#include <kth/blockchain/indexes/block_filter.hpp>
+#include <kth/blockchain/indexes/block_filter_index.hpp>
+#include <kth/blockchain/indexes/history_index.hpp>
+#include <kth/blockchain/indexes/muhash.hpp>
+#include <kth/blockchain/indexes/output_index.hpp>
+#include <kth/blockchain/indexes/record_file.hpp>
+#include <kth/blockchain/indexes/script_utxo_index.hpp>
+#include <kth/blockchain/indexes/token_index.hpp>
+#include <kth/blockchain/indexes/utxo_commitment_index.hpp>
 #include <kth/blockchain/pools/block_entry.hpp>
+#include <kth/blockchain/pools/block_metadata_cache.hpp>
 #include <kth/blockchain/pools/block_organizer.hpp>
 #include <kth/blockchain/pools/block_pool.hpp>
+#include <kth/blockchain/pools/block_stats.hpp>
 #include <kth/blockchain/pools/branch.hpp>
+#include <kth/blockchain/pools/ds_proof_pool.hpp>
+#include <kth/blockchain/pools/history_cache.hpp>
+#include <kth/blockchain/pools/insertion_order.hpp>
+#include <kth/blockchain/pools/mempool_index.hpp>
+#include <kth/blockchain/pools/orphan_pool.hpp>
+#include <kth/blockchain/pools/rolling_bloom_filter.hpp>
+#include <kth/blockchain/pools/script_hash_registry.hpp>
+#include <kth/blockchain/pools/short_id.hpp>
 #include <kth/blockchain/pools/transaction_entry.hpp>
+#include <kth/blockchain/pools/transaction_metadata_cache.hpp>
 #include <kth/blockchain/pools/transaction_organizer.hpp>
 #include <kth/blockchain/pools/transaction_pool.hpp>
 #include <kth/blockchain/populate/populate_base.hpp>
@@ -0,0 +1,47 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef KTH_BLOCKCHAIN_BLOCK_FILTER_HPP
+#define KTH_BLOCKCHAIN_BLOCK_FILTER_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include <kth/blockchain/define.hpp>
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+/// Golomb-Rice parameters of the BIP158 basic filter type.
+constexpr uint8_t basic_filter_p = 19;
+constexpr uint64_t basic_filter_m = 784931;
+
+/// The maximum number of filter hashes of a filter headers request (BIP157).
+constexpr size_t max_filter_headers = 2000;
+
+/// The SipHash keys of the filter of a block, from the block hash.
+BCB_API void filter_keys(hash_digest const& block_hash, uint64_t& out_k0, uint64_t& out_k1);
+
+/// The Golomb-coded set of the (distinct) elements, prefixed by their count.
+BCB_API data_chunk gcs_encode(data_stack const& elements, uint64_t k0, uint64_t k1, uint8_t p = basic_filter_p, uint64_t m = basic_filter_m);
+
+/// True if any of the elements is (probably) in the set, false if none is or
+/// if the filter is malformed.
+BCB_API bool gcs_match_any(data_chunk const& filter, data_stack const& elements, uint64_t k0, uint64_t k1, uint8_t p = basic_filter_p, uint64_t m = basic_filter_m);
+
+/// The distinct elements of the basic filter of a block: the output scripts,
+/// except empty and OP_RETURN, and the scripts spent by the inputs.
+/// Prevouts of non-coinbase inputs must be populated, false if any is not.
+BCB_API bool basic_filter_elements(domain::chain::block const& block, data_stack& out);
+
+/// The basic filter of a block, false if a prevout is not populated.
+BCB_API bool basic_filter(domain::chain::block const& block, data_chunk& out);
+
+/// The header of a filter, committing to the header of the previous block
+/// filter (null_hash for the genesis block).
+BCB_API hash_digest filter_header(hash_digest const& filter_hash, hash_digest const& previous_header);
+
+} // namespace kth::blockchain
+
+#endif
@@ -0,0 +1,91 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef KTH_BLOCKCHAIN_BLOCK_FILTER_INDEX_HPP
+#define KTH_BLOCKCHAIN_BLOCK_FILTER_INDEX_HPP
+
+#include <cstddef>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <kth/blockchain/define.hpp>
+#include <kth/blockchain/indexes/record_file.hpp>
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+/// This class is thread safe.
+/// The basic filters (BIP158) of the blocks of the chain, from genesis.
+/// Filter hashes and headers are kept for every indexed height, the filters
+/// themselves only for the most recent (window) blocks. With files, the
+/// entries and the filters of every height are also kept there, so that any
+/// filter is served and the index is not built again on restart.
+class BCB_API block_filter_index {
+public:
+    struct entry {
+        hash_digest block_hash;
+        hash_digest filter_hash;
+        hash_digest header;
+    };
+
+    explicit
+    block_filter_index(size_t window);
+
+    block_filter_index(size_t window, std::filesystem::path const& entries_file, std::filesystem::path const& filters_file);
+
+    /// Open the files and restore the entries and the most recent filters
+    /// they hold. True if there are no files, false if these cannot be opened.
+    bool open();
+
+    void close();
+
+    /// The number of indexed blocks, which is the next height to push.
+    size_t size() const;
+
+    /// Index the filter of the block at the next height. False if the height
+    /// is not the next one, if the block does not extend the indexed top or
+    /// if a file write fails.
+    bool push(hash_digest const& block_hash, hash_digest const& previous_block_hash, size_t height, data_chunk&& filter);
+
+    /// Keep only the first count blocks.
+    void truncate(size_t count);
+
+    /// Drop all blocks (to rebuild from genesis).
+    void clear();
+
+    /// The entry of the indexed block at the height.
+    bool get(size_t height, entry& out) const;
+
+    /// The entry and height of the indexed block.
+    bool get(hash_digest const& block_hash, entry& out_entry, size_t& out_height) const;
+
+    /// The filter of the block at the height, false if not within the window
+    /// and not in the file.
+    bool filter(size_t height, data_chunk& out) const;
+
+    /// The filter hashes of the heights [start, stop], empty if not indexed.
+    hash_list filter_hashes(size_t start, size_t stop) const;
+
+private:
+    void truncate_unlocked(size_t count);
+
+    size_t const window_;
+
+    // These are thread safe.
+    std::unique_ptr<record_file> entries_file_;
+    std::unique_ptr<record_file> filters_file_;
+
+    // These are protected by mutex.
+    std::vector<entry> entries_;
+    std::unordered_map<hash_digest, size_t> heights_;
+    std::deque<data_chunk> filters_;
+    mutable shared_mutex mutex_;
+};
+
+} // namespace kth::blockchain
+
+#endif
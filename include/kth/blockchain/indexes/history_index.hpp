@@ -0,0 +1,161 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef KTH_BLOCKCHAIN_HISTORY_INDEX_HPP
+#define KTH_BLOCKCHAIN_HISTORY_INDEX_HPP
+
+#include <atomic>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <iosfwd>
+#include <mutex>
+#include <vector>
+
+#include <kth/blockchain/define.hpp>
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+/// This class is thread safe.
+/// The history of the addresses of the chain, from genesis, with the rows the
+/// store writes (outputs paying and inputs spending each address), ordered by
+/// address and then by height, point and kind. A page of the history of an
+/// address is read by a seek to its first key and a scan of the page rows.
+/// The rows of the most recent blocks are kept in memory, older rows are
+/// written to sorted files (runs) of consecutive heights, which are merged as
+/// they accumulate so that a seek reads few files. A reorganization deeper
+/// than the window clears the index, to be built again. Without a directory
+/// all rows are kept in memory.
+class BCB_API history_index {
+public:
+    /// The position of a row in the history of an address.
+    struct key {
+        size_t height;
+        hash_digest hash;
+        uint32_t index;
+        domain::chain::point_kind kind;
+
+        auto operator<=>(key const& other) const = default;
+    };
+
+    /// The blocks past the window written to a run, by default.
+    static constexpr size_t default_run_blocks = 1000;
+
+    explicit
+    history_index(size_t window);
+
+    history_index(size_t window, std::filesystem::path const& directory, size_t run_blocks = default_run_blocks);
+
+    /// Open the directory and restore the runs it holds, the blocks held in
+    /// memory when closed are indexed again. True if there is no directory,
+    /// false if it cannot be opened. A damaged run clears the index.
+    bool open();
+
+    void close();
+
+    /// The number of indexed blocks, which is the next height to push.
+    size_t size() const;
+
+    /// The hash of the block at the height, false if not kept (only the
+    /// blocks in memory and the top written block are).
+    bool block_hash(size_t height, hash_digest& out) const;
+
+    /// Whether the builder has brought the index up to the chain top, the
+    /// results of read are partial until then. Cleared by open and clear.
+    bool synced() const;
+    void set_synced();
+
+    /// Index the rows of the block at the next height. False if the height is
+    /// not the next one, if the block does not extend the indexed top or if a
+    /// prevout is not populated.
+    bool push(domain::chain::block const& block, size_t height);
+
+    /// Keep only the first count blocks. False if a dropped block is past the
+    /// window, in which case the index is cleared.
+    bool truncate(size_t count);
+
+    /// Drop all blocks (to rebuild from genesis).
+    void clear();
+
+    /// Write the blocks past the window to a run and merge the runs, if due.
+    /// Files are written without holding the index, which is only held to
+    /// swap the runs. False if a write fails.
+    bool flush();
+
+    /// Up to limit (non-zero) rows of the address, from the key on. False if
+    /// a run cannot be read.
+    bool read(short_hash const& address, key const& from, size_t limit, domain::chain::history_compact::list& out) const;
+
+private:
+    struct row {
+        short_hash address;
+        uint32_t height;
+        hash_digest hash;
+        uint32_t index;
+        uint8_t kind;
+        uint64_t value;
+    };
+
+    using rows = std::vector<row>;
+
+    struct block_rows {
+        hash_digest block_hash;
+        rows values;
+    };
+
+    // A sampled row is the key of every sample_stride row of the run.
+    struct run {
+        uint64_t number;
+        uint32_t level;
+        size_t first_height;
+        size_t last_height;
+        uint64_t count;
+        rows samples;
+    };
+
+    static bool before(row const& left, row const& right);
+    static bool before(row const& value, short_hash const& address, key const& from);
+    static domain::chain::history_compact to_history(row const& value);
+    static void write_row(std::ostream& stream, row const& value);
+    static bool read_row(std::istream& stream, row& out);
+
+    std::filesystem::path run_file(uint64_t number) const;
+    bool write_run(run& out, rows const& values) const;
+    bool merge_runs(run& out, std::vector<run> const& runs) const;
+    bool read_run(run const& value, short_hash const& address, key const& from, size_t limit, domain::chain::history_compact::list& out) const;
+    bool sample_run(run& value) const;
+    bool read_manifest_unlocked();
+    bool write_manifest_unlocked() const;
+    void remove_runs(std::vector<run> const& runs) const;
+    void clear_unlocked();
+
+    size_t const window_;
+    size_t const run_blocks_;
+    std::filesystem::path const directory_;
+
+    // This is thread safe.
+    std::atomic<bool> synced_;
+
+    // Serializes the writers of runs, not held by readers.
+    std::mutex flush_mutex_;
+
+    // This is protected by flush mutex.
+    uint64_t next_number_;
+
+    // These are protected by mutex.
+    // The runs by height, then the rows of the blocks above them.
+    size_t size_;
+    hash_digest runs_top_hash_;
+    uint64_t generation_;
+    std::vector<run> runs_;
+    std::deque<block_rows> blocks_;
+    mutable shared_mutex mutex_;
+};
+
+} // namespace kth::blockchain
+
+#endif
@@ -0,0 +1,52 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef KTH_BLOCKCHAIN_MUHASH_HPP
+#define KTH_BLOCKCHAIN_MUHASH_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include <kth/blockchain/define.hpp>
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+/// This class is NOT thread safe.
+/// MuHash3072 set accumulator. Elements are hashed to numbers modulo the
+/// prime 2^3072 - 1103717, multiplied in on insert and divided out on
+/// removal, so the digest does not depend on the order of the updates.
+class BCB_API muhash {
+public:
+    static constexpr size_t limb_count = 48;
+    static constexpr size_t serialized_size = 2 * limb_count * sizeof(uint64_t);
+    using number = std::array<uint64_t, limb_count>;
+
+    /// The empty set.
+    muhash();
+
+    void insert(data_slice element);
+    void remove(data_slice element);
+
+    /// Apply the updates of another accumulator.
+    void combine(muhash const& other);
+
+    /// The SHA256 of the set number, which requires an inversion.
+    hash_digest digest() const;
+
+    /// The accumulator state, to be restored by from_data.
+    data_chunk to_data() const;
+
+    /// Restore the state, false (unchanged) if the size is not valid.
+    bool from_data(data_slice data);
+
+private:
+    number numerator_;
+    number denominator_;
+};
+
+} // namespace kth::blockchain
+
+#endif
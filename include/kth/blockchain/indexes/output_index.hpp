@@ -0,0 +1,113 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef KTH_BLOCKCHAIN_OUTPUT_INDEX_HPP
+#define KTH_BLOCKCHAIN_OUTPUT_INDEX_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <filesystem>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <kth/blockchain/define.hpp>
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+/// This class is thread safe.
+/// Unspent outputs by a key derived from each output (outputs without a key
+/// are not indexed), built from the connected blocks. The outputs spent by
+/// the most recent blocks are kept (up to the undo depth, zero for all) to
+/// restore them when the blocks are disconnected. The index is saved to a
+/// file and loaded from it, so that it is not built again on each start.
+class BCB_API output_index {
+public:
+    struct entry {
+        domain::chain::output_point point;
+        size_t height;
+        domain::chain::output output;
+    };
+
+    using list = std::vector<entry>;
+
+    explicit
+    output_index(size_t undo_depth);
+
+    virtual
+    ~output_index() = default;
+
+    /// The next height to connect.
+    size_t size() const;
+
+    /// The hash of the top connected block.
+    hash_digest top_hash() const;
+
+    /// Whether the builder has brought the index up to the chain top, the
+    /// results of find are partial until then. Cleared by reset and clear.
+    bool synced() const;
+    void set_synced();
+
+    /// Write the index (with its kept spends) to the file, replacing it.
+    bool save(std::filesystem::path const& file) const;
+
+    /// Replace the index by the one saved to the file. False if the file is
+    /// missing or invalid, in which case the index is cleared.
+    bool load(std::filesystem::path const& file);
+
+    /// Start an empty index above the block at height - 1, blocks below the
+    /// height are considered connected.
+    void reset(size_t height, hash_digest const& previous_block_hash);
+
+    /// Connect the block at the next height. False if the height is not the
+    /// next one or if the block does not extend the indexed top.
+    bool connect(domain::chain::block const& block, size_t height);
+
+    /// Disconnect the top block. False if the block is not the top one or if
+    /// its spends are no longer kept, the index must then be rebuilt.
+    bool disconnect(domain::chain::block const& block);
+
+    /// The unspent outputs of the key.
+    list find(hash_digest const& key) const;
+
+    /// Remove all outputs and blocks.
+    void clear();
+
+protected:
+    /// The key of the output, false if the output is not indexed.
+    virtual
+    bool key(domain::chain::output const& output, hash_digest& out) const = 0;
+
+private:
+    // The entry and its key, which is not derived again on removal.
+    using keyed_entry = std::pair<hash_digest, entry>;
+
+    struct undo {
+        hash_digest block_hash;
+        std::vector<keyed_entry> spent;
+    };
+
+    void add_unlocked(keyed_entry&& value);
+    bool remove_unlocked(domain::chain::output_point const& point, keyed_entry* out);
+
+    size_t const undo_depth_;
+
+    // This is thread safe.
+    std::atomic<bool> synced_;
+
+    // These are protected by mutex.
+    size_t size_;
+    hash_digest top_hash_;
+    std::unordered_map<domain::chain::output_point, keyed_entry> outputs_;
+    std::unordered_map<hash_digest, std::unordered_set<domain::chain::output_point>> keys_;
+    std::deque<undo> undo_;
+    mutable shared_mutex mutex_;
+};
+
+} // namespace kth::blockchain
+
+#endif
@@ -0,0 +1,66 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef KTH_BLOCKCHAIN_RECORD_FILE_HPP
+#define KTH_BLOCKCHAIN_RECORD_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <vector>
+
+#include <kth/blockchain/define.hpp>
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+/// This class is thread safe.
+/// Records by height, from zero, in a file appended at the top and truncated
+/// on reorganization. Each record is its size (four bytes, little endian)
+/// followed by its data. The record offsets are read on open and kept.
+class BCB_API record_file {
+public:
+    using record_handler = std::function<void(size_t, data_chunk&&)>;
+
+    explicit
+    record_file(std::filesystem::path path);
+
+    /// Open (or create) the file and read the record offsets, passing each
+    /// record to the handler if any. A partial last record (an interrupted
+    /// write) is dropped. False if the file cannot be opened.
+    bool open(record_handler const& handler = {});
+
+    void close();
+
+    /// The number of records, which is the next height to push.
+    size_t size() const;
+
+    /// Append the record of the next height. False if the height is not the
+    /// next one or if the write fails.
+    bool push(size_t height, data_slice data);
+
+    /// Keep only the first count records.
+    bool truncate(size_t count);
+
+    /// The record at the height.
+    bool get(size_t height, data_chunk& out) const;
+
+private:
+    bool truncate_unlocked(size_t count);
+    bool resize_unlocked();
+
+    std::filesystem::path const path_;
+
+    // These are protected by mutex.
+    // The offset of each record, followed by the end of the last one.
+    std::vector<uint64_t> offsets_;
+    mutable std::fstream file_;
+    mutable shared_mutex mutex_;
+};
+
+} // namespace kth::blockchain
+
+#endif
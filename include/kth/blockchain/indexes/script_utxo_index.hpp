@@ -0,0 +1,29 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef KTH_BLOCKCHAIN_SCRIPT_UTXO_INDEX_HPP
+#define KTH_BLOCKCHAIN_SCRIPT_UTXO_INDEX_HPP
+
+#include <cstddef>
+
+#include <kth/blockchain/define.hpp>
+#include <kth/blockchain/indexes/output_index.hpp>
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+/// This class is thread safe.
+/// The confirmed unspent outputs by script hash (see mempool_index).
+class BCB_API script_utxo_index : public output_index {
+public:
+    explicit
+    script_utxo_index(size_t undo_depth);
+
+protected:
+    bool key(domain::chain::output const& output, hash_digest& out) const override;
+};
+
+} // namespace kth::blockchain
+
+#endif
@@ -0,0 +1,34 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef KTH_BLOCKCHAIN_TOKEN_INDEX_HPP
+#define KTH_BLOCKCHAIN_TOKEN_INDEX_HPP
+
+#include <cstddef>
+
+#include <kth/blockchain/define.hpp>
+#include <kth/blockchain/indexes/output_index.hpp>
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+/// This class is thread safe.
+/// The unspent outputs holding CashTokens, by token category.
+class BCB_API token_index : public output_index {
+public:
+    explicit
+    token_index(size_t undo_depth);
+
+    using output_index::find;
+
+    /// The unspent token outputs of the category holding the NFT commitment.
+    list find(hash_digest const& category, data_chunk const& commitment) const;
+
+protected:
+    bool key(domain::chain::output const& output, hash_digest& out) const override;
+};
+
+} // namespace kth::blockchain
+
+#endif
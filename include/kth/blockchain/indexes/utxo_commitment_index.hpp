@@ -0,0 +1,84 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef KTH_BLOCKCHAIN_UTXO_COMMITMENT_INDEX_HPP
+#define KTH_BLOCKCHAIN_UTXO_COMMITMENT_INDEX_HPP
+
+#include <cstddef>
+#include <deque>
+#include <filesystem>
+#include <memory>
+
+#include <kth/blockchain/define.hpp>
+#include <kth/blockchain/indexes/muhash.hpp>
+#include <kth/blockchain/indexes/record_file.hpp>
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+/// This class is thread safe.
+/// MuHash of the unspent output set of the chain, from genesis, with the set
+/// state after each of the most recent (window) blocks. Each unspendable
+/// (OP_RETURN) output is excluded, an element is the serialized outpoint
+/// followed by the serialized output. The set is accumulated from the outputs
+/// created and spent by the blocks, not read from the store UTXO table.
+/// With a file, the state after every block is also kept there by height, so
+/// that any indexed height is served and the set is not rebuilt on restart.
+class BCB_API utxo_commitment_index {
+public:
+    explicit
+    utxo_commitment_index(size_t window);
+
+    utxo_commitment_index(size_t window, std::filesystem::path const& file);
+
+    /// Open the file and restore the most recent states it holds. True if
+    /// there is no file, false if it cannot be opened.
+    bool open();
+
+    void close();
+
+    /// The number of applied blocks, which is the next height to push.
+    size_t size() const;
+
+    /// Apply the outputs created and spent by the block at the next height.
+    /// False if the height is not the next one, if the block does not extend
+    /// the top, if a prevout is not populated or if the file write fails.
+    bool push(domain::chain::block const& block, size_t height);
+
+    /// Keep only the first count blocks. False if the state at the new top
+    /// is no longer kept, in which case the set is cleared.
+    bool truncate(size_t count);
+
+    /// The hash of the block at the height, false if not kept.
+    bool block_hash(size_t height, hash_digest& out) const;
+
+    /// The set digest after the block at the height and the hash of the
+    /// block, false if not kept.
+    bool digest(size_t height, hash_digest& out_block_hash, hash_digest& out_digest) const;
+
+    /// Drop all blocks (to rebuild from genesis).
+    void clear();
+
+private:
+    struct state {
+        hash_digest block_hash;
+        muhash set;
+    };
+
+    bool read(size_t height, state& out) const;
+
+    size_t const window_;
+
+    // This is thread safe.
+    std::unique_ptr<record_file> file_;
+
+    // These are protected by mutex.
+    size_t size_;
+    std::deque<state> states_;
+    mutable shared_mutex mutex_;
+};
+
+} // namespace kth::blockchain
+
+#endif
@@ -9,7 +9,9 @@
 #include <cstddef>
 #include <cstdint>
 #include <ctime>
+#include <filesystem>
 #include <functional>
+#include <mutex>
 #include <vector>
 
 // #include <kth/infrastructure.hpp>
@@ -19,7 +21,18 @@
 #include <kth/blockchain/define.hpp>
 #include <kth/blockchain/interface/fast_chain.hpp>
 #include <kth/blockchain/interface/safe_chain.hpp>
+#include <kth/blockchain/indexes/block_filter_index.hpp>
+#include <kth/blockchain/indexes/history_index.hpp>
+#include <kth/blockchain/indexes/record_file.hpp>
+#include <kth/blockchain/indexes/script_utxo_index.hpp>
+#include <kth/blockchain/indexes/token_index.hpp>
+#include <kth/blockchain/indexes/utxo_commitment_index.hpp>
 #include <kth/blockchain/pools/block_organizer.hpp>
+#include <kth/blockchain/pools/block_metadata_cache.hpp>
+#include <kth/blockchain/pools/history_cache.hpp>
+#include <kth/blockchain/pools/mempool_index.hpp>
+#include <kth/blockchain/pools/script_hash_registry.hpp>
+#include <kth/blockchain/pools/transaction_metadata_cache.hpp>
 #include <kth/blockchain/pools/transaction_organizer.hpp>
 #include <kth/blockchain/populate/populate_chain_state.hpp>
 #include <kth/blockchain/settings.hpp>
@@ -175,12 +188,57 @@ public:
 
     void fetch_block_header_txs_size(hash_digest const& hash, block_header_txs_size_fetch_handler handler) const override;
 
+    /// fetch the block metadata record, by block height.
+    void fetch_block_metadata(size_t height, block_metadata_fetch_handler handler) const override;
+
+    /// fetch the block metadata record, by block hash.
+    void fetch_block_metadata(hash_digest const& hash, block_metadata_fetch_handler handler) const override;
+
+    /// fetch the block statistics, by block height.
+    void fetch_block_stats(size_t height, block_stats_fetch_handler handler) const override;
+
+    /// fetch the block statistics, by block hash.
+    void fetch_block_stats(hash_digest const& hash, block_stats_fetch_handler handler) const override;
+
+    /// fetch the transactions at the indexes of a block, by block hash.
+    void fetch_block_transactions(hash_digest const& hash, std::vector<uint64_t> const& indexes, block_transactions_fetch_handler handler) const override;
+
     /// fetch hashes of transactions for a block, by block height.
     void fetch_merkle_block(size_t height, merkle_block_fetch_handler handler) const override;
 
     /// fetch hashes of transactions for a block, by block hash.
     void fetch_merkle_block(hash_digest const& hash, merkle_block_fetch_handler handler) const override;
 
+    /// fetch the merkle branch of a confirmed transaction, by tx hash.
+    void fetch_merkle_proof(hash_digest const& tx_hash, merkle_proof_fetch_handler handler) const override;
+
+    /// fetch the basic filter and filter header of a block, by block hash.
+    void fetch_block_filter(hash_digest const& block_hash, block_filter_fetch_handler handler) const override;
+
+    /// fetch the filter header preceding the start height and the filter
+    /// hashes from the start height to the stop block.
+    void fetch_filter_headers(size_t start_height, hash_digest const& stop_hash, filter_headers_fetch_handler handler) const override;
+
+    /// fetch the unspent output set digest (MuHash) after the block at the
+    /// height, with the hash of the block, if within the recent heights.
+    void fetch_utxo_commitment(size_t height, utxo_commitment_fetch_handler handler) const override;
+
+    /// fetch the confirmed unspent outputs holding tokens of the category
+    /// (index_not_ready while the index is built).
+    void fetch_token_outputs(hash_digest const& category, token_outputs_fetch_handler handler) const override;
+
+    /// fetch the confirmed unspent outputs holding the NFT of the category
+    /// (index_not_ready while the index is built).
+    void fetch_token_outputs(hash_digest const& category, data_chunk const& commitment, token_outputs_fetch_handler handler) const override;
+
+    /// fetch the unspent outputs of a script hash, including unconfirmed
+    /// (index_not_ready while the index is built).
+    void fetch_unspent_outputs(hash_digest const& script_hash, unspent_outputs_fetch_handler handler) const override;
+
+    /// fetch the confirmed balance and the unconfirmed change of a script hash
+    /// (index_not_ready while the index is built).
+    void fetch_balance(hash_digest const& script_hash, balance_fetch_handler handler) const override;
+
     /// fetch compact block by block height.
     void fetch_compact_block(size_t height, compact_block_fetch_handler handler) const override;
 
@@ -190,6 +248,9 @@ public:
     /// fetch DSProof by hash.
     void fetch_ds_proof(hash_digest const& hash, ds_proof_fetch_handler handler) const override;
 
+    /// fetch the DSProof of a double spend of an unconfirmed transaction.
+    void fetch_transaction_ds_proof(hash_digest const& hash, ds_proof_fetch_handler handler) const override;
+
     // void for_each_transaction(size_t from, size_t to, for_each_tx_handler const& handler) const override;
 
     // void for_each_transaction_non_coinbase(size_t from, size_t to, for_each_tx_handler const& handler) const override;
@@ -197,6 +258,9 @@ public:
     /// fetch transaction by hash.
     void fetch_transaction(hash_digest const& hash, bool require_confirmed, transaction_fetch_handler handler) const override;
 
+    /// fetch transactions by hash, results in request order.
+    void fetch_transactions(hash_list const& hashes, bool require_confirmed, transactions_fetch_handler handler) const override;
+
     /// fetch position and height within block of transaction by hash.
     void fetch_transaction_position(hash_digest const& hash, bool require_confirmed, transaction_index_fetch_handler handler) const override;
 
@@ -265,6 +329,22 @@ public:
     /// Fetch all the txns used by the wallet
     void fetch_confirmed_transactions(const short_hash& address_hash, size_t limit, size_t from_height, confirmed_transactions_fetch_handler handler) const override;
 
+    /// fetch the history of each address, streamed per address index.
+    void fetch_histories(std::vector<short_hash> const& address_hashes, size_t limit, size_t from_height, history_batch_handler handler, result_handler completion) const override;
+
+    /// fetch the confirmed transactions of each address, streamed per address index.
+    void fetch_confirmed_transactions(std::vector<short_hash> const& address_hashes, size_t limit, size_t from_height, confirmed_transactions_batch_handler handler, result_handler completion) const override;
+
+    /// fetch a page of history from the cursor, with the next cursor and
+    /// true if the history is exhausted. Read from the history index, the
+    /// error is not_found if it is disabled.
+    void fetch_history_page(short_hash const& address_hash, history_cursor const& cursor, size_t page_size, history_page_handler handler) const override;
+
+    /// fetch a page of confirmed transactions from the cursor, with the next
+    /// cursor and true if the history is exhausted. Read from the history
+    /// index, the error is not_found if it is disabled.
+    void fetch_confirmed_transactions_page(short_hash const& address_hash, history_cursor const& cursor, size_t page_size, confirmed_transactions_page_handler handler) const override;
+
 //     /// fetch stealth results.
 //     void fetch_stealth(const binary& filter, size_t from_height, stealth_fetch_handler handler) const override;
 
@@ -312,6 +392,18 @@ public:
     /// Send null data success notification to all subscribers.
     void unsubscribe() override;
 
+    /// Subscribe to the txs of a set of script hashes, returns the id.
+    size_t subscribe_script_hashes(script_hash_handler&& handler) override;
+
+    /// Add script hashes to the subscription.
+    bool watch_script_hashes(size_t id, hash_list const& script_hashes) override;
+
+    /// Remove script hashes from the subscription.
+    bool unwatch_script_hashes(size_t id, hash_list const& script_hashes) override;
+
+    /// Remove the script hash subscription.
+    void unsubscribe_script_hashes(size_t id) override;
+
     // Transaction Validation.
     //-----------------------------------------------------------------------------
 
@@ -321,14 +413,24 @@ public:
     //-------------------------------------------------------------------------
 
     /// Organize a block into the block pool if valid and sufficient.
+    /// Blocks are queued, the handler is invoked once the block is organized.
     void organize(block_const_ptr block, result_handler handler) override;
 
     /// Store a transaction to the pool if valid.
     void organize(transaction_const_ptr tx, result_handler handler) override;
 
+    /// Store the valid transactions of a batch to the pool, in dependency
+    /// order, with a result per transaction (in batch order).
+    void organize(transaction_const_ptr_list_const_ptr txs, organize_results_handler handler) override;
+
     /// Store a DSProof to the pool if valid.
     void organize(double_spend_proof_const_ptr ds_proof, result_handler handler) override;
 
+    /// Validate a package of dependent transactions, parents first, with a
+    /// result per transaction and fees checked for the whole package. The
+    /// package is stored to the pool unless testing.
+    void organize_package(transaction_const_ptr_list_const_ptr txs, bool test_accept, organize_results_handler handler) override;
+
     // Properties.
     //-------------------------------------------------------------------------
 
@@ -368,11 +470,46 @@ private:
     code set_chain_state(domain::chain::chain_state::ptr previous);
     void handle_transaction(code const& ec, transaction_const_ptr tx, result_handler handler) const;
     void handle_block(code const& ec, block_const_ptr block, result_handler handler) const;
-    void handle_reorganize(code const& ec, block_const_ptr top, result_handler handler);
+    void handle_reorganize(code const& ec, block_const_ptr_list_const_ptr incoming_blocks, block_const_ptr_list_const_ptr outgoing_blocks, result_handler handler);
+    void update_mempool_index(block_const_ptr_list_const_ptr incoming_blocks, block_const_ptr_list_const_ptr outgoing_blocks);
+    void populate_unconfirmed_prevouts(domain::chain::transaction const& tx) const;
+    void update_block_metadata(size_t top_height, block_const_ptr_list_const_ptr incoming_blocks, block_const_ptr_list_const_ptr outgoing_blocks);
+    void forget_transaction_metadata(block_const_ptr_list_const_ptr incoming_blocks);
+    bool open_block_records();
+    void write_block_record(size_t height, block_metadata const& metadata);
+    block_metadata::ptr find_block_metadata(size_t height) const;
+    block_metadata::ptr find_block_metadata(hash_digest const& hash) const;
+    block_metadata::ptr get_block_metadata(size_t height) const;
+    block_metadata::ptr get_block_metadata(hash_digest const& hash) const;
+    block_metadata::ptr get_block_stats(size_t height) const;
+    block_metadata::ptr get_block_stats(hash_digest const& hash) const;
+    block_metadata::ptr compute_block_stats(domain::chain::block const& block, size_t height, block_metadata::ptr metadata) const;
+    bool populate_spent_outputs(domain::chain::block const& block) const;
+    bool read_block_filter(size_t height, block_filter_index::entry const& entry, data_chunk& out) const;
+    void invalidate_history(block_const_ptr_list_const_ptr incoming_blocks, block_const_ptr_list_const_ptr outgoing_blocks);
+    void update_indexes(size_t top_height, block_const_ptr_list_const_ptr incoming_blocks, block_const_ptr_list_const_ptr outgoing_blocks);
+    void update_block_filters(size_t top_height, block_const_ptr_list_const_ptr incoming_blocks);
+    void update_utxo_commitments(size_t top_height, block_const_ptr_list_const_ptr incoming_blocks);
+    void update_history_index(size_t top_height, block_const_ptr_list_const_ptr incoming_blocks);
+    void update_output_index(output_index& index, size_t top_height, block_const_ptr_list_const_ptr incoming_blocks, block_const_ptr_list_const_ptr outgoing_blocks);
+    using indexed_hash_reader = std::function<bool(size_t, hash_digest&)>;
+
+    bool indexing() const;
+    bool open_indexes();
+    bool open_output_index(output_index& index, char const* name);
+    void close_indexes();
+    size_t chained_count(size_t count, indexed_hash_reader const& indexed_hash) const;
+    void start_index_sync();
+    void sync_indexes();
+    size_t index_sync_height(size_t top);
+    size_t output_index_sync_height(output_index& index, size_t start_height, size_t top);
+    bool sync_index_block(domain::chain::block const& block, size_t height, data_chunk filter);
+    transaction_fetch_result read_transaction(hash_digest const& hash, bool require_confirmed) const;
 
     // These are thread safe.
     std::atomic<bool> stopped_;
     settings const& settings_;
+    std::filesystem::path const index_directory_;
     const time_t notify_limit_seconds_;
     kth::atomic<block_const_ptr> last_block_;
 
@@ -387,10 +524,28 @@ private:
     mutable shared_mutex pool_state_mutex_;
 
     // These are thread safe.
+    mempool_index mempool_index_;
+    mutable block_metadata_cache block_metadata_;
+    record_file block_records_;
+    transaction_metadata_cache transaction_metadata_;
+    mutable history_cache history_cache_;
+    script_hash_registry script_hash_registry_;
+    block_filter_index block_filters_;
+    token_index token_index_;
+    script_utxo_index script_utxo_index_;
+    utxo_commitment_index utxo_commitments_;
+    history_index history_index_;
+    std::atomic<bool> indexes_syncing_;
+    std::atomic<bool> indexes_open_;
     mutable prioritized_mutex validation_mutex_;
     mutable threadpool priority_pool_;
     mutable dispatcher dispatch_;
+    dispatcher index_dispatch_;
+    dispatcher notify_dispatch_;
 
+    // Serializes the writers of the optional indexes, store reads are not
+    // made under it.
+    std::mutex indexes_mutex_;
 
 #if defined(KTH_WITH_MEMPOOL)
     mining::mempool mempool_;
@@ -16,6 +16,10 @@
 #include <kth/infrastructure/handlers.hpp>
 
 #include <kth/blockchain/define.hpp>
+#include <kth/blockchain/indexes/token_index.hpp>
+#include <kth/blockchain/pools/block_metadata_cache.hpp>
+#include <kth/blockchain/pools/block_stats.hpp>
+#include <kth/blockchain/pools/script_hash_registry.hpp>
 #include <kth/blockchain/pools/mempool_transaction_summary.hpp>
 
 namespace kth::blockchain {
@@ -26,6 +30,48 @@ namespace kth::blockchain {
 class BCB_API safe_chain {
 public:
     using result_handler = handle0;
+    using organize_results_handler = std::function<void(code const&, std::vector<code> const&)>;
+
+    /// The result of one lookup of a batched transaction fetch.
+    struct transaction_fetch_result {
+        code ec;
+        transaction_const_ptr transaction;
+        size_t position;
+        size_t height;
+        bool confirmed;
+    };
+
+    using transaction_fetch_results = std::vector<transaction_fetch_result>;
+
+    /// An unspent output of a script hash, unconfirmed ones at height zero.
+    struct unspent_output {
+        domain::chain::output_point point;
+        uint64_t value;
+        size_t height;
+        bool confirmed;
+    };
+
+    using unspent_outputs = std::vector<unspent_output>;
+
+    /// A resumable position in the history of an address, which is ordered
+    /// by height, then by point and kind. The cursor is the key of the first
+    /// entry to read, { height } reads from the height.
+    struct history_cursor {
+        size_t height;
+        hash_digest hash = null_hash;
+        uint32_t index = 0;
+        domain::chain::point_kind kind = domain::chain::point_kind::output;
+    };
+
+    /// The error of the index queries while the index is being built (on
+    /// first start or after a reorganization below its undo depth), the
+    /// results would be partial.
+    static constexpr auto index_not_ready = error::operation_failed_17;
+
+    /// The error of a block not organized as the organize queue is full. It
+    /// says nothing of the block, which may be submitted again once the queue
+    /// has drained.
+    static constexpr auto block_queue_full = error::operation_failed_20;
 
     /// Object fetch handlers.
     using last_height_fetch_handler = handle1<size_t>;
@@ -33,18 +79,33 @@ public:
     using output_fetch_handler = handle1<domain::chain::output>;
     using spend_fetch_handler = handle1<domain::chain::input_point>;
     using history_fetch_handler = handle1<domain::chain::history_compact::list>;
+    using history_batch_handler = std::function<void(code const&, size_t, domain::chain::history_compact::list const&)>;
+    using history_page_handler = std::function<void(code const&, domain::chain::history_compact::list const&, history_cursor const&, bool)>;
     using stealth_fetch_handler = handle1<domain::chain::stealth_compact::list>;
     using transaction_index_fetch_handler = handle2<size_t, size_t>;
 
     using confirmed_transactions_fetch_handler = handle1<std::vector<hash_digest>>;
+    using confirmed_transactions_batch_handler = std::function<void(code const&, size_t, std::vector<hash_digest> const&)>;
+    using confirmed_transactions_page_handler = std::function<void(code const&, std::vector<hash_digest> const&, history_cursor const&, bool)>;
     // Smart pointer parameters must not be passed by reference.
     using block_fetch_handler = std::function<void(code const&, block_const_ptr, size_t)>;
     using block_header_txs_size_fetch_handler = std::function<void(code const&, header_const_ptr, size_t, std::shared_ptr<hash_list>, uint64_t)>;
+    using block_metadata_fetch_handler = std::function<void(code const&, block_metadata::ptr)>;
+    using block_stats_fetch_handler = std::function<void(code const&, block_stats const&, size_t)>;
+    using block_transactions_fetch_handler = std::function<void(code const&, transaction_const_ptr_list_const_ptr, size_t)>;
     using block_hash_time_fetch_handler = std::function<void(code const&, hash_digest const&, uint32_t, size_t)>;
     using merkle_block_fetch_handler =  std::function<void(code const&, merkle_block_ptr, size_t)>;
+    using merkle_proof_fetch_handler = std::function<void(code const&, hash_list const&, size_t, size_t)>;
+    using block_filter_fetch_handler = std::function<void(code const&, data_chunk const&, hash_digest const&, size_t)>;
+    using filter_headers_fetch_handler = std::function<void(code const&, hash_digest const&, hash_list const&)>;
+    using utxo_commitment_fetch_handler = std::function<void(code const&, hash_digest const&, hash_digest const&)>;
+    using token_outputs_fetch_handler = std::function<void(code const&, token_index::list const&)>;
+    using unspent_outputs_fetch_handler = std::function<void(code const&, unspent_outputs const&)>;
+    using balance_fetch_handler = std::function<void(code const&, uint64_t, int64_t)>;
     using compact_block_fetch_handler = std::function<void(code const&, compact_block_ptr, size_t)>;
     using block_header_fetch_handler = std::function<void(code const&, header_ptr, size_t)>;
     using transaction_fetch_handler = std::function<void(code const&, transaction_const_ptr, size_t, size_t)>;
+    using transactions_fetch_handler = std::function<void(code const&, std::shared_ptr<transaction_fetch_results const>)>;
     using ds_proof_fetch_handler = std::function<void(code const&, double_spend_proof_const_ptr)>;
     using transaction_unconfirmed_fetch_handler = std::function<void(code const&, transaction_const_ptr)>;
 
@@ -56,6 +117,7 @@ public:
     using reorganize_handler = std::function<bool(code, size_t, block_const_ptr_list_const_ptr, block_const_ptr_list_const_ptr)>;
     using transaction_handler = std::function<bool(code, transaction_const_ptr)>;
     using ds_proof_handler = std::function<bool(code, double_spend_proof_const_ptr)>;
+    using script_hash_handler = script_hash_registry::handler;
 
     using for_each_tx_handler = std::function<void(code const&, size_t, domain::chain::transaction const&)>;
     using mempool_mini_hash_map = std::unordered_map<mini_hash, domain::chain::transaction>;
@@ -81,16 +143,46 @@ public:
 
     virtual void fetch_merkle_block(hash_digest const& hash, merkle_block_fetch_handler handler) const = 0;
 
+    virtual void fetch_merkle_proof(hash_digest const& tx_hash, merkle_proof_fetch_handler handler) const = 0;
+
+    virtual void fetch_block_filter(hash_digest const& block_hash, block_filter_fetch_handler handler) const = 0;
+
+    virtual void fetch_filter_headers(size_t start_height, hash_digest const& stop_hash, filter_headers_fetch_handler handler) const = 0;
+
+    virtual void fetch_utxo_commitment(size_t height, utxo_commitment_fetch_handler handler) const = 0;
+
+    virtual void fetch_token_outputs(hash_digest const& category, token_outputs_fetch_handler handler) const = 0;
+
+    virtual void fetch_token_outputs(hash_digest const& category, data_chunk const& commitment, token_outputs_fetch_handler handler) const = 0;
+
+    virtual void fetch_unspent_outputs(hash_digest const& script_hash, unspent_outputs_fetch_handler handler) const = 0;
+
+    virtual void fetch_balance(hash_digest const& script_hash, balance_fetch_handler handler) const = 0;
+
     virtual void fetch_compact_block(size_t height, compact_block_fetch_handler handler) const = 0;
 
     virtual void fetch_compact_block(hash_digest const& hash, compact_block_fetch_handler handler) const = 0;
 
     virtual void fetch_block_header_txs_size(hash_digest const& hash, block_header_txs_size_fetch_handler handler) const = 0;
 
+    virtual void fetch_block_metadata(size_t height, block_metadata_fetch_handler handler) const = 0;
+
+    virtual void fetch_block_metadata(hash_digest const& hash, block_metadata_fetch_handler handler) const = 0;
+
+    virtual void fetch_block_stats(size_t height, block_stats_fetch_handler handler) const = 0;
+
+    virtual void fetch_block_stats(hash_digest const& hash, block_stats_fetch_handler handler) const = 0;
+
+    virtual void fetch_block_transactions(hash_digest const& hash, std::vector<uint64_t> const& indexes, block_transactions_fetch_handler handler) const = 0;
+
     virtual void fetch_ds_proof(hash_digest const& hash, ds_proof_fetch_handler handler) const = 0;
 
+    virtual void fetch_transaction_ds_proof(hash_digest const& hash, ds_proof_fetch_handler handler) const = 0;
+
     virtual void fetch_transaction(hash_digest const& hash, bool require_confirmed, transaction_fetch_handler handler) const = 0;
 
+    virtual void fetch_transactions(hash_list const& hashes, bool require_confirmed, transactions_fetch_handler handler) const = 0;
+
     virtual void fetch_transaction_position(hash_digest const& hash, bool require_confirmed, transaction_index_fetch_handler handler) const = 0;
 
     // virtual void for_each_transaction(size_t from, size_t to, for_each_tx_handler const& handler) const = 0;
@@ -120,6 +212,10 @@ public:
 
     virtual void fetch_history(const short_hash& address_hash, size_t limit, size_t from_height, history_fetch_handler handler) const = 0;
     virtual void fetch_confirmed_transactions(const short_hash& address_hash, size_t limit, size_t from_height, confirmed_transactions_fetch_handler handler) const = 0;
+    virtual void fetch_histories(std::vector<short_hash> const& address_hashes, size_t limit, size_t from_height, history_batch_handler handler, result_handler completion) const = 0;
+    virtual void fetch_confirmed_transactions(std::vector<short_hash> const& address_hashes, size_t limit, size_t from_height, confirmed_transactions_batch_handler handler, result_handler completion) const = 0;
+    virtual void fetch_history_page(short_hash const& address_hash, history_cursor const& cursor, size_t page_size, history_page_handler handler) const = 0;
+    virtual void fetch_confirmed_transactions_page(short_hash const& address_hash, history_cursor const& cursor, size_t page_size, confirmed_transactions_page_handler handler) const = 0;
 
     // virtual void fetch_stealth(const binary& filter, size_t from_height, stealth_fetch_handler handler) const = 0;
 
@@ -157,6 +253,11 @@ public:
     virtual void subscribe_ds_proof(ds_proof_handler&& handler) = 0;
     virtual void unsubscribe() = 0;
 
+    virtual size_t subscribe_script_hashes(script_hash_handler&& handler) = 0;
+    virtual bool watch_script_hashes(size_t id, hash_list const& script_hashes) = 0;
+    virtual bool unwatch_script_hashes(size_t id, hash_list const& script_hashes) = 0;
+    virtual void unsubscribe_script_hashes(size_t id) = 0;
+
 
     // Transaction Validation.
     //-----------------------------------------------------------------------------
@@ -168,7 +269,9 @@ public:
 
     virtual void organize(block_const_ptr block, result_handler handler) = 0;
     virtual void organize(transaction_const_ptr tx, result_handler handler) = 0;
+    virtual void organize(transaction_const_ptr_list_const_ptr txs, organize_results_handler handler) = 0;
     virtual void organize(double_spend_proof_const_ptr ds_proof, result_handler handler) = 0;
+    virtual void organize_package(transaction_const_ptr_list_const_ptr txs, bool test_accept, organize_results_handler handler) = 0;
 
     // Properties
     // ------------------------------------------------------------------------
@@ -42,7 +42,7 @@ namespace mining {
 // }
 
 inline
-node make_node(domain::chain::transaction const& tx) {
+node make_node(domain::chain::transaction const& tx, size_t sigops) {
     return node(
                 transaction_element(tx.hash()
 #if ! defined(KTH_CURRENCY_BCH)
@@ -50,11 +50,16 @@ node make_node(domain::chain::transaction const& tx) {
 #endif
                                   , tx.to_data(true, KTH_WITNESS_DEFAULT)
                                   , tx.fees()
-                                  , tx.signature_operations()
+                                  , sigops
                                   , tx.outputs().size())
                         );
 }
 
+inline
+node make_node(domain::chain::transaction const& tx) {
+    return make_node(tx, tx.signature_operations());
+}
+
 #ifdef KTH_MINING_STATISTICS_ENABLED
 template <typename F>
 void measure(F f, measurements_t& t) {
@@ -379,17 +384,22 @@ public:
 
 
     error::error_code_t add(domain::chain::transaction const& tx) {
+        return add(tx, tx.signature_operations());
+    }
+
+    // The sigops are those already counted by transaction validation.
+    error::error_code_t add(domain::chain::transaction const& tx, size_t sigops) {
         //precondition: tx.validation.state != nullptr
         //              tx is fully validated: check() && accept() && connect()
         //              ! tx.is_coinbase()
 
         // std::cout << encode_base16(tx.to_data(true, KTH_WITNESS_DEFAULT)) << std::endl;
 
-        return prioritizer_.low_job([this, &tx]{
+        return prioritizer_.low_job([this, &tx, sigops]{
             auto const index = all_transactions_.size();
 
             auto start = std::chrono::high_resolution_clock::now();
-            auto temp_node = make_node(tx);
+            auto temp_node = make_node(tx, sigops);
             auto end = std::chrono::high_resolution_clock::now();
             increment_time(start, end, make_node_time);
 
@@ -821,6 +831,33 @@ public:
         return {std::move(res), accum_fees};
     }
 
+    // The hash of the pooled transaction spending the point, null if none.
+    hash_digest spender(domain::chain::point const& point) const {
+        return prioritizer_.low_job([&point, this]() -> hash_digest {
+            auto it = previous_outputs_.find(point);
+            if (it != previous_outputs_.end()) {
+                return all_transactions_[it->second].txid();
+            }
+
+            return null_hash;
+        });
+    }
+
+    // The pooled transaction spending the point, invalid if none.
+    domain::chain::transaction spending(domain::chain::point const& point) const {
+        return prioritizer_.low_job([&point, this]() -> domain::chain::transaction {
+            auto it = previous_outputs_.find(point);
+            if (it != previous_outputs_.end()) {
+                auto found = hash_index_.find(all_transactions_[it->second].txid());
+                if (found != hash_index_.end()) {
+                    return found->second.second;
+                }
+            }
+
+            return {};
+        });
+    }
+
     domain::chain::output get_utxo(domain::chain::point const& point) const {
         // shared_lock_t lock(mutex_);
         return prioritizer_.low_job([&point, this]{
@@ -0,0 +1,155 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef KTH_BLOCKCHAIN_BLOCK_METADATA_CACHE_HPP
+#define KTH_BLOCKCHAIN_BLOCK_METADATA_CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <kth/blockchain/define.hpp>
+#include <kth/blockchain/pools/block_stats.hpp>
+#include <kth/blockchain/pools/insertion_order.hpp>
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+/// This class is thread safe.
+/// Block data that can be served without deserializing the block.
+class BCB_API block_metadata {
+public:
+    using ptr = std::shared_ptr<block_metadata const>;
+
+    /// Summarize the block at the given height (tx hashes must be cached).
+    block_metadata(domain::chain::block const& block, size_t height);
+
+    /// Summarize a block with the totals computed in its validation.
+    block_metadata(domain::chain::block const& block, size_t height, uint64_t fees, size_t sigchecks);
+
+    /// Summarize a block with its statistics, whose fees and sigchecks are
+    /// the totals of its validation if validated.
+    block_metadata(domain::chain::block const& block, size_t height, block_stats const& stats, bool validated);
+
+    /// Restore the metadata of the block from its record and its header,
+    /// nullptr if the record is invalid.
+    static
+    ptr from_data(domain::chain::header const& header, size_t height, data_slice record);
+
+    /// The record of the metadata, which excludes the header.
+    data_chunk to_data() const;
+
+    hash_digest const& hash() const;
+    size_t height() const;
+    domain::chain::header const& header() const;
+    size_t serialized_size() const;
+    size_t transaction_count() const;
+
+    /// The transaction hashes in block order.
+    hash_list const& transaction_hashes() const;
+
+    /// The byte offset of each transaction within the serialized block.
+    std::vector<uint32_t> const& transaction_offsets() const;
+
+    /// True if fees and sigchecks were recorded by block validation.
+    bool validated() const;
+
+    /// The total fees paid by the block transactions.
+    uint64_t fees() const;
+
+    /// The sigchecks of the block transactions, counted at block connection
+    /// (those validated by the mempool as counted there).
+    size_t sigchecks() const;
+
+    /// The block statistics, empty if not computed.
+    std::optional<block_stats> const& stats() const;
+
+    /// The merkle branch of the transaction at position, leaf to root.
+    /// Interior tree levels are computed on first use, O(log n) thereafter.
+    hash_list merkle_branch(size_t position) const;
+
+    /// The partial merkle tree flags of a merkle block matching every
+    /// transaction, where the hashes are all of the transaction hashes.
+    data_chunk merkle_flags() const;
+
+private:
+    block_metadata() = default;
+
+    std::vector<hash_list> const& merkle_levels() const;
+
+    hash_digest hash_;
+    size_t height_;
+    domain::chain::header header_;
+    size_t serialized_size_;
+    hash_list transaction_hashes_;
+    std::vector<uint32_t> transaction_offsets_;
+    bool validated_;
+    uint64_t fees_;
+    size_t sigchecks_;
+    std::optional<block_stats> stats_;
+
+    // Tree levels above the leaves, root last, populated once.
+    mutable std::once_flag merkle_once_;
+    mutable std::vector<hash_list> merkle_levels_;
+};
+
+/// This class is thread safe.
+/// Bounded cache of block metadata by hash and by confirmed height.
+/// Entries are added as blocks are validated, confirmed as they are
+/// organized into the chain and otherwise filled on demand from the store.
+/// The oldest entries are evicted first, a capacity of zero disables it.
+class BCB_API block_metadata_cache {
+public:
+    block_metadata_cache(size_t capacity);
+
+    /// The number of cached entries.
+    size_t size() const;
+
+    /// Get the metadata of the block, nullptr if not cached.
+    block_metadata::ptr get(hash_digest const& hash) const;
+
+    /// Get the metadata of the block at the height, nullptr if not cached.
+    block_metadata::ptr get(size_t height) const;
+
+    /// Cache the metadata of a confirmed block, replacing any entry for the
+    /// same block or height.
+    void add(block_metadata::ptr metadata);
+
+    /// Cache the metadata of a validated block, indexed by hash only.
+    void add_validated(block_metadata::ptr metadata);
+
+    /// Index a cached block at its height, false if it is not cached.
+    bool confirm(hash_digest const& hash);
+
+    /// Forget the block (reorganized out of the chain).
+    void remove(hash_digest const& hash);
+
+private:
+    struct entry {
+        block_metadata::ptr metadata;
+        size_t sequence;
+    };
+
+    void insert_unlocked(block_metadata::ptr metadata, bool confirmed);
+    void index_unlocked(hash_digest const& hash, size_t height);
+    void remove_unlocked(hash_digest const& hash);
+
+    // This is thread safe.
+    size_t const capacity_;
+
+    // These are protected by mutex.
+    std::unordered_map<hash_digest, entry> entries_;
+    std::unordered_map<size_t, hash_digest> heights_;
+    insertion_order<hash_digest> order_;
+    mutable shared_mutex mutex_;
+};
+
+} // namespace kth::blockchain
+
+#endif
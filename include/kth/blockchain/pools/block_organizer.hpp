@@ -7,14 +7,18 @@
 
 #include <atomic>
 #include <cstddef>
+#include <deque>
 #include <future>
 #include <memory>
+#include <vector>
 
 #include <kth/blockchain/define.hpp>
 #include <kth/blockchain/interface/fast_chain.hpp>
 #include <kth/blockchain/interface/safe_chain.hpp>
+#include <kth/blockchain/pools/block_metadata_cache.hpp>
 #include <kth/blockchain/pools/block_pool.hpp>
 #include <kth/blockchain/pools/branch.hpp>
+#include <kth/blockchain/pools/transaction_metadata_cache.hpp>
 #include <kth/blockchain/settings.hpp>
 #include <kth/blockchain/validate/validate_block.hpp>
 #include <kth/domain.hpp>
@@ -35,9 +39,9 @@ public:
 
     /// Construct an instance.
 #if defined(KTH_WITH_MEMPOOL)
-    block_organizer(prioritized_mutex& mutex, dispatcher& dispatch, threadpool& thread_pool, fast_chain& chain, settings const& settings, domain::config::network network, bool relay_transactions, mining::mempool& mp);
+    block_organizer(prioritized_mutex& mutex, dispatcher& dispatch, threadpool& thread_pool, fast_chain& chain, settings const& settings, domain::config::network network, bool relay_transactions, block_metadata_cache& metadata, transaction_metadata_cache& transaction_metadata, mining::mempool& mp);
 #else
-    block_organizer(prioritized_mutex& mutex, dispatcher& dispatch, threadpool& thread_pool, fast_chain& chain, settings const& settings, domain::config::network network, bool relay_transactions);
+    block_organizer(prioritized_mutex& mutex, dispatcher& dispatch, threadpool& thread_pool, fast_chain& chain, settings const& settings, domain::config::network network, bool relay_transactions, block_metadata_cache& metadata, transaction_metadata_cache& transaction_metadata);
 #endif
 
     bool start();
@@ -57,6 +61,10 @@ private:
     // Utility.
     bool set_branch_height(branch::ptr branch);
 
+    // Organize sub-sequence.
+    void drain();
+    code organize_block(block_const_ptr block);
+
     // Verify sub-sequence.
     void handle_check(code const& ec, block_const_ptr block, result_handler handler);
     void handle_accept(code const& ec, branch::ptr branch, result_handler handler);
@@ -94,10 +102,27 @@ private:
     block_pool block_pool_;
     validate_block validator_;
     reorganize_subscriber::ptr subscriber_;
+    dispatcher organize_dispatch_;
 
 #if defined(KTH_WITH_MEMPOOL)
     mining::mempool& mempool_;
 #endif
+
+    // A block waiting to be organized (or the front one, being organized)
+    // with the handlers of each submission of it.
+    struct queued_block {
+        block_const_ptr block;
+        size_t size;
+        bool started;
+        std::vector<result_handler> handlers;
+    };
+
+    // These are protected by queue_mutex_.
+    std::deque<queued_block> queue_;
+    size_t queue_bytes_;
+    size_t const maximum_queue_bytes_;
+    bool draining_;
+    shared_mutex queue_mutex_;
 };
 
 } // namespace kth::blockchain
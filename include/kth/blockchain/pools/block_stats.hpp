@@ -0,0 +1,48 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef KTH_BLOCKCHAIN_BLOCK_STATS_HPP
+#define KTH_BLOCKCHAIN_BLOCK_STATS_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include <kth/blockchain/define.hpp>
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+/// Statistics of a block, computed from its populated prevouts.
+/// Fee rates are in satoshis per kilobyte of serialized transaction, the
+/// coinbase is excluded from all but the transaction and output counts.
+struct BCB_API block_stats {
+    /// The 10th, 25th, 50th, 75th and 90th fee rate percentiles, weighted
+    /// by transaction size.
+    using percentiles = std::array<uint64_t, 5>;
+
+    /// Compute the statistics, false if a prevout is not populated.
+    static
+    bool compute(domain::chain::block const& block, size_t sigchecks, block_stats& out);
+
+    size_t transaction_count = 0;
+    size_t inputs = 0;
+    size_t outputs = 0;
+    size_t total_size = 0;
+    uint64_t total_out = 0;
+    uint64_t fees = 0;
+    uint64_t min_fee = 0;
+    uint64_t max_fee = 0;
+    uint64_t min_feerate = 0;
+    uint64_t max_feerate = 0;
+    uint64_t average_feerate = 0;
+    percentiles feerate_percentiles{};
+
+    /// The sigchecks counted at block connection, zero if computed later.
+    size_t sigchecks = 0;
+};
+
+} // namespace kth::blockchain
+
+#endif
@@ -0,0 +1,85 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef KTH_BLOCKCHAIN_DS_PROOF_POOL_HPP
+#define KTH_BLOCKCHAIN_DS_PROOF_POOL_HPP
+
+#include <cstddef>
+#include <unordered_map>
+#include <utility>
+
+#include <kth/blockchain/define.hpp>
+#include <kth/blockchain/pools/insertion_order.hpp>
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+/// This class is thread safe.
+/// Double spend proofs by hash, by spent outpoint (one proof each) and by
+/// the hash of the unconfirmed transaction spending the outpoint. A proof
+/// is dropped once its outpoint is spent by a block. Bounded by bytes, the
+/// oldest proofs are evicted first.
+class BCB_API ds_proof_pool {
+public:
+    explicit
+    ds_proof_pool(size_t maximum_bytes);
+
+    /// The proof of the two spends of the outpoint, nullptr unless both
+    /// spend it with a P2PKH input signed SIGHASH_ALL|FORKID (Schnorr or
+    /// DER), the signatures that verify accepts.
+    static double_spend_proof_const_ptr create(domain::chain::transaction const& first, domain::chain::transaction const& second, domain::chain::point const& out_point);
+
+    /// True if both (Schnorr or DER) signatures of the proof are valid for
+    /// the spent P2PKH output, with the public key of the pooled transaction spending it.
+    static bool verify(domain::message::double_spend_proof const& proof, domain::chain::transaction const& spending, domain::chain::output const& spent);
+
+    /// The number of pooled proofs.
+    size_t size() const;
+
+    /// The serialized size of the pooled proofs.
+    size_t bytes() const;
+
+    /// Pool the proof of a double spend of the transaction (null hash if
+    /// not known), false if the outpoint already has a proof or if the
+    /// proof is too large.
+    bool add(double_spend_proof_const_ptr proof, hash_digest const& transaction_hash);
+
+    /// The proof with the hash, nullptr if not pooled.
+    double_spend_proof_const_ptr get(hash_digest const& hash) const;
+
+    /// The proof of a double spend of the outpoint, nullptr if none.
+    double_spend_proof_const_ptr find(domain::chain::point const& out_point) const;
+
+    /// The proof of a double spend of the transaction, nullptr if none.
+    double_spend_proof_const_ptr find_transaction(hash_digest const& transaction_hash) const;
+
+    /// Drop the proofs of the outpoints spent by the block.
+    void remove_spent(domain::chain::block const& block);
+
+private:
+    struct entry {
+        double_spend_proof_const_ptr proof;
+        domain::chain::point out_point;
+        hash_digest transaction_hash;
+        size_t size;
+        size_t sequence;
+    };
+
+    void remove_unlocked(hash_digest const& hash);
+
+    // This is thread safe.
+    size_t const maximum_bytes_;
+
+    // These are protected by mutex.
+    size_t bytes_;
+    std::unordered_map<hash_digest, entry> entries_;
+    std::unordered_map<domain::chain::point, hash_digest> out_points_;
+    std::unordered_map<hash_digest, hash_digest> transactions_;
+    insertion_order<hash_digest> order_;
+    mutable shared_mutex mutex_;
+};
+
+} // namespace kth::blockchain
+
+#endif
@@ -0,0 +1,84 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef KTH_BLOCKCHAIN_HISTORY_CACHE_HPP
+#define KTH_BLOCKCHAIN_HISTORY_CACHE_HPP
+
+#include <cstddef>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include <kth/blockchain/define.hpp>
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+/// This class is thread safe.
+/// Least recently used cache of address history results, by address hash,
+/// limit and from height. The capacity is the number of history rows held,
+/// larger results are not cached. The results of an address are dropped when
+/// a block touching the address is connected or disconnected.
+class BCB_API history_cache {
+public:
+    using list = domain::chain::history_compact::list;
+
+    explicit
+    history_cache(size_t capacity);
+
+    /// The number of history rows held.
+    size_t size() const;
+
+    /// The invalidation sequence, to be read before the store is read.
+    size_t sequence() const;
+
+    /// The cached result, false if not cached.
+    bool get(short_hash const& address_hash, size_t limit, size_t from_height, list& out);
+
+    /// Cache a result read from the store after the sequence was read,
+    /// ignored if addresses were invalidated meanwhile.
+    void add(short_hash const& address_hash, size_t limit, size_t from_height, list const& history, size_t sequence);
+
+    /// Drop the results of the addresses.
+    void invalidate(std::vector<short_hash> const& address_hashes);
+
+    /// Drop all results.
+    void clear();
+
+private:
+    struct key {
+        short_hash address_hash;
+        size_t limit;
+        size_t from_height;
+
+        bool operator==(key const& other) const = default;
+    };
+
+    struct key_hasher {
+        size_t operator()(key const& value) const;
+    };
+
+    using recency = std::list<key>;
+
+    struct entry {
+        list history;
+        recency::iterator position;
+    };
+
+    void remove_unlocked(key const& value);
+
+    size_t const capacity_;
+
+    // These are protected by mutex.
+    size_t rows_;
+    size_t sequence_;
+    recency recency_;
+    std::unordered_map<key, entry, key_hasher> entries_;
+    std::unordered_map<short_hash, std::vector<key>> addresses_;
+    mutable shared_mutex mutex_;
+};
+
+} // namespace kth::blockchain
+
+#endif
@@ -0,0 +1,70 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef KTH_BLOCKCHAIN_INSERTION_ORDER_HPP
+#define KTH_BLOCKCHAIN_INSERTION_ORDER_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <utility>
+
+namespace kth::blockchain {
+
+/// This class is NOT thread safe.
+/// The insertion order of the entries of a map, oldest first, for eviction.
+/// Each insertion is stamped with a sequence kept by the entry, so the
+/// records of entries removed or replaced since insertion are skipped. The
+/// mapped entries have a sequence member.
+template <typename Key>
+class insertion_order {
+public:
+    /// Record the insertion of the key, the sequence to keep with its entry.
+    size_t push(Key const& key) {
+        auto const sequence = sequence_++;
+        records_.emplace_back(key, sequence);
+        return sequence;
+    }
+
+    /// Pass the key of the oldest entries to evict, which removes the entry
+    /// and returns true, or returns false to keep it and stop.
+    template <typename Map, typename Evict>
+    void evict(Map const& entries, Evict&& evict) {
+        while ( ! records_.empty()) {
+            auto const oldest = records_.front();
+            if (current(entries, oldest) && ! evict(oldest.first)) {
+                return;
+            }
+
+            records_.pop_front();
+        }
+    }
+
+    /// Drop the records skipped by eviction once there are more than limit,
+    /// so that these are bounded when removals outpace evictions.
+    template <typename Map>
+    void compact(Map const& entries, size_t limit) {
+        if (records_.size() > limit) {
+            std::erase_if(records_, [&entries](record const& value) {
+                return ! current(entries, value);
+            });
+        }
+    }
+
+private:
+    using record = std::pair<Key, size_t>;
+
+    template <typename Map>
+    static bool current(Map const& entries, record const& value) {
+        auto const it = entries.find(value.first);
+        return it != entries.end() && it->second.sequence == value.second;
+    }
+
+    size_t sequence_ = 0;
+    std::deque<record> records_;
+};
+
+} // namespace kth::blockchain
+
+#endif
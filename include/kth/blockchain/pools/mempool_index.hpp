@@ -0,0 +1,106 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef KTH_BLOCKCHAIN_MEMPOOL_INDEX_HPP
+#define KTH_BLOCKCHAIN_MEMPOOL_INDEX_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <kth/blockchain/define.hpp>
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+/// This class is thread safe.
+/// In-memory index of the unconfirmed transactions held by the store.
+/// Scans over the unconfirmed set (such as compact block reconstruction)
+/// work from the hashes here and only read the matched transactions.
+/// Inputs and outputs are also indexed by the sha256 of the locking script
+/// they spend or pay (the script hash), inputs only if their prevout is
+/// populated.
+class BCB_API mempool_index {
+public:
+    using short_id_map = std::unordered_map<uint64_t, uint16_t>;
+
+    /// An input or output of an unconfirmed transaction. The value is that
+    /// of the output, or of the spent prevout for an input.
+    struct script_entry {
+        hash_digest hash;
+        uint32_t index;
+        bool input;
+        uint64_t value;
+        hash_digest previous_hash;
+        uint32_t previous_index;
+    };
+
+    using script_entries = std::vector<script_entry>;
+
+    /// The index key of a locking script.
+    static
+    hash_digest script_hash(domain::chain::script const& script);
+
+    /// Hashes per parallel short id matching bucket, below this one thread.
+    static constexpr size_t match_bucket_minimum = 4096;
+
+    /// The number of indexed transactions.
+    size_t size() const;
+
+    /// True if the transaction hash is indexed.
+    bool contains(hash_digest const& hash) const;
+
+    /// Index an unconfirmed transaction.
+    void add(domain::chain::transaction const& tx);
+
+    /// The unconfirmed inputs and outputs of the script hash, in the order
+    /// they were indexed.
+    script_entries find(hash_digest const& script_hash) const;
+
+    /// Remove a transaction from the index.
+    void remove(hash_digest const& hash);
+
+    /// Remove the (confirmed) transactions of the block from the index, and
+    /// those spending an outpoint the block spends (double spent by it), with
+    /// their descendants.
+    void remove(domain::chain::block const& block);
+
+    /// Remove all transactions from the index.
+    void clear();
+
+    /// Match compact block short ids against the indexed hashes.
+    /// The result is sized to slots, one hash for each short id position,
+    /// null_hash where the short id is unmatched or matched more than once.
+    hash_list match_short_ids(uint64_t k0, uint64_t k1, short_id_map const& wanted, size_t slots, dispatcher& dispatch) const;
+
+private:
+    struct spends {
+        std::vector<domain::chain::point> points;
+        uint32_t outputs;
+    };
+
+    void remove_unlocked(hash_digest const& hash);
+    void remove_descendants_unlocked(hash_digest const& hash);
+
+    void add_script_unlocked(hash_digest const& script_hash, script_entry const& entry);
+
+    // Hashes are kept dense (swap on remove) for cache friendly scans.
+    hash_list hashes_;
+    std::unordered_map<hash_digest, size_t> positions_;
+
+    // Script hash entries, and the script hashes of each tx for removal.
+    std::unordered_map<hash_digest, script_entries> scripts_;
+    std::unordered_map<hash_digest, hash_list> tx_scripts_;
+
+    // The spender of each outpoint, and the outpoints spent and the output
+    // count of each tx, to find the conflicts of a block and descendants.
+    std::unordered_map<domain::chain::point, hash_digest> spenders_;
+    std::unordered_map<hash_digest, spends> tx_spends_;
+    mutable shared_mutex mutex_;
+};
+
+} // namespace kth::blockchain
+
+#endif
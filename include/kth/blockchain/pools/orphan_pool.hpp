@@ -0,0 +1,72 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef KTH_BLOCKCHAIN_ORPHAN_POOL_HPP
+#define KTH_BLOCKCHAIN_ORPHAN_POOL_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <unordered_map>
+#include <utility>
+
+#include <kth/blockchain/define.hpp>
+#include <kth/blockchain/pools/insertion_order.hpp>
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+/// This class is thread safe.
+/// Transactions missing previous outputs, by the hashes of the transactions
+/// that would create them. Bounded by count and bytes (the oldest entries are
+/// evicted first) and by age, a zero count disables it.
+class BCB_API orphan_pool {
+public:
+    using clock = std::chrono::steady_clock;
+
+    orphan_pool(size_t maximum_count, size_t maximum_bytes, clock::duration expiration);
+
+    /// The number of pooled transactions.
+    size_t size() const;
+
+    /// The serialized size of the pooled transactions.
+    size_t bytes() const;
+
+    /// Pool a transaction by the prevouts that failed population, false if
+    /// there are none, if it is too large or if it is already pooled.
+    bool add(transaction_const_ptr tx);
+
+    /// Remove and return the transactions waiting on the parent.
+    transaction_const_ptr_list take(hash_digest const& parent_hash);
+
+    /// Remove the transactions older than the expiration.
+    void expire();
+
+private:
+    struct entry {
+        transaction_const_ptr tx;
+        hash_list parents;
+        size_t size;
+        clock::time_point added;
+        size_t sequence;
+    };
+
+    void expire_unlocked(clock::time_point now);
+    void remove_unlocked(hash_digest const& hash);
+
+    // These are thread safe.
+    size_t const maximum_count_;
+    size_t const maximum_bytes_;
+    clock::duration const expiration_;
+
+    // These are protected by mutex.
+    size_t bytes_;
+    std::unordered_map<hash_digest, entry> entries_;
+    std::unordered_multimap<hash_digest, hash_digest> waiting_;
+    insertion_order<hash_digest> order_;
+    mutable shared_mutex mutex_;
+};
+
+} // namespace kth::blockchain
+
+#endif
@@ -0,0 +1,59 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef KTH_BLOCKCHAIN_ROLLING_BLOOM_FILTER_HPP
+#define KTH_BLOCKCHAIN_ROLLING_BLOOM_FILTER_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <kth/blockchain/define.hpp>
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+/// This class is thread safe.
+/// Probabilistic set of hashes that remembers at least the most recent
+/// (elements) insertions. Two generations are kept, when the current one is
+/// full the previous is dropped. The bit positions are salted at random on
+/// construction and reset, so false positives cannot be targeted.
+class BCB_API rolling_bloom_filter {
+public:
+    /// The false positive rate is that of each generation, a zero count of
+    /// elements disables it.
+    rolling_bloom_filter(size_t elements, double false_positive_rate);
+
+    /// Remember the hash.
+    void insert(hash_digest const& hash);
+
+    /// True if the hash was (probably) inserted.
+    bool contains(hash_digest const& hash) const;
+
+    /// Forget all hashes.
+    void reset();
+
+private:
+    using bits = std::vector<uint64_t>;
+
+    size_t position(hash_digest const& hash, size_t function) const;
+    static bool test(bits const& generation, size_t position);
+
+    // These are thread safe.
+    size_t const elements_;
+    size_t const bit_count_;
+    size_t const function_count_;
+
+    // These are protected by mutex.
+    uint64_t salt_;
+    size_t count_;
+    std::array<bits, 2> generations_;
+    size_t current_;
+    mutable shared_mutex mutex_;
+};
+
+} // namespace kth::blockchain
+
+#endif
@@ -0,0 +1,100 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef KTH_BLOCKCHAIN_SCRIPT_HASH_REGISTRY_HPP
+#define KTH_BLOCKCHAIN_SCRIPT_HASH_REGISTRY_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <kth/blockchain/define.hpp>
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+/// This class is thread safe.
+/// Subscriptions to the transactions paying to or spending from a set of
+/// script hashes (see mempool_index::script_hash). Transactions are matched
+/// once against the watched script hashes, each subscriber is notified only
+/// of its own matches. Notification calls are made on the notifying thread.
+class BCB_API script_hash_registry {
+public:
+    enum class change {
+        /// The transaction was accepted to the mempool.
+        unconfirmed,
+
+        /// The transaction was confirmed in a block at the height.
+        confirmed,
+
+        /// The block at the height, confirming the tx, was reorganized out.
+        reorganized
+    };
+
+    struct notification {
+        hash_digest script_hash;
+        hash_digest tx_hash;
+        size_t height;
+        change kind;
+    };
+
+    using notifications = std::vector<notification>;
+
+    /// Return false to unsubscribe.
+    using handler = std::function<bool(code, notifications const&)>;
+
+    script_hash_registry();
+
+    void start();
+
+    /// Notify all subscribers of stop and remove them.
+    void stop();
+
+    /// Subscribe, returns the subscription id (zero if stopped).
+    size_t subscribe(handler&& handler);
+
+    /// Remove the subscription, without notification.
+    void unsubscribe(size_t id);
+
+    /// Add script hashes to the subscription, false if not subscribed.
+    bool watch(size_t id, hash_list const& script_hashes);
+
+    /// Remove script hashes from the subscription, false if not subscribed.
+    bool unwatch(size_t id, hash_list const& script_hashes);
+
+    /// Notify the subscribers matching a transaction accepted to the mempool.
+    void notify_transaction(domain::chain::transaction const& tx);
+
+    /// Notify the subscribers matching the transactions of a reorganization,
+    /// the reversals (outgoing) before the confirmations (incoming).
+    void notify_reorganize(size_t top_height, block_const_ptr_list_const_ptr incoming_blocks, block_const_ptr_list_const_ptr outgoing_blocks);
+
+private:
+    using matches = std::unordered_map<size_t, notifications>;
+
+    struct subscription {
+        handler notify;
+        std::unordered_set<hash_digest> script_hashes;
+    };
+
+    void match(domain::chain::transaction const& tx, size_t height, change kind, matches& out) const;
+    void match(hash_digest const& script_hash, hash_digest const& tx_hash, size_t height, change kind, matches& out) const;
+    void deliver(matches const& matched);
+
+    // This is thread safe.
+    std::atomic<bool> stopped_;
+
+    // These are protected by mutex.
+    size_t next_id_;
+    std::unordered_map<size_t, subscription> subscriptions_;
+    std::unordered_map<hash_digest, std::vector<size_t>> watchers_;
+    mutable shared_mutex mutex_;
+};
+
+} // namespace kth::blockchain
+
+#endif
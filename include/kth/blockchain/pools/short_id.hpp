@@ -0,0 +1,32 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef KTH_BLOCKCHAIN_SHORT_ID_HPP
+#define KTH_BLOCKCHAIN_SHORT_ID_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include <kth/blockchain/define.hpp>
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+/// Compact block (BIP152) short ids are the low 48 bits of SipHash-2-4.
+constexpr uint64_t short_id_mask = 0x0000ffffffffffff;
+
+/// The number of hashes processed together by short_ids.
+constexpr size_t short_id_lanes = 4;
+
+/// The short id of a transaction hash, same as the masked sip_hash_uint256.
+BCB_API uint64_t short_id(uint64_t k0, uint64_t k1, hash_digest const& hash);
+
+/// Compute the short ids of count contiguous hashes into out.
+/// Hashes are processed in groups of short_id_lanes independent SipHash
+/// states so that the rounds can be vectorized by the compiler.
+BCB_API void short_ids(uint64_t k0, uint64_t k1, hash_digest const* hashes, size_t count, uint64_t* out);
+
+} // namespace kth::blockchain
+
+#endif
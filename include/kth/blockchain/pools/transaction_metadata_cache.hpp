@@ -0,0 +1,84 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef KTH_BLOCKCHAIN_TRANSACTION_METADATA_CACHE_HPP
+#define KTH_BLOCKCHAIN_TRANSACTION_METADATA_CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+#include <kth/blockchain/define.hpp>
+#include <kth/blockchain/pools/insertion_order.hpp>
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+/// The hash by which transactions are cached and filtered. Copies of a
+/// transaction with another witness share its txid but not its sigops or
+/// its verdict, so where there are witnesses this is the wtxid.
+BCB_API hash_digest relay_hash(domain::chain::transaction const& tx);
+
+/// Transaction measures computed once when the transaction is accepted.
+struct BCB_API transaction_metadata {
+    using ptr = std::shared_ptr<transaction_metadata const>;
+
+    /// Measure the transaction, its prevouts must be populated.
+    static ptr compute(domain::chain::transaction const& tx, bool bip16, bool bip141);
+
+    /// True if the sigops were counted under the given rules.
+    bool counted(bool bip16, bool bip141) const;
+
+    size_t serialized_size;
+    size_t sigops;
+    uint64_t fees;
+    bool bip16;
+    bool bip141;
+
+    /// The sigchecks of the scripts, set once these are run.
+    std::optional<size_t> sigchecks;
+};
+
+/// This class is thread safe.
+/// Bounded cache of transaction metadata by relay hash, so that the
+/// measures taken by the mempool are not taken again by block validation.
+/// The oldest entries are evicted first, a capacity of zero disables it.
+class BCB_API transaction_metadata_cache {
+public:
+    explicit
+    transaction_metadata_cache(size_t capacity);
+
+    /// The number of cached entries.
+    size_t size() const;
+
+    /// Get the metadata of the transaction, nullptr if not cached.
+    transaction_metadata::ptr get(hash_digest const& hash) const;
+
+    /// Cache the metadata of the transaction, replacing any entry.
+    void add(hash_digest const& hash, transaction_metadata::ptr metadata);
+
+    /// Forget the transaction (confirmed or dropped).
+    void remove(hash_digest const& hash);
+
+private:
+    struct entry {
+        transaction_metadata::ptr metadata;
+        size_t sequence;
+    };
+
+    // This is thread safe.
+    size_t const capacity_;
+
+    // These are protected by mutex.
+    std::unordered_map<hash_digest, entry> entries_;
+    insertion_order<hash_digest> order_;
+    mutable shared_mutex mutex_;
+};
+
+} // namespace kth::blockchain
+
+#endif
@@ -10,10 +10,16 @@
 #include <cstdint>
 #include <future>
 #include <memory>
+#include <unordered_map>
+#include <vector>
 
 #include <kth/blockchain/define.hpp>
 #include <kth/blockchain/interface/fast_chain.hpp>
 #include <kth/blockchain/interface/safe_chain.hpp>
+#include <kth/blockchain/pools/ds_proof_pool.hpp>
+#include <kth/blockchain/pools/orphan_pool.hpp>
+#include <kth/blockchain/pools/rolling_bloom_filter.hpp>
+#include <kth/blockchain/pools/transaction_metadata_cache.hpp>
 #include <kth/blockchain/pools/transaction_pool.hpp>
 #include <kth/blockchain/settings.hpp>
 #include <kth/blockchain/validate/validate_transaction.hpp>
@@ -34,6 +40,7 @@ namespace kth::blockchain {
 class BCB_API transaction_organizer {
 public:
     using result_handler = handle0;
+    using organize_results_handler = safe_chain::organize_results_handler;
     using ptr = std::shared_ptr<transaction_organizer>;
     using transaction_handler = safe_chain::transaction_handler;
     using ds_proof_handler = safe_chain::ds_proof_handler;
@@ -46,19 +53,38 @@ public:
     /// Construct an instance.
 
 #if defined(KTH_WITH_MEMPOOL)
-    transaction_organizer(prioritized_mutex& mutex, dispatcher& dispatch, threadpool& thread_pool, fast_chain& chain, settings const& settings, mining::mempool& mp);
+    transaction_organizer(prioritized_mutex& mutex, dispatcher& dispatch, threadpool& thread_pool, fast_chain& chain, settings const& settings, transaction_metadata_cache& metadata, mining::mempool& mp);
 #else
-    transaction_organizer(prioritized_mutex& mutex, dispatcher& dispatch, threadpool& thread_pool, fast_chain& chain, settings const& settings);
+    transaction_organizer(prioritized_mutex& mutex, dispatcher& dispatch, threadpool& thread_pool, fast_chain& chain, settings const& settings, transaction_metadata_cache& metadata);
 #endif
 
     bool start();
     bool stop();
 
     void organize(transaction_const_ptr tx, result_handler handler);
+    void organize(transaction_const_ptr_list_const_ptr txs, organize_results_handler handler);
     void organize(double_spend_proof_const_ptr ds_proof, result_handler handler);
 
+    /// Validate a package of transactions, parents before children, and
+    /// accept it unless testing. The package is the last transaction with its
+    /// ancestors in the package. Fees are checked for the package as a whole.
+    /// Invalid or conflicting packages are not accepted at all, but members
+    /// are committed in order, so a commit failure (such as the mempool
+    /// refusing a member) keeps the members before it. The results are
+    /// success for the committed members.
+    void organize_package(transaction_const_ptr_list_const_ptr txs, bool test_accept, organize_results_handler handler);
+
     void transaction_validate(transaction_const_ptr tx, result_handler handler) const;
 
+    /// Organize again the orphans waiting on transactions of the blocks.
+    void resolve_orphans(block_const_ptr_list_const_ptr blocks);
+
+    /// Forget the rejected transactions, as the chain state has changed.
+    void reset_rejected();
+
+    /// Drop the DSProofs of the outpoints spent by the blocks.
+    void remove_ds_proofs(block_const_ptr_list_const_ptr blocks);
+
     void subscribe(transaction_handler&& handler);
     void subscribe_ds_proof(ds_proof_handler&& handler);
     void unsubscribe();
@@ -67,26 +93,43 @@ public:
     void fetch_template(merkle_block_fetch_handler) const;
     void fetch_mempool(size_t maximum, inventory_fetch_handler) const;
     void fetch_ds_proof(hash_digest const& hash, ds_proof_fetch_handler) const;
+    void fetch_transaction_ds_proof(hash_digest const& hash, ds_proof_fetch_handler) const;
 
 protected:
     bool stopped() const;
-    uint64_t price(transaction_const_ptr tx) const;
+    uint64_t price(transaction_metadata const& metadata) const;
 
 private:
-    // Verify sub-sequence.
-    void handle_check(code const& ec, transaction_const_ptr tx, result_handler handler);
-    void handle_accept(code const& ec, transaction_const_ptr tx, result_handler handler);
-    void handle_connect(code const& ec, transaction_const_ptr tx, result_handler handler);
+    using in_flight_map = std::unordered_map<hash_digest, std::vector<result_handler>>;
+
+    // Organize sub-sequence.
+    void organize_in_flight(transaction_const_ptr tx);
+    in_flight_map::iterator find_in_flight_unlocked(hash_digest const& txid);
+    code organize_transaction(transaction_const_ptr tx);
+    code validate(transaction_const_ptr tx) const;
+    code commit(transaction_const_ptr tx);
+
+    // Batch organize sub-sequence.
+    std::vector<code> validate(transaction_const_ptr_list const& txs, std::vector<size_t> const& indexes, bool check_price) const;
+    void admit(transaction_const_ptr_list const& txs, std::unordered_map<hash_digest, size_t> const& positions, std::vector<size_t> pending, std::vector<code>& results);
+    void resolve_orphans(hash_digest const& parent_hash);
+    void resolve_stored_parents(domain::chain::transaction const& tx);
+    void reject(transaction_const_ptr tx, code const& ec);
+
+    // Package organize sub-sequence.
+    code validate_package(transaction_const_ptr_list const& txs, std::unordered_map<hash_digest, size_t> const& positions, std::vector<std::vector<size_t>> const& waves, std::vector<code>& results) const;
+    code package_conflict(transaction_const_ptr_list const& txs, std::unordered_map<hash_digest, size_t> const& positions) const;
 
-#if ! defined(KTH_DB_READONLY)
-    void handle_pushed(code const& ec, transaction_const_ptr tx, result_handler handler);
+#if defined(KTH_WITH_MEMPOOL)
+    bool get_spent_output(domain::chain::output& out, domain::chain::output_point const& out_point) const;
+    void prove_double_spend(transaction_const_ptr tx);
 #endif
 
-    void signal_completion(code const& ec);
-
-    void validate_handle_check(code const& ec, transaction_const_ptr tx, result_handler handler) const;
-    void validate_handle_accept(code const& ec, transaction_const_ptr tx, result_handler handler) const;
-    void validate_handle_connect(code const& ec, transaction_const_ptr tx, result_handler handler) const;
+    void transaction_validate(transaction_const_ptr tx, bool check_price, result_handler handler) const;
+    void validate_handle_check(code const& ec, transaction_const_ptr tx, bool check_price, result_handler handler) const;
+    void validate_handle_accept(code const& ec, transaction_const_ptr tx, bool check_price, result_handler handler) const;
+    transaction_metadata::ptr measure(transaction_const_ptr tx) const;
+    void validate_handle_connect(code const& ec, size_t sigchecks, transaction_const_ptr tx, transaction_metadata::ptr metadata, result_handler handler) const;
 
     // Subscription.
     void notify(transaction_const_ptr tx);
@@ -98,10 +141,13 @@ private:
     // These are thread safe.
     prioritized_mutex& mutex_;
     std::atomic<bool> stopped_;
-    std::promise<code> resume_;
     settings const& settings_;
     dispatcher& dispatch_;
     transaction_pool transaction_pool_;
+    transaction_metadata_cache& transaction_metadata_;
+    orphan_pool orphans_;
+    rolling_bloom_filter rejected_;
+    dispatcher orphan_dispatch_;
     validate_transaction validator_;
     transaction_subscriber::ptr subscriber_;
     ds_proof_subscriber::ptr ds_proof_subscriber_;
@@ -110,7 +156,18 @@ private:
     mining::mempool& mempool_;
 #endif
 
-    std::unordered_map<hash_digest, double_spend_proof_const_ptr> ds_proofs_;
+    ds_proof_pool ds_proofs_;
+
+    // These are protected by in_flight_mutex_.
+    // The handlers of each transaction being organized, its own first, by
+    // wtxid where there are witnesses (with the wtxids by txid).
+    in_flight_map in_flight_;
+
+#if ! defined(KTH_CURRENCY_BCH)
+    std::unordered_multimap<hash_digest, hash_digest> in_flight_txids_;
+#endif
+
+    mutable shared_mutex in_flight_mutex_;
 };
 
 } // namespace kth::blockchain
@@ -18,7 +18,7 @@
 
 namespace kth::blockchain {
 
-/// This class is NOT thread safe.
+/// This class is thread safe for distinct transactions.
 class BCB_API populate_transaction : public populate_base {
 public:
 
@@ -32,6 +32,23 @@ public:
     uint64_t minimum_output_satoshis = 500;
     uint32_t notify_limit_hours = 24;
     uint32_t reorganization_limit = 256;
+    uint32_t block_metadata_cache_size = 1000;
+    uint32_t transaction_metadata_cache_size = 100000;
+    bool block_filter_index = false;
+    uint32_t block_filter_cache_size = 2016;
+    bool token_index = false;
+    uint32_t token_index_start_height = 0;
+    bool script_utxo_index = false;
+    uint32_t history_cache_size = 100000;
+    bool history_index = false;
+    bool utxo_commitment_index = false;
+    uint32_t utxo_commitment_cache_size = 1000;
+    uint32_t orphan_pool_size = 100;
+    uint32_t orphan_pool_bytes = 5000000;
+    uint32_t orphan_expiration_minutes = 20;
+    uint32_t rejected_filter_size = 120000;
+    uint32_t ds_proof_pool_bytes = 10000000;
+    uint32_t block_queue_bytes = 256000000;
     infrastructure::config::checkpoint::list checkpoints;
     bool fix_checkpoints = true;
     bool allow_collisions = true;
@@ -9,10 +9,13 @@
 #include <cstddef>
 #include <cstdint>
 #include <memory>
+#include <vector>
 
 #include <kth/blockchain/define.hpp>
 #include <kth/blockchain/interface/fast_chain.hpp>
+#include <kth/blockchain/pools/block_metadata_cache.hpp>
 #include <kth/blockchain/pools/branch.hpp>
+#include <kth/blockchain/pools/transaction_metadata_cache.hpp>
 #include <kth/blockchain/populate/populate_block.hpp>
 #include <kth/blockchain/settings.hpp>
 #include <kth/domain.hpp>
@@ -29,9 +32,9 @@ public:
     using result_handler = handle0;
 
 #if defined(KTH_WITH_MEMPOOL)
-    validate_block(dispatcher& dispatch, fast_chain const& chain, settings const& settings, domain::config::network network, bool relay_transactions, mining::mempool const& mp);
+    validate_block(dispatcher& dispatch, fast_chain const& chain, settings const& settings, domain::config::network network, bool relay_transactions, block_metadata_cache& metadata, transaction_metadata_cache& transaction_metadata, mining::mempool const& mp);
 #else
-    validate_block(dispatcher& dispatch, fast_chain const& chain, settings const& settings, domain::config::network network, bool relay_transactions);
+    validate_block(dispatcher& dispatch, fast_chain const& chain, settings const& settings, domain::config::network network, bool relay_transactions, block_metadata_cache& metadata, transaction_metadata_cache& transaction_metadata);
 #endif
 
     void start();
@@ -52,6 +55,7 @@ protected:
 private:
     using atomic_counter = std::atomic<size_t>;
     using atomic_counter_ptr = std::shared_ptr<atomic_counter>;
+    using skip_list = std::shared_ptr<std::vector<bool> const>;
 
     static
     void dump(code const& ec, const domain::chain::transaction& tx, uint32_t input_index, uint32_t forks, size_t height);
@@ -61,8 +65,10 @@ private:
     void handle_populated(code const& ec, block_const_ptr block, result_handler handler) const;
     void accept_transactions(block_const_ptr block, size_t bucket, size_t buckets, atomic_counter_ptr sigops, bool bip16, bool bip141, result_handler handler) const;
     void handle_accepted(code const& ec, block_const_ptr block, atomic_counter_ptr sigops, bool bip141, result_handler handler) const;
-    void connect_inputs(block_const_ptr block, size_t bucket, size_t buckets, result_handler handler) const;
+    skip_list skipped_transactions(domain::chain::block const& block) const;
+    void connect_inputs(block_const_ptr block, size_t bucket, size_t buckets, skip_list skipped, result_handler handler) const;
     void handle_connected(code const& ec, block_const_ptr block, result_handler handler) const;
+    void add_metadata(domain::chain::block const& block, size_t sigchecks) const;
 
     // These are thread safe.
     std::atomic<bool> stopped_;
@@ -71,6 +77,9 @@ private:
     dispatcher& priority_dispatch_;
     mutable atomic_counter hits_;
     mutable atomic_counter queries_;
+    mutable atomic_counter sigchecks_;
+    block_metadata_cache& block_metadata_;
+    transaction_metadata_cache& transaction_metadata_;
 
     // Caller must not invoke accept/connect concurrently.
     populate_block block_populator_;
@@ -7,6 +7,8 @@
 
 #include <atomic>
 #include <cstddef>
+#include <functional>
+#include <memory>
 
 #include <kth/blockchain/define.hpp>
 #include <kth/blockchain/interface/fast_chain.hpp>
@@ -27,6 +29,9 @@ public:
     // using result_handler = handle0;
     using result_handler = handle0;
 
+    /// The result of script validation and the sigchecks of the scripts run.
+    using connect_handler = std::function<void(code const&, size_t)>;
+
 #if defined(KTH_WITH_MEMPOOL)
     validate_transaction(dispatcher& dispatch, fast_chain const& chain, settings const& settings, mining::mempool const& mp);
 #else
@@ -38,7 +43,7 @@ public:
 
     void check(transaction_const_ptr tx, result_handler handler) const;
     void accept(transaction_const_ptr tx, result_handler handler) const;
-    void connect(transaction_const_ptr tx, result_handler handler) const;
+    void connect(transaction_const_ptr tx, connect_handler handler) const;
 
 protected:
     inline
@@ -48,7 +53,9 @@ protected:
 
 private:
     void handle_populated(code const& ec, transaction_const_ptr tx, result_handler handler) const;
-    void connect_inputs(transaction_const_ptr tx, size_t bucket, size_t buckets, result_handler handler) const;
+    using atomic_counter_ptr = std::shared_ptr<std::atomic<size_t>>;
+
+    void connect_inputs(transaction_const_ptr tx, size_t bucket, size_t buckets, atomic_counter_ptr sigchecks, result_handler handler) const;
 
     // These are thread safe.
     std::atomic<bool> stopped_;
@@ -56,7 +63,10 @@ private:
     fast_chain const& fast_chain_;
     dispatcher& dispatch_;
 
-    // Caller must not invoke accept/connect concurrently.
+    // Population state is kept on the transaction and the chain and mempool
+    // reads are thread safe, so accept/connect may be invoked concurrently for
+    // distinct transactions. A transaction spending one being validated does
+    // not see its outputs, the organizer serializes these.
     populate_transaction transaction_populator_;
 };
 
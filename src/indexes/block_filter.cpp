@@ -0,0 +1,368 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <kth/blockchain/indexes/block_filter.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+using namespace kd::chain;
+
+namespace {
+
+constexpr uint8_t op_return = 0x6a;
+
+constexpr uint64_t sip_c0 = 0x736f6d6570736575ULL;
+constexpr uint64_t sip_c1 = 0x646f72616e646f6dULL;
+constexpr uint64_t sip_c2 = 0x6c7967656e657261ULL;
+constexpr uint64_t sip_c3 = 0x7465646279746573ULL;
+
+inline
+uint64_t rotl(uint64_t x, int bits) {
+    return (x << bits) | (x >> (64 - bits));
+}
+
+inline
+void sip_round(uint64_t& v0, uint64_t& v1, uint64_t& v2, uint64_t& v3) {
+    v0 += v1; v1 = rotl(v1, 13) ^ v0; v0 = rotl(v0, 32);
+    v2 += v3; v3 = rotl(v3, 16) ^ v2;
+    v0 += v3; v3 = rotl(v3, 21) ^ v0;
+    v2 += v1; v1 = rotl(v1, 17) ^ v2; v2 = rotl(v2, 32);
+}
+
+// SipHash-2-4 of a message of any length.
+uint64_t sip_hash(uint64_t k0, uint64_t k1, data_chunk const& data) {
+    uint64_t v0 = sip_c0 ^ k0;
+    uint64_t v1 = sip_c1 ^ k1;
+    uint64_t v2 = sip_c2 ^ k0;
+    uint64_t v3 = sip_c3 ^ k1;
+
+    auto const size = data.size();
+    auto const end = size - size % sizeof(uint64_t);
+
+    for (size_t offset = 0; offset < end; offset += sizeof(uint64_t)) {
+        auto const word = from_little_endian_unsafe<uint64_t>(data.begin() + offset);
+        v3 ^= word;
+        sip_round(v0, v1, v2, v3);
+        sip_round(v0, v1, v2, v3);
+        v0 ^= word;
+    }
+
+    auto last = uint64_t(size) << 56;
+    for (auto offset = end; offset < size; ++offset) {
+        last |= uint64_t(data[offset]) << (8 * (offset - end));
+    }
+
+    v3 ^= last;
+    sip_round(v0, v1, v2, v3);
+    sip_round(v0, v1, v2, v3);
+    v0 ^= last;
+    v2 ^= 0xff;
+    sip_round(v0, v1, v2, v3);
+    sip_round(v0, v1, v2, v3);
+    sip_round(v0, v1, v2, v3);
+    sip_round(v0, v1, v2, v3);
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+// The high word of the 128 bit product, maps a hash uniformly to [0, range).
+uint64_t multiply_high(uint64_t x, uint64_t range) {
+    auto const x_high = x >> 32;
+    auto const x_low = x & 0xffffffff;
+    auto const range_high = range >> 32;
+    auto const range_low = range & 0xffffffff;
+
+    auto const high = x_high * range_high;
+    auto const middle1 = x_high * range_low;
+    auto const middle2 = x_low * range_high;
+    auto const low = x_low * range_low;
+
+    auto const carry = (low >> 32) + (middle1 & 0xffffffff) + (middle2 & 0xffffffff);
+    return high + (middle1 >> 32) + (middle2 >> 32) + (carry >> 32);
+}
+
+// The sorted set values of the elements.
+std::vector<uint64_t> hashed_set(data_stack const& elements, uint64_t k0, uint64_t k1, uint64_t m) {
+    auto const range = uint64_t(elements.size()) * m;
+
+    std::vector<uint64_t> values;
+    values.reserve(elements.size());
+    for (auto const& element : elements) {
+        values.push_back(multiply_high(sip_hash(k0, k1, element), range));
+    }
+
+    std::sort(values.begin(), values.end());
+    return values;
+}
+
+// Bits are written and read most significant first.
+class bit_writer {
+public:
+    explicit
+    bit_writer(data_chunk& out)
+        : out_(out)
+    {}
+
+    void write(uint64_t value, uint8_t bits) {
+        while (bits > 0) {
+            auto const take = std::min<uint8_t>(8 - used_, bits);
+            auto const chunk = uint8_t((value >> (bits - take)) & ((1u << take) - 1));
+            byte_ |= uint8_t(chunk << (8 - used_ - take));
+            used_ += take;
+            bits -= take;
+
+            if (used_ == 8) {
+                flush();
+            }
+        }
+    }
+
+    void flush() {
+        if (used_ != 0) {
+            out_.push_back(byte_);
+            byte_ = 0;
+            used_ = 0;
+        }
+    }
+
+private:
+    data_chunk& out_;
+    uint8_t byte_ = 0;
+    uint8_t used_ = 0;
+};
+
+class bit_reader {
+public:
+    bit_reader(data_chunk const& data, size_t offset)
+        : data_(data), offset_(offset)
+    {}
+
+    bool read(uint8_t bits, uint64_t& out) {
+        out = 0;
+        while (bits > 0) {
+            if (offset_ == data_.size()) {
+                return false;
+            }
+
+            auto const take = std::min<uint8_t>(8 - used_, bits);
+            auto const chunk = (data_[offset_] >> (8 - used_ - take)) & ((1u << take) - 1);
+            out = (out << take) | chunk;
+            used_ += take;
+            bits -= take;
+
+            if (used_ == 8) {
+                ++offset_;
+                used_ = 0;
+            }
+        }
+
+        return true;
+    }
+
+private:
+    data_chunk const& data_;
+    size_t offset_;
+    uint8_t used_ = 0;
+};
+
+void write_compact_size(data_chunk& out, uint64_t value) {
+    auto const write = [&out, value](uint8_t prefix, size_t bytes) {
+        out.push_back(prefix);
+        for (size_t byte = 0; byte < bytes; ++byte) {
+            out.push_back(uint8_t(value >> (8 * byte)));
+        }
+    };
+
+    if (value < 0xfd) {
+        out.push_back(uint8_t(value));
+    } else if (value <= 0xffff) {
+        write(0xfd, 2);
+    } else if (value <= 0xffffffff) {
+        write(0xfe, 4);
+    } else {
+        write(0xff, 8);
+    }
+}
+
+bool read_compact_size(data_chunk const& data, size_t& offset, uint64_t& out) {
+    if (data.empty()) {
+        return false;
+    }
+
+    auto const prefix = data[0];
+    auto const bytes = prefix == 0xff ? 8u : prefix == 0xfe ? 4u : prefix == 0xfd ? 2u : 0u;
+    if (bytes == 0) {
+        out = prefix;
+        offset = 1;
+        return true;
+    }
+
+    if (data.size() < bytes + 1) {
+        return false;
+    }
+
+    out = 0;
+    for (size_t byte = 0; byte < bytes; ++byte) {
+        out |= uint64_t(data[byte + 1]) << (8 * byte);
+    }
+
+    offset = bytes + 1;
+    return true;
+}
+
+// Golomb-Rice: the quotient in unary, then the p bit remainder.
+bool read_delta(bit_reader& reader, uint8_t p, uint64_t& out) {
+    uint64_t quotient = 0;
+    uint64_t bit;
+    while (true) {
+        if ( ! reader.read(1, bit)) {
+            return false;
+        }
+
+        if (bit == 0) {
+            break;
+        }
+
+        ++quotient;
+    }
+
+    uint64_t remainder;
+    if ( ! reader.read(p, remainder)) {
+        return false;
+    }
+
+    out = (quotient << p) + remainder;
+    return true;
+}
+
+} // namespace
+
+void filter_keys(hash_digest const& block_hash, uint64_t& out_k0, uint64_t& out_k1) {
+    out_k0 = from_little_endian_unsafe<uint64_t>(block_hash.begin());
+    out_k1 = from_little_endian_unsafe<uint64_t>(block_hash.begin() + sizeof(uint64_t));
+}
+
+data_chunk gcs_encode(data_stack const& elements, uint64_t k0, uint64_t k1, uint8_t p, uint64_t m) {
+    data_chunk out;
+    write_compact_size(out, elements.size());
+
+    bit_writer writer(out);
+    uint64_t previous = 0;
+    for (auto const value : hashed_set(elements, k0, k1, m)) {
+        auto const delta = value - previous;
+        for (auto quotient = delta >> p; quotient > 0; --quotient) {
+            writer.write(1, 1);
+        }
+
+        writer.write(0, 1);
+        writer.write(delta, p);
+        previous = value;
+    }
+
+    writer.flush();
+    return out;
+}
+
+// Both the set and the queried values are sorted, so they are merged in a
+// single pass over the filter.
+bool gcs_match_any(data_chunk const& filter, data_stack const& elements, uint64_t k0, uint64_t k1, uint8_t p, uint64_t m) {
+    size_t offset;
+    uint64_t count;
+    if (elements.empty() || ! read_compact_size(filter, offset, count) || count == 0) {
+        return false;
+    }
+
+    auto const range = count * m;
+    std::vector<uint64_t> queries;
+    queries.reserve(elements.size());
+    for (auto const& element : elements) {
+        queries.push_back(multiply_high(sip_hash(k0, k1, element), range));
+    }
+
+    std::sort(queries.begin(), queries.end());
+
+    bit_reader reader(filter, offset);
+    auto query = queries.begin();
+    uint64_t value = 0;
+
+    for (uint64_t index = 0; index < count; ++index) {
+        uint64_t delta;
+        if ( ! read_delta(reader, p, delta)) {
+            return false;
+        }
+
+        value += delta;
+        while (query != queries.end() && *query < value) {
+            ++query;
+        }
+
+        if (query == queries.end()) {
+            return false;
+        }
+
+        if (*query == value) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool basic_filter_elements(block const& block, data_stack& out) {
+    out.clear();
+
+    for (auto const& tx : block.transactions()) {
+        for (auto const& output : tx.outputs()) {
+            auto script = output.script().to_data(false);
+            if ( ! script.empty() && script.front() != op_return) {
+                out.push_back(std::move(script));
+            }
+        }
+
+        if (tx.is_coinbase()) {
+            continue;
+        }
+
+        for (auto const& input : tx.inputs()) {
+            auto const& cache = input.previous_output().validation.cache;
+            if ( ! cache.is_valid()) {
+                return false;
+            }
+
+            auto script = cache.script().to_data(false);
+            if ( ! script.empty()) {
+                out.push_back(std::move(script));
+            }
+        }
+    }
+
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+    return true;
+}
+
+bool basic_filter(block const& block, data_chunk& out) {
+    data_stack elements;
+    if ( ! basic_filter_elements(block, elements)) {
+        return false;
+    }
+
+    uint64_t k0;
+    uint64_t k1;
+    filter_keys(block.hash(), k0, k1);
+    out = gcs_encode(elements, k0, k1);
+    return true;
+}
+
+hash_digest filter_header(hash_digest const& filter_hash, hash_digest const& previous_header) {
+    return bitcoin_hash(build_chunk({ filter_hash, previous_header }));
+}
+
+} // namespace kth::blockchain
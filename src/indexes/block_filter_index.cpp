@@ -0,0 +1,240 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <kth/blockchain/indexes/block_filter_index.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <utility>
+
+#include <kth/blockchain/indexes/block_filter.hpp>
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+// An entry record is the block hash, the filter hash and the filter header.
+static constexpr size_t entry_size = 3 * hash_size;
+
+block_filter_index::block_filter_index(size_t window)
+    : window_(window)
+{}
+
+block_filter_index::block_filter_index(size_t window, std::filesystem::path const& entries_file, std::filesystem::path const& filters_file)
+    : window_(window)
+    , entries_file_(std::make_unique<record_file>(entries_file))
+    , filters_file_(std::make_unique<record_file>(filters_file))
+{}
+
+// Only the entries are read, the filters of the window are then read by
+// height. The files are cut to the heights held by both (an interrupted
+// push), an entry that cannot be read drops it and those above.
+bool block_filter_index::open() {
+    if ( ! entries_file_) {
+        return true;
+    }
+
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+
+    entries_.clear();
+    heights_.clear();
+    filters_.clear();
+
+    auto valid = true;
+    auto const restore = [this, &valid](size_t, data_chunk&& data) {
+        if ( ! valid || data.size() != entry_size) {
+            valid = false;
+            return;
+        }
+
+        entry value;
+        std::copy_n(data.begin(), hash_size, value.block_hash.begin());
+        std::copy_n(data.begin() + hash_size, hash_size, value.filter_hash.begin());
+        std::copy_n(data.begin() + 2 * hash_size, hash_size, value.header.begin());
+        heights_[value.block_hash] = entries_.size();
+        entries_.push_back(value);
+    };
+
+    if ( ! entries_file_->open(restore) || ! filters_file_->open()) {
+        return false;
+    }
+
+    auto const count = std::min(entries_.size(), filters_file_->size());
+    truncate_unlocked(count);
+
+    for (auto height = count - std::min(count, window_); height < count; ++height) {
+        data_chunk filter;
+        if ( ! filters_file_->get(height, filter)) {
+            // The window is left empty, filters are then read by height.
+            filters_.clear();
+            break;
+        }
+
+        filters_.push_back(std::move(filter));
+    }
+
+    return true;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+void block_filter_index::close() {
+    if (entries_file_) {
+        entries_file_->close();
+        filters_file_->close();
+    }
+}
+
+size_t block_filter_index::size() const {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    shared_lock lock(mutex_);
+    return entries_.size();
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+bool block_filter_index::push(hash_digest const& block_hash, hash_digest const& previous_block_hash, size_t height, data_chunk&& filter) {
+    auto const filter_hash = bitcoin_hash(filter);
+
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+
+    if (height != entries_.size()) {
+        return false;
+    }
+
+    if (height != 0 && entries_.back().block_hash != previous_block_hash) {
+        return false;
+    }
+
+    auto const previous_header = height == 0 ? null_hash : entries_.back().header;
+    entry const value{ block_hash, filter_hash, filter_header(filter_hash, previous_header) };
+
+    // The filter is written first, so that an entry always has its filter.
+    if (entries_file_) {
+        auto const record = build_chunk({ value.block_hash, value.filter_hash, value.header });
+        if ( ! filters_file_->push(height, filter) || ! entries_file_->push(height, record)) {
+            filters_file_->truncate(height);
+            return false;
+        }
+    }
+
+    entries_.push_back(value);
+    heights_[block_hash] = height;
+
+    if (window_ == 0) {
+        return true;
+    }
+
+    filters_.push_back(std::move(filter));
+    if (filters_.size() > window_) {
+        filters_.pop_front();
+    }
+
+    return true;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+void block_filter_index::truncate(size_t count) {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+    truncate_unlocked(count);
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+void block_filter_index::clear() {
+    truncate(0);
+}
+
+// private
+void block_filter_index::truncate_unlocked(size_t count) {
+    while (entries_.size() > count) {
+        heights_.erase(entries_.back().block_hash);
+        entries_.pop_back();
+
+        if ( ! filters_.empty()) {
+            filters_.pop_back();
+        }
+    }
+
+    if (entries_file_) {
+        entries_file_->truncate(count);
+        filters_file_->truncate(count);
+    }
+}
+
+bool block_filter_index::get(size_t height, entry& out) const {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    shared_lock lock(mutex_);
+
+    if (height >= entries_.size()) {
+        return false;
+    }
+
+    out = entries_[height];
+    return true;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+bool block_filter_index::get(hash_digest const& block_hash, entry& out_entry, size_t& out_height) const {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    shared_lock lock(mutex_);
+
+    auto const it = heights_.find(block_hash);
+    if (it == heights_.end()) {
+        return false;
+    }
+
+    out_height = it->second;
+    out_entry = entries_[out_height];
+    return true;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+// The filters kept in memory are those of the top heights.
+bool block_filter_index::filter(size_t height, data_chunk& out) const {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    shared_lock lock(mutex_);
+
+    if (height >= entries_.size()) {
+        return false;
+    }
+
+    auto const first = entries_.size() - filters_.size();
+    if (height < first) {
+        return filters_file_ && filters_file_->get(height, out);
+    }
+
+    out = filters_[height - first];
+    return true;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+hash_list block_filter_index::filter_hashes(size_t start, size_t stop) const {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    shared_lock lock(mutex_);
+
+    if (start > stop || stop >= entries_.size()) {
+        return {};
+    }
+
+    hash_list out;
+    out.reserve(stop - start + 1);
+    for (auto height = start; height <= stop; ++height) {
+        out.push_back(entries_[height].filter_hash);
+    }
+
+    return out;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+} // namespace kth::blockchain
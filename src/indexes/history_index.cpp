@@ -0,0 +1,723 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <kth/blockchain/indexes/history_index.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <tuple>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+using namespace kd::chain;
+using domain::wallet::payment_address;
+
+namespace {
+
+constexpr uint32_t file_version = 1;
+constexpr auto manifest_file = "manifest";
+
+// The address, height, point hash, point index, kind and value of a row.
+constexpr size_t row_size = sizeof(short_hash) + sizeof(uint32_t) + sizeof(hash_digest) + sizeof(uint32_t) + sizeof(uint8_t) + sizeof(uint64_t);
+
+// The rows between sampled keys, the most rows a seek skips in a run.
+constexpr uint64_t sample_stride = 1024;
+
+// The runs of a level merged into one of the next level, up to the top level
+// (so that a merge is of a bounded size).
+constexpr size_t merge_width = 4;
+constexpr uint32_t max_level = 3;
+
+// The rows past the window written to a run, even if of fewer blocks.
+constexpr size_t run_rows = 1000000;
+
+template <typename Integer>
+void write_integer(std::ostream& stream, Integer value) {
+    auto const data = to_little_endian(value);
+    stream.write(reinterpret_cast<char const*>(data.data()), data.size());
+}
+
+void write_hash(std::ostream& stream, hash_digest const& hash) {
+    stream.write(reinterpret_cast<char const*>(hash.data()), hash.size());
+}
+
+template <typename Integer>
+bool read_integer(std::istream& stream, Integer& out) {
+    byte_array<sizeof(Integer)> data;
+    if ( ! stream.read(reinterpret_cast<char*>(data.data()), data.size())) {
+        return false;
+    }
+
+    out = from_little_endian_unsafe<Integer>(data.begin());
+    return true;
+}
+
+bool read_hash(std::istream& stream, hash_digest& out) {
+    return bool(stream.read(reinterpret_cast<char*>(out.data()), out.size()));
+}
+
+// The file is written aside and then renamed, so that an interrupted write
+// leaves no partial file under the name.
+template <typename Writer>
+bool write_file(std::filesystem::path const& file, Writer writer) {
+    auto temporary = file;
+    temporary += ".tmp";
+
+    {
+        std::ofstream stream(temporary, std::ios::binary | std::ios::trunc);
+        if ( ! writer(stream)) {
+            return false;
+        }
+
+        stream.flush();
+        if ( ! stream) {
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(temporary, file, ec);
+    return ! ec;
+}
+
+} // namespace
+
+history_index::history_index(size_t window)
+    : history_index(window, {}, default_run_blocks)
+{}
+
+history_index::history_index(size_t window, std::filesystem::path const& directory, size_t run_blocks)
+    : window_(window)
+    , run_blocks_(std::max(run_blocks, size_t(1)))
+    , directory_(directory)
+    , synced_(false)
+    , next_number_(0)
+    , size_(0)
+    , runs_top_hash_(null_hash)
+    , generation_(0)
+{}
+
+// Files not of the manifest are of an interrupted write, and are removed.
+bool history_index::open() {
+    synced_ = false;
+
+    if (directory_.empty()) {
+        return true;
+    }
+
+    std::lock_guard flush_lock(flush_mutex_);
+
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+
+    runs_.clear();
+    blocks_.clear();
+    size_ = 0;
+    runs_top_hash_ = null_hash;
+    next_number_ = 0;
+
+    std::error_code ec;
+    std::filesystem::create_directories(directory_, ec);
+    if (ec) {
+        return false;
+    }
+
+    if ( ! read_manifest_unlocked()) {
+        clear_unlocked();
+    }
+
+    std::unordered_set<std::string> names{ manifest_file };
+    for (auto const& value : runs_) {
+        names.insert(run_file(value.number).filename().string());
+    }
+
+    std::vector<std::filesystem::path> stray;
+    for (auto const& entry : std::filesystem::directory_iterator(directory_, ec)) {
+        if ( ! names.contains(entry.path().filename().string())) {
+            stray.push_back(entry.path());
+        }
+    }
+
+    for (auto const& file : stray) {
+        std::filesystem::remove(file, ec);
+    }
+
+    return true;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+void history_index::close() {
+    std::lock_guard flush_lock(flush_mutex_);
+
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+    runs_.clear();
+    blocks_.clear();
+    size_ = 0;
+    runs_top_hash_ = null_hash;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+size_t history_index::size() const {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    shared_lock lock(mutex_);
+    return size_;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+bool history_index::block_hash(size_t height, hash_digest& out) const {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    shared_lock lock(mutex_);
+
+    if (height >= size_) {
+        return false;
+    }
+
+    auto const first = size_ - blocks_.size();
+    if (height >= first) {
+        out = blocks_[height - first].block_hash;
+        return true;
+    }
+
+    if (height + 1 != first) {
+        return false;
+    }
+
+    out = runs_top_hash_;
+    return true;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+bool history_index::synced() const {
+    return synced_;
+}
+
+void history_index::set_synced() {
+    synced_ = true;
+}
+
+// The rows are derived before locking. As the store does, the addresses of a
+// spend are those of the script of the spent output.
+bool history_index::push(block const& block, size_t height) {
+    rows values;
+
+    auto const add = [&values, height](script const& paid, hash_digest const& hash, uint32_t index, point_kind kind, uint64_t value) {
+        for (auto const& address : payment_address::extract(paid, payment_address::mainnet_p2kh, payment_address::mainnet_p2sh)) {
+            values.push_back({ address.hash(), uint32_t(height), hash, index, uint8_t(kind), value });
+        }
+    };
+
+    for (auto const& tx : block.transactions()) {
+        auto const tx_hash = tx.hash();
+
+        if ( ! tx.is_coinbase()) {
+            auto const& inputs = tx.inputs();
+            for (uint32_t index = 0; index < inputs.size(); ++index) {
+                auto const& prevout = inputs[index].previous_output();
+                if ( ! prevout.validation.cache.is_valid()) {
+                    return false;
+                }
+
+                add(prevout.validation.cache.script(), tx_hash, index, point_kind::spend, prevout.checksum());
+            }
+        }
+
+        auto const& outputs = tx.outputs();
+        for (uint32_t index = 0; index < outputs.size(); ++index) {
+            add(outputs[index].script(), tx_hash, index, point_kind::output, outputs[index].value());
+        }
+    }
+
+    std::sort(values.begin(), values.end(), [](row const& left, row const& right) {
+        return before(left, right);
+    });
+
+    auto const block_hash = block.hash();
+
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+
+    if (height != size_) {
+        return false;
+    }
+
+    if (height != 0) {
+        auto const& top_hash = blocks_.empty() ? runs_top_hash_ : blocks_.back().block_hash;
+        if (block.header().previous_block_hash() != top_hash) {
+            return false;
+        }
+    }
+
+    blocks_.push_back({ block_hash, std::move(values) });
+    ++size_;
+    return true;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+// Only the blocks in memory are dropped. Those past the window may be being
+// written to a run, a truncation of these clears the index.
+bool history_index::truncate(size_t count) {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+
+    if (count >= size_) {
+        return true;
+    }
+
+    auto const first = size_ - blocks_.size();
+    if (count < first || ( ! directory_.empty() && count + window_ < size_)) {
+        clear_unlocked();
+        return false;
+    }
+
+    blocks_.resize(count - first);
+    size_ = count;
+    return true;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+void history_index::clear() {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+    clear_unlocked();
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+// A run written while the index is cleared (of a previous generation) is
+// removed rather than installed.
+bool history_index::flush() {
+    if (directory_.empty()) {
+        return true;
+    }
+
+    std::lock_guard flush_lock(flush_mutex_);
+
+    rows values;
+    run written{};
+    hash_digest top_hash;
+    size_t past;
+    uint64_t generation;
+
+    {
+        // Critical Section
+        ///////////////////////////////////////////////////////////////////////
+        shared_lock lock(mutex_);
+
+        past = blocks_.size() > window_ ? blocks_.size() - window_ : 0;
+
+        size_t count = 0;
+        for (size_t position = 0; position < past; ++position) {
+            count += blocks_[position].values.size();
+        }
+
+        if (past == 0 || (past < run_blocks_ && count < run_rows)) {
+            return true;
+        }
+
+        values.reserve(count);
+        for (size_t position = 0; position < past; ++position) {
+            auto const& block_values = blocks_[position].values;
+            values.insert(values.end(), block_values.begin(), block_values.end());
+        }
+
+        written.first_height = size_ - blocks_.size();
+        written.last_height = written.first_height + past - 1;
+        top_hash = blocks_[past - 1].block_hash;
+        generation = generation_;
+        ///////////////////////////////////////////////////////////////////////
+    }
+
+    std::sort(values.begin(), values.end(), [](row const& left, row const& right) {
+        return before(left, right);
+    });
+
+    written.number = next_number_++;
+    written.level = 0;
+    written.count = values.size();
+    if ( ! write_run(written, values)) {
+        return false;
+    }
+
+    {
+        // Critical Section
+        ///////////////////////////////////////////////////////////////////////
+        unique_lock lock(mutex_);
+
+        if (generation != generation_) {
+            remove_runs({ written });
+            return true;
+        }
+
+        runs_.push_back(std::move(written));
+        runs_top_hash_ = top_hash;
+        blocks_.erase(blocks_.begin(), blocks_.begin() + past);
+        if ( ! write_manifest_unlocked()) {
+            return false;
+        }
+        ///////////////////////////////////////////////////////////////////////
+    }
+
+    // The last runs are merged while they share a level below the top.
+    while (true) {
+        std::vector<run> merging;
+
+        {
+            // Critical Section
+            ///////////////////////////////////////////////////////////////////
+            shared_lock lock(mutex_);
+
+            if (runs_.size() < merge_width || runs_.back().level >= max_level) {
+                return true;
+            }
+
+            auto const level = runs_.back().level;
+            auto const last = runs_.end() - merge_width;
+            if ( ! std::all_of(last, runs_.end(), [level](run const& value) { return value.level == level; })) {
+                return true;
+            }
+
+            merging.assign(last, runs_.end());
+            generation = generation_;
+            ///////////////////////////////////////////////////////////////////
+        }
+
+        run merged{ next_number_++, merging.front().level + 1, merging.front().first_height, merging.back().last_height, 0, {} };
+        if ( ! merge_runs(merged, merging)) {
+            return false;
+        }
+
+        // Critical Section
+        ///////////////////////////////////////////////////////////////////////
+        unique_lock lock(mutex_);
+
+        if (generation != generation_) {
+            remove_runs({ merged });
+            return true;
+        }
+
+        runs_.erase(runs_.end() - merge_width, runs_.end());
+        runs_.push_back(std::move(merged));
+        if ( ! write_manifest_unlocked()) {
+            return false;
+        }
+
+        // Readers hold the lock while reading, none reads the merged runs.
+        remove_runs(merging);
+        ///////////////////////////////////////////////////////////////////////
+    }
+}
+
+// The runs are of consecutive heights and the blocks above them, so that the
+// rows of the address are in key order when read in turn.
+bool history_index::read(short_hash const& address, key const& from, size_t limit, history_compact::list& out) const {
+    out.clear();
+
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    shared_lock lock(mutex_);
+
+    for (auto const& value : runs_) {
+        if (out.size() >= limit) {
+            return true;
+        }
+
+        if ( ! read_run(value, address, from, limit, out)) {
+            return false;
+        }
+    }
+
+    auto const first = size_ - blocks_.size();
+    for (size_t position = 0; position < blocks_.size() && out.size() < limit; ++position) {
+        if (first + position < from.height) {
+            continue;
+        }
+
+        auto const& values = blocks_[position].values;
+        auto it = std::partition_point(values.begin(), values.end(), [&address, &from](row const& value) {
+            return before(value, address, from);
+        });
+
+        for (; it != values.end() && it->address == address && out.size() < limit; ++it) {
+            out.push_back(to_history(*it));
+        }
+    }
+
+    return true;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+// private
+//-----------------------------------------------------------------------------
+
+// Rows are ordered by address, then as the history: by height, point and kind.
+bool history_index::before(row const& left, row const& right) {
+    return std::tie(left.address, left.height, left.hash, left.index, left.kind) <
+        std::tie(right.address, right.height, right.hash, right.index, right.kind);
+}
+
+bool history_index::before(row const& value, short_hash const& address, key const& from) {
+    size_t const height = value.height;
+    auto const kind = uint8_t(from.kind);
+    return std::tie(value.address, height, value.hash, value.index, value.kind) <
+        std::tie(address, from.height, from.hash, from.index, kind);
+}
+
+history_compact history_index::to_history(row const& value) {
+    return history_compact{ point_kind(value.kind), point{ value.hash, value.index }, value.height, value.value };
+}
+
+void history_index::write_row(std::ostream& stream, row const& value) {
+    stream.write(reinterpret_cast<char const*>(value.address.data()), value.address.size());
+    write_integer(stream, value.height);
+    write_hash(stream, value.hash);
+    write_integer(stream, value.index);
+    write_integer(stream, value.kind);
+    write_integer(stream, value.value);
+}
+
+bool history_index::read_row(std::istream& stream, row& out) {
+    return stream.read(reinterpret_cast<char*>(out.address.data()), out.address.size()) &&
+        read_integer(stream, out.height) && read_hash(stream, out.hash) && read_integer(stream, out.index) &&
+        read_integer(stream, out.kind) && read_integer(stream, out.value);
+}
+
+std::filesystem::path history_index::run_file(uint64_t number) const {
+    return directory_ / ("run_" + std::to_string(number));
+}
+
+bool history_index::write_run(run& out, rows const& values) const {
+    out.samples.clear();
+
+    return write_file(run_file(out.number), [&out, &values](std::ostream& stream) {
+        for (uint64_t position = 0; position < values.size(); ++position) {
+            if (position % sample_stride == 0) {
+                out.samples.push_back(values[position]);
+            }
+
+            write_row(stream, values[position]);
+        }
+
+        return true;
+    });
+}
+
+// Each run is sorted, the first row of the runs is taken in turn.
+bool history_index::merge_runs(run& out, std::vector<run> const& runs) const {
+    struct source {
+        std::ifstream stream;
+        uint64_t left;
+        row current;
+    };
+
+    std::vector<source> sources(runs.size());
+    for (size_t position = 0; position < runs.size(); ++position) {
+        auto& input = sources[position];
+        input.stream.open(run_file(runs[position].number), std::ios::binary);
+        input.left = runs[position].count;
+        if ( ! input.stream || (input.left != 0 && ! read_row(input.stream, input.current))) {
+            return false;
+        }
+    }
+
+    out.count = 0;
+    out.samples.clear();
+
+    return write_file(run_file(out.number), [&out, &sources](std::ostream& stream) {
+        while (true) {
+            source* next = nullptr;
+            for (auto& input : sources) {
+                if (input.left != 0 && (next == nullptr || before(input.current, next->current))) {
+                    next = &input;
+                }
+            }
+
+            if (next == nullptr) {
+                return true;
+            }
+
+            if (out.count % sample_stride == 0) {
+                out.samples.push_back(next->current);
+            }
+
+            write_row(stream, next->current);
+            ++out.count;
+
+            if (--next->left != 0 && ! read_row(next->stream, next->current)) {
+                return false;
+            }
+        }
+    });
+}
+
+// The seek starts at the last sample before the key, so that at most a
+// stride of rows is skipped.
+bool history_index::read_run(run const& value, short_hash const& address, key const& from, size_t limit, history_compact::list& out) const {
+    if (value.last_height < from.height || value.samples.empty()) {
+        return true;
+    }
+
+    auto const sample = std::partition_point(value.samples.begin(), value.samples.end(), [&address, &from](row const& sampled) {
+        return before(sampled, address, from);
+    });
+
+    uint64_t position = sample == value.samples.begin() ? 0 : uint64_t(sample - value.samples.begin() - 1) * sample_stride;
+
+    std::ifstream stream(run_file(value.number), std::ios::binary);
+    stream.seekg(position * row_size);
+    if ( ! stream) {
+        return false;
+    }
+
+    for (; position < value.count && out.size() < limit; ++position) {
+        row current;
+        if ( ! read_row(stream, current)) {
+            return false;
+        }
+
+        if (before(current, address, from)) {
+            continue;
+        }
+
+        if (current.address != address) {
+            return true;
+        }
+
+        out.push_back(to_history(current));
+    }
+
+    return true;
+}
+
+// The file must hold the rows of the run, of which the keys are sampled.
+bool history_index::sample_run(run& value) const {
+    auto const file = run_file(value.number);
+
+    std::error_code ec;
+    auto const size = std::filesystem::file_size(file, ec);
+    if (ec || size != value.count * row_size) {
+        return false;
+    }
+
+    std::ifstream stream(file, std::ios::binary);
+    value.samples.clear();
+
+    for (uint64_t position = 0; position < value.count; position += sample_stride) {
+        row sampled;
+        stream.seekg(position * row_size);
+        if ( ! read_row(stream, sampled)) {
+            return false;
+        }
+
+        value.samples.push_back(sampled);
+    }
+
+    return true;
+}
+
+// The runs must be of consecutive heights from genesis. A missing manifest is
+// of an empty index.
+bool history_index::read_manifest_unlocked() {
+    auto const file = directory_ / manifest_file;
+
+    std::error_code ec;
+    if ( ! std::filesystem::exists(file, ec)) {
+        return ! ec;
+    }
+
+    std::ifstream stream(file, std::ios::binary);
+
+    uint32_t version;
+    uint64_t count;
+
+    if ( ! stream || ! read_integer(stream, version) || version != file_version ||
+        ! read_hash(stream, runs_top_hash_) || ! read_integer(stream, count)) {
+        return false;
+    }
+
+    for (uint64_t index = 0; index < count; ++index) {
+        run value{};
+        uint64_t first_height;
+        uint64_t last_height;
+
+        if ( ! read_integer(stream, value.number) || ! read_integer(stream, value.level) ||
+            ! read_integer(stream, first_height) || ! read_integer(stream, last_height) ||
+            ! read_integer(stream, value.count) || first_height != size_ || last_height < first_height) {
+            return false;
+        }
+
+        value.first_height = first_height;
+        value.last_height = last_height;
+        if ( ! sample_run(value)) {
+            return false;
+        }
+
+        size_ = last_height + 1;
+        next_number_ = std::max(next_number_, value.number + 1);
+        runs_.push_back(std::move(value));
+    }
+
+    return true;
+}
+
+bool history_index::write_manifest_unlocked() const {
+    return write_file(directory_ / manifest_file, [this](std::ostream& stream) {
+        write_integer(stream, file_version);
+        write_hash(stream, runs_top_hash_);
+        write_integer(stream, uint64_t(runs_.size()));
+
+        for (auto const& value : runs_) {
+            write_integer(stream, value.number);
+            write_integer(stream, value.level);
+            write_integer(stream, uint64_t(value.first_height));
+            write_integer(stream, uint64_t(value.last_height));
+            write_integer(stream, value.count);
+        }
+
+        return true;
+    });
+}
+
+void history_index::remove_runs(std::vector<run> const& runs) const {
+    std::error_code ec;
+    for (auto const& value : runs) {
+        std::filesystem::remove(run_file(value.number), ec);
+    }
+}
+
+// The manifest is written empty before the runs are removed, so that an
+// interruption leaves no manifest of missing runs.
+void history_index::clear_unlocked() {
+    ++generation_;
+    synced_ = false;
+
+    auto const removed = std::move(runs_);
+    runs_.clear();
+    blocks_.clear();
+    size_ = 0;
+    runs_top_hash_ = null_hash;
+
+    if ( ! directory_.empty()) {
+        write_manifest_unlocked();
+        remove_runs(removed);
+    }
+}
+
+} // namespace kth::blockchain
@@ -0,0 +1,221 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <kth/blockchain/indexes/muhash.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+namespace {
+
+using number = muhash::number;
+using wide = unsigned __int128;
+
+constexpr auto limbs = muhash::limb_count;
+constexpr size_t number_size = limbs * sizeof(uint64_t);
+
+// The modulus is 2^3072 - offset.
+constexpr uint64_t offset = 1103717;
+
+number one() {
+    number result{};
+    result[0] = 1;
+    return result;
+}
+
+// Values are kept below 2^3072, which is less than twice the modulus.
+void reduce_once(number& value) {
+    number sum;
+    wide carry = offset;
+
+    for (size_t index = 0; index < limbs; ++index) {
+        carry += value[index];
+        sum[index] = uint64_t(carry);
+        carry >>= 64;
+    }
+
+    // Adding the offset overflows 2^3072 only if the value is not below it.
+    if (carry != 0) {
+        value = sum;
+    }
+}
+
+// The product is folded with 2^3072 = offset (mod p).
+number multiply(number const& left, number const& right) {
+    std::array<uint64_t, 2 * limbs> product{};
+
+    for (size_t i = 0; i < limbs; ++i) {
+        wide carry = 0;
+        for (size_t j = 0; j < limbs; ++j) {
+            carry += wide(left[i]) * right[j] + product[i + j];
+            product[i + j] = uint64_t(carry);
+            carry >>= 64;
+        }
+
+        product[i + limbs] = uint64_t(carry);
+    }
+
+    number result;
+    wide carry = 0;
+    for (size_t index = 0; index < limbs; ++index) {
+        carry += wide(product[index + limbs]) * offset + product[index];
+        result[index] = uint64_t(carry);
+        carry >>= 64;
+    }
+
+    while (carry != 0) {
+        wide fold = carry * offset;
+        for (size_t index = 0; index < limbs; ++index) {
+            fold += result[index];
+            result[index] = uint64_t(fold);
+            fold >>= 64;
+        }
+
+        carry = fold;
+    }
+
+    reduce_once(result);
+    return result;
+}
+
+// Fermat inversion, the exponent p - 2 = 2^3072 - (offset + 2).
+number inverse(number const& value) {
+    number exponent;
+    exponent.fill(max_uint64);
+    exponent[0] = uint64_t(0) - (offset + 2);
+
+    auto result = one();
+    for (size_t bit = limbs * 64; bit-- > 0;) {
+        result = multiply(result, result);
+        if (((exponent[bit / 64] >> (bit % 64)) & 1) != 0) {
+            result = multiply(result, value);
+        }
+    }
+
+    return result;
+}
+
+// ChaCha20 keystream (RFC 8439, zero nonce and counter) of the key.
+void chacha20(hash_digest const& key, uint8_t* out, size_t size) {
+    auto const rotate = [](uint32_t value, int bits) {
+        return (value << bits) | (value >> (32 - bits));
+    };
+
+    auto const quarter = [&rotate](uint32_t& a, uint32_t& b, uint32_t& c, uint32_t& d) {
+        a += b; d = rotate(d ^ a, 16);
+        c += d; b = rotate(b ^ c, 12);
+        a += b; d = rotate(d ^ a, 8);
+        c += d; b = rotate(b ^ c, 7);
+    };
+
+    std::array<uint32_t, 16> input{ 0x61707865, 0x3320646e, 0x79622d32, 0x6b206574 };
+    for (size_t index = 0; index < 8; ++index) {
+        input[4 + index] = from_little_endian_unsafe<uint32_t>(key.begin() + 4 * index);
+    }
+
+    for (size_t block = 0; block * 64 < size; ++block) {
+        input[12] = uint32_t(block);
+        auto state = input;
+
+        for (size_t round = 0; round < 10; ++round) {
+            quarter(state[0], state[4], state[8], state[12]);
+            quarter(state[1], state[5], state[9], state[13]);
+            quarter(state[2], state[6], state[10], state[14]);
+            quarter(state[3], state[7], state[11], state[15]);
+            quarter(state[0], state[5], state[10], state[15]);
+            quarter(state[1], state[6], state[11], state[12]);
+            quarter(state[2], state[7], state[8], state[13]);
+            quarter(state[3], state[4], state[9], state[14]);
+        }
+
+        for (size_t word = 0; word < 16 && block * 64 + word * 4 < size; ++word) {
+            auto const value = state[word] + input[word];
+            for (size_t byte = 0; byte < 4; ++byte) {
+                out[block * 64 + word * 4 + byte] = uint8_t(value >> (8 * byte));
+            }
+        }
+    }
+}
+
+// The element is hashed and expanded to a little endian 3072 bit number.
+number to_number(data_slice element) {
+    std::array<uint8_t, number_size> bytes;
+    chacha20(sha256_hash(element), bytes.data(), bytes.size());
+
+    number result;
+    for (size_t index = 0; index < limbs; ++index) {
+        result[index] = from_little_endian_unsafe<uint64_t>(bytes.begin() + index * sizeof(uint64_t));
+    }
+
+    reduce_once(result);
+    return result;
+}
+
+} // namespace
+
+muhash::muhash()
+    : numerator_(one())
+    , denominator_(one())
+{}
+
+void muhash::insert(data_slice element) {
+    numerator_ = multiply(numerator_, to_number(element));
+}
+
+void muhash::remove(data_slice element) {
+    denominator_ = multiply(denominator_, to_number(element));
+}
+
+void muhash::combine(muhash const& other) {
+    numerator_ = multiply(numerator_, other.numerator_);
+    denominator_ = multiply(denominator_, other.denominator_);
+}
+
+// The numerator followed by the denominator, limbs little endian.
+data_chunk muhash::to_data() const {
+    data_chunk data;
+    data.reserve(serialized_size);
+
+    for (auto const& value : { numerator_, denominator_ }) {
+        for (auto const limb : value) {
+            extend_data(data, to_little_endian(limb));
+        }
+    }
+
+    return data;
+}
+
+bool muhash::from_data(data_slice data) {
+    if (data.size() != serialized_size) {
+        return false;
+    }
+
+    auto it = data.begin();
+    for (auto value : { &numerator_, &denominator_ }) {
+        for (auto& limb : *value) {
+            limb = from_little_endian_unsafe<uint64_t>(it);
+            it += sizeof(uint64_t);
+        }
+    }
+
+    return true;
+}
+
+hash_digest muhash::digest() const {
+    auto const value = multiply(numerator_, inverse(denominator_));
+
+    data_chunk bytes;
+    bytes.reserve(number_size);
+    for (auto const limb : value) {
+        extend_data(bytes, to_little_endian(limb));
+    }
+
+    return sha256_hash(bytes);
+}
+
+} // namespace kth::blockchain
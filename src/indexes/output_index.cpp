@@ -0,0 +1,392 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <kth/blockchain/indexes/output_index.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+using namespace kd::chain;
+
+namespace {
+
+constexpr uint32_t file_version = 1;
+
+// Outputs are far smaller, a larger size is of a damaged file.
+constexpr uint32_t max_output_size = 1000000;
+
+template <typename Integer>
+void write_integer(std::ostream& stream, Integer value) {
+    auto const data = to_little_endian(value);
+    stream.write(reinterpret_cast<char const*>(data.data()), data.size());
+}
+
+void write_hash(std::ostream& stream, hash_digest const& hash) {
+    stream.write(reinterpret_cast<char const*>(hash.data()), hash.size());
+}
+
+void write_entry(std::ostream& stream, hash_digest const& key, output_index::entry const& value) {
+    auto const output = value.output.to_data();
+    write_hash(stream, key);
+    write_hash(stream, value.point.hash());
+    write_integer(stream, value.point.index());
+    write_integer(stream, uint64_t(value.height));
+    write_integer(stream, uint32_t(output.size()));
+    stream.write(reinterpret_cast<char const*>(output.data()), output.size());
+}
+
+template <typename Integer>
+bool read_integer(std::istream& stream, Integer& out) {
+    byte_array<sizeof(Integer)> data;
+    if ( ! stream.read(reinterpret_cast<char*>(data.data()), data.size())) {
+        return false;
+    }
+
+    out = from_little_endian_unsafe<Integer>(data.begin());
+    return true;
+}
+
+bool read_hash(std::istream& stream, hash_digest& out) {
+    return bool(stream.read(reinterpret_cast<char*>(out.data()), out.size()));
+}
+
+bool read_entry(std::istream& stream, hash_digest& key, output_index::entry& out) {
+    hash_digest hash;
+    uint32_t index;
+    uint64_t height;
+    uint32_t size;
+
+    if ( ! read_hash(stream, key) || ! read_hash(stream, hash) || ! read_integer(stream, index) ||
+        ! read_integer(stream, height) || ! read_integer(stream, size) || size > max_output_size) {
+        return false;
+    }
+
+    data_chunk data(size);
+    if ( ! stream.read(reinterpret_cast<char*>(data.data()), size)) {
+        return false;
+    }
+
+    out.point = output_point{ hash, index };
+    out.height = height;
+    return out.output.from_data(data);
+}
+
+} // namespace
+
+output_index::output_index(size_t undo_depth)
+    : undo_depth_(undo_depth == 0 ? max_size_t : undo_depth)
+    , synced_(false)
+    , size_(0)
+    , top_hash_(null_hash)
+{}
+
+size_t output_index::size() const {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    shared_lock lock(mutex_);
+    return size_;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+hash_digest output_index::top_hash() const {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    shared_lock lock(mutex_);
+    return top_hash_;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+bool output_index::synced() const {
+    return synced_;
+}
+
+void output_index::set_synced() {
+    synced_ = true;
+}
+
+void output_index::reset(size_t height, hash_digest const& previous_block_hash) {
+    synced_ = false;
+
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+    outputs_.clear();
+    keys_.clear();
+    undo_.clear();
+    size_ = height;
+    top_hash_ = previous_block_hash;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+// Inputs are applied before the outputs of each tx, so that spends within
+// the block of outputs created by it are also recorded. Keys are derived
+// before locking.
+bool output_index::connect(block const& block, size_t height) {
+    auto const& txs = block.transactions();
+
+    std::vector<keyed_entry> created;
+    std::vector<size_t> created_ends;
+    created_ends.reserve(txs.size());
+
+    for (auto const& tx : txs) {
+        auto const& tx_hash = tx.hash();
+        auto const& outputs = tx.outputs();
+        for (uint32_t index = 0; index < outputs.size(); ++index) {
+            hash_digest output_key;
+            if (key(outputs[index], output_key)) {
+                created.push_back({ output_key, { output_point{ tx_hash, index }, height, outputs[index] } });
+            }
+        }
+
+        created_ends.push_back(created.size());
+    }
+
+    undo record{ block.hash(), {} };
+
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+
+    if (height != size_ || (height != 0 && block.header().previous_block_hash() != top_hash_)) {
+        return false;
+    }
+
+    size_t next = 0;
+    for (size_t tx = 0; tx < txs.size(); ++tx) {
+        for (auto const& input : txs[tx].inputs()) {
+            keyed_entry spent;
+            if (remove_unlocked(input.previous_output(), &spent)) {
+                record.spent.push_back(std::move(spent));
+            }
+        }
+
+        for (; next < created_ends[tx]; ++next) {
+            add_unlocked(std::move(created[next]));
+        }
+    }
+
+    undo_.push_back(std::move(record));
+    if (undo_.size() > undo_depth_) {
+        undo_.pop_front();
+    }
+
+    ++size_;
+    top_hash_ = block.hash();
+    return true;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+// Outputs spent within the block were also created by it, these are not
+// restored (they are at the block height).
+bool output_index::disconnect(block const& block) {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+
+    if (size_ == 0 || undo_.empty() || block.hash() != top_hash_ ||
+        undo_.back().block_hash != top_hash_) {
+        return false;
+    }
+
+    auto const height = size_ - 1;
+
+    for (auto const& tx : block.transactions()) {
+        auto const& tx_hash = tx.hash();
+        for (uint32_t index = 0; index < tx.outputs().size(); ++index) {
+            remove_unlocked(output_point{ tx_hash, index }, nullptr);
+        }
+    }
+
+    for (auto& spent : undo_.back().spent) {
+        if (spent.second.height != height) {
+            add_unlocked(std::move(spent));
+        }
+    }
+
+    undo_.pop_back();
+    --size_;
+    top_hash_ = block.header().previous_block_hash();
+    return true;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+output_index::list output_index::find(hash_digest const& key) const {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    shared_lock lock(mutex_);
+
+    auto const it = keys_.find(key);
+    if (it == keys_.end()) {
+        return {};
+    }
+
+    list out;
+    out.reserve(it->second.size());
+    for (auto const& point : it->second) {
+        out.push_back(outputs_.at(point).second);
+    }
+
+    return out;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+void output_index::clear() {
+    reset(0, null_hash);
+}
+
+// The file is written aside and then renamed over the previous one, so that
+// an interrupted save leaves the previous index.
+bool output_index::save(std::filesystem::path const& file) const {
+    auto temporary = file;
+    temporary += ".tmp";
+
+    {
+        std::ofstream stream(temporary, std::ios::binary | std::ios::trunc);
+
+        // Critical Section
+        ///////////////////////////////////////////////////////////////////////
+        shared_lock lock(mutex_);
+
+        write_integer(stream, file_version);
+        write_integer(stream, uint64_t(size_));
+        write_hash(stream, top_hash_);
+
+        write_integer(stream, uint64_t(outputs_.size()));
+        for (auto const& output : outputs_) {
+            write_entry(stream, output.second.first, output.second.second);
+        }
+
+        write_integer(stream, uint64_t(undo_.size()));
+        for (auto const& record : undo_) {
+            write_hash(stream, record.block_hash);
+            write_integer(stream, uint64_t(record.spent.size()));
+            for (auto const& spent : record.spent) {
+                write_entry(stream, spent.first, spent.second);
+            }
+        }
+        ///////////////////////////////////////////////////////////////////////
+
+        stream.flush();
+        if ( ! stream) {
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(temporary, file, ec);
+    return ! ec;
+}
+
+// The most recent kept spends are loaded, up to the undo depth.
+bool output_index::load(std::filesystem::path const& file) {
+    synced_ = false;
+    std::ifstream stream(file, std::ios::binary);
+
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+
+    outputs_.clear();
+    keys_.clear();
+    undo_.clear();
+
+    auto const fail = [this]() {
+        outputs_.clear();
+        keys_.clear();
+        undo_.clear();
+        size_ = 0;
+        top_hash_ = null_hash;
+        return false;
+    };
+
+    uint32_t version;
+    uint64_t size;
+    uint64_t count;
+
+    if ( ! stream || ! read_integer(stream, version) || version != file_version ||
+        ! read_integer(stream, size) || ! read_hash(stream, top_hash_) || ! read_integer(stream, count)) {
+        return fail();
+    }
+
+    size_ = size;
+
+    for (uint64_t index = 0; index < count; ++index) {
+        keyed_entry value;
+        if ( ! read_entry(stream, value.first, value.second)) {
+            return fail();
+        }
+
+        add_unlocked(std::move(value));
+    }
+
+    if ( ! read_integer(stream, count)) {
+        return fail();
+    }
+
+    for (uint64_t index = 0; index < count; ++index) {
+        undo record;
+        uint64_t spent;
+        if ( ! read_hash(stream, record.block_hash) || ! read_integer(stream, spent)) {
+            return fail();
+        }
+
+        for (uint64_t position = 0; position < spent; ++position) {
+            keyed_entry value;
+            if ( ! read_entry(stream, value.first, value.second)) {
+                return fail();
+            }
+
+            record.spent.push_back(std::move(value));
+        }
+
+        undo_.push_back(std::move(record));
+        if (undo_.size() > undo_depth_) {
+            undo_.pop_front();
+        }
+    }
+
+    return true;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+// private
+void output_index::add_unlocked(keyed_entry&& value) {
+    auto const point = value.second.point;
+    keys_[value.first].insert(point);
+    outputs_.insert_or_assign(point, std::move(value));
+}
+
+// private
+bool output_index::remove_unlocked(output_point const& point, keyed_entry* out) {
+    auto const it = outputs_.find(point);
+    if (it == outputs_.end()) {
+        return false;
+    }
+
+    auto const keyed = keys_.find(it->second.first);
+    if (keyed != keys_.end()) {
+        keyed->second.erase(point);
+        if (keyed->second.empty()) {
+            keys_.erase(keyed);
+        }
+    }
+
+    if (out != nullptr) {
+        *out = std::move(it->second);
+    }
+
+    outputs_.erase(it);
+    return true;
+}
+
+} // namespace kth::blockchain
@@ -0,0 +1,179 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <kth/blockchain/indexes/record_file.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+#include <utility>
+
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+static constexpr size_t prefix_size = sizeof(uint32_t);
+static constexpr auto file_mode = std::ios::in | std::ios::out | std::ios::binary;
+
+record_file::record_file(std::filesystem::path path)
+    : path_(std::move(path))
+{}
+
+bool record_file::open(record_handler const& handler) {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+
+    // Create the file if missing, without truncating an existing one.
+    std::ofstream(path_, std::ios::app | std::ios::binary).close();
+
+    std::error_code ec;
+    auto const end = std::filesystem::file_size(path_, ec);
+    if (ec) {
+        return false;
+    }
+
+    file_.open(path_, file_mode);
+    if ( ! file_.is_open()) {
+        return false;
+    }
+
+    offsets_.assign(1, 0);
+    byte_array<prefix_size> prefix;
+
+    while (offsets_.back() + prefix_size <= end) {
+        auto const offset = offsets_.back();
+        file_.seekg(offset);
+        if ( ! file_.read(reinterpret_cast<char*>(prefix.data()), prefix_size)) {
+            break;
+        }
+
+        auto const size = from_little_endian_unsafe<uint32_t>(prefix.begin());
+        auto const next = offset + prefix_size + size;
+        if (next > end) {
+            break;
+        }
+
+        if (handler) {
+            data_chunk data(size);
+            if ( ! file_.read(reinterpret_cast<char*>(data.data()), size)) {
+                break;
+            }
+
+            handler(offsets_.size() - 1, std::move(data));
+        }
+
+        offsets_.push_back(next);
+    }
+
+    file_.clear();
+
+    // Drop a partial last record.
+    return offsets_.back() == end || resize_unlocked();
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+void record_file::close() {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+    file_.close();
+    offsets_.clear();
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+size_t record_file::size() const {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    shared_lock lock(mutex_);
+    return offsets_.empty() ? 0 : offsets_.size() - 1;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+bool record_file::push(size_t height, data_slice data) {
+    auto const prefix = to_little_endian(static_cast<uint32_t>(data.size()));
+
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+
+    if ( ! file_.is_open() || height + 1 != offsets_.size()) {
+        return false;
+    }
+
+    file_.seekp(offsets_.back());
+    file_.write(reinterpret_cast<char const*>(prefix.data()), prefix_size);
+    file_.write(reinterpret_cast<char const*>(data.data()), data.size());
+    file_.flush();
+
+    if ( ! file_) {
+        file_.clear();
+        return false;
+    }
+
+    offsets_.push_back(offsets_.back() + prefix_size + data.size());
+    return true;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+bool record_file::truncate(size_t count) {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+    return truncate_unlocked(count);
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+bool record_file::get(size_t height, data_chunk& out) const {
+    // Reads seek the shared stream, so these are exclusive.
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+
+    if ( ! file_.is_open() || height + 1 >= offsets_.size()) {
+        return false;
+    }
+
+    auto const offset = offsets_[height] + prefix_size;
+    out.resize(offsets_[height + 1] - offset);
+    file_.seekg(offset);
+
+    if ( ! file_.read(reinterpret_cast<char*>(out.data()), out.size())) {
+        file_.clear();
+        return false;
+    }
+
+    return true;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+// private
+bool record_file::truncate_unlocked(size_t count) {
+    if ( ! file_.is_open()) {
+        return false;
+    }
+
+    if (count + 1 >= offsets_.size()) {
+        return true;
+    }
+
+    offsets_.resize(count + 1);
+    return resize_unlocked();
+}
+
+// private
+// Cut the file at the end of the last record. The stream is reopened as it
+// does not follow a resize of the file.
+bool record_file::resize_unlocked() {
+    file_.close();
+
+    std::error_code ec;
+    std::filesystem::resize_file(path_, offsets_.back(), ec);
+    file_.open(path_, file_mode);
+    return ! ec && file_.is_open();
+}
+
+} // namespace kth::blockchain
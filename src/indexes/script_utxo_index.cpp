@@ -0,0 +1,26 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <kth/blockchain/indexes/script_utxo_index.hpp>
+
+#include <cstddef>
+
+#include <kth/blockchain/pools/mempool_index.hpp>
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+using namespace kd::chain;
+
+script_utxo_index::script_utxo_index(size_t undo_depth)
+    : output_index(undo_depth)
+{}
+
+// protected
+bool script_utxo_index::key(output const& output, hash_digest& out) const {
+    out = mempool_index::script_hash(output.script());
+    return true;
+}
+
+} // namespace kth::blockchain
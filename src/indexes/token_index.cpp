@@ -0,0 +1,60 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <kth/blockchain/indexes/token_index.hpp>
+
+#include <cstddef>
+#include <variant>
+#include <vector>
+
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+using namespace kd::chain;
+
+namespace {
+
+// The NFT commitment of the token data, null if fungible only.
+data_chunk const* nft_commitment(token_data_t const& token) {
+    if (auto const nft = std::get_if<non_fungible>(&token.data)) {
+        return &nft->commitment;
+    }
+
+    if (auto const both = std::get_if<both_kinds>(&token.data)) {
+        return &both->second.commitment;
+    }
+
+    return nullptr;
+}
+
+} // namespace
+
+token_index::token_index(size_t undo_depth)
+    : output_index(undo_depth)
+{}
+
+token_index::list token_index::find(hash_digest const& category, data_chunk const& commitment) const {
+    auto outputs = find(category);
+
+    std::erase_if(outputs, [&commitment](entry const& value) {
+        auto const nft = nft_commitment(*value.output.token_data());
+        return nft == nullptr || *nft != commitment;
+    });
+
+    return outputs;
+}
+
+// protected
+bool token_index::key(output const& output, hash_digest& out) const {
+    auto const& token = output.token_data();
+    if ( ! token) {
+        return false;
+    }
+
+    out = token->id;
+    return true;
+}
+
+} // namespace kth::blockchain
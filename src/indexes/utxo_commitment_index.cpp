@@ -0,0 +1,278 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <kth/blockchain/indexes/utxo_commitment_index.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <utility>
+
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+using namespace kd::chain;
+
+namespace {
+
+constexpr uint8_t op_return = 0x6a;
+
+bool unspendable(output const& output) {
+    auto const script = output.script().to_data(false);
+    return ! script.empty() && script.front() == op_return;
+}
+
+data_chunk element(output_point const& point, output const& output) {
+    auto data = point.to_data();
+    extend_data(data, output.to_data());
+    return data;
+}
+
+} // namespace
+
+// At least the state of the top is kept, the set is built upon it.
+utxo_commitment_index::utxo_commitment_index(size_t window)
+    : window_(std::max(window, size_t(1)))
+    , size_(0)
+{}
+
+utxo_commitment_index::utxo_commitment_index(size_t window, std::filesystem::path const& file)
+    : window_(std::max(window, size_t(1)))
+    , file_(std::make_unique<record_file>(file))
+    , size_(0)
+{}
+
+// A state that cannot be read (a damaged file) drops it and those above.
+bool utxo_commitment_index::open() {
+    if ( ! file_) {
+        return true;
+    }
+
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+
+    if ( ! file_->open()) {
+        return false;
+    }
+
+    size_ = file_->size();
+    states_.clear();
+
+    for (auto height = size_ - std::min(size_, window_); height < size_; ++height) {
+        state value;
+        if ( ! read(height, value)) {
+            size_ = height;
+            return file_->truncate(height);
+        }
+
+        states_.push_back(std::move(value));
+    }
+
+    return true;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+void utxo_commitment_index::close() {
+    if (file_) {
+        file_->close();
+    }
+}
+
+size_t utxo_commitment_index::size() const {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    shared_lock lock(mutex_);
+    return size_;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+// The updates of the block are accumulated before locking, the set state is
+// then combined with them (spends within the block cancel out).
+bool utxo_commitment_index::push(block const& block, size_t height) {
+    muhash updates;
+
+    for (auto const& tx : block.transactions()) {
+        if ( ! tx.is_coinbase()) {
+            for (auto const& input : tx.inputs()) {
+                auto const& prevout = input.previous_output();
+                if ( ! prevout.validation.cache.is_valid()) {
+                    return false;
+                }
+
+                if ( ! unspendable(prevout.validation.cache)) {
+                    updates.remove(element(prevout, prevout.validation.cache));
+                }
+            }
+        }
+
+        auto const tx_hash = tx.hash();
+        auto const& outputs = tx.outputs();
+        for (uint32_t index = 0; index < outputs.size(); ++index) {
+            if ( ! unspendable(outputs[index])) {
+                updates.insert(element(output_point{ tx_hash, index }, outputs[index]));
+            }
+        }
+    }
+
+    auto const block_hash = block.hash();
+
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+
+    if (height != size_) {
+        return false;
+    }
+
+    if (height != 0 && states_.back().block_hash != block.header().previous_block_hash()) {
+        return false;
+    }
+
+    auto set = states_.empty() ? muhash{} : states_.back().set;
+    set.combine(updates);
+
+    if (file_) {
+        data_chunk record(block_hash.begin(), block_hash.end());
+        extend_data(record, set.to_data());
+        if ( ! file_->push(height, record)) {
+            return false;
+        }
+    }
+
+    states_.push_back({ block_hash, set });
+    ++size_;
+
+    if (states_.size() > window_) {
+        states_.pop_front();
+    }
+
+    return true;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+// Without a file, the states below the window are not kept.
+bool utxo_commitment_index::truncate(size_t count) {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+
+    if (count >= size_) {
+        return true;
+    }
+
+    if (file_ && ! file_->truncate(count)) {
+        size_ = 0;
+        states_.clear();
+        return false;
+    }
+
+    while (size_ > count && ! states_.empty()) {
+        states_.pop_back();
+        --size_;
+    }
+
+    size_ = count;
+
+    // The set at the new top must be kept unless it is the empty set.
+    if (count == 0 || ! states_.empty()) {
+        return true;
+    }
+
+    state top;
+    if (read(count - 1, top)) {
+        states_.push_back(std::move(top));
+        return true;
+    }
+
+    size_ = 0;
+    if (file_) {
+        file_->truncate(0);
+    }
+
+    return false;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+bool utxo_commitment_index::block_hash(size_t height, hash_digest& out) const {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    shared_lock lock(mutex_);
+
+    if (height >= size_) {
+        return false;
+    }
+
+    auto const first = size_ - states_.size();
+    if (height >= first) {
+        out = states_[height - first].block_hash;
+        return true;
+    }
+
+    state value;
+    if ( ! read(height, value)) {
+        return false;
+    }
+
+    out = value.block_hash;
+    return true;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+// The inversion is computed outside of the lock.
+bool utxo_commitment_index::digest(size_t height, hash_digest& out_block_hash, hash_digest& out_digest) const {
+    state value;
+
+    {
+        // Critical Section
+        ///////////////////////////////////////////////////////////////////////
+        shared_lock lock(mutex_);
+
+        if (height >= size_) {
+            return false;
+        }
+
+        auto const first = size_ - states_.size();
+        if (height >= first) {
+            value = states_[height - first];
+        } else if ( ! read(height, value)) {
+            return false;
+        }
+        ///////////////////////////////////////////////////////////////////////
+    }
+
+    out_block_hash = value.block_hash;
+    out_digest = value.set.digest();
+    return true;
+}
+
+void utxo_commitment_index::clear() {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+    size_ = 0;
+    states_.clear();
+
+    if (file_) {
+        file_->truncate(0);
+    }
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+// private
+// A record is the block hash followed by the set state.
+bool utxo_commitment_index::read(size_t height, state& out) const {
+    data_chunk record;
+    if ( ! file_ || ! file_->get(height, record) || record.size() != hash_size + muhash::serialized_size) {
+        return false;
+    }
+
+    std::copy_n(record.begin(), hash_size, out.block_hash.begin());
+    return out.set.from_data(data_slice{ record.data() + hash_size, record.data() + record.size() });
+}
+
+} // namespace kth::blockchain
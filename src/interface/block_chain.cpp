@@ -5,17 +5,22 @@
 #include <kth/blockchain/interface/block_chain.hpp>
 
 #include <algorithm>
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 #include <functional>
 #include <latch>
 
 #include <memory>
+#include <mutex>
 #include <numeric>
 #include <string>
+#include <tuple>
+#include <unordered_map>
 #include <unordered_set>
 #include <utility>
 
+#include <kth/blockchain/indexes/block_filter.hpp>
 #include <kth/blockchain/populate/populate_chain_state.hpp>
 #include <kth/blockchain/settings.hpp>
 #include <kth/database.hpp>
@@ -24,6 +29,7 @@
 
 #include <kth/infrastructure/math/sip_hash.hpp>
 #include <kth/infrastructure/utility/limits.hpp>
+#include <kth/infrastructure/utility/synchronizer.hpp>
 #include <kth/infrastructure/utility/timer.hpp>
 
 namespace kth {
@@ -76,24 +82,124 @@ using namespace std::placeholders;
 
 static auto const hour_seconds = 3600u;
 
+// Lookups per parallel bucket of a batched fetch, below this one thread.
+static constexpr size_t batch_bucket_minimum = 64;
+
+// Blocks indexed by the index sync before giving the thread back.
+static constexpr size_t index_sync_chunk = 100;
+
+// The record and index files, in the store directory.
+static constexpr auto block_records_file = "block_records";
+static constexpr auto block_filter_entries_file = "block_filter_entries";
+static constexpr auto block_filters_file = "block_filters";
+static constexpr auto utxo_commitment_file = "utxo_commitments";
+static constexpr auto token_index_file = "token_index";
+static constexpr auto script_utxo_index_file = "script_utxo_index";
+static constexpr auto history_index_directory = "history_index";
+
+// Call the reader with each key index, in key (store) order, then the handler.
+// Sorted keys are split into contiguous ranges spread over the dispatcher, so
+// each thread walks an ascending key range.
+template <typename Key, typename Reader>
+static void read_ordered(dispatcher& dispatch, std::vector<Key> const& keys, Reader const& reader, result_handler handler) {
+    auto const count = keys.size();
+
+    auto const order = std::make_shared<std::vector<size_t>>(count);
+    std::iota(order->begin(), order->end(), size_t(0));
+    std::sort(order->begin(), order->end(), [&keys](size_t left, size_t right) {
+        return keys[left] < keys[right];
+    });
+
+    auto const wanted = (count + batch_bucket_minimum - 1) / batch_bucket_minimum;
+    auto const buckets = std::max(size_t(1), std::min(dispatch.size(), wanted));
+    auto const span = (count + buckets - 1) / buckets;
+    auto const join_handler = synchronize(std::move(handler), buckets, NAME "_read");
+
+    // If the priority threadpool is shut down when this is called the handler
+    // will never be invoked, resulting in a threadpool.join indefinite hang.
+    for (size_t bucket = 0; bucket < buckets; ++bucket) {
+        auto const first = std::min(bucket * span, count);
+        auto const last = std::min(first + span, count);
+
+        dispatch.concurrent([order, reader, join_handler, first, last]() {
+            for (auto index = first; index < last; ++index) {
+                reader((*order)[index]);
+            }
+
+            join_handler(error::success);
+        });
+    }
+}
+
+// History entries are ordered by height, then by point and kind.
+static history_index::key history_key(domain::chain::history_compact const& entry) {
+    return { size_t(entry.height), entry.point.hash(), entry.point.index(), entry.kind };
+}
+
+static history_index::key history_key(safe_chain::history_cursor const& cursor) {
+    return { cursor.height, cursor.hash, cursor.index, cursor.kind };
+}
+
+// The cursor of the entry, or of the height above the last entry if none.
+static safe_chain::history_cursor next_cursor(safe_chain::history_cursor const& cursor, domain::chain::history_compact::list const& history, domain::chain::history_compact::list::const_iterator next) {
+    if (next != history.end()) {
+        return { next->height, next->point.hash(), next->point.index(), next->kind };
+    }
+
+    return history.empty() ? cursor : safe_chain::history_cursor{ size_t(history.back().height) + 1 };
+}
+
+// Take up to wanted from the shared budget, returning the amount granted.
+static size_t claim_budget(std::atomic<size_t>& budget, size_t wanted) {
+    auto current = budget.load();
+    size_t granted;
+
+    do {
+        granted = std::min(current, wanted);
+    } while ( ! budget.compare_exchange_weak(current, current - granted));
+
+    return granted;
+}
+
 block_chain::block_chain(threadpool& pool, blockchain::settings const& chain_settings
                        , database::settings const& database_settings, domain::config::network network, bool relay_transactions /* = true*/)
     : stopped_(true)
     , settings_(chain_settings)
+    , index_directory_(database_settings.directory)
     , notify_limit_seconds_(chain_settings.notify_limit_hours * hour_seconds)
     , chain_state_populator_(*this, chain_settings, network)
     , database_(database_settings)
+    , block_metadata_(chain_settings.block_metadata_cache_size)
+    , block_records_(index_directory_ / block_records_file)
+    , transaction_metadata_(chain_settings.transaction_metadata_cache_size)
+
+#if defined(KTH_DB_READONLY)
+    // The store is written by another process, so there is no invalidation.
+    , history_cache_(0)
+#else
+    , history_cache_(chain_settings.history_cache_size)
+#endif
+
+    , block_filters_(chain_settings.block_filter_cache_size, index_directory_ / block_filter_entries_file, index_directory_ / block_filters_file)
+    , token_index_(chain_settings.reorganization_limit)
+    , script_utxo_index_(chain_settings.reorganization_limit)
+    , utxo_commitments_(chain_settings.utxo_commitment_cache_size, index_directory_ / utxo_commitment_file)
+    , history_index_(chain_settings.reorganization_limit, index_directory_ / history_index_directory)
+    , indexes_syncing_(false)
+    , indexes_open_(false)
     , validation_mutex_(relay_transactions)
     , priority_pool_("blockchain", thread_ceiling(chain_settings.cores), priority(chain_settings.priority))
     , dispatch_(priority_pool_, NAME "_priority")
+    , index_dispatch_(pool, NAME "_index")
+    , notify_dispatch_(pool, NAME "_notify")
 
 #if defined(KTH_WITH_MEMPOOL)
     , mempool_(chain_settings.mempool_max_template_size, chain_settings.mempool_size_multiplier)
-    , transaction_organizer_(validation_mutex_, dispatch_, pool, *this, chain_settings, mempool_)
-    , block_organizer_(validation_mutex_, dispatch_, pool, *this, chain_settings, network, relay_transactions, mempool_)
+    , transaction_organizer_(validation_mutex_, dispatch_, pool, *this, chain_settings, transaction_metadata_, mempool_)
+    , block_organizer_(validation_mutex_, dispatch_, pool, *this, chain_settings, network, relay_transactions, block_metadata_, transaction_metadata_, mempool_)
 #else
-    , transaction_organizer_(validation_mutex_, dispatch_, pool, *this, chain_settings)
-    , block_organizer_(validation_mutex_, dispatch_, pool, *this, chain_settings, network, relay_transactions)
+    , transaction_organizer_(validation_mutex_, dispatch_, pool, *this, chain_settings, transaction_metadata_)
+    , block_organizer_(validation_mutex_, dispatch_, pool, *this, chain_settings, network, relay_transactions, block_metadata_, transaction_metadata_)
 #endif
 {}
 
@@ -270,7 +376,19 @@ void block_chain::push(transaction_const_ptr tx, dispatcher&, result_handler han
     //last_transaction_.store(tx);
 
     // Transaction push is currently sequential so dispatch is not used.
-    handler(database_.push(*tx, chain_state()->enabled_forks()));
+    auto const ec = database_.push(*tx, chain_state()->enabled_forks());
+
+    if ( ! ec) {
+        mempool_index_.add(*tx);
+
+        // Subscribers are notified in order on the network pool, not within
+        // the push (under the validation lock).
+        notify_dispatch_.ordered([this, tx]() {
+            script_hash_registry_.notify_transaction(*tx);
+        });
+    }
+
+    handler(ec);
 }
 
 #endif // ! defined(KTH_DB_READONLY)
@@ -304,17 +422,19 @@ void block_chain::reorganize(const infrastructure::config::checkpoint& fork_poin
         return;
     }
 
-    // The top (back) block is used to update the chain state.
-    auto const complete = std::bind(&block_chain::handle_reorganize, this, _1, incoming_blocks->back(), handler);
+    auto const complete = std::bind(&block_chain::handle_reorganize, this, _1, incoming_blocks, outgoing_blocks, handler);
     database_.reorganize(fork_point, incoming_blocks, outgoing_blocks, dispatch, complete);
 }
 
-void block_chain::handle_reorganize(code const& ec, block_const_ptr top, result_handler handler) {
+void block_chain::handle_reorganize(code const& ec, block_const_ptr_list_const_ptr incoming_blocks, block_const_ptr_list_const_ptr outgoing_blocks, result_handler handler) {
     if (ec) {
         handler(ec);
         return;
     }
 
+    // The top (back) block is used to update the chain state.
+    auto const top = incoming_blocks->back();
+
     if ( ! top->validation.state) {
         handler(error::operation_failed_14);
         return;
@@ -323,254 +443,1445 @@ void block_chain::handle_reorganize(code const& ec, block_const_ptr top, result_
     set_chain_state(top->validation.state);
     last_block_.store(top);
 
-    handler(error::success);
-}
-
-#endif // ! defined(KTH_DB_READONLY)
-
-// Properties.
-// ----------------------------------------------------------------------------
-
-// For tx validator, call only from inside validate critical section.
-domain::chain::chain_state::ptr block_chain::chain_state() const {
-    // Critical Section
-    ///////////////////////////////////////////////////////////////////////////
-    shared_lock lock(pool_state_mutex_);
+    update_mempool_index(incoming_blocks, outgoing_blocks);
+    update_block_metadata(top->validation.state->height(), incoming_blocks, outgoing_blocks);
+    forget_transaction_metadata(incoming_blocks);
+    invalidate_history(incoming_blocks, outgoing_blocks);
+    transaction_organizer_.reset_rejected();
+    transaction_organizer_.remove_ds_proofs(incoming_blocks);
+    transaction_organizer_.resolve_orphans(incoming_blocks);
+
+    // As for a pushed transaction, not within the reorganization.
+    notify_dispatch_.ordered([this, height = top->validation.state->height(), incoming_blocks, outgoing_blocks]() {
+        script_hash_registry_.notify_reorganize(height, incoming_blocks, outgoing_blocks);
+    });
 
-    // Initialized on start and updated after each successful organization.
-    return pool_state_;
-    ///////////////////////////////////////////////////////////////////////////
-}
+    update_indexes(top->validation.state->height(), incoming_blocks, outgoing_blocks);
 
-// For block validator, call only from inside validate critical section.
-domain::chain::chain_state::ptr block_chain::chain_state(branch::const_ptr branch) const {
-    // Promote from cache if branch is same height as pool (most typical).
-    // Generate from branch/store if the promotion is not successful.
-    // If the organize is successful pool state will be updated accordingly.
-    return chain_state_populator_.populate(chain_state(), branch);
+    handler(error::success);
 }
 
-// private.
-code block_chain::set_chain_state(domain::chain::chain_state::ptr previous) {
-    // Critical Section
-    ///////////////////////////////////////////////////////////////////////////
-    unique_lock lock(pool_state_mutex_);
+// private
+void block_chain::update_mempool_index(block_const_ptr_list_const_ptr incoming_blocks, block_const_ptr_list_const_ptr outgoing_blocks) {
+    // Transactions of outgoing blocks are indexed again only if the store
+    // returned them to the unconfirmed set. Their prevouts are read again (on
+    // a copy, the blocks are shared), as a block read from the store has none.
+    for (auto const& block : *outgoing_blocks) {
+        auto const& txs = block->transactions();
+        for (auto tx = txs.begin() + 1; tx != txs.end(); ++tx) {
+            if (database_.internal_db().get_transaction_unconfirmed(tx->hash()).is_valid()) {
+                auto unconfirmed = *tx;
+                populate_unconfirmed_prevouts(unconfirmed);
+                mempool_index_.add(unconfirmed);
+            }
+        }
+    }
 
-    pool_state_ = chain_state_populator_.populate(previous);
-    return pool_state_ ? error::success : error::operation_failed_15;
-    ///////////////////////////////////////////////////////////////////////////
+    for (auto const& block : *incoming_blocks) {
+        mempool_index_.remove(*block);
+    }
 }
 
-// ============================================================================
-// SAFE CHAIN
-// ============================================================================
+// private
+// Incoming blocks are contiguous, ending at the top height. Records written
+// by validation are confirmed, others (such as checkpointed blocks) are
+// written here without the validation totals. Records are also kept in the
+// records file, whose records above the fork point are dropped.
+void block_chain::update_block_metadata(size_t top_height, block_const_ptr_list_const_ptr incoming_blocks, block_const_ptr_list_const_ptr outgoing_blocks) {
+    for (auto const& block : *outgoing_blocks) {
+        block_metadata_.remove(block->hash());
+    }
 
-// Startup and shutdown.
-// ----------------------------------------------------------------------------
+    auto height = top_height - incoming_blocks->size() + 1;
+    block_records_.truncate(height);
 
-bool block_chain::start() {
-    stopped_ = false;
+    for (auto const& block : *incoming_blocks) {
+        auto metadata = block_metadata_.confirm(block->hash()) ? block_metadata_.get(block->hash()) : nullptr;
+        if ( ! metadata) {
+            metadata = std::make_shared<block_metadata const>(*block, height);
+            block_metadata_.add(metadata);
+        }
 
-    if ( ! database_.open()) {
-        LOG_ERROR(LOG_BLOCKCHAIN, "Failed to open database.");
-        return false;
+        write_block_record(height, *metadata);
+        ++height;
     }
+}
 
-    //switch to fast mode if the database is stale
-    //set_database_flags();
+// private
+// Heights without a record (connected before the file existed) are held by
+// empty records, so that records are by height.
+void block_chain::write_block_record(size_t height, block_metadata const& metadata) {
+    while (block_records_.size() < height) {
+        if ( ! block_records_.push(block_records_.size(), data_chunk{})) {
+            return;
+        }
+    }
 
-    // Initialize chain state after database start but before organizers.
-    pool_state_ = chain_state_populator_.populate();
-    if ( ! pool_state_) {
-        LOG_ERROR(LOG_BLOCKCHAIN, "Failed to initialize chain state.");
-        return false;
+    if ( ! block_records_.push(height, metadata.to_data())) {
+        LOG_ERROR(LOG_BLOCKCHAIN, "Failed to write the record of block [", height, "].");
     }
+}
 
-    auto const tx_org_started = transaction_organizer_.start();
-    if ( ! tx_org_started) {
-        LOG_ERROR(LOG_BLOCKCHAIN, "Failed to start transaction organizer.");
-        return false;
+// private
+// Confirmed transactions are not measured again.
+void block_chain::forget_transaction_metadata(block_const_ptr_list_const_ptr incoming_blocks) {
+    if (transaction_metadata_.size() == 0) {
+        return;
     }
 
-    auto const blk_org_started = block_organizer_.start();
-    if ( ! blk_org_started) {
-        LOG_ERROR(LOG_BLOCKCHAIN, "Failed to start block organizer.");
-        return false;
+    for (auto const& block : *incoming_blocks) {
+        auto const& txs = block->transactions();
+        for (auto tx = txs.begin() + 1; tx != txs.end(); ++tx) {
+            transaction_metadata_.remove(relay_hash(*tx));
+        }
     }
-    return true;
 }
 
-bool block_chain::stop() {
-    stopped_ = true;
+// private
+// The addresses are extracted as the store does for its history rows, from
+// output scripts and input scripts (and prevout scripts where populated).
+// Blocks read from the store (outgoing) have no prevouts, the output spent
+// by an input without an address is read from the blocks or the store. If
+// it is not found the spender's address is unknown and all results dropped.
+void block_chain::invalidate_history(block_const_ptr_list_const_ptr incoming_blocks, block_const_ptr_list_const_ptr outgoing_blocks) {
+    if (history_cache_.size() == 0) {
+        history_cache_.invalidate({});
+        return;
+    }
 
-    // Critical Section
-    ///////////////////////////////////////////////////////////////////////////
-    validation_mutex_.lock_high_priority();
+    using domain::wallet::payment_address;
+    std::vector<short_hash> address_hashes;
+    std::unordered_map<hash_digest, domain::chain::transaction const*> block_txs;
 
-    // This cannot call organize or stop (lock safe).
-    auto result = transaction_organizer_.stop() && block_organizer_.stop();
+    auto const extract = [&address_hashes](domain::chain::script const& script) {
+        for (auto const& address : payment_address::extract(script, payment_address::mainnet_p2kh, payment_address::mainnet_p2sh)) {
+            address_hashes.push_back(address.hash());
+        }
+    };
 
-    // The priority pool must not be stopped while organizing.
-    priority_pool_.shutdown();
+    auto const read_spent = [&](domain::chain::output_point const& prevout, domain::chain::output& out) {
+        if (block_txs.empty()) {
+            for (auto const blocks : { incoming_blocks, outgoing_blocks }) {
+                for (auto const& block : *blocks) {
+                    for (auto const& tx : block->transactions()) {
+                        block_txs.emplace(tx.hash(), &tx);
+                    }
+                }
+            }
+        }
 
-    validation_mutex_.unlock_high_priority();
-    ///////////////////////////////////////////////////////////////////////////
-    return result;
-}
+        auto const tx = block_txs.find(prevout.hash());
+        if (tx != block_txs.end()) {
+            auto const& outputs = tx->second->outputs();
+            if (prevout.index() >= outputs.size()) {
+                return false;
+            }
 
-// Close is idempotent and thread safe.
-// Optional as the blockchain will close on destruct.
-bool block_chain::close() {
-    auto const result = stop();
-    priority_pool_.join();
-    return result && database_.close();
-}
+            out = outputs[prevout.index()];
+            return true;
+        }
 
-block_chain::~block_chain() {
-    close();
-}
+        auto const result = database_.internal_db().get_transaction(prevout.hash(), max_size_t);
+        if ( ! result.is_valid() || prevout.index() >= result.transaction().outputs().size()) {
+            return false;
+        }
 
-// Queries.
-// ----------------------------------------------------------------------------
-// Blocks are and transactions returned const because they don't change and
-// this eliminates the need to copy the cached items.
+        out = result.transaction().outputs()[prevout.index()];
+        return true;
+    };
 
-void block_chain::fetch_block(size_t height,
-    block_fetch_handler handler) const {
-    if (stopped()) {
-        handler(error::service_stopped, nullptr, 0);
-        return;
-    }
+    auto unknown = false;
+    auto const collect = [&](block_const_ptr_list_const_ptr blocks) {
+        for (auto const& block : *blocks) {
+            for (auto const& tx : block->transactions()) {
+                for (auto const& input : tx.inputs()) {
+                    auto const extracted = address_hashes.size();
+                    extract(input.script());
+
+                    auto const& prevout = input.previous_output();
+                    if (prevout.validation.cache.is_valid()) {
+                        extract(prevout.validation.cache.script());
+                        continue;
+                    }
 
-    auto const cached = last_block_.load();
+                    if (tx.is_coinbase() || address_hashes.size() != extracted) {
+                        continue;
+                    }
 
-    // Try the cached block first.
-    if (cached && cached->validation.state &&
-        cached->validation.state->height() == height) {
-        handler(error::success, cached, height);
-        return;
-    }
+                    domain::chain::output spent;
+                    if (read_spent(prevout, spent)) {
+                        extract(spent.script());
+                    } else {
+                        unknown = true;
+                    }
+                }
 
-    auto const block_result = database_.internal_db().get_block(height);
+                for (auto const& output : tx.outputs()) {
+                    extract(output.script());
+                }
+            }
+        }
+    };
 
-    if ( ! block_result.is_valid()) {
-        handler(error::not_found, nullptr, 0);
+    collect(incoming_blocks);
+    collect(outgoing_blocks);
+
+    if (unknown) {
+        history_cache_.clear();
         return;
     }
 
-    auto const result = std::make_shared<const block>(block_result);
-
-    handler(error::success, result, height);
+    history_cache_.invalidate(address_hashes);
 }
 
-void block_chain::fetch_block(hash_digest const& hash,
-    block_fetch_handler handler) const {
-    if (stopped()) {
-        handler(error::service_stopped, nullptr, 0);
+// private
+// The optional indexes are kept by reorganize where the blocks allow it, the
+// remaining heights are left to the store sync.
+void block_chain::update_indexes(size_t top_height, block_const_ptr_list_const_ptr incoming_blocks, block_const_ptr_list_const_ptr outgoing_blocks) {
+    if ( ! indexing()) {
         return;
     }
 
-    auto const cached = last_block_.load();
+    {
+        // Critical Section
+        ///////////////////////////////////////////////////////////////////////
+        std::lock_guard lock(indexes_mutex_);
 
-    // Try the cached block first.
-    if (cached && cached->validation.state && cached->hash() == hash) {
-        handler(error::success, cached, cached->validation.state->height());
-        return;
-    }
+        if (settings_.block_filter_index) {
+            update_block_filters(top_height, incoming_blocks);
+        }
 
-    auto const block_result = database_.internal_db().get_block(hash);
+        if (settings_.token_index) {
+            update_output_index(token_index_, top_height, incoming_blocks, outgoing_blocks);
+        }
 
-    if ( ! block_result.first.is_valid()) {
-        handler(error::not_found, nullptr, 0);
-        return;
-    }
+        if (settings_.script_utxo_index) {
+            update_output_index(script_utxo_index_, top_height, incoming_blocks, outgoing_blocks);
+        }
 
-    auto const height = block_result.second;
+        if (settings_.utxo_commitment_index) {
+            update_utxo_commitments(top_height, incoming_blocks);
+        }
 
-    auto const result = std::make_shared<const block>(block_result.first);
+        if (settings_.history_index) {
+            update_history_index(top_height, incoming_blocks);
+        }
+        ///////////////////////////////////////////////////////////////////////
+    }
 
-    handler(error::success, result, height);
+    start_index_sync();
 }
 
-void block_chain::fetch_block_header_txs_size(hash_digest const& hash,
-    block_header_txs_size_fetch_handler handler) const {
-    if (stopped()) {
-        handler(error::service_stopped, nullptr, 0, std::make_shared<hash_list>(hash_list()),0);
-        return;
-    }
+// private
+// Incoming blocks are contiguous, ending at the top height. Filters above the
+// fork point are dropped and those of the incoming blocks built from their
+// populated prevouts. Blocks without prevouts (not validated) or above a gap
+// are left to the store sync.
+void block_chain::update_block_filters(size_t top_height, block_const_ptr_list_const_ptr incoming_blocks) {
+    auto const fork_height = top_height - incoming_blocks->size();
+    block_filters_.truncate(fork_height + 1);
 
-    auto const block_result = database_.internal_db().get_block(hash);
+    auto height = fork_height + 1;
+    for (auto const& block : *incoming_blocks) {
+        data_chunk filter;
+        if (block_filters_.size() != height || ! basic_filter(*block, filter)) {
+            break;
+        }
 
-    if ( ! block_result.first.is_valid()) {
-        handler(error::not_found, nullptr, 0, std::make_shared<hash_list>(hash_list()),0);
-        return;
+        block_filters_.push(block->hash(), block->header().previous_block_hash(), height, std::move(filter));
+        ++height;
     }
-
-    auto const height = block_result.second;
-    auto const result = std::make_shared<const header>(block_result.first.header());
-    auto const tx_hashes = std::make_shared<hash_list>(block_result.first.to_hashes());
-    //TODO(fernando): encapsulate header and tx_list
-    handler(error::success, result, height, tx_hashes, block_result.first.serialized_size());
 }
 
+// private
+// The set states above the fork point are dropped (undoing the outgoing
+// blocks) and the incoming blocks applied from their populated prevouts. A
+// fork below the kept states rebuilds the set from genesis by the sync.
+void block_chain::update_utxo_commitments(size_t top_height, block_const_ptr_list_const_ptr incoming_blocks) {
+    auto const fork_height = top_height - incoming_blocks->size();
 
-// void block_chain::fetch_merkle_block(size_t height, transaction_hashes_fetch_handler handler) const
-void block_chain::fetch_merkle_block(size_t height, merkle_block_fetch_handler handler) const {
-    if (stopped()) {
-        handler(error::service_stopped, nullptr, 0);
+    if ( ! utxo_commitments_.truncate(fork_height + 1)) {
+        LOG_INFO(LOG_BLOCKCHAIN, "UTXO commitment reorganized below its kept states, rebuilding.");
         return;
     }
 
-    auto const block_result = database_.internal_db().get_block(height);
+    auto height = fork_height + 1;
+    for (auto const& block : *incoming_blocks) {
+        if ( ! utxo_commitments_.push(*block, height)) {
+            break;
+        }
 
-    if ( ! block_result.is_valid()) {
-        handler(error::not_found, nullptr, 0);
-        return;
+        ++height;
     }
-
-    auto const merkle = std::make_shared<merkle_block>(block_result.header(),
-        block_result.transactions().size(), block_result.to_hashes(), data_chunk{});
-    handler(error::success, merkle, height);
 }
 
-void block_chain::fetch_merkle_block(hash_digest const& hash,
-    merkle_block_fetch_handler handler) const {
-    if (stopped()) {
-        handler(error::service_stopped, nullptr, 0);
+// private
+// The blocks above the fork point are dropped and the incoming blocks pushed
+// from their populated prevouts. A fork past the blocks kept in memory
+// rebuilds the index from genesis by the sync.
+void block_chain::update_history_index(size_t top_height, block_const_ptr_list_const_ptr incoming_blocks) {
+    auto const fork_height = top_height - incoming_blocks->size();
+
+    if ( ! history_index_.truncate(fork_height + 1)) {
+        LOG_INFO(LOG_BLOCKCHAIN, "History index reorganized below its kept blocks, rebuilding.");
         return;
     }
 
-    auto const block_result = database_.internal_db().get_block(hash);
+    auto height = fork_height + 1;
+    for (auto const& block : *incoming_blocks) {
+        if ( ! history_index_.push(*block, height)) {
+            break;
+        }
 
-    if ( ! block_result.first.is_valid()) {
-        handler(error::not_found, nullptr, 0);
-        return;
+        ++height;
     }
-
-    auto const merkle = std::make_shared<merkle_block>(block_result.first.header(),
-        block_result.first.transactions().size(), block_result.first.to_hashes(), data_chunk{});
-    handler(error::success, merkle, block_result.second);
 }
 
-void block_chain::fetch_compact_block(size_t height, compact_block_fetch_handler handler) const {
-    // TODO (Mario): implement compact blocks.
-    handler(error::not_implemented, {}, 0);
-}
+// private
+// Outgoing blocks are contiguous from the fork point, they are disconnected
+// from the top down (those above the index top were not connected). If the
+// spends of a block are no longer kept the index is rebuilt by the sync.
+void block_chain::update_output_index(output_index& index, size_t top_height, block_const_ptr_list_const_ptr incoming_blocks, block_const_ptr_list_const_ptr outgoing_blocks) {
+    auto const fork_height = top_height - incoming_blocks->size();
 
-void block_chain::fetch_compact_block(hash_digest const& hash, compact_block_fetch_handler handler) const {
-    if (stopped()) {
-        handler(error::service_stopped, {},0);
-        return;
+    auto height = fork_height + outgoing_blocks->size();
+    for (auto block = outgoing_blocks->rbegin(); block != outgoing_blocks->rend(); ++block, --height) {
+        if (height + 1 == index.size() && ! index.disconnect(**block)) {
+            LOG_INFO(LOG_BLOCKCHAIN, "Index reorganized below its undo depth, rebuilding.");
+            index.clear();
+            return;
+        }
     }
 
-    fetch_block(hash,[&handler](code const& ec, block_const_ptr message, size_t height) {
-        if (ec == error::success) {
-            auto blk_ptr = std::make_shared<compact_block>(compact_block::factory_from_block(*message));
-            handler(error::success, blk_ptr, height);
-        } else {
-            handler(ec, nullptr, height);
+    height = fork_height + 1;
+    for (auto const& block : *incoming_blocks) {
+        if ( ! index.connect(*block, height)) {
+            break;
         }
-    });
+
+        ++height;
+    }
+}
+
+#endif // ! defined(KTH_DB_READONLY)
+
+// private
+bool block_chain::indexing() const {
+    return settings_.block_filter_index || settings_.token_index || settings_.script_utxo_index ||
+        settings_.utxo_commitment_index || settings_.history_index;
+}
+
+// private
+// Blocks indexed above the store top or no longer in the chain (reorganized
+// by a store rebuilt meanwhile) are dropped, the sync resumes from there.
+bool block_chain::open_indexes() {
+    if (settings_.block_filter_index) {
+        if ( ! block_filters_.open()) {
+            return false;
+        }
+
+        auto const count = chained_count(block_filters_.size(), [this](size_t height, hash_digest& out) {
+            block_filter_index::entry entry;
+            if ( ! block_filters_.get(height, entry)) {
+                return false;
+            }
+
+            out = entry.block_hash;
+            return true;
+        });
+
+        block_filters_.truncate(count);
+    }
+
+    if (settings_.utxo_commitment_index) {
+        if ( ! utxo_commitments_.open()) {
+            return false;
+        }
+
+        auto const count = chained_count(utxo_commitments_.size(), [this](size_t height, hash_digest& out) {
+            return utxo_commitments_.block_hash(height, out);
+        });
+
+        utxo_commitments_.truncate(count);
+    }
+
+    if (settings_.history_index) {
+        if ( ! history_index_.open()) {
+            return false;
+        }
+
+        auto const count = chained_count(history_index_.size(), [this](size_t height, hash_digest& out) {
+            return history_index_.block_hash(height, out);
+        });
+
+        history_index_.truncate(count);
+    }
+
+    if (settings_.token_index && ! open_output_index(token_index_, token_index_file)) {
+        return false;
+    }
+
+    if (settings_.script_utxo_index && ! open_output_index(script_utxo_index_, script_utxo_index_file)) {
+        return false;
+    }
+
+    indexes_open_ = true;
+    return true;
+}
+
+// private
+// Records of blocks no longer in the chain are dropped. Empty records are of
+// blocks without a record, these are taken as in the chain.
+bool block_chain::open_block_records() {
+    if ( ! block_records_.open()) {
+        return false;
+    }
+
+    auto const count = chained_count(block_records_.size(), [this](size_t height, hash_digest& out) {
+        data_chunk record;
+        if ( ! block_records_.get(height, record)) {
+            return false;
+        }
+
+        if (record.size() < hash_size) {
+            return record.empty() && get_block_hash(out, height);
+        }
+
+        std::copy_n(record.begin(), hash_size, out.begin());
+        return true;
+    });
+
+    return block_records_.truncate(count);
+}
+
+// private
+// A missing or damaged file, or an index whose top is no longer in the chain,
+// leaves the index to be built again by the sync.
+bool block_chain::open_output_index(output_index& index, char const* name) {
+    if ( ! index.load(index_directory_ / name)) {
+        LOG_INFO(LOG_BLOCKCHAIN, "Index file [", name, "] not loaded, building the index.");
+        return true;
+    }
+
+    auto const size = index.size();
+    hash_digest stored;
+    if (size != 0 && ( ! get_block_hash(stored, size - 1) || stored != index.top_hash())) {
+        LOG_INFO(LOG_BLOCKCHAIN, "Index file [", name, "] is not of the chain, building the index.");
+        index.clear();
+    }
+
+    return true;
+}
+
+// private
+// The output indexes are kept in memory, these are saved on close only.
+void block_chain::close_indexes() {
+    if ( ! indexes_open_.exchange(false)) {
+        return;
+    }
+
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    std::lock_guard lock(indexes_mutex_);
+
+    block_filters_.close();
+    utxo_commitments_.close();
+    history_index_.close();
+
+    if (settings_.token_index && ! token_index_.save(index_directory_ / token_index_file)) {
+        LOG_ERROR(LOG_BLOCKCHAIN, "Failed to save the index file [", token_index_file, "].");
+    }
+
+    if (settings_.script_utxo_index && ! script_utxo_index_.save(index_directory_ / script_utxo_index_file)) {
+        LOG_ERROR(LOG_BLOCKCHAIN, "Failed to save the index file [", script_utxo_index_file, "].");
+    }
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+// private
+// The number of the first count indexed blocks that are in the chain, which
+// is found from the top down.
+size_t block_chain::chained_count(size_t count, indexed_hash_reader const& indexed_hash) const {
+    size_t top;
+    if ( ! get_last_height(top)) {
+        return 0;
+    }
+
+    count = std::min(count, top + 1);
+
+    hash_digest indexed;
+    hash_digest stored;
+    while (count != 0 && ( ! indexed_hash(count - 1, indexed) || ! get_block_hash(stored, count - 1) || indexed != stored)) {
+        --count;
+    }
+
+    return count;
+}
+
+// private
+// The sync reads the store block by block, it runs on the network pool so
+// that the validation (priority) pool is not held by it.
+void block_chain::start_index_sync() {
+    if ( ! indexes_syncing_.exchange(true)) {
+        index_dispatch_.concurrent([this]() {
+            sync_indexes();
+        });
+    }
+}
+
+// private
+// The indexes are built from the store up to its top, a chunk of blocks per
+// call. The block (and its spent outputs) at the lowest indexed height is
+// read without the lock, which reorganize takes to update the indexes, and
+// applied under it to the indexes still at that height. A block reorganized
+// meanwhile is not applied, the height is read again. The sync does not
+// outlive the close of the indexes, checked under the lock. The history index
+// writes its runs here, without the lock.
+void block_chain::sync_indexes() {
+    if (settings_.history_index && ! history_index_.flush()) {
+        LOG_ERROR(LOG_BLOCKCHAIN, "Failed to write the history index files.");
+    }
+
+    for (size_t count = 0; count < index_sync_chunk; ++count) {
+        size_t height;
+        bool filters;
+        bool spends;
+
+        {
+            // Critical Section
+            ///////////////////////////////////////////////////////////////////
+            std::lock_guard lock(indexes_mutex_);
+
+            size_t top;
+            if (stopped() || ! indexes_open_ || ! get_last_height(top)) {
+                indexes_syncing_ = false;
+                return;
+            }
+
+            height = index_sync_height(top);
+            if (height == max_size_t) {
+                indexes_syncing_ = false;
+                return;
+            }
+
+            filters = settings_.block_filter_index && block_filters_.size() == height;
+            spends = filters || (settings_.utxo_commitment_index && utxo_commitments_.size() == height) ||
+                (settings_.history_index && history_index_.size() == height);
+            ///////////////////////////////////////////////////////////////////
+        }
+
+        data_chunk filter;
+        auto const block = database_.internal_db().get_block(height);
+        if ( ! block.is_valid() || (spends && ! populate_spent_outputs(block)) || (filters && ! basic_filter(block, filter))) {
+            LOG_ERROR(LOG_BLOCKCHAIN, "Failed to read block [", height, "] to index.");
+            indexes_syncing_ = false;
+            return;
+        }
+
+        // Critical Section
+        ///////////////////////////////////////////////////////////////////////
+        std::lock_guard lock(indexes_mutex_);
+
+        if (stopped() || ! indexes_open_ || ! sync_index_block(block, height, std::move(filter))) {
+            indexes_syncing_ = false;
+            return;
+        }
+        ///////////////////////////////////////////////////////////////////////
+    }
+
+    index_dispatch_.concurrent([this]() {
+        sync_indexes();
+    });
+}
+
+// private
+// The lowest height not yet indexed, max_size_t if the indexes are at the
+// store top.
+size_t block_chain::index_sync_height(size_t top) {
+    auto height = max_size_t;
+
+    if (settings_.block_filter_index) {
+        height = std::min(height, block_filters_.size());
+    }
+
+    if (settings_.utxo_commitment_index) {
+        height = std::min(height, utxo_commitments_.size());
+    }
+
+    // The index is complete from here, reorganize keeps it at the top.
+    if (settings_.history_index) {
+        if (history_index_.size() > top) {
+            history_index_.set_synced();
+        }
+
+        height = std::min(height, history_index_.size());
+    }
+
+    if (settings_.token_index) {
+        height = std::min(height, output_index_sync_height(token_index_, settings_.token_index_start_height, top));
+    }
+
+    if (settings_.script_utxo_index) {
+        height = std::min(height, output_index_sync_height(script_utxo_index_, 0, top));
+    }
+
+    return height > top ? max_size_t : height;
+}
+
+// private
+// The height of the next block to connect, max_size_t if there is none.
+// Blocks below the start height are not read.
+size_t block_chain::output_index_sync_height(output_index& index, size_t start_height, size_t top) {
+    auto height = index.size();
+
+    if (height < start_height) {
+        height = start_height;
+        auto previous = null_hash;
+        if (height > top) {
+            index.set_synced();
+            return max_size_t;
+        }
+
+        if (height != 0 && ! get_block_hash(previous, height - 1)) {
+            return max_size_t;
+        }
+
+        index.reset(height, previous);
+    }
+
+    // The index is complete from here, reorganize keeps it at the top.
+    if (height > top) {
+        index.set_synced();
+        return max_size_t;
+    }
+
+    return height;
+}
+
+// private
+// Extend the indexes at the height by the block, false if one fails. A block
+// no longer in the store (reorganized since read) is skipped.
+bool block_chain::sync_index_block(domain::chain::block const& block, size_t height, data_chunk filter) {
+    hash_digest stored;
+    if ( ! get_block_hash(stored, height) || stored != block.hash()) {
+        return true;
+    }
+
+    if (settings_.block_filter_index && block_filters_.size() == height &&
+        ! block_filters_.push(block.hash(), block.header().previous_block_hash(), height, std::move(filter))) {
+        LOG_ERROR(LOG_BLOCKCHAIN, "Failed to index the filter of block [", height, "].");
+        return false;
+    }
+
+    if (settings_.utxo_commitment_index && utxo_commitments_.size() == height && ! utxo_commitments_.push(block, height)) {
+        LOG_ERROR(LOG_BLOCKCHAIN, "Failed to apply block [", height, "] to the UTXO commitment.");
+        return false;
+    }
+
+    if (settings_.history_index && history_index_.size() == height && ! history_index_.push(block, height)) {
+        LOG_ERROR(LOG_BLOCKCHAIN, "Failed to push block [", height, "] to the history index.");
+        return false;
+    }
+
+    if (settings_.token_index && token_index_.size() == height && ! token_index_.connect(block, height)) {
+        LOG_ERROR(LOG_BLOCKCHAIN, "Failed to connect block [", height, "] to the token index.");
+        return false;
+    }
+
+    if (settings_.script_utxo_index && script_utxo_index_.size() == height && ! script_utxo_index_.connect(block, height)) {
+        LOG_ERROR(LOG_BLOCKCHAIN, "Failed to connect block [", height, "] to the script index.");
+        return false;
+    }
+
+    return true;
+}
+
+// private
+// Stored blocks carry no prevouts, the spent outputs are read from the
+// transactions that created them.
+bool block_chain::populate_spent_outputs(domain::chain::block const& block) const {
+    for (auto const& tx : block.transactions()) {
+        if (tx.is_coinbase()) {
+            continue;
+        }
+
+        for (auto const& input : tx.inputs()) {
+            auto const& prevout = input.previous_output();
+            if (prevout.validation.cache.is_valid()) {
+                continue;
+            }
+
+            auto const result = database_.internal_db().get_transaction(prevout.hash(), max_size_t);
+            if ( ! result.is_valid() || prevout.index() >= result.transaction().outputs().size()) {
+                return false;
+            }
+
+            prevout.validation.cache = result.transaction().outputs()[prevout.index()];
+        }
+    }
+
+    return true;
+}
+
+// private
+// Filters not served by the index (a damaged filter file) are built again
+// from the store and checked against the indexed filter hash.
+bool block_chain::read_block_filter(size_t height, block_filter_index::entry const& entry, data_chunk& out) const {
+    if (block_filters_.filter(height, out)) {
+        return true;
+    }
+
+    auto const block = database_.internal_db().get_block(height);
+    if ( ! block.is_valid() || block.hash() != entry.block_hash) {
+        return false;
+    }
+
+    return populate_spent_outputs(block) && basic_filter(block, out) &&
+        bitcoin_hash(out) == entry.filter_hash;
+}
+
+// private
+// Prevouts are confirmed outputs or outputs of other unconfirmed txs.
+void block_chain::populate_unconfirmed_prevouts(transaction const& tx) const {
+    for (auto const& input : tx.inputs()) {
+        auto const& prevout = input.previous_output();
+
+        auto const entry = database_.internal_db().get_utxo(prevout);
+        if (entry.is_valid()) {
+            prevout.validation.cache = entry.output();
+            continue;
+        }
+
+        auto const parent = database_.internal_db().get_transaction_unconfirmed(prevout.hash());
+        if (parent.is_valid() && prevout.index() < parent.transaction().outputs().size()) {
+            prevout.validation.cache = parent.transaction().outputs()[prevout.index()];
+        }
+    }
+}
+
+// Properties.
+// ----------------------------------------------------------------------------
+
+// For tx validator, call only from inside validate critical section.
+domain::chain::chain_state::ptr block_chain::chain_state() const {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    shared_lock lock(pool_state_mutex_);
+
+    // Initialized on start and updated after each successful organization.
+    return pool_state_;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+// For block validator, call only from inside validate critical section.
+domain::chain::chain_state::ptr block_chain::chain_state(branch::const_ptr branch) const {
+    // Promote from cache if branch is same height as pool (most typical).
+    // Generate from branch/store if the promotion is not successful.
+    // If the organize is successful pool state will be updated accordingly.
+    return chain_state_populator_.populate(chain_state(), branch);
+}
+
+// private.
+code block_chain::set_chain_state(domain::chain::chain_state::ptr previous) {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(pool_state_mutex_);
+
+    pool_state_ = chain_state_populator_.populate(previous);
+    return pool_state_ ? error::success : error::operation_failed_15;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+// ============================================================================
+// SAFE CHAIN
+// ============================================================================
+
+// Startup and shutdown.
+// ----------------------------------------------------------------------------
+
+bool block_chain::start() {
+    stopped_ = false;
+
+    if ( ! database_.open()) {
+        LOG_ERROR(LOG_BLOCKCHAIN, "Failed to open database.");
+        return false;
+    }
+
+    //switch to fast mode if the database is stale
+    //set_database_flags();
+
+    // Initialize chain state after database start but before organizers.
+    pool_state_ = chain_state_populator_.populate();
+    if ( ! pool_state_) {
+        LOG_ERROR(LOG_BLOCKCHAIN, "Failed to initialize chain state.");
+        return false;
+    }
+
+    // Load the unconfirmed set once, kept in sync by push and reorganize.
+    // Stored txs carry no prevouts, these are read for the script index.
+    mempool_index_.clear();
+    for (auto const& tx_res : database_.internal_db().get_all_transaction_unconfirmed()) {
+        auto tx = tx_res.transaction();
+        populate_unconfirmed_prevouts(tx);
+        mempool_index_.add(tx);
+    }
+
+    script_hash_registry_.start();
+
+    if ( ! open_block_records()) {
+        LOG_ERROR(LOG_BLOCKCHAIN, "Failed to open the block records file.");
+        return false;
+    }
+
+    // The optional indexes are built from the store, then kept by reorganize.
+    if (indexing()) {
+        if ( ! open_indexes()) {
+            LOG_ERROR(LOG_BLOCKCHAIN, "Failed to open the index files.");
+            return false;
+        }
+
+        start_index_sync();
+    }
+
+    auto const tx_org_started = transaction_organizer_.start();
+    if ( ! tx_org_started) {
+        LOG_ERROR(LOG_BLOCKCHAIN, "Failed to start transaction organizer.");
+        return false;
+    }
+
+    auto const blk_org_started = block_organizer_.start();
+    if ( ! blk_org_started) {
+        LOG_ERROR(LOG_BLOCKCHAIN, "Failed to start block organizer.");
+        return false;
+    }
+    return true;
+}
+
+bool block_chain::stop() {
+    stopped_ = true;
+
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    validation_mutex_.lock_high_priority();
+
+    // This cannot call organize or stop (lock safe).
+    auto result = transaction_organizer_.stop() && block_organizer_.stop();
+    script_hash_registry_.stop();
+
+    // The priority pool must not be stopped while organizing.
+    priority_pool_.shutdown();
+
+    validation_mutex_.unlock_high_priority();
+    ///////////////////////////////////////////////////////////////////////////
+    return result;
+}
+
+// Close is idempotent and thread safe.
+// Optional as the blockchain will close on destruct.
+bool block_chain::close() {
+    auto const result = stop();
+    priority_pool_.join();
+    close_indexes();
+    block_records_.close();
+    return result && database_.close();
+}
+
+block_chain::~block_chain() {
+    close();
+}
+
+// Queries.
+// ----------------------------------------------------------------------------
+// Blocks are and transactions returned const because they don't change and
+// this eliminates the need to copy the cached items.
+
+void block_chain::fetch_block(size_t height,
+    block_fetch_handler handler) const {
+    if (stopped()) {
+        handler(error::service_stopped, nullptr, 0);
+        return;
+    }
+
+    auto const cached = last_block_.load();
+
+    // Try the cached block first.
+    if (cached && cached->validation.state &&
+        cached->validation.state->height() == height) {
+        handler(error::success, cached, height);
+        return;
+    }
+
+    auto const block_result = database_.internal_db().get_block(height);
+
+    if ( ! block_result.is_valid()) {
+        handler(error::not_found, nullptr, 0);
+        return;
+    }
+
+    auto const result = std::make_shared<const block>(block_result);
+
+    handler(error::success, result, height);
+}
+
+void block_chain::fetch_block(hash_digest const& hash,
+    block_fetch_handler handler) const {
+    if (stopped()) {
+        handler(error::service_stopped, nullptr, 0);
+        return;
+    }
+
+    auto const cached = last_block_.load();
+
+    // Try the cached block first.
+    if (cached && cached->validation.state && cached->hash() == hash) {
+        handler(error::success, cached, cached->validation.state->height());
+        return;
+    }
+
+    auto const block_result = database_.internal_db().get_block(hash);
+
+    if ( ! block_result.first.is_valid()) {
+        handler(error::not_found, nullptr, 0);
+        return;
+    }
+
+    auto const height = block_result.second;
+
+    auto const result = std::make_shared<const block>(block_result.first);
+
+    handler(error::success, result, height);
+}
+
+void block_chain::fetch_block_header_txs_size(hash_digest const& hash,
+    block_header_txs_size_fetch_handler handler) const {
+    if (stopped()) {
+        handler(error::service_stopped, nullptr, 0, std::make_shared<hash_list>(hash_list()),0);
+        return;
+    }
+
+    auto const metadata = get_block_metadata(hash);
+
+    if ( ! metadata) {
+        handler(error::not_found, nullptr, 0, std::make_shared<hash_list>(hash_list()),0);
+        return;
+    }
+
+    auto const result = std::make_shared<const header>(metadata->header());
+    auto const tx_hashes = std::make_shared<hash_list>(metadata->transaction_hashes());
+    //TODO(fernando): encapsulate header and tx_list
+    handler(error::success, result, metadata->height(), tx_hashes, metadata->serialized_size());
+}
+
+void block_chain::fetch_block_metadata(size_t height, block_metadata_fetch_handler handler) const {
+    if (stopped()) {
+        handler(error::service_stopped, nullptr);
+        return;
+    }
+
+    auto const metadata = get_block_metadata(height);
+    handler(metadata ? error::success : error::not_found, metadata);
+}
+
+void block_chain::fetch_block_metadata(hash_digest const& hash, block_metadata_fetch_handler handler) const {
+    if (stopped()) {
+        handler(error::service_stopped, nullptr);
+        return;
+    }
+
+    auto const metadata = get_block_metadata(hash);
+    handler(metadata ? error::success : error::not_found, metadata);
+}
+
+void block_chain::fetch_block_stats(size_t height, block_stats_fetch_handler handler) const {
+    if (stopped()) {
+        handler(error::service_stopped, {}, 0);
+        return;
+    }
+
+    auto const metadata = get_block_stats(height);
+
+    if ( ! metadata) {
+        handler(error::not_found, {}, 0);
+        return;
+    }
+
+    handler(error::success, *metadata->stats(), metadata->height());
+}
+
+void block_chain::fetch_block_stats(hash_digest const& hash, block_stats_fetch_handler handler) const {
+    if (stopped()) {
+        handler(error::service_stopped, {}, 0);
+        return;
+    }
+
+    auto const metadata = get_block_stats(hash);
+
+    if ( ! metadata) {
+        handler(error::not_found, {}, 0);
+        return;
+    }
+
+    handler(error::success, *metadata->stats(), metadata->height());
+}
+
+// Only the requested transactions are read, located by their hashes in the
+// block record, rather than the full block.
+void block_chain::fetch_block_transactions(hash_digest const& hash, std::vector<uint64_t> const& indexes, block_transactions_fetch_handler handler) const {
+    if (stopped()) {
+        handler(error::service_stopped, nullptr, 0);
+        return;
+    }
+
+    auto const txs = std::make_shared<transaction_const_ptr_list>();
+    txs->reserve(indexes.size());
+
+    // Try the cached block first.
+    auto const cached = last_block_.load();
+    if (cached && cached->validation.state && cached->hash() == hash) {
+        auto const& block_txs = cached->transactions();
+        for (auto const index : indexes) {
+            if (index >= block_txs.size()) {
+                handler(error::not_found, nullptr, 0);
+                return;
+            }
+
+            txs->push_back(std::make_shared<const transaction>(block_txs[index]));
+        }
+
+        handler(error::success, txs, cached->validation.state->height());
+        return;
+    }
+
+    // Without a record the block is read once, the requested transactions
+    // are taken from it rather than read again by hash.
+    auto const metadata = find_block_metadata(hash);
+    if ( ! metadata) {
+        auto const block_result = database_.internal_db().get_block(hash);
+        if ( ! block_result.first.is_valid()) {
+            handler(error::not_found, nullptr, 0);
+            return;
+        }
+
+        auto const& block_txs = block_result.first.transactions();
+        for (auto const index : indexes) {
+            if (index >= block_txs.size()) {
+                handler(error::not_found, nullptr, 0);
+                return;
+            }
+
+            txs->push_back(std::make_shared<const transaction>(block_txs[index]));
+        }
+
+        block_metadata_.add(std::make_shared<block_metadata const>(block_result.first, block_result.second));
+        handler(error::success, txs, block_result.second);
+        return;
+    }
+
+    // The record gives the hashes at the indexes, only those are read.
+    auto const& tx_hashes = metadata->transaction_hashes();
+    for (auto const index : indexes) {
+        if (index >= tx_hashes.size()) {
+            handler(error::not_found, nullptr, 0);
+            return;
+        }
+
+        auto const result = database_.internal_db().get_transaction(tx_hashes[index], max_size_t);
+        if ( ! result.is_valid()) {
+            handler(error::not_found, nullptr, 0);
+            return;
+        }
+
+        txs->push_back(std::make_shared<const transaction>(result.transaction()));
+    }
+
+    handler(error::success, txs, metadata->height());
+}
+
+// private
+// Records are cached on read, a record must be of the block in the store.
+block_metadata::ptr block_chain::find_block_metadata(size_t height) const {
+    auto metadata = block_metadata_.get(height);
+    if (metadata) {
+        return metadata;
+    }
+
+    data_chunk record;
+    if ( ! block_records_.get(height, record) || record.empty()) {
+        return nullptr;
+    }
+
+    auto const header = database_.internal_db().get_header(height);
+    if ( ! header.is_valid()) {
+        return nullptr;
+    }
+
+    metadata = block_metadata::from_data(header, height, record);
+    if ( ! metadata || metadata->hash() != header.hash()) {
+        return nullptr;
+    }
+
+    block_metadata_.add(metadata);
+    return metadata;
+}
+
+// private
+block_metadata::ptr block_chain::find_block_metadata(hash_digest const& hash) const {
+    auto const metadata = block_metadata_.get(hash);
+    if (metadata) {
+        return metadata;
+    }
+
+    auto const result = database_.internal_db().get_header(hash);
+    return result.first.is_valid() ? find_block_metadata(result.second) : nullptr;
+}
+
+// private
+// Kept records are used first, a miss reads the block once to record it.
+block_metadata::ptr block_chain::get_block_metadata(size_t height) const {
+    auto metadata = find_block_metadata(height);
+    if (metadata) {
+        return metadata;
+    }
+
+    auto const block_result = database_.internal_db().get_block(height);
+    if ( ! block_result.is_valid()) {
+        return nullptr;
+    }
+
+    metadata = std::make_shared<block_metadata const>(block_result, height);
+    block_metadata_.add(metadata);
+    return metadata;
+}
+
+// private
+block_metadata::ptr block_chain::get_block_metadata(hash_digest const& hash) const {
+    auto metadata = find_block_metadata(hash);
+    if (metadata) {
+        return metadata;
+    }
+
+    auto const block_result = database_.internal_db().get_block(hash);
+    if ( ! block_result.first.is_valid()) {
+        return nullptr;
+    }
+
+    metadata = std::make_shared<block_metadata const>(block_result.first, block_result.second);
+    block_metadata_.add(metadata);
+    return metadata;
+}
+
+// private
+// Statistics recorded at connection are served from the records, others are
+// computed once from the stored block and the outputs it spends.
+block_metadata::ptr block_chain::get_block_stats(size_t height) const {
+    auto const metadata = find_block_metadata(height);
+    if (metadata && metadata->stats()) {
+        return metadata;
+    }
+
+    auto const block_result = database_.internal_db().get_block(height);
+    if ( ! block_result.is_valid()) {
+        return nullptr;
+    }
+
+    return compute_block_stats(block_result, height, metadata);
+}
+
+// private
+block_metadata::ptr block_chain::get_block_stats(hash_digest const& hash) const {
+    auto const metadata = find_block_metadata(hash);
+    if (metadata && metadata->stats()) {
+        return metadata;
+    }
+
+    auto const block_result = database_.internal_db().get_block(hash);
+    if ( ! block_result.first.is_valid()) {
+        return nullptr;
+    }
+
+    return compute_block_stats(block_result.first, block_result.second, metadata);
+}
+
+// private
+// The sigchecks of a cached validated record are kept, they cannot be
+// counted without running the scripts.
+block_metadata::ptr block_chain::compute_block_stats(domain::chain::block const& block, size_t height, block_metadata::ptr metadata) const {
+    auto const validated = metadata && metadata->validated();
+    block_stats stats;
+
+    if ( ! populate_spent_outputs(block) || ! block_stats::compute(block, validated ? metadata->sigchecks() : 0, stats)) {
+        LOG_ERROR(LOG_BLOCKCHAIN, "Failed to compute the statistics of block [", height, "].");
+        return nullptr;
+    }
+
+    auto const result = std::make_shared<block_metadata const>(block, height, stats, validated);
+    block_metadata_.add(result);
+    return result;
+}
+
+// The merkle block matches all transactions (full partial merkle tree).
+void block_chain::fetch_merkle_block(size_t height, merkle_block_fetch_handler handler) const {
+    if (stopped()) {
+        handler(error::service_stopped, nullptr, 0);
+        return;
+    }
+
+    auto const metadata = get_block_metadata(height);
+
+    if ( ! metadata) {
+        handler(error::not_found, nullptr, 0);
+        return;
+    }
+
+    auto const& hashes = metadata->transaction_hashes();
+    auto const merkle = std::make_shared<merkle_block>(metadata->header(),
+        hashes.size(), hashes, metadata->merkle_flags());
+    handler(error::success, merkle, height);
+}
+
+void block_chain::fetch_merkle_block(hash_digest const& hash,
+    merkle_block_fetch_handler handler) const {
+    if (stopped()) {
+        handler(error::service_stopped, nullptr, 0);
+        return;
+    }
+
+    auto const metadata = get_block_metadata(hash);
+
+    if ( ! metadata) {
+        handler(error::not_found, nullptr, 0);
+        return;
+    }
+
+    auto const& hashes = metadata->transaction_hashes();
+    auto const merkle = std::make_shared<merkle_block>(metadata->header(),
+        hashes.size(), hashes, metadata->merkle_flags());
+    handler(error::success, merkle, metadata->height());
+}
+
+void block_chain::fetch_merkle_proof(hash_digest const& tx_hash,
+    merkle_proof_fetch_handler handler) const {
+    if (stopped()) {
+        handler(error::service_stopped, {}, 0, 0);
+        return;
+    }
+
+    auto const result = database_.internal_db().get_transaction(tx_hash, max_size_t);
+
+    if ( ! result.is_valid()) {
+        handler(error::not_found, {}, 0, 0);
+        return;
+    }
+
+    auto const metadata = get_block_metadata(result.height());
+
+    // The record must be of the confirming block (not of a reorganized one).
+    auto const position = result.position();
+    if ( ! metadata || position >= metadata->transaction_hashes().size() ||
+        metadata->transaction_hashes()[position] != tx_hash) {
+        handler(error::not_found, {}, 0, 0);
+        return;
+    }
+
+    handler(error::success, metadata->merkle_branch(position), position, result.height());
+}
+
+void block_chain::fetch_block_filter(hash_digest const& block_hash, block_filter_fetch_handler handler) const {
+    if (stopped()) {
+        handler(error::service_stopped, {}, null_hash, 0);
+        return;
+    }
+
+    size_t height;
+    data_chunk filter;
+    block_filter_index::entry entry;
+
+    if ( ! block_filters_.get(block_hash, entry, height) ||
+        ! read_block_filter(height, entry, filter)) {
+        handler(error::not_found, {}, null_hash, 0);
+        return;
+    }
+
+    handler(error::success, filter, entry.header, height);
+}
+
+// As getcfheaders (BIP157) the range ends at the stop block and is bounded.
+void block_chain::fetch_filter_headers(size_t start_height, hash_digest const& stop_hash, filter_headers_fetch_handler handler) const {
+    if (stopped()) {
+        handler(error::service_stopped, null_hash, {});
+        return;
+    }
+
+    size_t stop_height;
+    block_filter_index::entry stop;
+    block_filter_index::entry previous{ null_hash, null_hash, null_hash };
+
+    if ( ! block_filters_.get(stop_hash, stop, stop_height) ||
+        start_height > stop_height || stop_height - start_height >= max_filter_headers ||
+        (start_height != 0 && ! block_filters_.get(start_height - 1, previous))) {
+        handler(error::not_found, null_hash, {});
+        return;
+    }
+
+    // Empty if truncated by a reorganization since the lookup.
+    auto const filter_hashes = block_filters_.filter_hashes(start_height, stop_height);
+    if (filter_hashes.empty()) {
+        handler(error::not_found, null_hash, {});
+        return;
+    }
+
+    handler(error::success, previous.header, filter_hashes);
+}
+
+void block_chain::fetch_utxo_commitment(size_t height, utxo_commitment_fetch_handler handler) const {
+    if (stopped()) {
+        handler(error::service_stopped, null_hash, null_hash);
+        return;
+    }
+
+    hash_digest block_hash;
+    hash_digest digest;
+
+    if ( ! settings_.utxo_commitment_index || ! utxo_commitments_.digest(height, block_hash, digest)) {
+        handler(error::not_found, null_hash, null_hash);
+        return;
+    }
+
+    handler(error::success, digest, block_hash);
+}
+
+void block_chain::fetch_token_outputs(hash_digest const& category, token_outputs_fetch_handler handler) const {
+    if (stopped()) {
+        handler(error::service_stopped, {});
+        return;
+    }
+
+    if ( ! settings_.token_index) {
+        handler(error::not_found, {});
+        return;
+    }
+
+    if ( ! token_index_.synced()) {
+        handler(index_not_ready, {});
+        return;
+    }
+
+    handler(error::success, token_index_.find(category));
+}
+
+void block_chain::fetch_token_outputs(hash_digest const& category, data_chunk const& commitment, token_outputs_fetch_handler handler) const {
+    if (stopped()) {
+        handler(error::service_stopped, {});
+        return;
+    }
+
+    if ( ! settings_.token_index) {
+        handler(error::not_found, {});
+        return;
+    }
+
+    if ( ! token_index_.synced()) {
+        handler(index_not_ready, {});
+        return;
+    }
+
+    handler(error::success, token_index_.find(category, commitment));
+}
+
+// Confirmed outputs spent by unconfirmed txs are left out, unconfirmed outputs
+// are added unless also spent by unconfirmed txs.
+void block_chain::fetch_unspent_outputs(hash_digest const& script_hash, unspent_outputs_fetch_handler handler) const {
+    if (stopped()) {
+        handler(error::service_stopped, {});
+        return;
+    }
+
+    if ( ! settings_.script_utxo_index) {
+        handler(error::not_found, {});
+        return;
+    }
+
+    if ( ! script_utxo_index_.synced()) {
+        handler(index_not_ready, {});
+        return;
+    }
+
+    auto const unconfirmed = mempool_index_.find(script_hash);
+
+    std::unordered_set<domain::chain::output_point> spent;
+    for (auto const& entry : unconfirmed) {
+        if (entry.input) {
+            spent.insert(domain::chain::output_point{ entry.previous_hash, entry.previous_index });
+        }
+    }
+
+    unspent_outputs result;
+    for (auto const& entry : script_utxo_index_.find(script_hash)) {
+        if ( ! spent.contains(entry.point)) {
+            result.push_back({ entry.point, entry.output.value(), entry.height, true });
+        }
+    }
+
+    for (auto const& entry : unconfirmed) {
+        domain::chain::output_point const point{ entry.hash, entry.index };
+        if ( ! entry.input && ! spent.contains(point)) {
+            result.push_back({ point, entry.value, 0, false });
+        }
+    }
+
+    handler(error::success, result);
+}
+
+// The unconfirmed change is the value received less the value spent by the
+// unconfirmed txs.
+void block_chain::fetch_balance(hash_digest const& script_hash, balance_fetch_handler handler) const {
+    if (stopped()) {
+        handler(error::service_stopped, 0, 0);
+        return;
+    }
+
+    if ( ! settings_.script_utxo_index) {
+        handler(error::not_found, 0, 0);
+        return;
+    }
+
+    if ( ! script_utxo_index_.synced()) {
+        handler(index_not_ready, 0, 0);
+        return;
+    }
+
+    uint64_t confirmed = 0;
+    for (auto const& entry : script_utxo_index_.find(script_hash)) {
+        confirmed += entry.output.value();
+    }
+
+    int64_t unconfirmed = 0;
+    for (auto const& entry : mempool_index_.find(script_hash)) {
+        unconfirmed += entry.input ? -int64_t(entry.value) : int64_t(entry.value);
+    }
+
+    handler(error::success, confirmed, unconfirmed);
+}
+
+void block_chain::fetch_compact_block(size_t height, compact_block_fetch_handler handler) const {
+    // TODO (Mario): implement compact blocks.
+    handler(error::not_implemented, {}, 0);
+}
+
+void block_chain::fetch_compact_block(hash_digest const& hash, compact_block_fetch_handler handler) const {
+    if (stopped()) {
+        handler(error::service_stopped, {},0);
+        return;
+    }
+
+    fetch_block(hash,[&handler](code const& ec, block_const_ptr message, size_t height) {
+        if (ec == error::success) {
+            auto blk_ptr = std::make_shared<compact_block>(compact_block::factory_from_block(*message));
+            handler(error::success, blk_ptr, height);
+        } else {
+            handler(ec, nullptr, height);
+        }
+    });
 }
 
 // This may execute over 500 queries.
@@ -655,31 +1966,63 @@ void block_chain::fetch_ds_proof(hash_digest const& hash, ds_proof_fetch_handler
     transaction_organizer_.fetch_ds_proof(hash, handler);
 }
 
+void block_chain::fetch_transaction_ds_proof(hash_digest const& hash, ds_proof_fetch_handler handler) const {
+    if (stopped()) {
+        handler(error::service_stopped, nullptr);
+        return;
+    }
+
+    transaction_organizer_.fetch_transaction_ds_proof(hash, handler);
+}
+
 void block_chain::fetch_transaction(hash_digest const& hash, bool require_confirmed, transaction_fetch_handler handler) const {
     if (stopped()) {
         handler(error::service_stopped, nullptr, 0, 0);
         return;
     }
+
+    auto const result = read_transaction(hash, require_confirmed);
+    handler(result.ec, result.transaction, result.position, result.height);
+}
+
+// Lookups are made in hash (store key) order across the dispatcher.
+void block_chain::fetch_transactions(hash_list const& hashes, bool require_confirmed, transactions_fetch_handler handler) const {
+    if (stopped()) {
+        handler(error::service_stopped, nullptr);
+        return;
+    }
+
+    auto const results = std::make_shared<transaction_fetch_results>(hashes.size());
+    auto const keys = std::make_shared<hash_list const>(hashes);
+
+    auto const reader = [this, results, keys, require_confirmed](size_t index) {
+        (*results)[index] = read_transaction((*keys)[index], require_confirmed);
+    };
+
+    read_ordered(dispatch_, hashes, reader, [results, handler](code const& ec) {
+        handler(ec, results);
+    });
+}
+
+// private
+block_chain::transaction_fetch_result block_chain::read_transaction(hash_digest const& hash, bool require_confirmed) const {
     auto const result = database_.internal_db().get_transaction(hash, max_size_t);
     if ( result.is_valid() ) {
         auto const tx = std::make_shared<const transaction>(result.transaction());
-        handler(error::success, tx, result.position(), result.height());
-        return;
+        return { error::success, tx, result.position(), result.height(), true };
     }
 
     if (require_confirmed) {
-        handler(error::not_found, nullptr, 0, 0);
-        return;
+        return { error::not_found, nullptr, 0, 0, false };
     }
 
     auto const result2 = database_.internal_db().get_transaction_unconfirmed(hash);
     if ( !  result2.is_valid() ) {
-        handler(error::not_found, nullptr, 0, 0);
-        return;
+        return { error::not_found, nullptr, 0, 0, false };
     }
 
     auto const tx = std::make_shared<const transaction>(result2.transaction());
-    handler(error::success, tx, position_max, result2.height());
+    return { error::success, tx, position_max, result2.height(), false };
 }
 
 // This is same as fetch_transaction but skips deserializing the tx payload.
@@ -738,35 +2081,20 @@ hash_digest generate_merkle_root(std::vector<domain::chain::transaction> transac
 
         for (auto it = merkle.begin(); it != merkle.end(); it += 2) {
             update.push_back(bitcoin_hash(build_chunk({ it[0], it[1] })));
-        }
-
-        swap(merkle, update);
-        update.clear();
-    }
-
-    // There is now only one item in the list.
-    return merkle.front();
-}
-
-namespace {
-
-std::tuple<uint8_t, uint8_t> get_address_versions(bool use_testnet_rules) {
-    if (use_testnet_rules) {
-        return {
-            kth::domain::wallet::payment_address::testnet_p2kh,
-            kth::domain::wallet::payment_address::testnet_p2sh};
-    }
+        }
 
-    return {
-        kth::domain::wallet::payment_address::mainnet_p2kh,
-        kth::domain::wallet::payment_address::mainnet_p2sh};
+        swap(merkle, update);
+        update.clear();
+    }
 
+    // There is now only one item in the list.
+    return merkle.front();
 }
 
-} // anonymous namespace
-
-//TODO(fernando): refactor!!!
-std::vector<kth::blockchain::mempool_transaction_summary> block_chain::get_mempool_transactions(std::vector<std::string> const& payment_addresses, bool use_testnet_rules) const {
+// Only the unconfirmed inputs and outputs of the given addresses are read,
+// through the script hash index, inputs by the script of the spent prevout.
+// Addresses are matched by script, so the network of the encoding is unused.
+std::vector<kth::blockchain::mempool_transaction_summary> block_chain::get_mempool_transactions(std::vector<std::string> const& payment_addresses, bool /*use_testnet_rules*/) const {
 /*          "    \"address\"  (string) The base58check encoded address\n"
             "    \"txid\"  (string) The related txid\n"
             "    \"index\"  (number) The related input or output index\n"
@@ -776,63 +2104,43 @@ std::vector<kth::blockchain::mempool_transaction_summary> block_chain::get_mempo
             "    \"prevout\"  (string) The previous transaction output index (if spending)\n"
 */
 
-    auto const [encoding_p2kh, encoding_p2sh] = get_address_versions(use_testnet_rules);
-
     std::vector<kth::blockchain::mempool_transaction_summary> ret;
 
     std::unordered_set<kth::domain::wallet::payment_address> addrs;
+    std::unordered_map<hash_digest, uint32_t> arrival_times;
+
     for (auto const& payment_address : payment_addresses) {
         kth::domain::wallet::payment_address address(payment_address);
-        if (address){
-            addrs.insert(address);
+        if ( ! address || ! addrs.insert(address).second) {
+            continue;
         }
-    }
 
-    auto const result = database_.internal_db().get_all_transaction_unconfirmed();
+        auto const encoded = address.encoded_cashaddr(false);
+        auto const entries = mempool_index_.find(mempool_index::script_hash(address.output_script()));
 
-    for (auto const& tx_res : result) {
-        auto const& tx = tx_res.transaction();
-        //tx.recompute_hash();
-        size_t i = 0;
-        for (auto const& output : tx.outputs()) {
-            auto const tx_addresses = kth::domain::wallet::payment_address::extract(output.script(), encoding_p2kh, encoding_p2sh);
-            for(auto const tx_address : tx_addresses) {
-                if (tx_address && addrs.find(tx_address) != addrs.end()) {
-                    ret.push_back
-                            (kth::blockchain::mempool_transaction_summary
-                                     (tx_address.encoded_cashaddr(false), kth::encode_hash(tx.hash()), "",
-                                      "", std::to_string(output.value()), i, tx_res.arrival_time()));
+        for (auto const& entry : entries) {
+            auto time = arrival_times.find(entry.hash);
+            if (time == arrival_times.end()) {
+                auto const tx_res = database_.internal_db().get_transaction_unconfirmed(entry.hash);
+
+                // The transaction may have been confirmed since it was found.
+                if ( ! tx_res.is_valid()) {
+                    continue;
                 }
+
+                time = arrival_times.emplace(entry.hash, tx_res.arrival_time()).first;
             }
-            ++i;
-        }
-        i = 0;
-        for (auto const& input : tx.inputs()) {
-            // TODO(kth): payment_addrress::extract should use the prev_output script instead of the input script
-            // see https://github.com/k-nuth/core/blob/v0.10.0/src/wallet/payment_address.cpp#L505
-            auto const tx_addresses = kth::domain::wallet::payment_address::extract(input.script(), encoding_p2kh, encoding_p2sh);
-            for(auto const tx_address : tx_addresses)
-            if (tx_address && addrs.find(tx_address) != addrs.end()) {
-                std::latch latch(1);
-                fetch_transaction(input.previous_output().hash(), false,
-                                  [&](const kth::code &ec,
-                                      kth::transaction_const_ptr tx_ptr, size_t index,
-                                      size_t height) {
-                                      if (ec == kth::error::success) {
-                                          ret.push_back(kth::blockchain::mempool_transaction_summary
-                                                                (tx_address.encoded_cashaddr(false),
-                                                                kth::encode_hash(tx.hash()),
-                                                                kth::encode_hash(input.previous_output().hash()),
-                                                                 std::to_string(input.previous_output().index()),
-                                                                "-"+std::to_string(tx_ptr->outputs()[input.previous_output().index()].value()),
-                                                                i,
-                                                                tx_res.arrival_time()));
-                                      }
-                                      latch.count_down();
-                                  });
-                latch.wait();
+
+            if (entry.input) {
+                ret.push_back(kth::blockchain::mempool_transaction_summary(encoded,
+                    kth::encode_hash(entry.hash), kth::encode_hash(entry.previous_hash),
+                    std::to_string(entry.previous_index), "-" + std::to_string(entry.value),
+                    entry.index, time->second));
+            } else {
+                ret.push_back(kth::blockchain::mempool_transaction_summary(encoded,
+                    kth::encode_hash(entry.hash), "", "", std::to_string(entry.value),
+                    entry.index, time->second));
             }
-            ++i;
         }
     }
 
@@ -840,99 +2148,55 @@ std::vector<kth::blockchain::mempool_transaction_summary> block_chain::get_mempo
 }
 
 // Precondition: valid payment addresses
-std::vector<domain::chain::transaction> block_chain::get_mempool_transactions_from_wallets(std::vector<domain::wallet::payment_address> const& payment_addresses, bool use_testnet_rules) const {
-    auto const [encoding_p2kh, encoding_p2sh] = get_address_versions(use_testnet_rules);
-
+std::vector<domain::chain::transaction> block_chain::get_mempool_transactions_from_wallets(std::vector<domain::wallet::payment_address> const& payment_addresses, bool /*use_testnet_rules*/) const {
     std::vector<domain::chain::transaction> ret;
 
-    auto const result = database_.internal_db().get_all_transaction_unconfirmed();
-
-    for (auto const& tx_res : result) {
-        auto const& tx = tx_res.transaction();
-        //tx.recompute_hash();
-        // Only insert the transaction once. Avoid duplicating the tx if serveral wallets are used in the same tx, and if the same wallet is the input and output addr.
-        bool inserted = false;
-
-        for (auto iter_output = tx.outputs().begin(); (iter_output != tx.outputs().end() && !inserted); ++iter_output) {
+    // Only insert the transaction once. Avoid duplicating the tx if serveral wallets are used in the same tx, and if the same wallet is the input and output addr.
+    std::unordered_set<hash_digest> inserted;
 
-            auto const tx_addresses = kth::domain::wallet::payment_address::extract((*iter_output).script(), encoding_p2kh, encoding_p2sh);
+    for (auto const& address : payment_addresses) {
+        auto const entries = mempool_index_.find(mempool_index::script_hash(address.output_script()));
 
-            for (auto iter_addr = tx_addresses.begin(); (iter_addr != tx_addresses.end() && !inserted); ++iter_addr) {
-                if (*iter_addr) {
-                    auto it = std::find(payment_addresses.begin(), payment_addresses.end(), *iter_addr);
-                    if (it != payment_addresses.end()) {
-                        ret.push_back(tx);
-                        inserted = true;
-                    }
-                }
+        for (auto const& entry : entries) {
+            if ( ! inserted.insert(entry.hash).second) {
+                continue;
             }
-        }
 
-        for (auto iter_input = tx.inputs().begin(); (iter_input != tx.inputs().end() && !inserted); ++iter_input) {
-            // TODO(kth): payment_addrress::extract should use the prev_output script instead of the input script
-            // see https://github.com/k-nuth/core/blob/v0.10.0/src/wallet/payment_address.cpp#L505
-            auto const tx_addresses = kth::domain::wallet::payment_address::extract((*iter_input).script(), encoding_p2kh, encoding_p2sh);
-            for (auto iter_addr = tx_addresses.begin(); (iter_addr != tx_addresses.end() && !inserted); ++iter_addr) {
-                if (*iter_addr) {
-                    auto it = std::find(payment_addresses.begin(), payment_addresses.end(), *iter_addr);
-                    if (it != payment_addresses.end()) {
-                        ret.push_back(tx);
-                        inserted = true;
-                    }
-                }
+            auto const tx_res = database_.internal_db().get_transaction_unconfirmed(entry.hash);
+            if (tx_res.is_valid()) {
+                ret.push_back(tx_res.transaction());
             }
         }
-
     }
 
     return ret;
 }
 
 void block_chain::fill_tx_list_from_mempool(domain::message::compact_block const& block, size_t& mempool_count, std::vector<domain::chain::transaction>& txn_available, std::unordered_map<uint64_t, uint16_t> const& shorttxids) const {
+    auto const header_hash = hash(block);
+    auto const k0 = from_little_endian_unsafe<uint64_t>(header_hash.begin());
+    auto const k1 = from_little_endian_unsafe<uint64_t>(header_hash.begin() + sizeof(uint64_t));
+
+    // Short ids are computed over the in-memory hashes, ambiguous matches
+    // are left empty so they get requested.
+    auto const matches = mempool_index_.match_short_ids(k0, k1, shorttxids, txn_available.size(), dispatch_);
+
+    // Only the matched transactions are read from the store.
+    for (size_t slot = 0; slot < matches.size(); ++slot) {
+        if (matches[slot] == null_hash) {
+            continue;
+        }
 
-    std::vector<bool> have_txn(txn_available.size());
-
-    auto header_hash = hash(block);
-    auto k0 = from_little_endian_unsafe<uint64_t>(header_hash.begin());
-    auto k1 = from_little_endian_unsafe<uint64_t>(header_hash.begin() + sizeof(uint64_t));
-
-    auto const result = database_.internal_db().get_all_transaction_unconfirmed();
-
-    for (auto const& tx_res : result) {
-        auto const& tx = tx_res.transaction();
-
-        uint64_t shortid = sip_hash_uint256(k0, k1, tx.hash()) & uint64_t(0xffffffffffff);
+        auto const result = database_.internal_db().get_transaction_unconfirmed(matches[slot]);
 
-        auto idit = shorttxids.find(shortid);
-        if (idit != shorttxids.end()) {
-            if ( ! have_txn[idit->second]) {
-                txn_available[idit->second] = tx;
-                have_txn[idit->second] = true;
-                ++mempool_count;
-            } else {
-                // If we find two mempool txn that match the short id, just
-                // request it. This should be rare enough that the extra
-                // bandwidth doesn't matter, but eating a round-trip due to
-                // FillBlock failure would be annoying.
-                if (txn_available[idit->second].is_valid()) {
-                    //txn_available[idit->second].reset();
-                    txn_available[idit->second] = domain::chain::transaction{};
-                    --mempool_count;
-                }
-            }
+        // The transaction may have been confirmed since it was matched.
+        if ( ! result.is_valid()) {
+            continue;
         }
 
-        //TODO (Mario) :  break the loop
-        // Though ideally we'd continue scanning for the
-        // two-txn-match-shortid case, the performance win of an early exit
-        // here is too good to pass up and worth the extra risk.
-        /*if (mempool_count == shorttxids.size()) {
-            return false;
-        } else {
-            return true;
-        }*/
+        txn_available[slot] = result.transaction();
+        ++mempool_count;
     }
-
 }
 
 safe_chain::mempool_mini_hash_map block_chain::get_mempool_mini_hash_map(domain::message::compact_block const& block) const {
@@ -996,6 +2260,23 @@ void block_chain::fetch_unconfirmed_transaction(hash_digest const& hash, transac
 
 
 #ifdef KTH_DB_TRANSACTION_UNCONFIRMED
+namespace {
+
+std::tuple<uint8_t, uint8_t> get_address_versions(bool use_testnet_rules) {
+    if (use_testnet_rules) {
+        return {
+            kth::domain::wallet::payment_address::testnet_p2kh,
+            kth::domain::wallet::payment_address::testnet_p2sh};
+    }
+
+    return {
+        kth::domain::wallet::payment_address::mainnet_p2kh,
+        kth::domain::wallet::payment_address::mainnet_p2sh};
+
+}
+
+} // anonymous namespace
+
 //TODO(fernando): refactor!!!
 std::vector<kth::blockchain::mempool_transaction_summary> block_chain::get_mempool_transactions(std::vector<std::string> const& payment_addresses, bool use_testnet_rules) const {
 /*          "    \"address\"  (string) The base58check encoded address\n"
@@ -1448,12 +2729,23 @@ void block_chain::fetch_history(short_hash const& address_hash, size_t limit, si
         return;
     }
 
+    domain::chain::history_compact::list history;
+    if (history_cache_.get(address_hash, limit, from_height, history)) {
+        handler(error::success, history);
+        return;
+    }
+
+    // The sequence is read first so a concurrent invalidation discards the read.
+    auto const sequence = history_cache_.sequence();
+
 #if defined(KTH_DB_HISTORY)
-    handler(error::success, database_.history().get(address_hash, limit, from_height));
+    history = database_.history().get(address_hash, limit, from_height);
 #else
-    handler(error::success, database_.internal_db().get_history(address_hash, limit, from_height));
+    history = database_.internal_db().get_history(address_hash, limit, from_height);
 #endif
 
+    history_cache_.add(address_hash, limit, from_height, history, sequence);
+    handler(error::success, history);
 }
 
 void block_chain::fetch_confirmed_transactions(const short_hash& address_hash, size_t limit, size_t from_height, confirmed_transactions_fetch_handler handler) const {
@@ -1469,6 +2761,186 @@ void block_chain::fetch_confirmed_transactions(const short_hash& address_hash, s
 #endif
 }
 
+// Addresses are read in key order across the dispatcher. Each result is
+// handed to the handler as it completes, in no particular order. Handler calls
+// are serialized on the dispatcher strand and the completion follows the last.
+// A non-zero limit is a budget shared by all addresses.
+void block_chain::fetch_histories(std::vector<short_hash> const& address_hashes, size_t limit, size_t from_height, history_batch_handler handler, result_handler completion) const {
+    if (stopped()) {
+        completion(error::service_stopped);
+        return;
+    }
+
+    auto const keys = std::make_shared<std::vector<short_hash> const>(address_hashes);
+    auto const budget = std::make_shared<std::atomic<size_t>>(limit);
+
+    auto const reader = [this, keys, budget, limit, from_height, handler](size_t index) {
+        auto const wanted = limit == 0 ? 0 : budget->load();
+        domain::chain::history_compact::list history;
+
+        if (limit == 0 || wanted != 0) {
+#if defined(KTH_DB_HISTORY)
+            history = database_.history().get((*keys)[index], wanted, from_height);
+#else
+            history = database_.internal_db().get_history((*keys)[index], wanted, from_height);
+#endif
+        }
+
+        if (limit != 0) {
+            history.erase(history.begin() + claim_budget(*budget, history.size()), history.end());
+        }
+
+        dispatch_.ordered(handler, error::success, index, std::move(history));
+    };
+
+    read_ordered(dispatch_, address_hashes, reader, [this, completion](code const&) {
+        dispatch_.ordered(completion, stopped() ? error::service_stopped : error::success);
+    });
+}
+
+// The page is read from the history index by a seek to the cursor, one entry
+// more than the page is read, which is the cursor of the next page.
+void block_chain::fetch_history_page(short_hash const& address_hash, history_cursor const& cursor, size_t page_size, history_page_handler handler) const {
+    if (stopped()) {
+        handler(error::service_stopped, {}, cursor, false);
+        return;
+    }
+
+    if ( ! settings_.history_index) {
+        handler(error::not_found, {}, cursor, false);
+        return;
+    }
+
+    if ( ! history_index_.synced()) {
+        handler(index_not_ready, {}, cursor, false);
+        return;
+    }
+
+    auto const size = std::max(page_size, size_t(1));
+    domain::chain::history_compact::list history;
+    if ( ! history_index_.read(address_hash, history_key(cursor), size + 1, history)) {
+        handler(error::operation_failed_22, {}, cursor, false);
+        return;
+    }
+
+    auto const done = history.size() <= size;
+    auto const next = next_cursor(cursor, history, done ? history.end() : history.begin() + size);
+
+    if ( ! done) {
+        history.resize(size);
+    }
+
+    handler(error::success, history, next, done);
+}
+
+// Pages are cut at a transaction boundary, so that a tx with several entries
+// for the address is not split over two pages. A tx with more entries than
+// the page is read to its end, as the page.
+void block_chain::fetch_confirmed_transactions_page(short_hash const& address_hash, history_cursor const& cursor, size_t page_size, confirmed_transactions_page_handler handler) const {
+    if (stopped()) {
+        handler(error::service_stopped, {}, cursor, false);
+        return;
+    }
+
+    if ( ! settings_.history_index) {
+        handler(error::not_found, {}, cursor, false);
+        return;
+    }
+
+    if ( ! history_index_.synced()) {
+        handler(index_not_ready, {}, cursor, false);
+        return;
+    }
+
+    auto const size = std::max(page_size, size_t(1));
+    domain::chain::history_compact::list history;
+    if ( ! history_index_.read(address_hash, history_key(cursor), size + 1, history)) {
+        handler(error::operation_failed_22, {}, cursor, false);
+        return;
+    }
+
+    auto done = history.size() <= size;
+    auto end = done ? history.end() : history.begin() + size;
+
+    // The entries of a tx are adjacent, as they are at one height.
+    if ( ! done) {
+        auto const& next = end->point.hash();
+        auto cut = end;
+        while (cut != history.begin() && (cut - 1)->point.hash() == next) {
+            --cut;
+        }
+
+        if (cut != history.begin()) {
+            end = cut;
+        } else {
+            // Each read is from the last entry read, which is dropped.
+            auto const tx_hash = next;
+            while (history.back().point.hash() == tx_hash) {
+                domain::chain::history_compact::list more;
+                if ( ! history_index_.read(address_hash, history_key(history.back()), size + 1, more)) {
+                    handler(error::operation_failed_22, {}, cursor, false);
+                    return;
+                }
+
+                if (more.size() < 2) {
+                    break;
+                }
+
+                history.insert(history.end(), std::next(more.begin()), more.end());
+            }
+
+            end = std::find_if(history.begin(), history.end(), [&tx_hash](auto const& entry) {
+                return entry.point.hash() != tx_hash;
+            });
+
+            done = end == history.end();
+        }
+    }
+
+    std::vector<hash_digest> hashes;
+    std::unordered_set<hash_digest> seen;
+    for (auto it = history.begin(); it != end; ++it) {
+        if (seen.insert(it->point.hash()).second) {
+            hashes.push_back(it->point.hash());
+        }
+    }
+
+    handler(error::success, hashes, next_cursor(cursor, history, end), done);
+}
+
+void block_chain::fetch_confirmed_transactions(std::vector<short_hash> const& address_hashes, size_t limit, size_t from_height, confirmed_transactions_batch_handler handler, result_handler completion) const {
+    if (stopped()) {
+        completion(error::service_stopped);
+        return;
+    }
+
+    auto const keys = std::make_shared<std::vector<short_hash> const>(address_hashes);
+    auto const budget = std::make_shared<std::atomic<size_t>>(limit);
+
+    auto const reader = [this, keys, budget, limit, from_height, handler](size_t index) {
+        auto const wanted = limit == 0 ? 0 : budget->load();
+        std::vector<hash_digest> hashes;
+
+        if (limit == 0 || wanted != 0) {
+#if defined(KTH_DB_HISTORY)
+            hashes = database_.history().get_txns((*keys)[index], wanted, from_height);
+#else
+            hashes = database_.internal_db().get_history_txns((*keys)[index], wanted, from_height);
+#endif
+        }
+
+        if (limit != 0) {
+            hashes.erase(hashes.begin() + claim_budget(*budget, hashes.size()), hashes.end());
+        }
+
+        dispatch_.ordered(handler, error::success, index, std::move(hashes));
+    };
+
+    read_ordered(dispatch_, address_hashes, reader, [this, completion](code const&) {
+        dispatch_.ordered(completion, stopped() ? error::service_stopped : error::success);
+    });
+}
+
 
 #ifdef KTH_DB_STEALTH
 void block_chain::fetch_stealth(const binary& filter, size_t from_height, stealth_fetch_handler handler) const {
@@ -1600,6 +3072,24 @@ void block_chain::unsubscribe() {
     transaction_organizer_.unsubscribe_ds_proof();
 }
 
+size_t block_chain::subscribe_script_hashes(script_hash_handler&& handler) {
+    // Fed by tx push and reorganization, matched once for all subscribers
+    // (in order, on the network pool).
+    return script_hash_registry_.subscribe(std::move(handler));
+}
+
+bool block_chain::watch_script_hashes(size_t id, hash_list const& script_hashes) {
+    return script_hash_registry_.watch(id, script_hashes);
+}
+
+bool block_chain::unwatch_script_hashes(size_t id, hash_list const& script_hashes) {
+    return script_hash_registry_.unwatch(id, script_hashes);
+}
+
+void block_chain::unsubscribe_script_hashes(size_t id) {
+    script_hash_registry_.unsubscribe(id);
+}
+
 // Transaction Validation.
 //-----------------------------------------------------------------------------
 
@@ -1620,11 +3110,21 @@ void block_chain::organize(transaction_const_ptr tx, result_handler handler) {
     transaction_organizer_.organize(tx, handler);
 }
 
+void block_chain::organize(transaction_const_ptr_list_const_ptr txs, organize_results_handler handler) {
+    // This cannot call organize or stop (lock safe).
+    transaction_organizer_.organize(txs, handler);
+}
+
 void block_chain::organize(double_spend_proof_const_ptr ds_proof, result_handler handler) {
     // This cannot call organize or stop (lock safe).
     transaction_organizer_.organize(ds_proof, handler);
 }
 
+void block_chain::organize_package(transaction_const_ptr_list_const_ptr txs, bool test_accept, organize_results_handler handler) {
+    // This cannot call organize or stop (lock safe).
+    transaction_organizer_.organize_package(txs, test_accept, handler);
+}
+
 
 // Properties (thread safe).
 // ----------------------------------------------------------------------------
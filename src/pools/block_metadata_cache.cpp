@@ -0,0 +1,490 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <kth/blockchain/pools/block_metadata_cache.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+namespace {
+
+template <typename Integer>
+void write(data_chunk& out, Integer value) {
+    extend_data(out, to_little_endian(value));
+}
+
+// Reads the fields of a record, each read is false past its end.
+class record_reader {
+public:
+    explicit
+    record_reader(data_slice data)
+        : it_(data.begin())
+        , end_(data.end())
+    {}
+
+    template <typename Integer>
+    bool read(Integer& out) {
+        if (size_t(end_ - it_) < sizeof(Integer)) {
+            return false;
+        }
+
+        out = from_little_endian_unsafe<Integer>(it_);
+        it_ += sizeof(Integer);
+        return true;
+    }
+
+    bool read(hash_digest& out) {
+        if (size_t(end_ - it_) < out.size()) {
+            return false;
+        }
+
+        std::copy_n(it_, out.size(), out.begin());
+        it_ += out.size();
+        return true;
+    }
+
+    bool read(bool& out) {
+        uint8_t value;
+        if ( ! read(value) || value > 1) {
+            return false;
+        }
+
+        out = value == 1;
+        return true;
+    }
+
+    size_t remaining() const {
+        return size_t(end_ - it_);
+    }
+
+private:
+    uint8_t const* it_;
+    uint8_t const* end_;
+};
+
+void write_stats(data_chunk& out, block_stats const& stats) {
+    write(out, uint64_t(stats.transaction_count));
+    write(out, uint64_t(stats.inputs));
+    write(out, uint64_t(stats.outputs));
+    write(out, uint64_t(stats.total_size));
+    write(out, stats.total_out);
+    write(out, stats.fees);
+    write(out, stats.min_fee);
+    write(out, stats.max_fee);
+    write(out, stats.min_feerate);
+    write(out, stats.max_feerate);
+    write(out, stats.average_feerate);
+
+    for (auto const percentile : stats.feerate_percentiles) {
+        write(out, percentile);
+    }
+
+    write(out, uint64_t(stats.sigchecks));
+}
+
+bool read_stats(record_reader& reader, block_stats& out) {
+    uint64_t transaction_count;
+    uint64_t inputs;
+    uint64_t outputs;
+    uint64_t total_size;
+    uint64_t sigchecks;
+
+    if ( ! reader.read(transaction_count) || ! reader.read(inputs) || ! reader.read(outputs) ||
+        ! reader.read(total_size) || ! reader.read(out.total_out) || ! reader.read(out.fees) ||
+        ! reader.read(out.min_fee) || ! reader.read(out.max_fee) || ! reader.read(out.min_feerate) ||
+        ! reader.read(out.max_feerate) || ! reader.read(out.average_feerate)) {
+        return false;
+    }
+
+    for (auto& percentile : out.feerate_percentiles) {
+        if ( ! reader.read(percentile)) {
+            return false;
+        }
+    }
+
+    if ( ! reader.read(sigchecks)) {
+        return false;
+    }
+
+    out.transaction_count = transaction_count;
+    out.inputs = inputs;
+    out.outputs = outputs;
+    out.total_size = total_size;
+    out.sigchecks = sigchecks;
+    return true;
+}
+
+} // namespace
+
+// block_metadata
+//-----------------------------------------------------------------------------
+
+block_metadata::block_metadata(domain::chain::block const& block, size_t height)
+    : block_metadata(block, height, 0, 0)
+{
+    validated_ = false;
+}
+
+// Transactions follow the header and the transaction count, whose combined
+// size is what remains of the block size after the transaction sizes.
+block_metadata::block_metadata(domain::chain::block const& block, size_t height, uint64_t fees, size_t sigchecks)
+    : hash_(block.hash())
+    , height_(height)
+    , header_(block.header())
+    , serialized_size_(block.serialized_size())
+    , transaction_hashes_(block.to_hashes())
+    , validated_(true)
+    , fees_(fees)
+    , sigchecks_(sigchecks)
+{
+    auto const& txs = block.transactions();
+    transaction_offsets_.reserve(txs.size());
+
+    size_t transactions_size = 0;
+    for (auto const& tx : txs) {
+        transactions_size += tx.serialized_size(true);
+    }
+
+    auto offset = serialized_size_ - transactions_size;
+    for (auto const& tx : txs) {
+        transaction_offsets_.push_back(uint32_t(offset));
+        offset += tx.serialized_size(true);
+    }
+}
+
+block_metadata::block_metadata(domain::chain::block const& block, size_t height, block_stats const& stats, bool validated)
+    : block_metadata(block, height, stats.fees, stats.sigchecks)
+{
+    validated_ = validated;
+    stats_ = stats;
+}
+
+// The record is the block hash, the size, the validation totals, the
+// statistics if computed, then the transaction hashes and offsets.
+block_metadata::ptr block_metadata::from_data(domain::chain::header const& header, size_t height, data_slice record) {
+    std::shared_ptr<block_metadata> out(new block_metadata());
+    record_reader reader(record);
+
+    uint64_t serialized_size;
+    uint64_t sigchecks;
+    bool has_stats;
+    uint32_t count;
+
+    if ( ! reader.read(out->hash_) || ! reader.read(serialized_size) || ! reader.read(out->validated_) ||
+        ! reader.read(out->fees_) || ! reader.read(sigchecks) || ! reader.read(has_stats)) {
+        return nullptr;
+    }
+
+    if (has_stats) {
+        block_stats stats;
+        if ( ! read_stats(reader, stats)) {
+            return nullptr;
+        }
+
+        out->stats_ = stats;
+    }
+
+    if ( ! reader.read(count) || reader.remaining() != size_t(count) * (hash_size + sizeof(uint32_t))) {
+        return nullptr;
+    }
+
+    out->transaction_hashes_.resize(count);
+    for (auto& hash : out->transaction_hashes_) {
+        reader.read(hash);
+    }
+
+    out->transaction_offsets_.resize(count);
+    for (auto& offset : out->transaction_offsets_) {
+        reader.read(offset);
+    }
+
+    out->height_ = height;
+    out->header_ = header;
+    out->serialized_size_ = serialized_size;
+    out->sigchecks_ = sigchecks;
+    return out;
+}
+
+data_chunk block_metadata::to_data() const {
+    data_chunk out(hash_.begin(), hash_.end());
+    write(out, uint64_t(serialized_size_));
+    write(out, uint8_t(validated_));
+    write(out, fees_);
+    write(out, uint64_t(sigchecks_));
+    write(out, uint8_t(stats_.has_value()));
+
+    if (stats_) {
+        write_stats(out, *stats_);
+    }
+
+    write(out, uint32_t(transaction_hashes_.size()));
+    for (auto const& hash : transaction_hashes_) {
+        extend_data(out, hash);
+    }
+
+    for (auto const offset : transaction_offsets_) {
+        write(out, offset);
+    }
+
+    return out;
+}
+
+hash_digest const& block_metadata::hash() const {
+    return hash_;
+}
+
+size_t block_metadata::height() const {
+    return height_;
+}
+
+domain::chain::header const& block_metadata::header() const {
+    return header_;
+}
+
+size_t block_metadata::serialized_size() const {
+    return serialized_size_;
+}
+
+size_t block_metadata::transaction_count() const {
+    return transaction_hashes_.size();
+}
+
+hash_list const& block_metadata::transaction_hashes() const {
+    return transaction_hashes_;
+}
+
+std::vector<uint32_t> const& block_metadata::transaction_offsets() const {
+    return transaction_offsets_;
+}
+
+bool block_metadata::validated() const {
+    return validated_;
+}
+
+uint64_t block_metadata::fees() const {
+    return fees_;
+}
+
+size_t block_metadata::sigchecks() const {
+    return sigchecks_;
+}
+
+std::optional<block_stats> const& block_metadata::stats() const {
+    return stats_;
+}
+
+// The last hash of an odd level is paired with itself (as in the root).
+std::vector<hash_list> const& block_metadata::merkle_levels() const {
+    std::call_once(merkle_once_, [this]() {
+        auto const* level = &transaction_hashes_;
+
+        while (level->size() > 1) {
+            hash_list next;
+            next.reserve((level->size() + 1) / 2);
+
+            for (size_t index = 0; index < level->size(); index += 2) {
+                auto const& left = (*level)[index];
+                auto const& right = index + 1 < level->size() ? (*level)[index + 1] : left;
+                next.push_back(bitcoin_hash(build_chunk({ left, right })));
+            }
+
+            merkle_levels_.push_back(std::move(next));
+            level = &merkle_levels_.back();
+        }
+    });
+
+    return merkle_levels_;
+}
+
+hash_list block_metadata::merkle_branch(size_t position) const {
+    hash_list branch;
+
+    if (position >= transaction_hashes_.size()) {
+        return branch;
+    }
+
+    auto const& levels = merkle_levels();
+    branch.reserve(levels.size());
+
+    auto const* level = &transaction_hashes_;
+    for (auto const& parent : levels) {
+        auto const sibling = position ^ 1;
+        branch.push_back(sibling < level->size() ? (*level)[sibling] : (*level)[position]);
+        position >>= 1;
+        level = &parent;
+    }
+
+    return branch;
+}
+
+// Matching every transaction the partial tree descends to all nodes, each
+// flagged, and the hashes are the leaves in order (bip37).
+data_chunk block_metadata::merkle_flags() const {
+    auto const leaves = transaction_hashes_.size();
+    if (leaves == 0) {
+        return {};
+    }
+
+    size_t nodes = 0;
+    for (size_t width = leaves; ; width = (width + 1) / 2) {
+        nodes += width;
+        if (width == 1) {
+            break;
+        }
+    }
+
+    data_chunk flags((nodes + 7) / 8, 0xff);
+    auto const remainder = nodes % 8;
+    if (remainder != 0) {
+        flags.back() = uint8_t((1u << remainder) - 1);
+    }
+
+    return flags;
+}
+
+// block_metadata_cache
+//-----------------------------------------------------------------------------
+
+block_metadata_cache::block_metadata_cache(size_t capacity)
+    : capacity_(capacity)
+{}
+
+size_t block_metadata_cache::size() const {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    shared_lock lock(mutex_);
+    return entries_.size();
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+block_metadata::ptr block_metadata_cache::get(hash_digest const& hash) const {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    shared_lock lock(mutex_);
+    auto const it = entries_.find(hash);
+    return it == entries_.end() ? nullptr : it->second.metadata;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+block_metadata::ptr block_metadata_cache::get(size_t height) const {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    shared_lock lock(mutex_);
+
+    auto const height_it = heights_.find(height);
+    if (height_it == heights_.end()) {
+        return nullptr;
+    }
+
+    auto const it = entries_.find(height_it->second);
+    return it == entries_.end() ? nullptr : it->second.metadata;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+void block_metadata_cache::add(block_metadata::ptr metadata) {
+    if (capacity_ == 0 || ! metadata) {
+        return;
+    }
+
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+    insert_unlocked(std::move(metadata), true);
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+void block_metadata_cache::add_validated(block_metadata::ptr metadata) {
+    if (capacity_ == 0 || ! metadata) {
+        return;
+    }
+
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+    insert_unlocked(std::move(metadata), false);
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+bool block_metadata_cache::confirm(hash_digest const& hash) {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+
+    auto const it = entries_.find(hash);
+    if (it == entries_.end()) {
+        return false;
+    }
+
+    index_unlocked(hash, it->second.metadata->height());
+    return true;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+void block_metadata_cache::remove(hash_digest const& hash) {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+    remove_unlocked(hash);
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+// private
+void block_metadata_cache::insert_unlocked(block_metadata::ptr metadata, bool confirmed) {
+    auto const hash = metadata->hash();
+    auto const height = metadata->height();
+
+    remove_unlocked(hash);
+
+    entries_.emplace(hash, entry{ std::move(metadata), order_.push(hash) });
+
+    if (confirmed) {
+        index_unlocked(hash, height);
+    }
+
+    order_.evict(entries_, [this](hash_digest const& oldest) {
+        if (entries_.size() <= capacity_) {
+            return false;
+        }
+
+        remove_unlocked(oldest);
+        return true;
+    });
+
+    order_.compact(entries_, 2 * capacity_);
+}
+
+// private
+// A stale block at this height is replaced by the confirmed one.
+void block_metadata_cache::index_unlocked(hash_digest const& hash, size_t height) {
+    auto const height_it = heights_.find(height);
+    if (height_it != heights_.end() && height_it->second != hash) {
+        remove_unlocked(height_it->second);
+    }
+
+    heights_[height] = hash;
+}
+
+// private
+void block_metadata_cache::remove_unlocked(hash_digest const& hash) {
+    auto const it = entries_.find(hash);
+    if (it == entries_.end()) {
+        return;
+    }
+
+    auto const height_it = heights_.find(it->second.metadata->height());
+    if (height_it != heights_.end() && height_it->second == hash) {
+        heights_.erase(height_it);
+    }
+
+    entries_.erase(it);
+}
+
+} // namespace kth::blockchain
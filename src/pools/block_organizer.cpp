@@ -4,11 +4,14 @@
 
 #include <kth/blockchain/pools/block_organizer.hpp>
 
+#include <algorithm>
 #include <cstddef>
 #include <functional>
 #include <future>
+#include <iterator>
 #include <memory>
 #include <utility>
+#include <vector>
 
 #include <kth/blockchain/interface/fast_chain.hpp>
 #include <kth/blockchain/pools/block_pool.hpp>
@@ -32,9 +35,9 @@ using namespace std::placeholders;
 // transaction: { exists, height, output }
 
 #if defined(KTH_WITH_MEMPOOL)
-block_organizer::block_organizer(prioritized_mutex& mutex, dispatcher& dispatch, threadpool& thread_pool, fast_chain& chain, settings const& settings, domain::config::network network, bool relay_transactions, mining::mempool& mp)
+block_organizer::block_organizer(prioritized_mutex& mutex, dispatcher& dispatch, threadpool& thread_pool, fast_chain& chain, settings const& settings, domain::config::network network, bool relay_transactions, block_metadata_cache& metadata, transaction_metadata_cache& transaction_metadata, mining::mempool& mp)
 #else
-block_organizer::block_organizer(prioritized_mutex& mutex, dispatcher& dispatch, threadpool& thread_pool, fast_chain& chain, settings const& settings, domain::config::network network, bool relay_transactions)
+block_organizer::block_organizer(prioritized_mutex& mutex, dispatcher& dispatch, threadpool& thread_pool, fast_chain& chain, settings const& settings, domain::config::network network, bool relay_transactions, block_metadata_cache& metadata, transaction_metadata_cache& transaction_metadata)
 #endif
     : fast_chain_(chain)
     , mutex_(mutex)
@@ -42,15 +45,20 @@ block_organizer::block_organizer(prioritized_mutex& mutex, dispatcher& dispatch,
     , dispatch_(dispatch)
     , block_pool_(settings.reorganization_limit)
 #if defined(KTH_WITH_MEMPOOL)
-    , validator_(dispatch, fast_chain_, settings, network, relay_transactions, mp)
+    , validator_(dispatch, fast_chain_, settings, network, relay_transactions, metadata, transaction_metadata, mp)
 #else
-    , validator_(dispatch, fast_chain_, settings, network, relay_transactions)
+    , validator_(dispatch, fast_chain_, settings, network, relay_transactions, metadata, transaction_metadata)
 #endif
     , subscriber_(std::make_shared<reorganize_subscriber>(thread_pool, NAME))
+    , organize_dispatch_(thread_pool, NAME "_organize")
 
 #if defined(KTH_WITH_MEMPOOL)
     , mempool_(mp)
 #endif
+
+    , queue_bytes_(0)
+    , maximum_queue_bytes_(settings.block_queue_bytes)
+    , draining_(false)
 {}
 
 // Properties.
@@ -75,22 +83,147 @@ bool block_organizer::stop() {
     subscriber_->stop();
     subscriber_->invoke(error::service_stopped, 0, {}, {});
     stopped_ = true;
+
+    // The block being organized completes on its own, queued blocks do not.
+    std::vector<result_handler> handlers;
+
+    {
+        // Critical Section
+        ///////////////////////////////////////////////////////////////////////
+        unique_lock lock(queue_mutex_);
+
+        auto const first = std::find_if(queue_.begin(), queue_.end(), [](queued_block const& entry) {
+            return ! entry.started;
+        });
+
+        for (auto it = first; it != queue_.end(); ++it) {
+            std::move(it->handlers.begin(), it->handlers.end(), std::back_inserter(handlers));
+            queue_bytes_ -= it->size;
+        }
+
+        queue_.erase(first, queue_.end());
+        ///////////////////////////////////////////////////////////////////////
+    }
+
+    for (auto const& handler : handlers) {
+        handler(error::service_stopped);
+    }
+
     return true;
 }
 
 // Organize sequence.
 //-----------------------------------------------------------------------------
 
+// Two submissions are the same block if the transactions are the same, as
+// a malleated copy (see CVE-2012-2459) shares the header hash of the block.
+static
+bool same_block(block const& left, block const& right) {
+    return &left == &right || (left.hash() == right.hash() &&
+        left.transactions().size() == right.transactions().size() &&
+        left.generate_merkle_root() == right.generate_merkle_root());
+}
+
 // This is called from blockchain::organize.
+// Blocks are queued and organized in order of arrival on one thread of the
+// network pool, the caller is not held during validation. A block already
+// queued or being organized is not queued again, the handler is attached to
+// its result. The queue is limited in bytes, a block that does not fit is
+// failed with block_queue_full (not a fault of the block) unless the queue is
+// empty.
 void block_organizer::organize(block_const_ptr block, result_handler handler) {
+    if (stopped()) {
+        handler(error::service_stopped);
+        return;
+    }
+
+    auto const size = block->serialized_size(1);
+
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(queue_mutex_);
+
+    auto const it = std::find_if(queue_.begin(), queue_.end(), [&block](queued_block const& entry) {
+        return same_block(*entry.block, *block);
+    });
+
+    if (it != queue_.end()) {
+        it->handlers.push_back(std::move(handler));
+        return;
+    }
+
+    if ( ! queue_.empty() && queue_bytes_ + size > maximum_queue_bytes_) {
+        lock.unlock();
+        handler(safe_chain::block_queue_full);
+        return;
+    }
+
+    queue_.push_back({ block, size, false, { std::move(handler) } });
+    queue_bytes_ += size;
+
+    if (draining_) {
+        return;
+    }
+
+    draining_ = true;
+    lock.unlock();
+    ///////////////////////////////////////////////////////////////////////////
+
+    organize_dispatch_.concurrent(&block_organizer::drain, this);
+}
+
+// private
+// The front block is left queued while organized, so that submissions of it
+// meanwhile are attached to its result.
+void block_organizer::drain() {
+    while (true) {
+        block_const_ptr block;
+
+        {
+            // Critical Section
+            ///////////////////////////////////////////////////////////////////
+            unique_lock lock(queue_mutex_);
+
+            if (queue_.empty()) {
+                draining_ = false;
+                return;
+            }
+
+            queue_.front().started = true;
+            block = queue_.front().block;
+            ///////////////////////////////////////////////////////////////////
+        }
+
+        auto const ec = organize_block(block);
+        std::vector<result_handler> handlers;
+
+        {
+            // Critical Section
+            ///////////////////////////////////////////////////////////////////
+            unique_lock lock(queue_mutex_);
+
+            handlers = std::move(queue_.front().handlers);
+            queue_bytes_ -= queue_.front().size;
+            queue_.pop_front();
+            ///////////////////////////////////////////////////////////////////
+        }
+
+        // Invoke caller handlers outside of critical sections.
+        for (auto const& handler : handlers) {
+            handler(ec);
+        }
+    }
+}
+
+// private
+code block_organizer::organize_block(block_const_ptr block) {
     // Critical Section
     ///////////////////////////////////////////////////////////////////////////
     mutex_.lock_high_priority();
 
     if (stopped()) {
         mutex_.unlock_high_priority();
-        handler(error::service_stopped);
-        return;
+        return error::service_stopped;
     }
 
     // Reset the reusable promise.
@@ -110,8 +243,7 @@ void block_organizer::organize(block_const_ptr block, result_handler handler) {
     mutex_.unlock_high_priority();
     ///////////////////////////////////////////////////////////////////////////
 
-    // Invoke caller handler outside of critical section.
-    handler(ec);
+    return ec;
 }
 
 // private
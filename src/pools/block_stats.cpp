@@ -0,0 +1,93 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <kth/blockchain/pools/block_stats.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+namespace {
+
+constexpr std::array<size_t, 5> percentile_points{ 10, 25, 50, 75, 90 };
+
+// Each percentile is the fee rate of the transaction at which the cumulative
+// size (in fee rate order) reaches the percentile of the total size.
+block_stats::percentiles feerate_percentiles(std::vector<std::pair<uint64_t, size_t>>& rates, size_t total_size) {
+    block_stats::percentiles result{};
+
+    if (rates.empty()) {
+        return result;
+    }
+
+    std::sort(rates.begin(), rates.end());
+
+    size_t point = 0;
+    size_t cumulative = 0;
+    for (auto const& rate : rates) {
+        cumulative += rate.second;
+
+        while (point < percentile_points.size() && cumulative * 100 >= total_size * percentile_points[point]) {
+            result[point++] = rate.first;
+        }
+    }
+
+    return result;
+}
+
+} // namespace
+
+bool block_stats::compute(domain::chain::block const& block, size_t sigchecks, block_stats& out) {
+    block_stats stats;
+    stats.transaction_count = block.transactions().size();
+    stats.sigchecks = sigchecks;
+
+    std::vector<std::pair<uint64_t, size_t>> rates;
+    rates.reserve(stats.transaction_count);
+
+    for (auto const& tx : block.transactions()) {
+        stats.outputs += tx.outputs().size();
+
+        if (tx.is_coinbase()) {
+            continue;
+        }
+
+        for (auto const& input : tx.inputs()) {
+            if ( ! input.previous_output().validation.cache.is_valid()) {
+                return false;
+            }
+        }
+
+        auto const size = tx.serialized_size(true);
+        auto const fee = tx.fees();
+        auto const rate = size == 0 ? 0 : fee * 1000 / size;
+
+        stats.min_fee = rates.empty() ? fee : std::min(stats.min_fee, fee);
+        stats.max_fee = std::max(stats.max_fee, fee);
+        stats.min_feerate = rates.empty() ? rate : std::min(stats.min_feerate, rate);
+        stats.max_feerate = std::max(stats.max_feerate, rate);
+
+        stats.inputs += tx.inputs().size();
+        stats.total_size += size;
+        stats.total_out += tx.total_output_value();
+        stats.fees += fee;
+        rates.emplace_back(rate, size);
+    }
+
+    if (stats.total_size != 0) {
+        stats.average_feerate = stats.fees * 1000 / stats.total_size;
+    }
+
+    stats.feerate_percentiles = feerate_percentiles(rates, stats.total_size);
+    out = stats;
+    return true;
+}
+
+} // namespace kth::blockchain
@@ -0,0 +1,328 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <kth/blockchain/pools/ds_proof_pool.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <tuple>
+#include <utility>
+
+#include <secp256k1.h>
+#include <secp256k1_schnorr.h>
+
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+using domain::message::double_spend_proof;
+
+namespace {
+
+constexpr uint8_t sighash_all_forkid = 0x41;
+
+// A 64 byte signature is Schnorr, DER signatures are never that size.
+constexpr size_t schnorr_signature_size = 64;
+
+secp256k1_context const* verification_context() {
+    static auto const context = secp256k1_context_create(SECP256K1_CONTEXT_VERIFY);
+    return context;
+}
+
+bool is_schnorr(data_chunk const& push) {
+    return push.size() == schnorr_signature_size + 1;
+}
+
+// A Schnorr or a strict DER signature, followed by SIGHASH_ALL|FORKID.
+bool is_signature(data_chunk const& push) {
+    if (push.size() < 2 || push.back() != sighash_all_forkid) {
+        return false;
+    }
+
+    if (is_schnorr(push)) {
+        return true;
+    }
+
+    ec_signature signature;
+    data_slice const der(push.data(), push.data() + push.size() - 1);
+    return parse_signature(signature, der, true);
+}
+
+// The P2PKH input of the transaction spending the outpoint, nullptr if none.
+domain::chain::input const* find_input(domain::chain::transaction const& tx, domain::chain::point const& out_point) {
+    auto const& inputs = tx.inputs();
+    auto const input = std::find_if(inputs.begin(), inputs.end(), [&out_point](auto const& input) {
+        auto const& prevout = input.previous_output();
+        return prevout.hash() == out_point.hash() && prevout.index() == out_point.index();
+    });
+
+    if (input == inputs.end()) {
+        return nullptr;
+    }
+
+    // The signature and the public key of a P2PKH input.
+    auto const& ops = input->script().operations();
+    if (ops.size() != 2 || ops[0].data().empty() || ops[1].data().empty()) {
+        return nullptr;
+    }
+
+    return &*input;
+}
+
+// The spender of the input, as committed by its (bip143) signature hash.
+bool make_spender(domain::chain::transaction const& tx, domain::chain::point const& out_point, double_spend_proof::spender& out) {
+    auto const input = find_input(tx, out_point);
+    if (input == nullptr) {
+        return false;
+    }
+
+    auto const& inputs = tx.inputs();
+    auto const& signature = input->script().operations()[0].data();
+    if ( ! is_signature(signature)) {
+        return false;
+    }
+
+    data_chunk prevouts;
+    data_chunk sequences;
+    for (auto const& spend : inputs) {
+        extend_data(prevouts, spend.previous_output().to_data());
+        extend_data(sequences, to_little_endian(spend.sequence()));
+    }
+
+    data_chunk outputs;
+    for (auto const& output : tx.outputs()) {
+        extend_data(outputs, output.to_data());
+    }
+
+    out.version = tx.version();
+    out.out_sequence = input->sequence();
+    out.locktime = tx.locktime();
+    out.prev_outs_hash = bitcoin_hash(prevouts);
+    out.sequence_hash = bitcoin_hash(sequences);
+    out.outputs_hash = bitcoin_hash(outputs);
+    out.push_data = signature;
+    return true;
+}
+
+// The (bip143) signature hash of the spender, with the spent output.
+hash_digest signature_hash(double_spend_proof::spender const& spender, domain::chain::output_point const& out_point, domain::chain::script const& script_code, uint64_t value) {
+    data_chunk preimage;
+    extend_data(preimage, to_little_endian(spender.version));
+    extend_data(preimage, spender.prev_outs_hash);
+    extend_data(preimage, spender.sequence_hash);
+    extend_data(preimage, out_point.to_data());
+    extend_data(preimage, script_code.to_data(true));
+    extend_data(preimage, to_little_endian(value));
+    extend_data(preimage, to_little_endian(spender.out_sequence));
+    extend_data(preimage, spender.outputs_hash);
+    extend_data(preimage, to_little_endian(spender.locktime));
+    extend_data(preimage, to_little_endian(uint32_t(sighash_all_forkid)));
+    return bitcoin_hash(preimage);
+}
+
+bool verify_schnorr(data_chunk const& public_key, hash_digest const& hash, uint8_t const* signature) {
+    auto const context = verification_context();
+    secp256k1_pubkey key;
+    if (secp256k1_ec_pubkey_parse(context, &key, public_key.data(), public_key.size()) != 1) {
+        return false;
+    }
+
+    return secp256k1_schnorr_verify(context, signature, hash.data(), &key) == 1;
+}
+
+bool verify_spender(double_spend_proof::spender const& spender, domain::chain::output_point const& out_point, data_chunk const& public_key, domain::chain::script const& script_code, uint64_t value) {
+    auto const& push = spender.push_data;
+    if ( ! is_signature(push)) {
+        return false;
+    }
+
+    auto const hash = signature_hash(spender, out_point, script_code, value);
+    if (is_schnorr(push)) {
+        return verify_schnorr(public_key, hash, push.data());
+    }
+
+    ec_signature signature;
+    data_slice const der(push.data(), push.data() + push.size() - 1);
+    return parse_signature(signature, der, true) && verify_signature(public_key, hash, signature);
+}
+
+} // namespace
+
+// The public key is that of the pooled spend (the spenders commit only to
+// its hash), it must be the key paid by the spent output.
+bool ds_proof_pool::verify(double_spend_proof const& proof, domain::chain::transaction const& spending, domain::chain::output const& spent) {
+    auto const& spender1 = proof.spender1();
+    auto const& spender2 = proof.spender2();
+
+    // The spenders are distinct and in order, as created.
+    if (std::tie(spender1.outputs_hash, spender1.prev_outs_hash) >= std::tie(spender2.outputs_hash, spender2.prev_outs_hash)) {
+        return false;
+    }
+
+    auto const& out_point = proof.out_point();
+    auto const input = find_input(spending, out_point);
+    if (input == nullptr) {
+        return false;
+    }
+
+    auto const& public_key = input->script().operations()[1].data();
+    domain::chain::script const script_code(domain::chain::script::to_pay_key_hash_pattern(bitcoin_short_hash(public_key)));
+    if (spent.script() != script_code) {
+        return false;
+    }
+
+    return verify_spender(spender1, out_point, public_key, script_code, spent.value()) &&
+        verify_spender(spender2, out_point, public_key, script_code, spent.value());
+}
+
+// The spenders are ordered by their hashes, so the proof is the same
+// whichever spend was seen first.
+double_spend_proof_const_ptr ds_proof_pool::create(domain::chain::transaction const& first, domain::chain::transaction const& second, domain::chain::point const& out_point) {
+    double_spend_proof::spender spender1;
+    double_spend_proof::spender spender2;
+
+    if ( ! make_spender(first, out_point, spender1) || ! make_spender(second, out_point, spender2)) {
+        return nullptr;
+    }
+
+    auto const ordered = std::tie(spender1.outputs_hash, spender1.prev_outs_hash) <= std::tie(spender2.outputs_hash, spender2.prev_outs_hash);
+    domain::chain::output_point const spent{ out_point.hash(), out_point.index() };
+
+    return ordered ?
+        std::make_shared<double_spend_proof const>(spent, spender1, spender2) :
+        std::make_shared<double_spend_proof const>(spent, spender2, spender1);
+}
+
+ds_proof_pool::ds_proof_pool(size_t maximum_bytes)
+    : maximum_bytes_(maximum_bytes)
+    , bytes_(0)
+{}
+
+size_t ds_proof_pool::size() const {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    shared_lock lock(mutex_);
+    return entries_.size();
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+size_t ds_proof_pool::bytes() const {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    shared_lock lock(mutex_);
+    return bytes_;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+// A transaction double spent on several outpoints is indexed by the first.
+bool ds_proof_pool::add(double_spend_proof_const_ptr proof, hash_digest const& transaction_hash) {
+    auto const size = proof->serialized_size(domain::message::version::level::canonical);
+    if (size > maximum_bytes_) {
+        return false;
+    }
+
+    auto const proof_hash = hash(*proof);
+    domain::chain::point const out_point = proof->out_point();
+
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+
+    if (entries_.contains(proof_hash) || out_points_.contains(out_point)) {
+        return false;
+    }
+
+    order_.evict(entries_, [this, size](hash_digest const& oldest) {
+        if (bytes_ + size <= maximum_bytes_) {
+            return false;
+        }
+
+        remove_unlocked(oldest);
+        return true;
+    });
+
+    entries_.emplace(proof_hash, entry{ std::move(proof), out_point, transaction_hash, size, order_.push(proof_hash) });
+    out_points_.emplace(out_point, proof_hash);
+    bytes_ += size;
+
+    if (transaction_hash != null_hash) {
+        transactions_.try_emplace(transaction_hash, proof_hash);
+    }
+
+    order_.compact(entries_, 2 * entries_.size() + 64);
+
+    return true;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+double_spend_proof_const_ptr ds_proof_pool::get(hash_digest const& hash) const {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    shared_lock lock(mutex_);
+    auto const it = entries_.find(hash);
+    return it == entries_.end() ? nullptr : it->second.proof;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+double_spend_proof_const_ptr ds_proof_pool::find(domain::chain::point const& out_point) const {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    shared_lock lock(mutex_);
+    auto const it = out_points_.find(out_point);
+    return it == out_points_.end() ? nullptr : entries_.at(it->second).proof;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+double_spend_proof_const_ptr ds_proof_pool::find_transaction(hash_digest const& transaction_hash) const {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    shared_lock lock(mutex_);
+    auto const it = transactions_.find(transaction_hash);
+    return it == transactions_.end() ? nullptr : entries_.at(it->second).proof;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+// Whichever spend was confirmed, the double spend is resolved.
+void ds_proof_pool::remove_spent(domain::chain::block const& block) {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+
+    if (entries_.empty()) {
+        return;
+    }
+
+    auto const& txs = block.transactions();
+    for (auto tx = txs.begin() + 1; tx != txs.end(); ++tx) {
+        for (auto const& input : tx->inputs()) {
+            auto const it = out_points_.find(input.previous_output());
+            if (it != out_points_.end()) {
+                remove_unlocked(it->second);
+            }
+        }
+    }
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+// private
+void ds_proof_pool::remove_unlocked(hash_digest const& hash) {
+    auto const it = entries_.find(hash);
+    if (it == entries_.end()) {
+        return;
+    }
+
+    out_points_.erase(it->second.out_point);
+
+    auto const tx = transactions_.find(it->second.transaction_hash);
+    if (tx != transactions_.end() && tx->second == hash) {
+        transactions_.erase(tx);
+    }
+
+    bytes_ -= it->second.size;
+    entries_.erase(it);
+}
+
+} // namespace kth::blockchain
@@ -0,0 +1,147 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <kth/blockchain/pools/history_cache.hpp>
+
+#include <cstddef>
+#include <utility>
+
+#include <boost/functional/hash.hpp>
+
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+history_cache::history_cache(size_t capacity)
+    : capacity_(capacity)
+    , rows_(0)
+    , sequence_(0)
+{}
+
+size_t history_cache::key_hasher::operator()(key const& value) const {
+    auto seed = boost::hash_range(value.address_hash.begin(), value.address_hash.end());
+    boost::hash_combine(seed, value.limit);
+    boost::hash_combine(seed, value.from_height);
+    return seed;
+}
+
+size_t history_cache::size() const {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    shared_lock lock(mutex_);
+    return rows_;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+size_t history_cache::sequence() const {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    shared_lock lock(mutex_);
+    return sequence_;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+bool history_cache::get(short_hash const& address_hash, size_t limit, size_t from_height, list& out) {
+    if (capacity_ == 0) {
+        return false;
+    }
+
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+
+    auto const it = entries_.find(key{ address_hash, limit, from_height });
+    if (it == entries_.end()) {
+        return false;
+    }
+
+    recency_.splice(recency_.begin(), recency_, it->second.position);
+    out = it->second.history;
+    return true;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+void history_cache::add(short_hash const& address_hash, size_t limit, size_t from_height, list const& history, size_t sequence) {
+    if (history.size() > capacity_) {
+        return;
+    }
+
+    key const value{ address_hash, limit, from_height };
+
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+
+    // The store read may predate a block touching the address.
+    if (sequence != sequence_ || entries_.contains(value)) {
+        return;
+    }
+
+    while (rows_ + history.size() > capacity_) {
+        remove_unlocked(recency_.back());
+    }
+
+    recency_.push_front(value);
+    entries_.emplace(value, entry{ history, recency_.begin() });
+    addresses_[address_hash].push_back(value);
+    rows_ += history.size();
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+// The sequence moves even if no address is cached, so that store reads in
+// flight are not cached.
+void history_cache::invalidate(std::vector<short_hash> const& address_hashes) {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+    ++sequence_;
+
+    for (auto const& address_hash : address_hashes) {
+        auto const it = addresses_.find(address_hash);
+        if (it == addresses_.end()) {
+            continue;
+        }
+
+        // Removal of the last key of the address erases the keys list.
+        auto const keys = it->second;
+        for (auto const& value : keys) {
+            remove_unlocked(value);
+        }
+    }
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+void history_cache::clear() {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+    ++sequence_;
+    rows_ = 0;
+    recency_.clear();
+    entries_.clear();
+    addresses_.clear();
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+// private
+void history_cache::remove_unlocked(key const& value) {
+    auto const it = entries_.find(value);
+    if (it == entries_.end()) {
+        return;
+    }
+
+    auto const address = addresses_.find(value.address_hash);
+    if (address != addresses_.end()) {
+        std::erase(address->second, value);
+        if (address->second.empty()) {
+            addresses_.erase(address);
+        }
+    }
+
+    rows_ -= it->second.history.size();
+    recency_.erase(it->second.position);
+    entries_.erase(it);
+}
+
+} // namespace kth::blockchain
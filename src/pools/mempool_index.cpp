@@ -0,0 +1,340 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <kth/blockchain/pools/mempool_index.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <kth/blockchain/pools/short_id.hpp>
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+hash_digest mempool_index::script_hash(domain::chain::script const& script) {
+    return sha256_hash(script.to_data(false));
+}
+
+// Properties.
+//-----------------------------------------------------------------------------
+
+size_t mempool_index::size() const {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    shared_lock lock(mutex_);
+    return hashes_.size();
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+bool mempool_index::contains(hash_digest const& hash) const {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    shared_lock lock(mutex_);
+    return positions_.find(hash) != positions_.end();
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+// Writers.
+//-----------------------------------------------------------------------------
+
+// Script hashing is done before locking, so writers only hold the lock to
+// insert.
+void mempool_index::add(domain::chain::transaction const& tx) {
+    auto const& hash = tx.hash();
+    std::vector<std::pair<hash_digest, script_entry>> entries;
+
+    auto const& outputs = tx.outputs();
+    for (uint32_t index = 0; index < outputs.size(); ++index) {
+        auto const& output = outputs[index];
+        entries.emplace_back(script_hash(output.script()), script_entry{ hash, index, false, output.value(), null_hash, 0 });
+    }
+
+    auto const& inputs = tx.inputs();
+    spends spent{ {}, uint32_t(outputs.size()) };
+    for (uint32_t index = 0; index < inputs.size(); ++index) {
+        auto const& prevout = inputs[index].previous_output();
+        spent.points.emplace_back(prevout.hash(), prevout.index());
+
+        if ( ! prevout.validation.cache.is_valid()) {
+            continue;
+        }
+
+        auto const& cache = prevout.validation.cache;
+        entries.emplace_back(script_hash(cache.script()), script_entry{ hash, index, true, cache.value(), prevout.hash(), prevout.index() });
+    }
+
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+
+    if ( ! positions_.emplace(hash, hashes_.size()).second) {
+        return;
+    }
+
+    hashes_.push_back(hash);
+
+    for (auto const& entry : entries) {
+        add_script_unlocked(entry.first, entry.second);
+    }
+
+    for (auto const& point : spent.points) {
+        spenders_.try_emplace(point, hash);
+    }
+
+    tx_spends_.emplace(hash, std::move(spent));
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+// private
+void mempool_index::add_script_unlocked(hash_digest const& script_hash, script_entry const& entry) {
+    auto& list = scripts_[script_hash];
+
+    // A tx paying the same script more than once is listed once for removal.
+    if (list.empty() || list.back().hash != entry.hash) {
+        tx_scripts_[entry.hash].push_back(script_hash);
+    }
+
+    list.push_back(entry);
+}
+
+void mempool_index::remove(hash_digest const& hash) {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+    remove_unlocked(hash);
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+void mempool_index::remove(domain::chain::block const& block) {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+
+    for (auto const& tx : block.transactions()) {
+        remove_unlocked(tx.hash());
+    }
+
+    // Spenders left of the outpoints spent by the block are double spends.
+    for (auto const& tx : block.transactions()) {
+        if (tx.is_coinbase()) {
+            continue;
+        }
+
+        for (auto const& input : tx.inputs()) {
+            auto const& prevout = input.previous_output();
+            auto const spender = spenders_.find(domain::chain::point{ prevout.hash(), prevout.index() });
+            if (spender != spenders_.end()) {
+                remove_descendants_unlocked(spender->second);
+            }
+        }
+    }
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+void mempool_index::clear() {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+    hashes_.clear();
+    positions_.clear();
+    scripts_.clear();
+    tx_scripts_.clear();
+    spenders_.clear();
+    tx_spends_.clear();
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+// private
+// Swap the last hash into the vacated position to keep the array dense.
+void mempool_index::remove_unlocked(hash_digest const& hash) {
+    auto const it = positions_.find(hash);
+    if (it == positions_.end()) {
+        return;
+    }
+
+    auto const position = it->second;
+    positions_.erase(it);
+
+    if (position != hashes_.size() - 1) {
+        hashes_[position] = hashes_.back();
+        positions_[hashes_[position]] = position;
+    }
+
+    hashes_.pop_back();
+
+    auto const spent = tx_spends_.find(hash);
+    if (spent != tx_spends_.end()) {
+        for (auto const& point : spent->second.points) {
+            auto const spender = spenders_.find(point);
+            if (spender != spenders_.end() && spender->second == hash) {
+                spenders_.erase(spender);
+            }
+        }
+
+        tx_spends_.erase(spent);
+    }
+
+    auto const scripts = tx_scripts_.find(hash);
+    if (scripts == tx_scripts_.end()) {
+        return;
+    }
+
+    for (auto const& script_hash : scripts->second) {
+        auto const list = scripts_.find(script_hash);
+        if (list == scripts_.end()) {
+            continue;
+        }
+
+        std::erase_if(list->second, [&hash](script_entry const& entry) {
+            return entry.hash == hash;
+        });
+
+        if (list->second.empty()) {
+            scripts_.erase(list);
+        }
+    }
+
+    tx_scripts_.erase(scripts);
+}
+
+// private
+// The tx and the txs spending its outputs, recursively.
+void mempool_index::remove_descendants_unlocked(hash_digest const& hash) {
+    hash_list pending{ hash };
+
+    while ( ! pending.empty()) {
+        auto const parent = pending.back();
+        pending.pop_back();
+
+        auto const spent = tx_spends_.find(parent);
+        if (spent == tx_spends_.end()) {
+            continue;
+        }
+
+        auto const outputs = spent->second.outputs;
+        remove_unlocked(parent);
+
+        for (uint32_t index = 0; index < outputs; ++index) {
+            auto const spender = spenders_.find(domain::chain::point{ parent, index });
+            if (spender != spenders_.end()) {
+                pending.push_back(spender->second);
+            }
+        }
+    }
+}
+
+// Queries.
+//-----------------------------------------------------------------------------
+
+mempool_index::script_entries mempool_index::find(hash_digest const& script_hash) const {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    shared_lock lock(mutex_);
+    auto const it = scripts_.find(script_hash);
+    return it == scripts_.end() ? script_entries{} : it->second;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+hash_list mempool_index::match_short_ids(uint64_t k0, uint64_t k1, short_id_map const& wanted, size_t slots, dispatcher& dispatch) const {
+    // Matches are (slot, hash position) pairs.
+    using matches = std::vector<std::pair<size_t, size_t>>;
+    static constexpr size_t chunk = 256;
+
+    hash_list result(slots, null_hash);
+
+    if (wanted.empty() || slots == 0) {
+        return result;
+    }
+
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    shared_lock lock(mutex_);
+
+    auto const count = hashes_.size();
+    if (count == 0) {
+        return result;
+    }
+
+    auto const needed = (count + match_bucket_minimum - 1) / match_bucket_minimum;
+    auto const buckets = std::max(size_t(1), std::min(dispatch.size(), needed));
+    auto const span = (count + buckets - 1) / buckets;
+    std::vector<matches> found(buckets);
+
+    auto const match_bucket = [&](size_t bucket) {
+        auto const first = bucket * span;
+        auto const last = std::min(first + span, count);
+        uint64_t ids[chunk];
+
+        for (auto begin = first; begin < last; begin += chunk) {
+            auto const size = std::min(chunk, last - begin);
+            short_ids(k0, k1, hashes_.data() + begin, size, ids);
+
+            for (size_t index = 0; index < size; ++index) {
+                auto const it = wanted.find(ids[index]);
+                if (it != wanted.end()) {
+                    found[bucket].emplace_back(it->second, begin + index);
+                }
+            }
+        }
+    };
+
+    // Buckets are claimed from a shared counter by the calling thread and by
+    // the dispatched jobs. The caller runs every bucket not yet claimed, so it
+    // only waits on buckets running on other threads, never on queued jobs.
+    // A job that starts after all buckets are claimed touches only the state.
+    struct join_state {
+        std::function<void(size_t)> run;
+        std::atomic<size_t> next{ 0 };
+        std::atomic<size_t> done{ 0 };
+    };
+
+    auto const state = std::make_shared<join_state>();
+    state->run = match_bucket;
+
+    auto const claim = [buckets](std::shared_ptr<join_state> const& shared) {
+        for (auto bucket = shared->next++; bucket < buckets; bucket = shared->next++) {
+            shared->run(bucket);
+            if (++shared->done == buckets) {
+                shared->done.notify_one();
+            }
+        }
+    };
+
+    for (size_t bucket = 1; bucket < buckets; ++bucket) {
+        dispatch.concurrent([state, claim]() {
+            claim(state);
+        });
+    }
+
+    claim(state);
+    for (auto done = state->done.load(); done != buckets; done = state->done.load()) {
+        state->done.wait(done);
+    }
+
+    // If two mempool txs match the same short id neither is used, so that
+    // the caller requests it. This is rare and avoids a failed block fill.
+    std::vector<bool> hit(slots, false);
+    for (auto const& bucket : found) {
+        for (auto const& match : bucket) {
+            auto const slot = match.first;
+            if (slot >= slots) {
+                continue;
+            }
+
+            result[slot] = hit[slot] ? null_hash : hashes_[match.second];
+            hit[slot] = true;
+        }
+    }
+
+    return result;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+} // namespace kth::blockchain
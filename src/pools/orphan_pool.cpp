@@ -0,0 +1,159 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <kth/blockchain/pools/orphan_pool.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+orphan_pool::orphan_pool(size_t maximum_count, size_t maximum_bytes, clock::duration expiration)
+    : maximum_count_(maximum_count)
+    , maximum_bytes_(maximum_bytes)
+    , expiration_(expiration)
+    , bytes_(0)
+{}
+
+size_t orphan_pool::size() const {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    shared_lock lock(mutex_);
+    return entries_.size();
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+size_t orphan_pool::bytes() const {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    shared_lock lock(mutex_);
+    return bytes_;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+// The parents are the distinct hashes of the unpopulated prevouts.
+bool orphan_pool::add(transaction_const_ptr tx) {
+    if (maximum_count_ == 0) {
+        return false;
+    }
+
+    hash_list parents;
+    for (auto const& input : tx->inputs()) {
+        auto const& prevout = input.previous_output();
+        if ( ! prevout.validation.cache.is_valid() && std::find(parents.begin(), parents.end(), prevout.hash()) == parents.end()) {
+            parents.push_back(prevout.hash());
+        }
+    }
+
+    auto const size = tx->serialized_size(true);
+    if (parents.empty() || size > maximum_bytes_) {
+        return false;
+    }
+
+    auto const hash = tx->hash();
+    auto const now = clock::now();
+
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+    expire_unlocked(now);
+
+    if (entries_.contains(hash)) {
+        return false;
+    }
+
+    order_.evict(entries_, [this, size](hash_digest const& oldest) {
+        if (entries_.size() < maximum_count_ && bytes_ + size <= maximum_bytes_) {
+            return false;
+        }
+
+        remove_unlocked(oldest);
+        return true;
+    });
+
+    for (auto const& parent : parents) {
+        waiting_.emplace(parent, hash);
+    }
+
+    entries_.emplace(hash, entry{ std::move(tx), std::move(parents), size, now, order_.push(hash) });
+    bytes_ += size;
+
+    order_.compact(entries_, 2 * maximum_count_);
+
+    return true;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+transaction_const_ptr_list orphan_pool::take(hash_digest const& parent_hash) {
+    transaction_const_ptr_list children;
+
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+    expire_unlocked(clock::now());
+
+    auto const range = waiting_.equal_range(parent_hash);
+    hash_list hashes;
+    for (auto it = range.first; it != range.second; ++it) {
+        hashes.push_back(it->second);
+    }
+
+    for (auto const& hash : hashes) {
+        auto const it = entries_.find(hash);
+        if (it != entries_.end()) {
+            children.push_back(it->second.tx);
+            remove_unlocked(hash);
+        }
+    }
+
+    return children;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+void orphan_pool::expire() {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+    expire_unlocked(clock::now());
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+// private
+// Entries are added in time order, so the oldest are evicted first.
+void orphan_pool::expire_unlocked(clock::time_point now) {
+    order_.evict(entries_, [this, now](hash_digest const& oldest) {
+        if (now - entries_.at(oldest).added < expiration_) {
+            return false;
+        }
+
+        remove_unlocked(oldest);
+        return true;
+    });
+}
+
+// private
+void orphan_pool::remove_unlocked(hash_digest const& hash) {
+    auto const it = entries_.find(hash);
+    if (it == entries_.end()) {
+        return;
+    }
+
+    for (auto const& parent : it->second.parents) {
+        auto const range = waiting_.equal_range(parent);
+        for (auto child = range.first; child != range.second; ++child) {
+            if (child->second == hash) {
+                waiting_.erase(child);
+                break;
+            }
+        }
+    }
+
+    bytes_ -= it->second.size;
+    entries_.erase(it);
+}
+
+} // namespace kth::blockchain
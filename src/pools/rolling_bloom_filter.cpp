@@ -0,0 +1,142 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <kth/blockchain/pools/rolling_bloom_filter.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+namespace {
+
+constexpr size_t word_bits = 64;
+constexpr size_t maximum_functions = 50;
+
+// The optimal size of a filter of the elements at the rate (in bits).
+size_t optimal_bits(size_t elements, double false_positive_rate) {
+    if (elements == 0) {
+        return 0;
+    }
+
+    auto const ln2 = std::log(2.0);
+    auto const bits = -double(elements) * std::log(false_positive_rate) / (ln2 * ln2);
+    return std::max(size_t(std::ceil(bits)), word_bits);
+}
+
+size_t optimal_functions(size_t elements, size_t bits) {
+    if (elements == 0) {
+        return 0;
+    }
+
+    auto const functions = std::lround(double(bits) / elements * std::log(2.0));
+    return std::clamp(size_t(functions), size_t(1), maximum_functions);
+}
+
+uint64_t random_salt() {
+    std::random_device device;
+    return (uint64_t(device()) << 32) | device();
+}
+
+// The splitmix64 finalizer.
+uint64_t mix(uint64_t value) {
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111eb;
+    return value ^ (value >> 31);
+}
+
+} // namespace
+
+rolling_bloom_filter::rolling_bloom_filter(size_t elements, double false_positive_rate)
+    : elements_(elements)
+    , bit_count_(optimal_bits(elements, false_positive_rate))
+    , function_count_(optimal_functions(elements, bit_count_))
+    , salt_(random_salt())
+    , count_(0)
+    , generations_{ bits((bit_count_ + word_bits - 1) / word_bits, 0), bits((bit_count_ + word_bits - 1) / word_bits, 0) }
+    , current_(0)
+{}
+
+void rolling_bloom_filter::insert(hash_digest const& hash) {
+    if (elements_ == 0) {
+        return;
+    }
+
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+
+    if (count_ == elements_) {
+        current_ = 1 - current_;
+        std::fill(generations_[current_].begin(), generations_[current_].end(), 0);
+        count_ = 0;
+    }
+
+    auto& generation = generations_[current_];
+    for (size_t function = 0; function < function_count_; ++function) {
+        auto const bit = position(hash, function);
+        generation[bit / word_bits] |= uint64_t(1) << (bit % word_bits);
+    }
+
+    ++count_;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+bool rolling_bloom_filter::contains(hash_digest const& hash) const {
+    if (elements_ == 0) {
+        return false;
+    }
+
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    shared_lock lock(mutex_);
+
+    for (auto const& generation : generations_) {
+        auto found = true;
+        for (size_t function = 0; function < function_count_ && found; ++function) {
+            found = test(generation, position(hash, function));
+        }
+
+        if (found) {
+            return true;
+        }
+    }
+
+    return false;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+void rolling_bloom_filter::reset() {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+
+    for (auto& generation : generations_) {
+        std::fill(generation.begin(), generation.end(), 0);
+    }
+
+    salt_ = random_salt();
+    count_ = 0;
+    current_ = 0;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+// private
+// The hash words are already uniform, each function mixes one with the salt.
+size_t rolling_bloom_filter::position(hash_digest const& hash, size_t function) const {
+    auto const word = from_little_endian_unsafe<uint64_t>(hash.begin() + (function % 4) * sizeof(uint64_t));
+    return mix(word ^ mix(salt_ + function)) % bit_count_;
+}
+
+// private
+bool rolling_bloom_filter::test(bits const& generation, size_t position) {
+    return (generation[position / word_bits] & (uint64_t(1) << (position % word_bits))) != 0;
+}
+
+} // namespace kth::blockchain
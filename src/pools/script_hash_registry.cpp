@@ -0,0 +1,267 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <kth/blockchain/pools/script_hash_registry.hpp>
+
+#include <cstddef>
+#include <utility>
+
+#include <kth/blockchain/pools/mempool_index.hpp>
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+using namespace kd::chain;
+
+script_hash_registry::script_hash_registry()
+    : stopped_(true)
+    , next_id_(1)
+{}
+
+// Start/stop sequences.
+//-----------------------------------------------------------------------------
+
+void script_hash_registry::start() {
+    stopped_ = false;
+}
+
+void script_hash_registry::stop() {
+    stopped_ = true;
+
+    std::unordered_map<size_t, subscription> subscriptions;
+
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    {
+        unique_lock lock(mutex_);
+        subscriptions.swap(subscriptions_);
+        watchers_.clear();
+    }
+    ///////////////////////////////////////////////////////////////////////////
+
+    for (auto const& entry : subscriptions) {
+        entry.second.notify(error::service_stopped, {});
+    }
+}
+
+// Subscriptions.
+//-----------------------------------------------------------------------------
+
+size_t script_hash_registry::subscribe(handler&& handler) {
+    if (stopped_) {
+        handler(error::service_stopped, {});
+        return 0;
+    }
+
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+    auto const id = next_id_++;
+    subscriptions_.emplace(id, subscription{ std::move(handler), {} });
+    return id;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+void script_hash_registry::unsubscribe(size_t id) {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+
+    auto const it = subscriptions_.find(id);
+    if (it == subscriptions_.end()) {
+        return;
+    }
+
+    for (auto const& script_hash : it->second.script_hashes) {
+        auto const watcher = watchers_.find(script_hash);
+        if (watcher == watchers_.end()) {
+            continue;
+        }
+
+        std::erase(watcher->second, id);
+        if (watcher->second.empty()) {
+            watchers_.erase(watcher);
+        }
+    }
+
+    subscriptions_.erase(it);
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+bool script_hash_registry::watch(size_t id, hash_list const& script_hashes) {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+
+    auto const it = subscriptions_.find(id);
+    if (it == subscriptions_.end()) {
+        return false;
+    }
+
+    for (auto const& script_hash : script_hashes) {
+        if (it->second.script_hashes.insert(script_hash).second) {
+            watchers_[script_hash].push_back(id);
+        }
+    }
+
+    return true;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+bool script_hash_registry::unwatch(size_t id, hash_list const& script_hashes) {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+
+    auto const it = subscriptions_.find(id);
+    if (it == subscriptions_.end()) {
+        return false;
+    }
+
+    for (auto const& script_hash : script_hashes) {
+        if (it->second.script_hashes.erase(script_hash) == 0) {
+            continue;
+        }
+
+        auto const watcher = watchers_.find(script_hash);
+        if (watcher == watchers_.end()) {
+            continue;
+        }
+
+        std::erase(watcher->second, id);
+        if (watcher->second.empty()) {
+            watchers_.erase(watcher);
+        }
+    }
+
+    return true;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+// Notifications.
+//-----------------------------------------------------------------------------
+
+void script_hash_registry::notify_transaction(transaction const& tx) {
+    if (stopped_) {
+        return;
+    }
+
+    matches matched;
+    match(tx, 0, change::unconfirmed, matched);
+    deliver(matched);
+}
+
+// Incoming blocks are contiguous, ending at the top height, and outgoing
+// blocks are contiguous from the same fork point.
+void script_hash_registry::notify_reorganize(size_t top_height, block_const_ptr_list_const_ptr incoming_blocks, block_const_ptr_list_const_ptr outgoing_blocks) {
+    if (stopped_) {
+        return;
+    }
+
+    matches matched;
+    auto const fork_height = top_height - incoming_blocks->size();
+
+    auto height = fork_height + 1;
+    for (auto const& block : *outgoing_blocks) {
+        for (auto const& tx : block->transactions()) {
+            match(tx, height, change::reorganized, matched);
+        }
+
+        ++height;
+    }
+
+    height = fork_height + 1;
+    for (auto const& block : *incoming_blocks) {
+        for (auto const& tx : block->transactions()) {
+            match(tx, height, change::confirmed, matched);
+        }
+
+        ++height;
+    }
+
+    deliver(matched);
+}
+
+// private
+// Inputs are matched by the script of their prevout, if populated.
+void script_hash_registry::match(transaction const& tx, size_t height, change kind, matches& out) const {
+    {
+        // Critical Section
+        ///////////////////////////////////////////////////////////////////////
+        shared_lock lock(mutex_);
+        if (watchers_.empty()) {
+            return;
+        }
+        ///////////////////////////////////////////////////////////////////////
+    }
+
+    auto const& tx_hash = tx.hash();
+
+    for (auto const& output : tx.outputs()) {
+        match(mempool_index::script_hash(output.script()), tx_hash, height, kind, out);
+    }
+
+    for (auto const& input : tx.inputs()) {
+        auto const& prevout = input.previous_output();
+        if (prevout.validation.cache.is_valid()) {
+            match(mempool_index::script_hash(prevout.validation.cache.script()), tx_hash, height, kind, out);
+        }
+    }
+}
+
+// private
+// A script hash is notified once per tx and subscriber.
+void script_hash_registry::match(hash_digest const& script_hash, hash_digest const& tx_hash, size_t height, change kind, matches& out) const {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    shared_lock lock(mutex_);
+
+    auto const it = watchers_.find(script_hash);
+    if (it == watchers_.end()) {
+        return;
+    }
+
+    for (auto const id : it->second) {
+        // Notes of the current tx are the last ones of the list.
+        auto& list = out[id];
+        auto duplicate = false;
+        for (auto note = list.rbegin(); note != list.rend() && note->tx_hash == tx_hash; ++note) {
+            if (note->script_hash == script_hash && note->kind == kind) {
+                duplicate = true;
+                break;
+            }
+        }
+
+        if ( ! duplicate) {
+            list.push_back({ script_hash, tx_hash, height, kind });
+        }
+    }
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+// private
+void script_hash_registry::deliver(matches const& matched) {
+    for (auto const& entry : matched) {
+        handler notify;
+
+        {
+            // Critical Section
+            ///////////////////////////////////////////////////////////////////
+            shared_lock lock(mutex_);
+            auto const it = subscriptions_.find(entry.first);
+            if (it == subscriptions_.end()) {
+                continue;
+            }
+
+            notify = it->second.notify;
+            ///////////////////////////////////////////////////////////////////
+        }
+
+        if ( ! notify(error::success, entry.second)) {
+            unsubscribe(entry.first);
+        }
+    }
+}
+
+} // namespace kth::blockchain
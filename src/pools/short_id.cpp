@@ -0,0 +1,115 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <kth/blockchain/pools/short_id.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+namespace {
+
+constexpr uint64_t sip_c0 = 0x736f6d6570736575ULL;
+constexpr uint64_t sip_c1 = 0x646f72616e646f6dULL;
+constexpr uint64_t sip_c2 = 0x6c7967656e657261ULL;
+constexpr uint64_t sip_c3 = 0x7465646279746573ULL;
+
+// SipHash finalization of a 32 byte message, (length << 56).
+constexpr uint64_t sip_length = uint64_t(4) << 59;
+
+constexpr size_t words_per_hash = sizeof(hash_digest) / sizeof(uint64_t);
+
+inline
+uint64_t rotl(uint64_t x, int bits) {
+    return (x << bits) | (x >> (64 - bits));
+}
+
+// One SipRound over N independent states, written as flat loops over the
+// lanes so that each step maps to a single vector instruction.
+template <size_t N>
+inline
+void sip_round(uint64_t (&v0)[N], uint64_t (&v1)[N], uint64_t (&v2)[N], uint64_t (&v3)[N]) {
+    for (size_t i = 0; i < N; ++i) v0[i] += v1[i];
+    for (size_t i = 0; i < N; ++i) v1[i] = rotl(v1[i], 13) ^ v0[i];
+    for (size_t i = 0; i < N; ++i) v0[i] = rotl(v0[i], 32);
+    for (size_t i = 0; i < N; ++i) v2[i] += v3[i];
+    for (size_t i = 0; i < N; ++i) v3[i] = rotl(v3[i], 16) ^ v2[i];
+    for (size_t i = 0; i < N; ++i) v0[i] += v3[i];
+    for (size_t i = 0; i < N; ++i) v3[i] = rotl(v3[i], 21) ^ v0[i];
+    for (size_t i = 0; i < N; ++i) v2[i] += v1[i];
+    for (size_t i = 0; i < N; ++i) v1[i] = rotl(v1[i], 17) ^ v2[i];
+    for (size_t i = 0; i < N; ++i) v2[i] = rotl(v2[i], 32);
+}
+
+template <size_t N>
+void sip_hash_lanes(uint64_t k0, uint64_t k1, hash_digest const* hashes, uint64_t* out) {
+    uint64_t v0[N];
+    uint64_t v1[N];
+    uint64_t v2[N];
+    uint64_t v3[N];
+    uint64_t word[N];
+
+    for (size_t i = 0; i < N; ++i) {
+        v0[i] = sip_c0 ^ k0;
+        v1[i] = sip_c1 ^ k1;
+        v2[i] = sip_c2 ^ k0;
+        v3[i] = sip_c3 ^ k1;
+    }
+
+    for (size_t w = 0; w < words_per_hash; ++w) {
+        for (size_t i = 0; i < N; ++i) {
+            word[i] = from_little_endian_unsafe<uint64_t>(hashes[i].begin() + w * sizeof(uint64_t));
+            v3[i] ^= word[i];
+        }
+
+        sip_round(v0, v1, v2, v3);
+        sip_round(v0, v1, v2, v3);
+
+        for (size_t i = 0; i < N; ++i) v0[i] ^= word[i];
+    }
+
+    for (size_t i = 0; i < N; ++i) v3[i] ^= sip_length;
+    sip_round(v0, v1, v2, v3);
+    sip_round(v0, v1, v2, v3);
+
+    for (size_t i = 0; i < N; ++i) {
+        v0[i] ^= sip_length;
+        v2[i] ^= 0xff;
+    }
+
+    sip_round(v0, v1, v2, v3);
+    sip_round(v0, v1, v2, v3);
+    sip_round(v0, v1, v2, v3);
+    sip_round(v0, v1, v2, v3);
+
+    for (size_t i = 0; i < N; ++i) {
+        out[i] = (v0[i] ^ v1[i] ^ v2[i] ^ v3[i]) & short_id_mask;
+    }
+}
+
+} // namespace
+
+uint64_t short_id(uint64_t k0, uint64_t k1, hash_digest const& hash) {
+    uint64_t result;
+    sip_hash_lanes<1>(k0, k1, &hash, &result);
+    return result;
+}
+
+void short_ids(uint64_t k0, uint64_t k1, hash_digest const* hashes, size_t count, uint64_t* out) {
+    size_t index = 0;
+
+    for (; index + short_id_lanes <= count; index += short_id_lanes) {
+        sip_hash_lanes<short_id_lanes>(k0, k1, hashes + index, out + index);
+    }
+
+    // Remainder, fewer than short_id_lanes hashes.
+    for (; index < count; ++index) {
+        sip_hash_lanes<1>(k0, k1, hashes + index, out + index);
+    }
+}
+
+} // namespace kth::blockchain
@@ -0,0 +1,100 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <kth/blockchain/pools/transaction_metadata_cache.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <utility>
+
+#include <kth/domain.hpp>
+
+namespace kth::blockchain {
+
+hash_digest relay_hash(domain::chain::transaction const& tx) {
+#if defined(KTH_CURRENCY_BCH)
+    return tx.hash();
+#else
+    return tx.hash(true);
+#endif
+}
+
+// transaction_metadata
+//-----------------------------------------------------------------------------
+
+// The script parsing of the sigop count is the expensive part.
+transaction_metadata::ptr transaction_metadata::compute(domain::chain::transaction const& tx, bool bip16, bool bip141) {
+    return std::make_shared<transaction_metadata const>(transaction_metadata{
+        tx.serialized_size(true),
+        tx.signature_operations(bip16, bip141),
+        tx.fees(),
+        bip16,
+        bip141,
+        std::nullopt
+    });
+}
+
+bool transaction_metadata::counted(bool bip16, bool bip141) const {
+    return this->bip16 == bip16 && this->bip141 == bip141;
+}
+
+// transaction_metadata_cache
+//-----------------------------------------------------------------------------
+
+transaction_metadata_cache::transaction_metadata_cache(size_t capacity)
+    : capacity_(capacity)
+{}
+
+size_t transaction_metadata_cache::size() const {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    shared_lock lock(mutex_);
+    return entries_.size();
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+transaction_metadata::ptr transaction_metadata_cache::get(hash_digest const& hash) const {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    shared_lock lock(mutex_);
+    auto const it = entries_.find(hash);
+    return it == entries_.end() ? nullptr : it->second.metadata;
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+void transaction_metadata_cache::add(hash_digest const& hash, transaction_metadata::ptr metadata) {
+    if (capacity_ == 0 || ! metadata) {
+        return;
+    }
+
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+
+    entries_.insert_or_assign(hash, entry{ std::move(metadata), order_.push(hash) });
+
+    order_.evict(entries_, [this](hash_digest const& oldest) {
+        if (entries_.size() <= capacity_) {
+            return false;
+        }
+
+        entries_.erase(oldest);
+        return true;
+    });
+
+    order_.compact(entries_, 2 * capacity_);
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+void transaction_metadata_cache::remove(hash_digest const& hash) {
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    unique_lock lock(mutex_);
+    entries_.erase(hash);
+    ///////////////////////////////////////////////////////////////////////////
+}
+
+} // namespace kth::blockchain
@@ -5,10 +5,14 @@
 #include <kth/blockchain/pools/transaction_organizer.hpp>
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstddef>
 #include <functional>
 #include <future>
 #include <memory>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 
 #include <kth/blockchain/define.hpp>
@@ -24,12 +28,25 @@ using namespace std::placeholders;
 
 #define NAME "transaction_organizer"
 
+// A rejected transaction is not validated again until the next block.
+static constexpr double rejected_false_positive_rate = 0.000001;
+
+// The prevouts marked as supplied (from_mempool) are kept by population, so
+// the marks of a previous population (a mempool lookup) are cleared before
+// each validation. Otherwise a prevout since spent or evicted is not read.
+static
+void forget_outputs(domain::chain::transaction const& tx) {
+    for (auto const& input : tx.inputs()) {
+        input.previous_output().validation.from_mempool = false;
+    }
+}
+
 // TODO(legacy): create priority pool at blockchain level and use in both organizers.
 
 #if defined(KTH_WITH_MEMPOOL)
-transaction_organizer::transaction_organizer(prioritized_mutex& mutex, dispatcher& dispatch, threadpool& thread_pool, fast_chain& chain, settings const& settings, mining::mempool& mp)
+transaction_organizer::transaction_organizer(prioritized_mutex& mutex, dispatcher& dispatch, threadpool& thread_pool, fast_chain& chain, settings const& settings, transaction_metadata_cache& metadata, mining::mempool& mp)
 #else
-transaction_organizer::transaction_organizer(prioritized_mutex& mutex, dispatcher& dispatch, threadpool& thread_pool, fast_chain& chain, settings const& settings)
+transaction_organizer::transaction_organizer(prioritized_mutex& mutex, dispatcher& dispatch, threadpool& thread_pool, fast_chain& chain, settings const& settings, transaction_metadata_cache& metadata)
 #endif
     : fast_chain_(chain)
     , mutex_(mutex)
@@ -37,6 +54,10 @@ transaction_organizer::transaction_organizer(prioritized_mutex& mutex, dispatche
     , settings_(settings)
     , dispatch_(dispatch)
     , transaction_pool_(settings)
+    , transaction_metadata_(metadata)
+    , orphans_(settings.orphan_pool_size, settings.orphan_pool_bytes, std::chrono::minutes(settings.orphan_expiration_minutes))
+    , rejected_(settings.rejected_filter_size, rejected_false_positive_rate)
+    , orphan_dispatch_(thread_pool, NAME "_orphan")
 
 #if defined(KTH_WITH_MEMPOOL)
     , validator_(dispatch, fast_chain_, settings, mp)
@@ -51,6 +72,8 @@ transaction_organizer::transaction_organizer(prioritized_mutex& mutex, dispatche
 #if defined(KTH_WITH_MEMPOOL)
     , mempool_(mp)
 #endif
+
+    , ds_proofs_(settings.ds_proof_pool_bytes)
 {}
 
 // Properties.
@@ -85,14 +108,22 @@ bool transaction_organizer::stop() {
 //-----------------------------------------------------------------------------
 
 // This is called from blockchain::transaction_validate.
+// Prevouts marked by a previous population are read again.
 void transaction_organizer::transaction_validate(transaction_const_ptr tx, result_handler handler) const {
-    auto const check_handler = std::bind(&transaction_organizer::validate_handle_check, this, _1, tx, handler);
+    forget_outputs(*tx);
+    transaction_validate(tx, true, handler);
+}
+
+// private
+// The price is not checked for a package member, but for the package.
+void transaction_organizer::transaction_validate(transaction_const_ptr tx, bool check_price, result_handler handler) const {
+    auto const check_handler = std::bind(&transaction_organizer::validate_handle_check, this, _1, tx, check_price, handler);
     // Checks that are independent of chain state.
     validator_.check(tx, check_handler);
 }
 
 // private
-void transaction_organizer::validate_handle_check(code const& ec, transaction_const_ptr tx, result_handler handler) const {
+void transaction_organizer::validate_handle_check(code const& ec, transaction_const_ptr tx, bool check_price, result_handler handler) const {
     if (stopped()) {
         handler(error::service_stopped);
         return;
@@ -103,13 +134,13 @@ void transaction_organizer::validate_handle_check(code const& ec, transaction_co
         return;
     }
 
-    auto const accept_handler = std::bind(&transaction_organizer::validate_handle_accept, this, _1, tx, handler);
+    auto const accept_handler = std::bind(&transaction_organizer::validate_handle_accept, this, _1, tx, check_price, handler);
     // Checks that are dependent on chain state and prevouts.
     validator_.accept(tx, accept_handler);
 }
 
 // private
-void transaction_organizer::validate_handle_accept(code const& ec, transaction_const_ptr tx, result_handler handler) const {
+void transaction_organizer::validate_handle_accept(code const& ec, transaction_const_ptr tx, bool check_price, result_handler handler) const {
     if (stopped()) {
         handler(error::service_stopped);
         return;
@@ -120,24 +151,31 @@ void transaction_organizer::validate_handle_accept(code const& ec, transaction_c
         return;
     }
 
-    if (tx->fees() < price(tx)) {
+    // Measured once here, the mempool and block validation reuse these.
+    auto const metadata = measure(tx);
+
+    if (check_price && metadata->fees < price(*metadata)) {
         handler(error::insufficient_fee);
         return;
     }
 
+    transaction_metadata_.add(relay_hash(*tx), metadata);
+
     if (tx->is_dusty(settings_.minimum_output_satoshis)) {
         handler(error::dusty_transaction);
         return;
     }
 
-    auto const connect_handler = std::bind(&transaction_organizer::validate_handle_connect, this, _1, tx, handler);
+    auto const connect_handler = std::bind(&transaction_organizer::validate_handle_connect, this, _1, _2, tx, metadata, handler);
 
     // Checks that include script validation.
     validator_.connect(tx, connect_handler);
 }
 
 // private
-void transaction_organizer::validate_handle_connect(code const& ec, transaction_const_ptr tx, result_handler handler) const {
+// The sigchecks are recorded so that block validation counts them for the
+// transaction without running its scripts again.
+void transaction_organizer::validate_handle_connect(code const& ec, size_t sigchecks, transaction_const_ptr tx, transaction_metadata::ptr metadata, result_handler handler) const {
     if (stopped()) {
         handler(error::service_stopped);
         return;
@@ -148,6 +186,10 @@ void transaction_organizer::validate_handle_connect(code const& ec, transaction_
         return;
     }
 
+    auto connected = *metadata;
+    connected.sigchecks = sigchecks;
+    transaction_metadata_.add(relay_hash(*tx), std::make_shared<transaction_metadata const>(std::move(connected)));
+
     handler(error::success);
     return;
 }
@@ -156,171 +198,737 @@ void transaction_organizer::validate_handle_connect(code const& ec, transaction_
 //-----------------------------------------------------------------------------
 
 // This is called from blockchain::organize.
+// The proof is indexed by the pooled transaction it proves double spent.
+// A proof is verified against that transaction and the output it spends
+// before it is pooled, so an invalid proof cannot take the outpoint. Without
+// the mempool there is no pooled spend to verify against.
 void transaction_organizer::organize(double_spend_proof_const_ptr ds_proof, result_handler handler) {
-    // Critical Section
-    ///////////////////////////////////////////////////////////////////////////
-    mutex_.lock_low_priority();
-
     if (stopped()) {
-        mutex_.unlock_low_priority();
         handler(error::service_stopped);
         return;
     }
 
-    ds_proofs_.try_emplace(hash(*ds_proof), ds_proof);
+#if defined(KTH_WITH_MEMPOOL)
+    domain::chain::output_point const& out_point = ds_proof->out_point();
+    auto const spending = mempool_.spending(out_point);
+    if ( ! spending.is_valid()) {
+        handler(error::not_found);
+        return;
+    }
 
-    mutex_.unlock_low_priority();
-    ///////////////////////////////////////////////////////////////////////////
+    domain::chain::output spent;
+    if ( ! get_spent_output(spent, out_point)) {
+        handler(error::missing_previous_output);
+        return;
+    }
+
+    if ( ! ds_proof_pool::verify(*ds_proof, spending, spent)) {
+        handler(error::invalid_signature_encoding);
+        return;
+    }
 
-    // This gets picked up by node DSProof-out protocol for announcement to peers.
-    notify_ds_proof(ds_proof);
+    // A proof already known for the outpoint is not announced again.
+    if (ds_proofs_.add(ds_proof, spending.hash())) {
+        // This gets picked up by node DSProof-out protocol for announcement to peers.
+        notify_ds_proof(ds_proof);
+    }
 
-    // Invoke caller handler outside of critical section.
     handler(error::success);
+#else
+    handler(error::not_found);
+#endif
 }
 
 // Transaction Organize sequence.
 //-----------------------------------------------------------------------------
 
 // This is called from blockchain::organize.
+// A transaction already being organized (announced by several peers at once)
+// is not organized again, the handler is attached to the pending result.
 void transaction_organizer::organize(transaction_const_ptr tx, result_handler handler) {
+    if (tx->validation.simulate) {
+        handler(organize_transaction(tx));
+        return;
+    }
+
+    auto const hash = relay_hash(*tx);
+
+    {
+        // Critical Section
+        ///////////////////////////////////////////////////////////////////////
+        unique_lock lock(in_flight_mutex_);
+
+        auto const it = in_flight_.find(hash);
+        if (it != in_flight_.end()) {
+            it->second.push_back(std::move(handler));
+            return;
+        }
+
+        in_flight_.emplace(hash, std::vector<result_handler>{ std::move(handler) });
+
+#if ! defined(KTH_CURRENCY_BCH)
+        in_flight_txids_.emplace(tx->hash(), hash);
+#endif
+        ///////////////////////////////////////////////////////////////////////
+    }
+
+    organize_in_flight(tx);
+}
+
+// private
+// Transactions are validated concurrently, so a transaction spending one
+// still being organized waits for it (attached to its pending result) rather
+// than failing on a missing prevout. It is then organized again on the
+// network pool, where it waits for any other parent being organized.
+void transaction_organizer::organize_in_flight(transaction_const_ptr tx) {
+    {
+        // Critical Section
+        ///////////////////////////////////////////////////////////////////////
+        unique_lock lock(in_flight_mutex_);
+
+        for (auto const& input : tx->inputs()) {
+            auto const parent = find_in_flight_unlocked(input.previous_output().hash());
+            if (parent != in_flight_.end()) {
+                parent->second.push_back([this, tx](code const&) {
+                    orphan_dispatch_.concurrent([this, tx]() {
+                        organize_in_flight(tx);
+                    });
+                });
+                return;
+            }
+        }
+        ///////////////////////////////////////////////////////////////////////
+    }
+
+    auto const ec = organize_transaction(tx);
+    std::vector<result_handler> handlers;
+
+    {
+        // Critical Section
+        ///////////////////////////////////////////////////////////////////////
+        unique_lock lock(in_flight_mutex_);
+
+        auto const hash = relay_hash(*tx);
+        auto const it = in_flight_.find(hash);
+        handlers = std::move(it->second);
+        in_flight_.erase(it);
+
+#if ! defined(KTH_CURRENCY_BCH)
+        auto const range = in_flight_txids_.equal_range(tx->hash());
+        auto const txid = std::find_if(range.first, range.second, [&hash](auto const& entry) {
+            return entry.second == hash;
+        });
+
+        in_flight_txids_.erase(txid);
+#endif
+        ///////////////////////////////////////////////////////////////////////
+    }
+
+    // Invoke caller handlers outside of critical section.
+    for (auto const& handler : handlers) {
+        handler(ec);
+    }
+}
+
+// private
+// In flight transactions are by relay hash, spends of them are by txid.
+transaction_organizer::in_flight_map::iterator transaction_organizer::find_in_flight_unlocked(hash_digest const& txid) {
+#if defined(KTH_CURRENCY_BCH)
+    return in_flight_.find(txid);
+#else
+    auto const it = in_flight_txids_.find(txid);
+    return it == in_flight_txids_.end() ? in_flight_.end() : in_flight_.find(it->second);
+#endif
+}
+
+// private
+// Transactions are validated concurrently against the chain state taken by
+// accept, the lock is held only to commit. A block organized meanwhile may
+// have spent or created prevouts (or changed the forks), so a transaction
+// validated with a previous chain state is validated again.
+code transaction_organizer::organize_transaction(transaction_const_ptr tx) {
+    if (stopped()) {
+        return error::service_stopped;
+    }
+
+    // A false positive only delays the transaction until the next block.
+    if ( ! tx->validation.simulate && rejected_.contains(relay_hash(*tx))) {
+        return error::duplicate_transaction;
+    }
+
+    auto ec = validate(tx);
+
+    if (ec || tx->validation.simulate) {
+        reject(tx, ec);
+        return ec;
+    }
+
     // Critical Section
     ///////////////////////////////////////////////////////////////////////////
     mutex_.lock_low_priority();
 
-    if (stopped()) {
+    while ( ! ec && ! stopped() && tx->validation.state != fast_chain_.chain_state()) {
         mutex_.unlock_low_priority();
-        handler(error::service_stopped);
-        return;
+        ec = validate(tx);
+        mutex_.lock_low_priority();
     }
 
-    // Reset the reusable promise.
-    resume_ = std::promise<code>();
+    if ( ! ec) {
+        ec = stopped() ? error::service_stopped : commit(tx);
+    }
 
-    result_handler const complete = std::bind(&transaction_organizer::signal_completion, this, _1);
-    auto const check_handler = std::bind(&transaction_organizer::handle_check, this, _1, tx, complete);
+    mutex_.unlock_low_priority();
+    ///////////////////////////////////////////////////////////////////////////
 
-    // Checks that are independent of chain state.
-    validator_.check(tx, check_handler);
+    reject(tx, ec);
+    return ec;
+}
 
-    // Wait on completion signal.
-    // This is necessary in order to continue on a non-priority thread.
-    // If we do not wait on the original thread there may be none left.
-    auto ec = resume_.get_future().get();
+// private
+// Wait on completion of the validation sequence.
+// This is necessary in order to continue on a non-priority thread.
+// If we do not wait on the original thread there may be none left.
+code transaction_organizer::validate(transaction_const_ptr tx) const {
+    std::promise<code> resume;
 
-    mutex_.unlock_low_priority();
-    ///////////////////////////////////////////////////////////////////////////
+    transaction_validate(tx, [&resume](code const& ec) {
+        resume.set_value(ec);
+    });
 
-    // Invoke caller handler outside of critical section.
-    handler(ec);
+    return resume.get_future().get();
 }
 
 // private
-void transaction_organizer::signal_completion(code const& ec) {
-    // This must be protected so that it is properly cleared.
-    // Signal completion, which results in original handler invoke with code.
-    resume_.set_value(ec);
+// Conflicts with pooled transactions are detected by the mempool insert.
+code transaction_organizer::commit(transaction_const_ptr tx) {
+#if defined(KTH_WITH_MEMPOOL)
+    auto const metadata = transaction_metadata_.get(relay_hash(*tx));
+    auto res = metadata ? mempool_.add(*tx, metadata->sigops) : mempool_.add(*tx);
+    if (res == error::double_spend_mempool || res == error::double_spend_blockchain) {
+        prove_double_spend(tx);
+        return res;
+    }
+    // LOG_INFO(LOG_BLOCKCHAIN, "Transaction ", encode_hash(tx->hash()), " added to mempool.");
+#endif
+
+#if ! defined(KTH_DB_READONLY)
+    std::promise<code> pushed;
+
+    //#########################################################################
+    fast_chain_.push(tx, dispatch_, [&pushed](code const& ec) {
+        pushed.set_value(ec);
+    });
+    //#########################################################################
+
+    auto const ec = pushed.get_future().get();
+    if (ec) {
+        LOG_FATAL(LOG_BLOCKCHAIN, "Failure writing transaction to store, is now corrupted: ", ec.message());
+        return ec;
+    }
+
+    // This gets picked up by node tx-out protocol for announcement to peers.
+    notify(tx);
+#endif
+
+    resolve_orphans(tx->hash());
+    return error::success;
 }
 
-// Verify sub-sequence.
-//-----------------------------------------------------------------------------
+#if defined(KTH_WITH_MEMPOOL)
+// private
+// The output is pooled or confirmed.
+bool transaction_organizer::get_spent_output(domain::chain::output& out, domain::chain::output_point const& out_point) const {
+    out = mempool_.get_utxo(out_point);
+    if (out.is_valid()) {
+        return true;
+    }
+
+    size_t height;
+    uint32_t median_time_past;
+    bool coinbase;
+    return fast_chain_.get_utxo(out, height, median_time_past, coinbase, out_point, max_size_t);
+}
 
 // private
-void transaction_organizer::handle_check(code const& ec, transaction_const_ptr tx, result_handler handler) {
-    if (stopped()) {
-        handler(error::service_stopped);
+// The proof of the first provable conflict with a pooled transaction is
+// published as if received, the pooled one is indexed as double spent. The
+// proof is verified as a received one is, so no proof is published that
+// peers (or this node) would refuse.
+void transaction_organizer::prove_double_spend(transaction_const_ptr tx) {
+    for (auto const& input : tx->inputs()) {
+        auto const& prevout = input.previous_output();
+        auto const conflict = mempool_.spending(prevout);
+        if ( ! conflict.is_valid()) {
+            continue;
+        }
+
+        auto const ds_proof = ds_proof_pool::create(conflict, *tx, prevout);
+        if ( ! ds_proof) {
+            continue;
+        }
+
+        domain::chain::output spent;
+        if ( ! get_spent_output(spent, prevout) || ! ds_proof_pool::verify(*ds_proof, conflict, spent)) {
+            continue;
+        }
+
+        if (ds_proofs_.add(ds_proof, conflict.hash())) {
+            // This gets picked up by node DSProof-out protocol for announcement to peers.
+            notify_ds_proof(ds_proof);
+        }
+
         return;
     }
+}
+#endif
 
-    if (ec) {
-        handler(ec);
-        return;
+// private
+// Children are organized again (those still missing prevouts are pooled
+// again) on the network pool, as organize waits on the priority pool.
+void transaction_organizer::resolve_orphans(hash_digest const& parent_hash) {
+    for (auto const& child : orphans_.take(parent_hash)) {
+        orphan_dispatch_.concurrent([this, child]() {
+            organize(child, [](code const&) {});
+        });
     }
+}
 
-    auto const accept_handler = std::bind(&transaction_organizer::handle_accept, this, _1, tx, handler);
+// private
+// A parent stored after the orphan was validated but before it was pooled
+// resolved its orphans without it. The parents are read after the add, so
+// either the parent's resolution takes the orphan or the parent is read here.
+void transaction_organizer::resolve_stored_parents(domain::chain::transaction const& tx) {
+    size_t height;
+    size_t position;
+    hash_list parents;
+
+    for (auto const& input : tx.inputs()) {
+        auto const& prevout = input.previous_output();
+        if ( ! prevout.validation.cache.is_valid() && std::find(parents.begin(), parents.end(), prevout.hash()) == parents.end()) {
+            parents.push_back(prevout.hash());
+        }
+    }
 
-    // Checks that are dependent on chain state and prevouts.
-    validator_.accept(tx, accept_handler);
+    for (auto const& parent : parents) {
+        if (fast_chain_.get_transaction_position(height, position, parent, false)) {
+            resolve_orphans(parent);
+        }
+    }
 }
 
 // private
-void transaction_organizer::handle_accept(code const& ec, transaction_const_ptr tx, result_handler handler) {
-    if (stopped()) {
-        handler(error::service_stopped);
+// Transactions missing prevouts are pooled, the others are not validated
+// again until the chain state changes.
+void transaction_organizer::reject(transaction_const_ptr tx, code const& ec) {
+    if ( ! ec || ec == error::service_stopped || tx->validation.simulate) {
         return;
     }
 
-    if (ec) {
-        handler(ec);
+    if (ec == error::missing_previous_output) {
+        if (orphans_.add(tx)) {
+            resolve_stored_parents(*tx);
+        }
+
         return;
     }
 
-    if (tx->fees() < price(tx)) {
-        handler(error::insufficient_fee);
-        return;
+    rejected_.insert(relay_hash(*tx));
+}
+
+void transaction_organizer::reset_rejected() {
+    rejected_.reset();
+}
+
+void transaction_organizer::remove_ds_proofs(block_const_ptr_list_const_ptr blocks) {
+    for (auto const& block : *blocks) {
+        ds_proofs_.remove_spent(*block);
     }
+}
 
-    if (tx->is_dusty(settings_.minimum_output_satoshis)) {
-        handler(error::dusty_transaction);
+void transaction_organizer::resolve_orphans(block_const_ptr_list_const_ptr blocks) {
+    if (orphans_.size() == 0) {
         return;
     }
 
-    auto const connect_handler = std::bind(&transaction_organizer::handle_connect, this, _1, tx, handler);
+    for (auto const& block : *blocks) {
+        for (auto const& tx : block->transactions()) {
+            resolve_orphans(tx.hash());
+        }
+    }
+}
 
-    // Checks that include script validation.
-    validator_.connect(tx, connect_handler);
+// Transaction Batch Organize sequence.
+//-----------------------------------------------------------------------------
+
+// The outputs of the (successful) parents in the list are supplied to the
+// transactions, so these are not read from the store or the mempool. Only
+// the prevouts supplied here are left marked.
+static
+void supply_outputs(transaction_const_ptr_list const& list, std::unordered_map<hash_digest, size_t> const& positions, std::vector<size_t> const& indexes, std::vector<code> const& results) {
+    for (auto const index : indexes) {
+        forget_outputs(*list[index]);
+
+        for (auto const& input : list[index]->inputs()) {
+            auto const& prevout = input.previous_output();
+            auto const parent = positions.find(prevout.hash());
+            if (parent == positions.end() || results[parent->second] != error::success) {
+                continue;
+            }
+
+            auto const& outputs = list[parent->second]->outputs();
+            if (prevout.index() < outputs.size()) {
+                prevout.validation.cache = outputs[prevout.index()];
+                prevout.validation.from_mempool = true;
+            }
+        }
+    }
+}
+
+// This is called from blockchain::organize.
+// The batch is admitted in waves, each of the transactions whose parents in
+// the batch have been admitted. The outputs of admitted parents are supplied
+// to their children, so these are not read from the store or the mempool.
+// Transactions not reached when stopped are left as service_stopped.
+void transaction_organizer::organize(transaction_const_ptr_list_const_ptr txs, organize_results_handler handler) {
+    auto const& list = *txs;
+    std::vector<code> results(list.size(), error::service_stopped);
+
+    std::unordered_map<hash_digest, size_t> positions;
+    for (size_t index = 0; index < list.size(); ++index) {
+        positions.emplace(list[index]->hash(), index);
+    }
+
+    // The number of parents in the batch of each transaction, and the
+    // children in the batch of each transaction.
+    std::vector<size_t> waiting(list.size(), 0);
+    std::vector<std::vector<size_t>> children(list.size());
+    std::vector<size_t> wave;
+
+    for (size_t index = 0; index < list.size(); ++index) {
+        std::unordered_set<size_t> parents;
+        for (auto const& input : list[index]->inputs()) {
+            auto const parent = positions.find(input.previous_output().hash());
+            if (parent != positions.end() && parent->second != index) {
+                parents.insert(parent->second);
+            }
+        }
+
+        for (auto const parent : parents) {
+            children[parent].push_back(index);
+        }
+
+        waiting[index] = parents.size();
+        if (parents.empty()) {
+            wave.push_back(index);
+        }
+    }
+
+    while ( ! wave.empty() && ! stopped()) {
+        admit(list, positions, wave, results);
+
+        std::vector<size_t> next;
+        for (auto const index : wave) {
+            for (auto const child : children[index]) {
+                if (--waiting[child] == 0) {
+                    next.push_back(child);
+                }
+            }
+        }
+
+        wave = std::move(next);
+    }
+
+    handler(stopped() ? error::service_stopped : error::success, results);
 }
 
 // private
-void transaction_organizer::handle_connect(code const& ec, transaction_const_ptr tx, result_handler handler) {
+// The transactions are validated concurrently.
+std::vector<code> transaction_organizer::validate(transaction_const_ptr_list const& txs, std::vector<size_t> const& indexes, bool check_price) const {
+    std::vector<code> results(indexes.size());
+
+    if (indexes.empty()) {
+        return results;
+    }
+
+    std::promise<void> resume;
+    std::atomic<size_t> remaining(indexes.size());
+
+    for (size_t position = 0; position < indexes.size(); ++position) {
+        transaction_validate(txs[indexes[position]], check_price, [&, position](code const& ec) {
+            results[position] = ec;
+            if (--remaining == 0) {
+                resume.set_value();
+            }
+        });
+    }
+
+    resume.get_future().get();
+    return results;
+}
+
+// private
+// The valid transactions are committed under one lock, those validated with
+// a previous chain state are validated again.
+void transaction_organizer::admit(transaction_const_ptr_list const& txs, std::unordered_map<hash_digest, size_t> const& positions, std::vector<size_t> pending, std::vector<code>& results) {
+    std::erase_if(pending, [&](size_t index) {
+        auto const& tx = txs[index];
+        if (tx->validation.simulate || ! rejected_.contains(relay_hash(*tx))) {
+            return false;
+        }
+
+        results[index] = error::duplicate_transaction;
+        return true;
+    });
+
+    while ( ! pending.empty()) {
+        supply_outputs(txs, positions, pending, results);
+        auto const validated = validate(txs, pending, true);
+
+        std::vector<size_t> valid;
+        for (size_t position = 0; position < pending.size(); ++position) {
+            auto const index = pending[position];
+            results[index] = validated[position];
+            reject(txs[index], validated[position]);
+
+            if ( ! validated[position] && ! txs[index]->validation.simulate) {
+                valid.push_back(index);
+            }
+        }
+
+        pending.clear();
+
+        if (valid.empty()) {
+            return;
+        }
+
+        // Critical Section
+        ///////////////////////////////////////////////////////////////////////
+        mutex_.lock_low_priority();
+
+        auto const state = fast_chain_.chain_state();
+        for (auto const index : valid) {
+            if (stopped()) {
+                results[index] = error::service_stopped;
+            } else if (txs[index]->validation.state != state) {
+                pending.push_back(index);
+            } else {
+                results[index] = commit(txs[index]);
+                reject(txs[index], results[index]);
+            }
+        }
+
+        mutex_.unlock_low_priority();
+        ///////////////////////////////////////////////////////////////////////
+    }
+}
+
+// Package Organize sequence.
+//-----------------------------------------------------------------------------
+
+// This is called from blockchain::organize_package.
+// Each wave holds the transactions whose parents in the package are in the
+// previous waves. A wave is validated concurrently, with the outputs of the
+// parents supplied, and nothing is committed until the whole package is
+// valid. A package validated with a previous chain state is validated again.
+// The rejected filter is not used, as a member rejected for its own fee may
+// be paid for by a child.
+void transaction_organizer::organize_package(transaction_const_ptr_list_const_ptr txs, bool test_accept, organize_results_handler handler) {
+    auto const& list = *txs;
+    std::vector<code> results(list.size(), error::service_stopped);
+
     if (stopped()) {
-        handler(error::service_stopped);
+        handler(error::service_stopped, results);
         return;
     }
 
-    if (ec) {
-        handler(ec);
-        return;
+    std::unordered_map<hash_digest, size_t> positions;
+    for (size_t index = 0; index < list.size(); ++index) {
+        if ( ! positions.emplace(list[index]->hash(), index).second) {
+            handler(error::duplicate_transaction, results);
+            return;
+        }
     }
 
-    // TODO: create a simulated validation path that does not block others.
-    if (tx->validation.simulate) {
-        handler(error::success);
-        return;
+    // The depth of a transaction is one more than that of its deepest parent.
+    std::vector<size_t> depths(list.size(), 0);
+    std::vector<std::vector<size_t>> waves;
+
+    for (size_t index = 0; index < list.size(); ++index) {
+        for (auto const& input : list[index]->inputs()) {
+            auto const parent = positions.find(input.previous_output().hash());
+            if (parent == positions.end()) {
+                continue;
+            }
+
+            if (parent->second >= index) {
+                handler(error::operation_failed, results);
+                return;
+            }
+
+            depths[index] = std::max(depths[index], depths[parent->second] + 1);
+        }
+
+        if (depths[index] == waves.size()) {
+            waves.emplace_back();
+        }
+
+        waves[depths[index]].push_back(index);
     }
 
-#if defined(KTH_WITH_MEMPOOL)
-    auto res = mempool_.add(*tx);
-    if (res == error::double_spend_mempool || res == error::double_spend_blockchain) {
-        handler(res);
+    // The package is the last transaction with its ancestors, so the fees of
+    // a member cannot pay for an unrelated transaction.
+    std::vector<bool> connected(list.size(), false);
+    if ( ! list.empty()) {
+        connected.back() = true;
+    }
+
+    for (auto index = list.size(); index-- > 0;) {
+        if ( ! connected[index]) {
+            handler(error::operation_failed, results);
+            return;
+        }
+
+        for (auto const& input : list[index]->inputs()) {
+            auto const parent = positions.find(input.previous_output().hash());
+            if (parent != positions.end()) {
+                connected[parent->second] = true;
+            }
+        }
+    }
+
+    auto ec = validate_package(list, positions, waves, results);
+
+    if (ec || test_accept) {
+        handler(ec, results);
         return;
     }
-    // LOG_INFO(LOG_BLOCKCHAIN, "Transaction ", encode_hash(tx->hash()), " added to mempool.");
-#endif
 
-#if ! defined(KTH_DB_READONLY)
-    auto const pushed_handler = std::bind(&transaction_organizer::handle_pushed, this, _1, tx, handler);
-    //#########################################################################
-    fast_chain_.push(tx, dispatch_, pushed_handler);
-    //#########################################################################
-#endif
+    auto const stale = [this, &list]() {
+        auto const state = fast_chain_.chain_state();
+        return std::any_of(list.begin(), list.end(), [&state](auto const& tx) {
+            return tx->validation.state != state;
+        });
+    };
+
+    // Critical Section
+    ///////////////////////////////////////////////////////////////////////////
+    mutex_.lock_low_priority();
+
+    while ( ! ec && ! stopped() && stale()) {
+        mutex_.unlock_low_priority();
+        ec = validate_package(list, positions, waves, results);
+        mutex_.lock_low_priority();
+    }
+
+    if ( ! ec && stopped()) {
+        ec = error::service_stopped;
+    }
+
+    // Conflicts are found before any member is committed, so that these do
+    // not leave the package partly committed. A member still refused by the
+    // mempool, or a failed store write, stops the commit with the members
+    // before it committed.
+    if ( ! ec) {
+        ec = package_conflict(list, positions);
+        if (ec) {
+            std::fill(results.begin(), results.end(), ec);
+        }
+    }
+
+    for (size_t index = 0; index < list.size() && ! ec; ++index) {
+        ec = commit(list[index]);
+        if (ec) {
+            std::fill(results.begin() + index, results.end(), ec);
+        }
+    }
+
+    mutex_.unlock_low_priority();
+    ///////////////////////////////////////////////////////////////////////////
+
+    // Invoke caller handler outside of critical section.
+    handler(ec, results);
 }
 
-#if ! defined(KTH_DB_READONLY)
 // private
-void transaction_organizer::handle_pushed(code const& ec, transaction_const_ptr tx, result_handler handler) {
-    if (ec) {
-        LOG_FATAL(LOG_BLOCKCHAIN, "Failure writing transaction to store, is now corrupted: ", ec.message());
-        handler(ec);
-        return;
+// The package fails with its first failing transaction, otherwise with
+// insufficient_fee if its fees do not pay the sum of the prices.
+code transaction_organizer::validate_package(transaction_const_ptr_list const& txs, std::unordered_map<hash_digest, size_t> const& positions, std::vector<std::vector<size_t>> const& waves, std::vector<code>& results) const {
+    std::fill(results.begin(), results.end(), error::service_stopped);
+
+    for (auto const& wave : waves) {
+        if (stopped()) {
+            return error::service_stopped;
+        }
+
+        supply_outputs(txs, positions, wave, results);
+        auto const validated = validate(txs, wave, false);
+
+        for (size_t position = 0; position < wave.size(); ++position) {
+            results[wave[position]] = validated[position];
+        }
     }
 
-    // This gets picked up by node tx-out protocol for announcement to peers.
-    notify(tx);
+    for (auto const& ec : results) {
+        if (ec) {
+            return ec;
+        }
+    }
 
-    handler(error::success);
+    uint64_t fees = 0;
+    uint64_t prices = 0;
+    for (auto const& tx : txs) {
+        auto metadata = transaction_metadata_.get(relay_hash(*tx));
+        if ( ! metadata) {
+            metadata = measure(tx);
+        }
+
+        fees = ceiling_add(fees, metadata->fees);
+        prices = ceiling_add(prices, price(*metadata));
+    }
+
+    return fees < prices ? error::insufficient_fee : error::success;
+}
+
+// private
+// This must be called under the lock. A member already pooled, a prevout
+// spent by another member or by a pooled transaction, or a pooled parent no
+// longer pooled, is a conflict arising since validation. Without the mempool
+// the store does not index the spenders of its unconfirmed transactions, so
+// as for a single transaction only the conflicts between members are found.
+code transaction_organizer::package_conflict(transaction_const_ptr_list const& txs, std::unordered_map<hash_digest, size_t> const& positions) const {
+    std::unordered_set<domain::chain::point> spent;
+
+    for (auto const& tx : txs) {
+#if defined(KTH_WITH_MEMPOOL)
+        if (mempool_.contains(tx->hash())) {
+            return error::duplicate_transaction;
+        }
+#endif
+
+        for (auto const& input : tx->inputs()) {
+            auto const& prevout = input.previous_output();
+            if ( ! spent.insert(prevout).second) {
+                return error::double_spend_mempool;
+            }
+
+            if (positions.find(prevout.hash()) != positions.end()) {
+                continue;
+            }
+
+#if defined(KTH_WITH_MEMPOOL)
+            if (mempool_.spender(prevout) != null_hash) {
+                return prevout.validation.from_mempool ? error::double_spend_mempool : error::double_spend_blockchain;
+            }
+
+            if (prevout.validation.from_mempool && ! mempool_.get_utxo(prevout).is_valid()) {
+                return error::missing_previous_output;
+            }
+#endif
+        }
+    }
+
+    return error::success;
 }
-#endif // ! defined(KTH_DB_READONLY)
 
 // Subscription.
 //-----------------------------------------------------------------------------
@@ -364,40 +972,39 @@ void transaction_organizer::fetch_mempool(size_t maximum, inventory_fetch_handle
 }
 
 void transaction_organizer::fetch_ds_proof(hash_digest const& hash, ds_proof_fetch_handler handler) const {
-    // Critical Section
-    ///////////////////////////////////////////////////////////////////////////
-    mutex_.lock_low_priority();
-
-    auto it = ds_proofs_.find(hash);
-    if (it == ds_proofs_.end()) {
-        mutex_.unlock_low_priority();
-        handler(error::not_found, nullptr);
-        return;
-    }
-
-    auto const res = it->second;
-
-    mutex_.unlock_low_priority();
-    ///////////////////////////////////////////////////////////////////////////
+    auto const ds_proof = ds_proofs_.get(hash);
+    handler(ds_proof ? error::success : error::not_found, ds_proof);
+}
 
-    // Invoke caller handler outside of critical section.
-    handler(error::success, res);
+void transaction_organizer::fetch_transaction_ds_proof(hash_digest const& hash, ds_proof_fetch_handler handler) const {
+    auto const ds_proof = ds_proofs_.find_transaction(hash);
+    handler(ds_proof ? error::success : error::not_found, ds_proof);
 }
 
 // Utility.
 //-----------------------------------------------------------------------------
 
-uint64_t transaction_organizer::price(transaction_const_ptr tx) const {
+// private
+transaction_metadata::ptr transaction_organizer::measure(transaction_const_ptr tx) const {
+    auto const& state = *tx->validation.state;
+    auto const bip16 = state.is_enabled(domain::machine::rule_fork::bip16_rule);
+#if defined(KTH_CURRENCY_BCH)
+    auto const bip141 = false;
+#else
+    auto const bip141 = state.is_enabled(domain::machine::rule_fork::bip141_rule);
+#endif
+    return transaction_metadata::compute(*tx, bip16, bip141);
+}
+
+uint64_t transaction_organizer::price(transaction_metadata const& metadata) const {
     auto const byte_fee = settings_.byte_fee_satoshis;
     auto const sigop_fee = settings_.sigop_fee_satoshis;
 
     // Guard against summing signed values by testing independently.
     if (byte_fee == 0.0f && sigop_fee == 0.0f) return 0;
 
-    // TODO: this is a second pass on size and sigops, implement cache.
-    // This at least prevents uncached calls when zero fee is configured.
-    auto byte = byte_fee > 0 ? byte_fee * tx->serialized_size(true) : 0;
-    auto sigop = sigop_fee > 0 ? sigop_fee * tx->signature_operations() : 0;
+    auto byte = byte_fee > 0 ? byte_fee * metadata.serialized_size : 0;
+    auto sigop = sigop_fee > 0 ? sigop_fee * metadata.sigops : 0;
 
     // Require at least one satoshi per tx if there are any fees configured.
     return std::max(uint64_t(1), static_cast<uint64_t>(byte + sigop));
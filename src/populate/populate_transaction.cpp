@@ -85,6 +85,13 @@ void populate_transaction::populate_inputs(transaction_const_ptr tx, size_t chai
     for (auto input_index = bucket; input_index < inputs.size(); input_index = ceiling_add(input_index, buckets)) {
         auto const& input = inputs[input_index];
         auto const& prevout = input.previous_output();
+
+        // Prevouts supplied by parents in the same batch are kept. The marks
+        // of a previous population are cleared by the organizer.
+        if (prevout.validation.from_mempool && prevout.validation.cache.is_valid()) {
+            continue;
+        }
+
         populate_prevout(chain_height, prevout, false);
 
 #if defined(KTH_WITH_MEMPOOL)
@@ -9,6 +9,7 @@
 #include <cstdint>
 #include <functional>
 #include <memory>
+#include <numeric>
 
 #include <kth/blockchain/interface/fast_chain.hpp>
 #include <kth/blockchain/pools/branch.hpp>
@@ -36,14 +37,16 @@ using namespace std::placeholders;
 // will never be invoked, resulting in a threadpool.join indefinite hang.
 
 #if defined(KTH_WITH_MEMPOOL)
-validate_block::validate_block(dispatcher& dispatch, fast_chain const& chain, settings const& settings, domain::config::network network, bool relay_transactions, mining::mempool const& mp)
+validate_block::validate_block(dispatcher& dispatch, fast_chain const& chain, settings const& settings, domain::config::network network, bool relay_transactions, block_metadata_cache& metadata, transaction_metadata_cache& transaction_metadata, mining::mempool const& mp)
 #else
-validate_block::validate_block(dispatcher& dispatch, fast_chain const& chain, settings const& settings, domain::config::network network, bool relay_transactions)
+validate_block::validate_block(dispatcher& dispatch, fast_chain const& chain, settings const& settings, domain::config::network network, bool relay_transactions, block_metadata_cache& metadata, transaction_metadata_cache& transaction_metadata)
 #endif
     : stopped_(true)
     , fast_chain_(chain)
     , network_(network)
     , priority_dispatch_(dispatch)
+    , block_metadata_(metadata)
+    , transaction_metadata_(transaction_metadata)
 #if defined(KTH_WITH_MEMPOOL)
     , block_populator_(dispatch, chain, relay_transactions, mp)
 #else
@@ -210,7 +213,14 @@ void validate_block::accept_transactions(block_const_ptr block, size_t bucket, s
         } else {
             // LOG_INFO(LOG_BLOCKCHAIN, "Transaction ", encode_hash(transaction.hash()), " validation could be skiped.");
         }
-        *sigops += transaction.signature_operations(bip16, bip141);
+
+        // Transactions measured by the mempool are not parsed again.
+        auto const metadata = transaction_metadata_.get(relay_hash(transaction));
+        if (metadata && metadata->counted(bip16, bip141)) {
+            *sigops += metadata->sigops;
+        } else {
+            *sigops += transaction.signature_operations(bip16, bip141);
+        }
     }
 
     handler(ec);
@@ -257,6 +267,7 @@ void validate_block::connect(branch::const_ptr branch, result_handler handler) c
 
     // Return if there are no non-coinbase inputs to validate.
     if (non_coinbase_inputs == 0) {
+        add_metadata(*block, 0);
         handler(error::success);
         return;
     }
@@ -264,6 +275,10 @@ void validate_block::connect(branch::const_ptr branch, result_handler handler) c
     // Reset statistics for each block (treat coinbase as cached).
     hits_ = 0;
     queries_ = 0;
+    sigchecks_ = 0;
+
+    // Counts the skipped transactions, before the buckets run.
+    auto const skipped = skipped_transactions(*block);
 
     result_handler complete_handler = std::bind(&validate_block::handle_connected, this, _1, block, handler);
 
@@ -274,37 +289,53 @@ void validate_block::connect(branch::const_ptr branch, result_handler handler) c
     auto const join_handler = synchronize(std::move(complete_handler), buckets, NAME "_validate");
 
     for (size_t bucket = 0; bucket < buckets; ++bucket) {
-        priority_dispatch_.concurrent(&validate_block::connect_inputs, this, block, bucket, buckets, join_handler);
+        priority_dispatch_.concurrent(&validate_block::connect_inputs, this, block, bucket, buckets, skipped, join_handler);
+    }
+}
+
+// Scripts validated by the mempool (with the current fork state) are not run
+// again, the sigchecks it recorded for them are counted instead. Without a
+// record the scripts are run, so that the block count is exact. This is
+// decided once, so that all buckets skip the same transactions.
+validate_block::skip_list validate_block::skipped_transactions(block const& block) const {
+    auto const& txs = block.transactions();
+    auto skipped = std::make_shared<std::vector<bool>>(txs.size(), false);
+
+    for (size_t position = 1; position < txs.size(); ++position) {
+        auto const& tx = txs[position];
+        ++queries_;
+
+        if ( ! tx.validation.current && ! tx.validation.validated) {
+            continue;
+        }
+
+        auto const metadata = transaction_metadata_.get(relay_hash(tx));
+        if ( ! metadata || ! metadata->sigchecks) {
+            continue;
+        }
+
+        ++hits_;
+        sigchecks_ += *metadata->sigchecks;
+        (*skipped)[position] = true;
     }
+
+    return skipped;
 }
 
-void validate_block::connect_inputs(block_const_ptr block, size_t bucket, size_t buckets, result_handler handler) const {
+void validate_block::connect_inputs(block_const_ptr block, size_t bucket, size_t buckets, skip_list skipped, result_handler handler) const {
     KTH_ASSERT(bucket < buckets);
     code ec(error::success);
     auto const forks = block->validation.state->enabled_forks();
     auto const& txs = block->transactions();
     size_t position = 0;
-
-#if defined(KTH_CURRENCY_BCH)
     size_t block_sigchecks = 0;
-#endif
 
     //TODO(fernando): count the coinbase sigchecks
 
     // Must skip coinbase here as it is already accounted for.
     for (auto tx = txs.begin() + 1; tx != txs.end(); ++tx) {
-        ++queries_;
-
-        // The tx is pooled with current fork state so outputs are validated.
-        if (tx->validation.current) {
-            ++hits_;
-            continue;
-        }
-
-        // The tx was validated before its insertion in the mempool
-        // TODO(fernando): what happend with Blockchain forks?
-        if (tx->validation.validated) {
-            ++hits_;
+        // The tx was validated by the mempool and its sigchecks counted.
+        if ((*skipped)[tx - txs.begin()]) {
             continue;
         }
 
@@ -334,8 +365,9 @@ void validate_block::connect_inputs(block_const_ptr block, size_t bucket, size_t
                 break;
             }
 
-#if defined(KTH_CURRENCY_BCH)
             block_sigchecks += sigchecks;
+
+#if defined(KTH_CURRENCY_BCH)
             // if (block_sigchecks > get_max_block_sigchecks(network_)) {
             if (block_sigchecks > block->validation.state->dynamic_max_block_sigchecks()) {
                 ec = error::block_sigchecks_limit;
@@ -351,6 +383,7 @@ void validate_block::connect_inputs(block_const_ptr block, size_t bucket, size_t
         }
     }
 
+    sigchecks_ += block_sigchecks;
     handler(ec);
 }
 
@@ -360,14 +393,48 @@ float validate_block::hit_rate() const {
     return queries_ == 0 ? 0.0f : (hits_ * 1.0f / queries_);
 }
 
+// All prevouts are populated once connected, so fees are summed here.
+// The buckets check their own sigchecks, the block total is checked here.
 void validate_block::handle_connected(code const& ec, block_const_ptr block, result_handler handler) const {
     block->validation.cache_efficiency = hit_rate();
+
+#if defined(KTH_CURRENCY_BCH)
+    if ( ! ec && sigchecks_ > block->validation.state->dynamic_max_block_sigchecks()) {
+        handler(error::block_sigchecks_limit);
+        return;
+    }
+#endif
+
+    if ( ! ec) {
+        add_metadata(*block, sigchecks_);
+    }
+
     handler(ec);
 }
 
 // Utility.
 //-----------------------------------------------------------------------------
 
+// The block statistics are computed here, while all prevouts are populated,
+// so that they are not recomputed from the store.
+void validate_block::add_metadata(block const& block, size_t sigchecks) const {
+    auto const height = block.validation.state->height();
+    block_stats stats;
+
+    if ( ! block_stats::compute(block, sigchecks, stats)) {
+        auto const& txs = block.transactions();
+        auto const fees = std::accumulate(txs.begin() + 1, txs.end(), uint64_t(0),
+            [](uint64_t total, transaction const& tx) {
+                return total + tx.fees();
+            });
+
+        block_metadata_.add_validated(std::make_shared<block_metadata const>(block, height, fees, sigchecks));
+        return;
+    }
+
+    block_metadata_.add_validated(std::make_shared<block_metadata const>(block, height, stats, true));
+}
+
 void validate_block::dump(code const& ec, transaction const& tx, uint32_t input_index, uint32_t forks, size_t height) {
     auto const& prevout = tx.inputs()[input_index].previous_output();
     auto const script = prevout.validation.cache.script().to_data(false);
@@ -110,28 +110,35 @@ void validate_transaction::handle_populated(code const& ec, transaction_const_pt
 //-----------------------------------------------------------------------------
 // These checks require chain state, block state and perform script validation.
 
-void validate_transaction::connect(transaction_const_ptr tx, result_handler handler) const {
+// The sigchecks of the buckets are summed, so that block validation can
+// count those of the transaction without running its scripts again.
+void validate_transaction::connect(transaction_const_ptr tx, connect_handler handler) const {
     KTH_ASSERT(tx->validation.state);
     auto const total_inputs = tx->inputs().size();
 
     // Return if there are no inputs to validate (will fail later).
     if (total_inputs == 0) {
-        handler(error::success);
+        handler(error::success, 0);
         return;
     }
 
+    auto const sigchecks = std::make_shared<std::atomic<size_t>>(0);
+    result_handler complete_handler = [sigchecks, handler](code const& ec) {
+        handler(ec, *sigchecks);
+    };
+
     auto const buckets = std::min(dispatch_.size(), total_inputs);
-    auto const join_handler = synchronize(handler, buckets, NAME "_validate");
+    auto const join_handler = synchronize(std::move(complete_handler), buckets, NAME "_validate");
     KTH_ASSERT(buckets != 0);
 
     // If the priority threadpool is shut down when this is called the handler
     // will never be invoked, resulting in a threadpool.join indefinite hang.
     for (size_t bucket = 0; bucket < buckets; ++bucket) {
-        dispatch_.concurrent(&validate_transaction::connect_inputs, this, tx, bucket, buckets, join_handler);
+        dispatch_.concurrent(&validate_transaction::connect_inputs, this, tx, bucket, buckets, sigchecks, join_handler);
     }
 }
 
-void validate_transaction::connect_inputs(transaction_const_ptr tx, size_t bucket, size_t buckets, result_handler handler) const {
+void validate_transaction::connect_inputs(transaction_const_ptr tx, size_t bucket, size_t buckets, atomic_counter_ptr sigchecks, result_handler handler) const {
     KTH_ASSERT(bucket < buckets);
 
 #if defined(KTH_CURRENCY_BCH)
@@ -167,6 +174,8 @@ void validate_transaction::connect_inputs(transaction_const_ptr tx, size_t bucke
             return;
         }
 #endif
+
+        *sigchecks += res.second;
     }
     handler(error::success);
 }
@@ -4,13 +4,20 @@
 
 #include <test_helpers.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <future>
 #include <memory>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 #include <kth/blockchain.hpp>
 
 using namespace kth;
 using namespace kth::blockchain;
+using namespace kth::blockchain::test;
 using namespace boost::system;
 using namespace std::filesystem;
 
@@ -53,6 +60,15 @@ using namespace std::filesystem;
     block_chain name(pool, blockchain_settings, database_settings); \
     REQUIRE(name.start())
 
+#define START_FUNDED_BLOCKCHAIN(name, blocks)                          \
+    threadpool pool;                                                   \
+    database::settings database_settings;                              \
+    database_settings.directory = TEST_NAME;                           \
+    REQUIRE(create_database(database_settings, blocks));               \
+    blockchain::settings blockchain_settings;                          \
+    block_chain name(pool, blockchain_settings, database_settings);    \
+    REQUIRE(name.start())
+
 #define NEW_BLOCK(height) \
     std::make_shared<const domain::message::block>(read_block(MAINNET_BLOCK##height))
 
@@ -64,13 +80,107 @@ void print_headers(std::string const& test) {
     LOG_INFO(TEST_SET_NAME, header);
 }
 
-bool create_database(database::settings& out_database) {
+// The value of each output of the funded blocks.
+static constexpr uint64_t funded_value = 5000000000;
+
+// An output script spent by an empty input script.
+static
+domain::chain::script spendable_script() {
+    return domain::chain::script{ data_chunk{ 0x51 }, false };
+}
+
+static
+short_hash funded_address() {
+    short_hash hash;
+    hash.fill(0x2a);
+    return hash;
+}
+
+// A coinbase paying a spendable output and the funded address, distinct by
+// height (locktime).
+static
+domain::chain::transaction make_funded_coinbase(uint32_t height) {
+    using namespace domain::chain;
+    return transaction{ 1, height, { input{ output_point{ null_hash, max_uint32 }, script{}, max_uint32 } }, { output{ funded_value, spendable_script(), {} }, output{ funded_value, script{ script::to_pay_key_hash_pattern(funded_address()) }, {} } } };
+}
+
+static
+domain::chain::block make_funded_block(hash_digest const& previous, uint32_t height) {
+    using namespace domain::chain;
+    auto const genesis = block::genesis_mainnet().header();
+    header const header{ 1, previous, null_hash, genesis.timestamp() + height * 600, genesis.bits(), height };
+    return block{ header, { make_funded_coinbase(height) } };
+}
+
+// The funded blocks are stored on genesis, from height one.
+bool create_database(database::settings& out_database, size_t funded_blocks = 0) {
     print_headers(out_database.directory.string());
 
     std::error_code ec;
     remove_all(out_database.directory, ec);
     database::data_base database(out_database);
-    return create_directories(out_database.directory, ec) && database.create(domain::chain::block::genesis_mainnet());
+    auto const genesis = domain::chain::block::genesis_mainnet();
+    if ( ! create_directories(out_database.directory, ec) || ! database.create(genesis)) {
+        return false;
+    }
+
+    auto previous = genesis.hash();
+    for (size_t height = 1; height <= funded_blocks; ++height) {
+        auto const block = make_funded_block(previous, static_cast<uint32_t>(height));
+        if (database.insert(block, height) != error::success) {
+            return false;
+        }
+
+        previous = block.hash();
+    }
+
+    return true;
+}
+
+// The spendable output of the coinbase of the funded block, mature at the
+// top of a chain of at least 99 more blocks.
+static
+domain::chain::output_point funded_output(uint32_t height) {
+    return { make_funded_coinbase(height).hash(), 0 };
+}
+
+// A transaction spending the prevouts to a spendable output of the value.
+static
+transaction_const_ptr make_spend(domain::chain::output_point::list const& prevouts, uint64_t value) {
+    using namespace domain::chain;
+    input::list inputs;
+    for (auto const& prevout : prevouts) {
+        inputs.emplace_back(prevout, script{}, max_uint32);
+    }
+
+    return std::make_shared<transaction const>(transaction{ 1, 0, std::move(inputs), { output{ value, spendable_script(), {} } } });
+}
+
+static
+std::pair<code, std::vector<code>> submit_batch(block_chain& instance, transaction_const_ptr_list txs) {
+    std::promise<std::pair<code, std::vector<code>>> promise;
+    instance.organize(std::make_shared<transaction_const_ptr_list const>(std::move(txs)), [&promise](code const& ec, std::vector<code> const& results) {
+        promise.set_value({ ec, results });
+    });
+
+    return promise.get_future().get();
+}
+
+static
+std::pair<code, std::vector<code>> submit_package(block_chain& instance, transaction_const_ptr_list txs, bool test_accept) {
+    std::promise<std::pair<code, std::vector<code>>> promise;
+    instance.organize_package(std::make_shared<transaction_const_ptr_list const>(std::move(txs)), test_accept, [&promise](code const& ec, std::vector<code> const& results) {
+        promise.set_value({ ec, results });
+    });
+
+    return promise.get_future().get();
+}
+
+static
+bool is_stored(block_chain const& instance, transaction_const_ptr const& tx) {
+    size_t height;
+    size_t position;
+    return instance.get_transaction_position(height, position, tx->hash(), false);
 }
 
 domain::chain::block read_block(const std::string hex) {
@@ -124,10 +234,205 @@ domain::chain::block read_block(const std::string hex) {
 // TODO: subscribe_blockchain
 // TODO: subscribe_transaction
 // TODO: unsubscribe
-// TODO: organize_block
-// TODO: organize_transaction
 // TODO: chain_settings
 // TODO: stopped
 // TODO: to_hashes
 
+TEST_CASE("block chain  organize batch  parent and child  both admitted", "[safe chain tests]") {
+    START_FUNDED_BLOCKCHAIN(instance, 110);
+
+    auto const parent = make_spend({ funded_output(1) }, funded_value - 1000);
+    auto const child = make_spend({ { parent->hash(), 0 } }, funded_value - 2000);
+
+    // The child is listed first, the parent is admitted in the first wave.
+    auto const result = submit_batch(instance, { child, parent });
+    REQUIRE(result.first == error::success);
+    REQUIRE(result.second == std::vector<code>{ error::success, error::success });
+    REQUIRE(is_stored(instance, parent));
+    REQUIRE(is_stored(instance, child));
+}
+
+TEST_CASE("block chain  organize package  parent paid for by child  both admitted", "[safe chain tests]") {
+    START_FUNDED_BLOCKCHAIN(instance, 110);
+
+    auto const parent = make_spend({ funded_output(2) }, funded_value);
+    auto const child = make_spend({ { parent->hash(), 0 } }, funded_value - 10000);
+
+    REQUIRE(submit_package(instance, { parent }, true).first == error::insufficient_fee);
+
+    auto const result = submit_package(instance, { parent, child }, false);
+    REQUIRE(result.first == error::success);
+    REQUIRE(result.second == std::vector<code>{ error::success, error::success });
+    REQUIRE(is_stored(instance, parent));
+    REQUIRE(is_stored(instance, child));
+}
+
+TEST_CASE("block chain  organize package  conflicting parents  none admitted", "[safe chain tests]") {
+    START_FUNDED_BLOCKCHAIN(instance, 110);
+
+    auto const first = make_spend({ funded_output(3) }, funded_value - 1000);
+    auto const second = make_spend({ funded_output(3) }, funded_value - 2000);
+    auto const child = make_spend({ { first->hash(), 0 }, { second->hash(), 0 } }, 2 * funded_value - 5000);
+
+    auto const result = submit_package(instance, { first, second, child }, false);
+    REQUIRE(result.first == error::double_spend_mempool);
+    REQUIRE( ! is_stored(instance, first));
+    REQUIRE( ! is_stored(instance, second));
+    REQUIRE( ! is_stored(instance, child));
+}
+
+TEST_CASE("block chain  organize  duplicate in flight  attached to first", "[safe chain tests]") {
+    START_FUNDED_BLOCKCHAIN(instance, 110);
+
+    auto const tx = make_spend({ funded_output(4) }, funded_value - 1000);
+    auto const copy = std::make_shared<const domain::message::transaction>(*tx);
+
+    // The first submission is held in its commit by the notification of it,
+    // the second is made meanwhile. Had the second been validated on its own
+    // it would have found the first stored (a duplicate).
+    struct hook {
+        std::promise<void> entered;
+        std::promise<void> release;
+        std::atomic<size_t> notified{ 0 };
+    };
+
+    auto const state = std::make_shared<hook>();
+    auto const released = state->release.get_future().share();
+
+    instance.subscribe_transaction([state, released, hash = tx->hash()](code ec, transaction_const_ptr notified) {
+        if (ec || ! notified || notified->hash() != hash) {
+            return ! ec;
+        }
+
+        if (state->notified++ == 0) {
+            state->entered.set_value();
+            released.wait();
+        }
+
+        return true;
+    });
+
+    std::promise<code> first_result;
+    std::promise<code> second_result;
+    auto first = std::async(std::launch::async, [&instance, &tx, &first_result]() {
+        instance.organize(tx, [&first_result](code const& ec) {
+            first_result.set_value(ec);
+        });
+    });
+
+    state->entered.get_future().wait();
+    instance.organize(copy, [&second_result](code const& ec) {
+        second_result.set_value(ec);
+    });
+
+    // Attached to the pending result of the first.
+    auto second = second_result.get_future();
+    REQUIRE(second.wait_for(std::chrono::seconds(0)) == std::future_status::timeout);
+
+    state->release.set_value();
+    first.get();
+
+    REQUIRE(first_result.get_future().get() == error::success);
+    REQUIRE(second.get() == error::success);
+    REQUIRE(state->notified == 1u);
+    REQUIRE(is_stored(instance, tx));
+}
+
+TEST_CASE("block chain  fetch history page  index disabled  not found", "[safe chain tests]") {
+    START_FUNDED_BLOCKCHAIN(instance, 1);
+
+    code result;
+    instance.fetch_history_page(funded_address(), { 1 }, 2, [&result](code const& ec, domain::chain::history_compact::list const&, safe_chain::history_cursor const&, bool) {
+        result = ec;
+    });
+
+    REQUIRE(result == error::not_found);
+}
+
+// The history index is built by the sync on the network pool, the pages are
+// not ready until it is at the store top.
+TEST_CASE("block chain  fetch history page  across heights  each entry once in order", "[safe chain tests]") {
+    threadpool pool("test", 1);
+    database::settings database_settings;
+    database_settings.directory = TEST_NAME;
+    REQUIRE(create_database(database_settings, 5));
+    blockchain::settings blockchain_settings;
+    blockchain_settings.history_index = true;
+    block_chain instance(pool, blockchain_settings, database_settings);
+    REQUIRE(instance.start());
+
+    safe_chain::history_cursor cursor{ 1 };
+    std::vector<size_t> heights;
+    size_t pages = 0;
+    size_t waits = 0;
+    auto done = false;
+
+    while ( ! done) {
+        REQUIRE(pages <= 5u);
+        instance.fetch_history_page(funded_address(), cursor, 2, [&](code const& ec, domain::chain::history_compact::list const& history, safe_chain::history_cursor const& next, bool last) {
+            if (ec == safe_chain::index_not_ready) {
+                REQUIRE(++waits < 1000u);
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                return;
+            }
+
+            REQUIRE(ec == error::success);
+            ++pages;
+            for (auto const& entry : history) {
+                heights.push_back(entry.height);
+            }
+
+            cursor = next;
+            done = last;
+        });
+    }
+
+    REQUIRE(pages == 3u);
+    REQUIRE(heights == std::vector<size_t>{ 1, 2, 3, 4, 5 });
+
+    REQUIRE(instance.stop());
+    pool.shutdown();
+    pool.join();
+}
+
+// The network pool has no threads, so the organize queue is not drained and
+// the queued blocks are failed by stop.
+TEST_CASE("block chain  organize block  queue full  same block attached others refused", "[safe chain tests]") {
+    auto const block1 = NEW_BLOCK(1);
+    auto const copy1 = NEW_BLOCK(1);
+    auto const block2 = NEW_BLOCK(2);
+
+    // The header of block 1 over other transactions, so of the same hash.
+    auto txs = block1->transactions();
+    txs.push_back(make_coinbase(1));
+    auto const tampered1 = std::make_shared<const domain::message::block>(domain::chain::block{ block1->header(), std::move(txs) });
+    REQUIRE(tampered1->hash() == block1->hash());
+
+    threadpool pool;
+    database::settings database_settings;
+    database_settings.directory = TEST_NAME;
+    REQUIRE(create_database(database_settings));
+    blockchain::settings blockchain_settings;
+    blockchain_settings.block_queue_bytes = block1->serialized_size(1);
+    block_chain instance(pool, blockchain_settings, database_settings);
+    REQUIRE(instance.start());
+
+    std::vector<code> results;
+    auto const record = [&results](code const& ec) {
+        results.push_back(ec);
+    };
+
+    instance.organize(block1, record);
+    instance.organize(copy1, record);
+    REQUIRE(results.empty());
+
+    instance.organize(tampered1, record);
+    instance.organize(block2, record);
+    REQUIRE(results == std::vector<code>{ safe_chain::block_queue_full, safe_chain::block_queue_full });
+
+    results.clear();
+    REQUIRE(instance.stop());
+    REQUIRE(results == std::vector<code>{ error::service_stopped, error::service_stopped });
+}
+
 // End Test Suite
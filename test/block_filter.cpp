@@ -0,0 +1,186 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <test_helpers.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+#include <kth/blockchain.hpp>
+
+using namespace kth;
+using namespace kth::blockchain;
+using namespace kth::blockchain::test;
+
+// Start Test Suite: block filter tests
+
+// BIP158 test vector: testnet genesis block.
+static auto const testnet_genesis_hash = hash_literal("000000000933ea01ad0ee984209779baaec3ced90fa3f408719526f8d77f4943");
+static std::string const testnet_genesis_script = "4104678afdb0fe5548271967f1a67130b7105cd6a828e03909a67962e0ea1f61deb649f6bc3f4cef38c4f35504e51ec112de5c384df7ba0b8d578a4c702b6bf11d5fac";
+
+static
+data_chunk decode(std::string const& hex) {
+    data_chunk data;
+    decode_base16(data, hex);
+    return data;
+}
+
+static
+data_chunk make_element(uint64_t value) {
+    return to_chunk(to_little_endian(value));
+}
+
+// gcs_encode
+
+TEST_CASE("block filter  gcs encode  no elements  count only", "[block filter tests]") {
+    REQUIRE(gcs_encode({}, 0, 0) == data_chunk{ 0x00 });
+}
+
+TEST_CASE("block filter  gcs encode  testnet genesis  bip158 vector", "[block filter tests]") {
+    uint64_t k0;
+    uint64_t k1;
+    filter_keys(testnet_genesis_hash, k0, k1);
+
+    auto const filter = gcs_encode({ decode(testnet_genesis_script) }, k0, k1);
+    REQUIRE(filter == decode("019dfca8"));
+    REQUIRE(filter_header(bitcoin_hash(filter), null_hash) == hash_literal("21584579b7eb08997773e5aeff3a7f932700042d0ed2a6129012b7d7ae81b750"));
+}
+
+// gcs_match_any
+
+TEST_CASE("block filter  gcs match any  every element  true", "[block filter tests]") {
+    data_stack elements;
+    for (uint64_t value = 0; value < 500; ++value) {
+        elements.push_back(make_element(value));
+    }
+
+    auto const filter = gcs_encode(elements, 1, 2);
+    for (auto const& element : elements) {
+        REQUIRE(gcs_match_any(filter, { element }, 1, 2));
+    }
+}
+
+TEST_CASE("block filter  gcs match any  missing elements  false", "[block filter tests]") {
+    auto const filter = gcs_encode({ make_element(1), make_element(2) }, 1, 2);
+    REQUIRE( ! gcs_match_any(filter, { make_element(3), make_element(4) }, 1, 2));
+}
+
+TEST_CASE("block filter  gcs match any  other key  false", "[block filter tests]") {
+    auto const filter = gcs_encode({ make_element(1) }, 1, 2);
+    REQUIRE( ! gcs_match_any(filter, { make_element(1) }, 3, 4));
+}
+
+TEST_CASE("block filter  gcs match any  truncated filter  false", "[block filter tests]") {
+    auto filter = gcs_encode({ make_element(1), make_element(2) }, 1, 2);
+    filter.resize(2);
+    REQUIRE( ! gcs_match_any(filter, { make_element(2) }, 1, 2));
+}
+
+// block_filter_index
+
+TEST_CASE("block filter index  push  chained headers", "[block filter tests]") {
+    block_filter_index instance(10);
+    REQUIRE(instance.push(make_hash(1), null_hash, 0, data_chunk{ 0x00 }));
+    REQUIRE(instance.push(make_hash(2), make_hash(1), 1, data_chunk{ 0x01 }));
+
+    block_filter_index::entry first;
+    block_filter_index::entry second;
+    REQUIRE(instance.get(0, first));
+    REQUIRE(instance.get(1, second));
+    REQUIRE(first.header == filter_header(bitcoin_hash(data_chunk{ 0x00 }), null_hash));
+    REQUIRE(second.header == filter_header(bitcoin_hash(data_chunk{ 0x01 }), first.header));
+    REQUIRE(instance.size() == 2u);
+}
+
+TEST_CASE("block filter index  push  not extending top  false", "[block filter tests]") {
+    block_filter_index instance(10);
+    REQUIRE(instance.push(make_hash(1), null_hash, 0, {}));
+    REQUIRE( ! instance.push(make_hash(2), make_hash(3), 1, {}));
+    REQUIRE( ! instance.push(make_hash(2), make_hash(1), 2, {}));
+    REQUIRE(instance.size() == 1u);
+}
+
+TEST_CASE("block filter index  filter  outside window  false", "[block filter tests]") {
+    block_filter_index instance(2);
+    REQUIRE(instance.push(make_hash(1), null_hash, 0, data_chunk{ 0x00 }));
+    REQUIRE(instance.push(make_hash(2), make_hash(1), 1, data_chunk{ 0x01 }));
+    REQUIRE(instance.push(make_hash(3), make_hash(2), 2, data_chunk{ 0x02 }));
+
+    data_chunk filter;
+    REQUIRE( ! instance.filter(0, filter));
+    REQUIRE(instance.filter(2, filter));
+    REQUIRE(filter == data_chunk{ 0x02 });
+}
+
+TEST_CASE("block filter index  truncate  removes top blocks", "[block filter tests]") {
+    block_filter_index instance(10);
+    REQUIRE(instance.push(make_hash(1), null_hash, 0, data_chunk{ 0x00 }));
+    REQUIRE(instance.push(make_hash(2), make_hash(1), 1, data_chunk{ 0x01 }));
+    instance.truncate(1);
+
+    size_t height;
+    data_chunk filter;
+    block_filter_index::entry entry;
+    REQUIRE(instance.size() == 1u);
+    REQUIRE( ! instance.get(make_hash(2), entry, height));
+    REQUIRE( ! instance.filter(1, filter));
+    REQUIRE(instance.push(make_hash(4), make_hash(1), 1, data_chunk{ 0x04 }));
+    REQUIRE(instance.get(make_hash(4), entry, height));
+    REQUIRE(height == 1u);
+}
+
+TEST_CASE("block filter index  filter hashes  range", "[block filter tests]") {
+    block_filter_index instance(10);
+    REQUIRE(instance.push(make_hash(1), null_hash, 0, data_chunk{ 0x00 }));
+    REQUIRE(instance.push(make_hash(2), make_hash(1), 1, data_chunk{ 0x01 }));
+
+    REQUIRE(instance.filter_hashes(0, 1) == hash_list{ bitcoin_hash(data_chunk{ 0x00 }), bitcoin_hash(data_chunk{ 0x01 }) });
+    REQUIRE(instance.filter_hashes(1, 2).empty());
+}
+
+TEST_CASE("block filter index  open  existing files  restores entries and filters", "[block filter tests]") {
+    std::filesystem::path const entries_file = "block_filter_index_open_entries";
+    std::filesystem::path const filters_file = "block_filter_index_open_filters";
+    std::error_code ec;
+    std::filesystem::remove(entries_file, ec);
+    std::filesystem::remove(filters_file, ec);
+
+    block_filter_index::entry expected;
+
+    {
+        block_filter_index instance(1, entries_file, filters_file);
+        REQUIRE(instance.open());
+        REQUIRE(instance.push(make_hash(1), null_hash, 0, data_chunk{ 0x00 }));
+        REQUIRE(instance.push(make_hash(2), make_hash(1), 1, data_chunk{ 0x01 }));
+        REQUIRE(instance.push(make_hash(3), make_hash(2), 2, data_chunk{ 0x02 }));
+        REQUIRE(instance.get(2, expected));
+        instance.close();
+    }
+
+    block_filter_index instance(1, entries_file, filters_file);
+    REQUIRE(instance.open());
+    REQUIRE(instance.size() == 3u);
+
+    size_t height;
+    block_filter_index::entry entry;
+    REQUIRE(instance.get(make_hash(3), entry, height));
+    REQUIRE(height == 2u);
+    REQUIRE(entry.header == expected.header);
+
+    // Filters below the window are read from the file.
+    data_chunk filter;
+    REQUIRE(instance.filter(0, filter));
+    REQUIRE(filter == data_chunk{ 0x00 });
+    REQUIRE(instance.filter(2, filter));
+    REQUIRE(filter == data_chunk{ 0x02 });
+
+    instance.truncate(1);
+    REQUIRE( ! instance.filter(1, filter));
+    REQUIRE(instance.push(make_hash(4), make_hash(1), 1, data_chunk{ 0x04 }));
+    REQUIRE(instance.filter(1, filter));
+    REQUIRE(filter == data_chunk{ 0x04 });
+}
+
+// End Test Suite
@@ -0,0 +1,206 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <test_helpers.hpp>
+
+#include <cstdint>
+
+#include <kth/blockchain.hpp>
+
+using namespace kth;
+using namespace kd::chain;
+using namespace kth::blockchain;
+
+// Start Test Suite: block metadata cache tests
+
+static
+block make_block(uint32_t id, uint32_t tx_count) {
+    transaction::list txs;
+    for (uint32_t locktime = 0; locktime < tx_count; ++locktime) {
+        txs.push_back(transaction{1, locktime, {}, {}});
+    }
+
+    return block{ header{ id, null_hash, null_hash, 0, 0, 0 }, std::move(txs) };
+}
+
+static
+hash_digest fold_branch(hash_digest hash, size_t position, hash_list const& branch) {
+    for (auto const& sibling : branch) {
+        hash = (position & 1) != 0 ?
+            bitcoin_hash(build_chunk({ sibling, hash })) :
+            bitcoin_hash(build_chunk({ hash, sibling }));
+        position >>= 1;
+    }
+
+    return hash;
+}
+
+// construct
+
+TEST_CASE("block metadata  construct  transaction offsets  follow header and count", "[block metadata cache tests]") {
+    auto const instance = make_block(1, 3);
+    block_metadata const metadata(instance, 7);
+    auto const& txs = instance.transactions();
+    auto const& offsets = metadata.transaction_offsets();
+
+    REQUIRE(metadata.serialized_size() == instance.serialized_size());
+    REQUIRE(metadata.transaction_count() == 3u);
+    REQUIRE(offsets.size() == 3u);
+
+    // 80 byte header and a single byte transaction count.
+    REQUIRE(offsets[0] == 81u);
+    REQUIRE(offsets[1] == offsets[0] + txs[0].serialized_size(true));
+    REQUIRE(offsets[2] == offsets[1] + txs[1].serialized_size(true));
+    REQUIRE( ! metadata.validated());
+}
+
+TEST_CASE("block metadata  construct  with totals  validated", "[block metadata cache tests]") {
+    block_metadata const metadata(make_block(1, 1), 7, 1000, 12);
+    REQUIRE(metadata.validated());
+    REQUIRE(metadata.fees() == 1000u);
+    REQUIRE(metadata.sigchecks() == 12u);
+}
+
+// merkle_branch
+
+// record
+
+TEST_CASE("block metadata  from data  record  round trip", "[block metadata cache tests]") {
+    auto const instance = make_block(1, 3);
+    block_stats stats;
+    stats.transaction_count = 3;
+    stats.fees = 1000;
+    stats.feerate_percentiles = { 1, 2, 3, 4, 5 };
+    stats.sigchecks = 12;
+    block_metadata const metadata(instance, 7, stats, true);
+
+    auto const restored = block_metadata::from_data(instance.header(), 7, metadata.to_data());
+    REQUIRE(restored);
+    REQUIRE(restored->hash() == metadata.hash());
+    REQUIRE(restored->height() == 7u);
+    REQUIRE(restored->serialized_size() == metadata.serialized_size());
+    REQUIRE(restored->transaction_hashes() == metadata.transaction_hashes());
+    REQUIRE(restored->transaction_offsets() == metadata.transaction_offsets());
+    REQUIRE(restored->validated());
+    REQUIRE(restored->fees() == 1000u);
+    REQUIRE(restored->sigchecks() == 12u);
+    REQUIRE(restored->stats());
+    REQUIRE(restored->stats()->feerate_percentiles == stats.feerate_percentiles);
+}
+
+TEST_CASE("block metadata  from data  truncated record  nullptr", "[block metadata cache tests]") {
+    auto const instance = make_block(1, 2);
+    auto record = block_metadata(instance, 7).to_data();
+    record.pop_back();
+    REQUIRE( ! block_metadata::from_data(instance.header(), 7, record));
+    REQUIRE( ! block_metadata::from_data(instance.header(), 7, data_chunk{}));
+}
+
+TEST_CASE("block metadata  merkle branch  every position  folds to merkle root", "[block metadata cache tests]") {
+    auto const instance = make_block(1, 7);
+    block_metadata const metadata(instance, 42);
+    auto const root = instance.generate_merkle_root();
+    auto const& hashes = metadata.transaction_hashes();
+
+    REQUIRE(hashes.size() == 7u);
+    for (size_t position = 0; position < hashes.size(); ++position) {
+        auto const branch = metadata.merkle_branch(position);
+        REQUIRE(branch.size() == 3u);
+        REQUIRE(fold_branch(hashes[position], position, branch) == root);
+    }
+}
+
+TEST_CASE("block metadata  merkle branch  out of range  empty", "[block metadata cache tests]") {
+    block_metadata const metadata(make_block(1, 3), 0);
+    REQUIRE(metadata.merkle_branch(3).empty());
+}
+
+// merkle_flags
+
+TEST_CASE("block metadata  merkle flags  single transaction  one bit", "[block metadata cache tests]") {
+    block_metadata const metadata(make_block(1, 1), 0);
+    REQUIRE(metadata.merkle_flags() == data_chunk{ 0x01 });
+}
+
+TEST_CASE("block metadata  merkle flags  three transactions  six bits", "[block metadata cache tests]") {
+    block_metadata const metadata(make_block(1, 3), 0);
+    REQUIRE(metadata.merkle_flags() == data_chunk{ 0x3f });
+}
+
+// add
+
+TEST_CASE("block metadata cache  add  zero capacity  not cached", "[block metadata cache tests]") {
+    block_metadata_cache instance(0);
+    instance.add(std::make_shared<block_metadata const>(make_block(1, 1), 10));
+    REQUIRE(instance.size() == 0u);
+}
+
+TEST_CASE("block metadata cache  add  over capacity  evicts oldest", "[block metadata cache tests]") {
+    block_metadata_cache instance(2);
+    auto const block1 = make_block(1, 1);
+    auto const block2 = make_block(2, 1);
+    auto const block3 = make_block(3, 1);
+    instance.add(std::make_shared<block_metadata const>(block1, 1));
+    instance.add(std::make_shared<block_metadata const>(block2, 2));
+    instance.add(std::make_shared<block_metadata const>(block3, 3));
+
+    REQUIRE(instance.size() == 2u);
+    REQUIRE( ! instance.get(block1.hash()));
+    REQUIRE( ! instance.get(size_t(1)));
+    REQUIRE(instance.get(block2.hash()));
+    REQUIRE(instance.get(size_t(3))->hash() == block3.hash());
+}
+
+TEST_CASE("block metadata cache  add  same height  replaces block", "[block metadata cache tests]") {
+    block_metadata_cache instance(10);
+    auto const block1 = make_block(1, 1);
+    auto const block2 = make_block(2, 1);
+    instance.add(std::make_shared<block_metadata const>(block1, 5));
+    instance.add(std::make_shared<block_metadata const>(block2, 5));
+
+    REQUIRE(instance.size() == 1u);
+    REQUIRE( ! instance.get(block1.hash()));
+    REQUIRE(instance.get(size_t(5))->hash() == block2.hash());
+}
+
+// add_validated
+
+TEST_CASE("block metadata cache  add validated  unconfirmed  not indexed by height", "[block metadata cache tests]") {
+    block_metadata_cache instance(10);
+    auto const block1 = make_block(1, 1);
+    instance.add_validated(std::make_shared<block_metadata const>(block1, 5, 0, 0));
+
+    REQUIRE(instance.get(block1.hash()));
+    REQUIRE( ! instance.get(size_t(5)));
+}
+
+// confirm
+
+TEST_CASE("block metadata cache  confirm  validated block  indexed by height", "[block metadata cache tests]") {
+    block_metadata_cache instance(10);
+    auto const block1 = make_block(1, 1);
+    instance.add_validated(std::make_shared<block_metadata const>(block1, 5, 0, 0));
+
+    REQUIRE(instance.confirm(block1.hash()));
+    REQUIRE(instance.get(size_t(5))->hash() == block1.hash());
+}
+
+TEST_CASE("block metadata cache  confirm  missing block  false", "[block metadata cache tests]") {
+    block_metadata_cache instance(10);
+    REQUIRE( ! instance.confirm(make_block(1, 1).hash()));
+}
+
+// remove
+
+TEST_CASE("block metadata cache  remove  cached block  clears height", "[block metadata cache tests]") {
+    block_metadata_cache instance(10);
+    auto const block1 = make_block(1, 1);
+    instance.add(std::make_shared<block_metadata const>(block1, 5));
+    instance.remove(block1.hash());
+
+    REQUIRE(instance.size() == 0u);
+    REQUIRE( ! instance.get(size_t(5)));
+}
+
+// End Test Suite
@@ -0,0 +1,83 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <test_helpers.hpp>
+
+#include <cstdint>
+
+#include <kth/blockchain.hpp>
+
+using namespace kth;
+using namespace kd::chain;
+using namespace kth::blockchain;
+using namespace kth::blockchain::test;
+
+// Start Test Suite: block stats tests
+
+static
+transaction make_spend(uint8_t id, uint64_t value) {
+    hash_digest hash = null_hash;
+    hash[0] = id;
+    return transaction{ 1, 0, { input{ output_point{ hash, 0 }, script{}, max_uint32 } }, { output{ value, script{}, {} } } };
+}
+
+// Prevouts are populated on the block copies of the transactions.
+static
+void populate(block const& block, uint64_t value) {
+    for (auto const& tx : block.transactions()) {
+        if ( ! tx.is_coinbase()) {
+            tx.inputs()[0].previous_output().validation.cache = output{ value, script{}, {} };
+        }
+    }
+}
+
+TEST_CASE("block stats  compute  unpopulated prevout  false", "[block stats tests]") {
+    auto const instance = make_block(null_hash, 1, { make_coinbase(0), make_spend(1, 900) });
+    block_stats stats;
+    REQUIRE( ! block_stats::compute(instance, 0, stats));
+}
+
+TEST_CASE("block stats  compute  coinbase only  counts", "[block stats tests]") {
+    auto const instance = make_block(null_hash, 1, { make_coinbase(0) });
+    block_stats stats;
+    REQUIRE(block_stats::compute(instance, 7, stats));
+    REQUIRE(stats.transaction_count == 1u);
+    REQUIRE(stats.inputs == 0u);
+    REQUIRE(stats.outputs == 1u);
+    REQUIRE(stats.fees == 0u);
+    REQUIRE(stats.total_size == 0u);
+    REQUIRE(stats.sigchecks == 7u);
+}
+
+TEST_CASE("block stats  compute  populated  fees and fee rates", "[block stats tests]") {
+    auto const instance = make_block(null_hash, 1, { make_coinbase(0), make_spend(1, 900), make_spend(2, 500) });
+    populate(instance, 1000);
+
+    block_stats stats;
+    REQUIRE(block_stats::compute(instance, 0, stats));
+
+    auto const& txs = instance.transactions();
+    auto const size = txs[1].serialized_size(true);
+    REQUIRE(txs[2].serialized_size(true) == size);
+
+    REQUIRE(stats.transaction_count == 3u);
+    REQUIRE(stats.inputs == 2u);
+    REQUIRE(stats.outputs == 3u);
+    REQUIRE(stats.total_size == 2 * size);
+    REQUIRE(stats.total_out == 1400u);
+    REQUIRE(stats.fees == 600u);
+    REQUIRE(stats.min_fee == 100u);
+    REQUIRE(stats.max_fee == 500u);
+    REQUIRE(stats.min_feerate == 100 * 1000 / size);
+    REQUIRE(stats.max_feerate == 500 * 1000 / size);
+    REQUIRE(stats.average_feerate == 600 * 1000 / (2 * size));
+
+    // Half of the size is at each rate, the median is the lower one.
+    REQUIRE(stats.feerate_percentiles[0] == stats.min_feerate);
+    REQUIRE(stats.feerate_percentiles[2] == stats.min_feerate);
+    REQUIRE(stats.feerate_percentiles[3] == stats.max_feerate);
+    REQUIRE(stats.feerate_percentiles[4] == stats.max_feerate);
+}
+
+// End Test Suite
@@ -0,0 +1,277 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <test_helpers.hpp>
+
+#include <cstdint>
+
+#include <secp256k1.h>
+#include <secp256k1_schnorr.h>
+
+#include <kth/blockchain.hpp>
+
+using namespace kth;
+using namespace kd::chain;
+using namespace kth::blockchain;
+using namespace kth::blockchain::test;
+
+using kd::message::double_spend_proof;
+
+// Start Test Suite: ds proof pool tests
+
+static
+double_spend_proof_const_ptr make_proof(uint8_t parent) {
+    return std::make_shared<double_spend_proof const>(output_point{ make_hash(parent), 0 }, double_spend_proof::spender{}, double_spend_proof::spender{});
+}
+
+static
+ec_secret make_secret(uint8_t value) {
+    ec_secret secret{};
+    secret.back() = value;
+    return secret;
+}
+
+static
+data_chunk public_key(ec_secret const& secret) {
+    ec_compressed point;
+    REQUIRE(secret_to_public(point, secret));
+    return to_chunk(point);
+}
+
+static
+script paying(ec_secret const& secret) {
+    return script{ script::to_pay_key_hash_pattern(bitcoin_short_hash(public_key(secret))) };
+}
+
+// The (bip143) signature hash of the first input, spending the output.
+static
+hash_digest signature_hash(transaction const& tx, output const& spent) {
+    data_chunk prevouts;
+    data_chunk sequences;
+    for (auto const& spend : tx.inputs()) {
+        extend_data(prevouts, spend.previous_output().to_data());
+        extend_data(sequences, to_little_endian(spend.sequence()));
+    }
+
+    data_chunk outputs;
+    for (auto const& out : tx.outputs()) {
+        extend_data(outputs, out.to_data());
+    }
+
+    auto const& input = tx.inputs().front();
+    data_chunk preimage;
+    extend_data(preimage, to_little_endian(tx.version()));
+    extend_data(preimage, bitcoin_hash(prevouts));
+    extend_data(preimage, bitcoin_hash(sequences));
+    extend_data(preimage, input.previous_output().to_data());
+    extend_data(preimage, spent.script().to_data(true));
+    extend_data(preimage, to_little_endian(spent.value()));
+    extend_data(preimage, to_little_endian(input.sequence()));
+    extend_data(preimage, bitcoin_hash(outputs));
+    extend_data(preimage, to_little_endian(tx.locktime()));
+    extend_data(preimage, to_little_endian(uint32_t(0x41)));
+    return bitcoin_hash(preimage);
+}
+
+static
+data_chunk sign_der(ec_secret const& secret, hash_digest const& hash) {
+    ec_signature signature;
+    der_signature der;
+    REQUIRE(sign(signature, secret, hash));
+    REQUIRE(encode_signature(der, signature));
+    return der;
+}
+
+static
+data_chunk sign_schnorr(ec_secret const& secret, hash_digest const& hash) {
+    static auto const context = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
+    data_chunk signature(64);
+    REQUIRE(secp256k1_schnorr_sign(context, signature.data(), hash.data(), secret.data(), nullptr, nullptr) == 1);
+    return signature;
+}
+
+enum class signer { der, schnorr };
+
+// A P2PKH spend of the output at the outpoint, signed with the secret
+// (the input carries the public key of the key secret).
+static
+transaction make_spend(output_point const& prevout, output const& spent, uint64_t value, signer kind, ec_secret const& secret, ec_secret const& key_secret, uint8_t sighash_type = 0x41) {
+    transaction const unsigned_tx{ 1, 0, { input{ prevout, script{}, max_uint32 } }, { output{ value, script{}, {} } } };
+    auto const hash = signature_hash(unsigned_tx, spent);
+    auto signature = kind == signer::der ? sign_der(secret, hash) : sign_schnorr(secret, hash);
+    signature.push_back(sighash_type);
+
+    script const input_script{ { operation{ signature }, operation{ public_key(key_secret) } } };
+    return transaction{ 1, 0, { input{ prevout, input_script, max_uint32 } }, { output{ value, script{}, {} } } };
+}
+
+static
+transaction make_spend(output_point const& prevout, output const& spent, uint64_t value, signer kind = signer::der, uint8_t sighash_type = 0x41) {
+    return make_spend(prevout, spent, value, kind, make_secret(1), make_secret(1), sighash_type);
+}
+
+static
+output make_spent() {
+    return output{ 5000, paying(make_secret(1)), {} };
+}
+
+static
+size_t proof_size() {
+    return make_proof(1)->serialized_size(kd::message::version::level::canonical);
+}
+
+TEST_CASE("ds proof pool  add  indexed  by hash outpoint and transaction", "[ds proof pool tests]") {
+    ds_proof_pool instance(100000);
+    auto const proof = make_proof(1);
+    REQUIRE(instance.add(proof, make_hash(42)));
+    REQUIRE(instance.size() == 1u);
+    REQUIRE(instance.get(hash(*proof)) == proof);
+    REQUIRE(instance.find(point{ make_hash(1), 0 }) == proof);
+    REQUIRE(instance.find_transaction(make_hash(42)) == proof);
+    REQUIRE( ! instance.find(point{ make_hash(1), 1 }));
+    REQUIRE( ! instance.find_transaction(make_hash(43)));
+}
+
+TEST_CASE("ds proof pool  add  outpoint with proof  false", "[ds proof pool tests]") {
+    ds_proof_pool instance(100000);
+    REQUIRE(instance.add(make_proof(1), null_hash));
+    REQUIRE( ! instance.add(make_proof(1), make_hash(42)));
+    REQUIRE(instance.size() == 1u);
+    REQUIRE( ! instance.find_transaction(null_hash));
+}
+
+TEST_CASE("ds proof pool  add  over bytes  evicts oldest", "[ds proof pool tests]") {
+    ds_proof_pool instance(2 * proof_size());
+    REQUIRE(instance.add(make_proof(1), make_hash(41)));
+    REQUIRE(instance.add(make_proof(2), make_hash(42)));
+    REQUIRE(instance.add(make_proof(3), make_hash(43)));
+    REQUIRE(instance.size() == 2u);
+    REQUIRE(instance.bytes() == 2 * proof_size());
+    REQUIRE( ! instance.find(point{ make_hash(1), 0 }));
+    REQUIRE( ! instance.find_transaction(make_hash(41)));
+    REQUIRE(instance.find_transaction(make_hash(43)));
+}
+
+TEST_CASE("ds proof pool  remove spent  block spending outpoint  removed", "[ds proof pool tests]") {
+    ds_proof_pool instance(100000);
+    REQUIRE(instance.add(make_proof(1), make_hash(41)));
+    REQUIRE(instance.add(make_proof(2), make_hash(42)));
+
+    transaction const coinbase{ 1, 0, { input{ output_point{ null_hash, max_uint32 }, script{}, max_uint32 } }, {} };
+    transaction const spend{ 1, 0, { input{ output_point{ make_hash(1), 0 }, script{}, max_uint32 } }, {} };
+    block const spending{ header{}, { coinbase, spend } };
+
+    instance.remove_spent(spending);
+    REQUIRE(instance.size() == 1u);
+    REQUIRE( ! instance.find(point{ make_hash(1), 0 }));
+    REQUIRE( ! instance.find_transaction(make_hash(41)));
+    REQUIRE(instance.find_transaction(make_hash(42)));
+    REQUIRE(instance.bytes() == proof_size());
+}
+
+TEST_CASE("ds proof pool  create  p2pkh spends  independent of order", "[ds proof pool tests]") {
+    output_point const prevout{ make_hash(1), 0 };
+    auto const spent = make_spent();
+    auto const first = make_spend(prevout, spent, 1000);
+    auto const second = make_spend(prevout, spent, 2000);
+
+    auto const proof = ds_proof_pool::create(first, second, prevout);
+    REQUIRE(proof);
+    REQUIRE(proof->out_point() == prevout);
+    REQUIRE(hash(*proof) == hash(*ds_proof_pool::create(second, first, prevout)));
+}
+
+TEST_CASE("ds proof pool  create  not sighash all forkid  nullptr", "[ds proof pool tests]") {
+    output_point const prevout{ make_hash(1), 0 };
+    auto const spent = make_spent();
+    auto const first = make_spend(prevout, spent, 1000);
+    auto const second = make_spend(prevout, spent, 2000, signer::der, 0x01);
+    REQUIRE( ! ds_proof_pool::create(first, second, prevout));
+}
+
+TEST_CASE("ds proof pool  create  signature not der nor schnorr  nullptr", "[ds proof pool tests]") {
+    output_point const prevout{ make_hash(1), 0 };
+    auto const spent = make_spent();
+    auto const first = make_spend(prevout, spent, 1000);
+
+    data_chunk signature(71, 0x30);
+    signature.back() = 0x41;
+    script const input_script{ { operation{ signature }, operation{ public_key(make_secret(1)) } } };
+    transaction const second{ 1, 0, { input{ prevout, input_script, max_uint32 } }, { output{ 2000, script{}, {} } } };
+    REQUIRE( ! ds_proof_pool::create(first, second, prevout));
+}
+
+TEST_CASE("ds proof pool  create  outpoint not spent  nullptr", "[ds proof pool tests]") {
+    output_point const prevout{ make_hash(1), 0 };
+    auto const spent = make_spent();
+    auto const first = make_spend(prevout, spent, 1000);
+    auto const second = make_spend(output_point{ make_hash(2), 0 }, spent, 2000);
+    REQUIRE( ! ds_proof_pool::create(first, second, prevout));
+}
+
+TEST_CASE("ds proof pool  verify  der signatures  true", "[ds proof pool tests]") {
+    output_point const prevout{ make_hash(1), 0 };
+    auto const spent = make_spent();
+    auto const first = make_spend(prevout, spent, 1000);
+    auto const second = make_spend(prevout, spent, 2000);
+    auto const proof = ds_proof_pool::create(first, second, prevout);
+    REQUIRE(proof);
+    REQUIRE(ds_proof_pool::verify(*proof, first, spent));
+    REQUIRE(ds_proof_pool::verify(*proof, second, spent));
+}
+
+TEST_CASE("ds proof pool  verify  schnorr signatures  true", "[ds proof pool tests]") {
+    output_point const prevout{ make_hash(1), 0 };
+    auto const spent = make_spent();
+    auto const first = make_spend(prevout, spent, 1000, signer::schnorr);
+    auto const second = make_spend(prevout, spent, 2000, signer::der);
+    REQUIRE(first.inputs().front().script().operations()[0].data().size() == 65u);
+
+    auto const proof = ds_proof_pool::create(first, second, prevout);
+    REQUIRE(proof);
+    REQUIRE(ds_proof_pool::verify(*proof, first, spent));
+}
+
+TEST_CASE("ds proof pool  verify  output not paying the key  false", "[ds proof pool tests]") {
+    output_point const prevout{ make_hash(1), 0 };
+    auto const spent = make_spent();
+    auto const first = make_spend(prevout, spent, 1000);
+    auto const second = make_spend(prevout, spent, 2000);
+    auto const proof = ds_proof_pool::create(first, second, prevout);
+    REQUIRE(proof);
+
+    REQUIRE( ! ds_proof_pool::verify(*proof, first, output{ 5000, script{}, {} }));
+    REQUIRE( ! ds_proof_pool::verify(*proof, first, output{ 5000, paying(make_secret(2)), {} }));
+}
+
+TEST_CASE("ds proof pool  verify  signed by another key  false", "[ds proof pool tests]") {
+    output_point const prevout{ make_hash(1), 0 };
+    auto const spent = make_spent();
+    auto const first = make_spend(prevout, spent, 1000);
+    auto const second = make_spend(prevout, spent, 2000, signer::schnorr, make_secret(2), make_secret(1));
+    auto const proof = ds_proof_pool::create(first, second, prevout);
+    REQUIRE(proof);
+    REQUIRE( ! ds_proof_pool::verify(*proof, first, spent));
+}
+
+TEST_CASE("ds proof pool  verify  other spent value  false", "[ds proof pool tests]") {
+    output_point const prevout{ make_hash(1), 0 };
+    auto const spent = make_spent();
+    auto const first = make_spend(prevout, spent, 1000);
+    auto const second = make_spend(prevout, spent, 2000);
+    auto const proof = ds_proof_pool::create(first, second, prevout);
+    REQUIRE(proof);
+    REQUIRE( ! ds_proof_pool::verify(*proof, first, output{ 4000, spent.script(), {} }));
+}
+
+TEST_CASE("ds proof pool  verify  same spender twice  false", "[ds proof pool tests]") {
+    output_point const prevout{ make_hash(1), 0 };
+    auto const spent = make_spent();
+    auto const first = make_spend(prevout, spent, 1000);
+    auto const proof = ds_proof_pool::create(first, first, prevout);
+    REQUIRE(proof);
+    REQUIRE( ! ds_proof_pool::verify(*proof, first, spent));
+}
+
+// End Test Suite
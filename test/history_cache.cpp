@@ -0,0 +1,92 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <test_helpers.hpp>
+
+#include <cstdint>
+
+#include <kth/blockchain.hpp>
+
+using namespace kth;
+using namespace kd::chain;
+using namespace kth::blockchain;
+
+// Start Test Suite: history cache tests
+
+static
+history_compact::list make_history(size_t rows) {
+    history_compact::list history;
+    for (uint32_t height = 0; height < rows; ++height) {
+        history.push_back(history_compact{ point_kind::output, point{ null_hash, height }, height, height });
+    }
+
+    return history;
+}
+
+static short_hash const address1{ { 1 } };
+static short_hash const address2{ { 2 } };
+
+TEST_CASE("history cache  get  added result  found by key", "[history cache tests]") {
+    history_cache instance(10);
+    instance.add(address1, 0, 5, make_history(3), instance.sequence());
+
+    history_compact::list out;
+    REQUIRE(instance.get(address1, 0, 5, out));
+    REQUIRE(out.size() == 3u);
+    REQUIRE(instance.size() == 3u);
+    REQUIRE( ! instance.get(address1, 0, 0, out));
+    REQUIRE( ! instance.get(address1, 1, 5, out));
+    REQUIRE( ! instance.get(address2, 0, 5, out));
+}
+
+TEST_CASE("history cache  add  over capacity  evicts least recently used", "[history cache tests]") {
+    history_cache instance(5);
+    instance.add(address1, 0, 0, make_history(2), instance.sequence());
+    instance.add(address2, 0, 0, make_history(2), instance.sequence());
+
+    history_compact::list out;
+    REQUIRE(instance.get(address1, 0, 0, out));
+
+    instance.add(address1, 0, 1, make_history(2), instance.sequence());
+    REQUIRE(instance.size() == 4u);
+    REQUIRE(instance.get(address1, 0, 0, out));
+    REQUIRE(instance.get(address1, 0, 1, out));
+    REQUIRE( ! instance.get(address2, 0, 0, out));
+}
+
+TEST_CASE("history cache  add  larger than capacity  not cached", "[history cache tests]") {
+    history_cache instance(2);
+    instance.add(address1, 0, 0, make_history(3), instance.sequence());
+
+    history_compact::list out;
+    REQUIRE( ! instance.get(address1, 0, 0, out));
+    REQUIRE(instance.size() == 0u);
+}
+
+TEST_CASE("history cache  invalidate  address  drops only its results", "[history cache tests]") {
+    history_cache instance(10);
+    instance.add(address1, 0, 0, make_history(1), instance.sequence());
+    instance.add(address1, 5, 0, make_history(1), instance.sequence());
+    instance.add(address2, 0, 0, make_history(1), instance.sequence());
+
+    instance.invalidate({ address1 });
+
+    history_compact::list out;
+    REQUIRE( ! instance.get(address1, 0, 0, out));
+    REQUIRE( ! instance.get(address1, 5, 0, out));
+    REQUIRE(instance.get(address2, 0, 0, out));
+    REQUIRE(instance.size() == 1u);
+}
+
+TEST_CASE("history cache  add  stale sequence  ignored", "[history cache tests]") {
+    history_cache instance(10);
+    auto const sequence = instance.sequence();
+    instance.invalidate({ address2 });
+    instance.add(address1, 0, 0, make_history(1), sequence);
+
+    history_compact::list out;
+    REQUIRE( ! instance.get(address1, 0, 0, out));
+}
+
+// End Test Suite
@@ -0,0 +1,221 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <test_helpers.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include <kth/blockchain.hpp>
+
+using namespace kth;
+using namespace kd::chain;
+using namespace kth::blockchain;
+using namespace kth::blockchain::test;
+
+// Start Test Suite: history index tests
+
+static
+short_hash address(uint8_t id) {
+    short_hash hash;
+    hash.fill(id);
+    return hash;
+}
+
+// A coinbase with outputs paying each address, distinct by id (locktime).
+static
+transaction make_paying(uint32_t id, std::vector<short_hash> const& addresses) {
+    output::list outputs;
+    for (auto const& paid : addresses) {
+        outputs.push_back(output{ 50, script{ script::to_pay_key_hash_pattern(paid) }, {} });
+    }
+
+    return transaction{ 1, id, { input{ output_point{ null_hash, max_uint32 }, script{}, max_uint32 } }, std::move(outputs) };
+}
+
+static
+history_index::key key_of(history_compact const& entry) {
+    return { entry.height, entry.point.hash(), entry.point.index(), entry.kind };
+}
+
+// The history of the address read by pages, each from the key following the
+// previous page.
+static
+history_compact::list read_pages(history_index const& instance, short_hash const& paid, size_t page) {
+    history_compact::list result;
+    history_index::key from{ 0, null_hash, 0, point_kind::output };
+
+    while (true) {
+        history_compact::list rows;
+        REQUIRE(instance.read(paid, from, page + 1, rows));
+
+        auto const done = rows.size() <= page;
+        if ( ! done) {
+            from = key_of(rows[page]);
+            rows.resize(page);
+        }
+
+        result.insert(result.end(), rows.begin(), rows.end());
+        if (done) {
+            return result;
+        }
+    }
+}
+
+static
+bool ordered(history_compact::list const& history) {
+    for (size_t index = 1; index < history.size(); ++index) {
+        if ( ! (key_of(history[index - 1]) < key_of(history[index]))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static
+std::filesystem::path fresh_directory(std::string const& name) {
+    std::error_code ec;
+    std::filesystem::remove_all(name, ec);
+    return name;
+}
+
+TEST_CASE("history index  read  resume within height  each entry once in order", "[history index tests]") {
+    history_index instance(10);
+    auto const block0 = make_block(null_hash, 0, { make_paying(0, { address(1), address(2), address(1) }), make_paying(1, { address(1), address(1) }) });
+    auto const block1 = make_block(block0.hash(), 1, { make_paying(2, { address(1) }) });
+    REQUIRE(instance.push(block0, 0));
+    REQUIRE(instance.push(block1, 1));
+
+    history_compact::list first;
+    REQUIRE(instance.read(address(1), { 0, null_hash, 0, point_kind::output }, 3, first));
+    REQUIRE(first.size() == 3u);
+    REQUIRE(first[2].height == 0u);
+
+    // The next page starts at the third entry, within height zero.
+    history_compact::list second;
+    REQUIRE(instance.read(address(1), key_of(first[2]), 10, second));
+    REQUIRE(second.size() == 3u);
+    REQUIRE(key_of(second[0]) == key_of(first[2]));
+    REQUIRE(second[1].height == 0u);
+    REQUIRE(second[2].height == 1u);
+
+    auto const history = read_pages(instance, address(1), 2);
+    REQUIRE(history.size() == 5u);
+    REQUIRE(ordered(history));
+}
+
+TEST_CASE("history index  read  other address  not listed", "[history index tests]") {
+    history_index instance(10);
+    auto const block0 = make_block(null_hash, 0, { make_paying(0, { address(1), address(2), address(3) }) });
+    REQUIRE(instance.push(block0, 0));
+
+    history_compact::list out;
+    REQUIRE(instance.read(address(2), { 0, null_hash, 0, point_kind::output }, 10, out));
+    REQUIRE(out.size() == 1u);
+    REQUIRE(out[0].point.index() == 1u);
+    REQUIRE(instance.read(address(4), { 0, null_hash, 0, point_kind::output }, 10, out));
+    REQUIRE(out.empty());
+}
+
+TEST_CASE("history index  push  spend  listed from prevout", "[history index tests]") {
+    history_index instance(10);
+    auto const paying = make_paying(0, { address(1) });
+    auto const block0 = make_block(null_hash, 0, { paying });
+    REQUIRE(instance.push(block0, 0));
+
+    transaction const spend{ 1, 0, { input{ output_point{ paying.hash(), 0 }, script{}, max_uint32 } }, { output{ 40, script{}, {} } } };
+    auto const block1 = make_block(block0.hash(), 1, { make_coinbase(1), spend });
+    REQUIRE( ! instance.push(block1, 1));
+
+    block1.transactions()[1].inputs()[0].previous_output().validation.cache = paying.outputs()[0];
+    REQUIRE(instance.push(block1, 1));
+
+    history_compact::list out;
+    REQUIRE(instance.read(address(1), { 1, null_hash, 0, point_kind::output }, 10, out));
+    REQUIRE(out.size() == 1u);
+    REQUIRE(out[0].kind == point_kind::spend);
+    REQUIRE(out[0].point.hash() == spend.hash());
+}
+
+TEST_CASE("history index  push  not extending top  false", "[history index tests]") {
+    history_index instance(10);
+    auto const block0 = make_block(null_hash, 0, { make_coinbase(0) });
+    REQUIRE(instance.push(block0, 0));
+    REQUIRE( ! instance.push(make_block(null_hash, 1, { make_coinbase(1) }), 1));
+    REQUIRE( ! instance.push(make_block(block0.hash(), 2, { make_coinbase(2) }), 2));
+    REQUIRE(instance.size() == 1u);
+}
+
+TEST_CASE("history index  truncate  within window  drops top blocks", "[history index tests]") {
+    history_index instance(10);
+    auto const block0 = make_block(null_hash, 0, { make_paying(0, { address(1) }) });
+    auto const block1 = make_block(block0.hash(), 1, { make_paying(1, { address(1) }) });
+    REQUIRE(instance.push(block0, 0));
+    REQUIRE(instance.push(block1, 1));
+
+    REQUIRE(instance.truncate(1));
+    REQUIRE(instance.size() == 1u);
+    REQUIRE(read_pages(instance, address(1), 10).size() == 1u);
+    REQUIRE(instance.push(block1, 1));
+}
+
+TEST_CASE("history index  flush  runs merged  read in order and reopened", "[history index tests]") {
+    auto const directory = fresh_directory("history_index_flush");
+    std::vector<block> blocks;
+    auto previous = null_hash;
+
+    for (uint32_t height = 0; height < 6; ++height) {
+        blocks.push_back(make_block(previous, height, { make_paying(height, { address(2), address(1), address(1) }) }));
+        previous = blocks.back().hash();
+    }
+
+    {
+        history_index instance(1, directory, 1);
+        REQUIRE(instance.open());
+
+        for (size_t height = 0; height < blocks.size(); ++height) {
+            REQUIRE(instance.push(blocks[height], height));
+            REQUIRE(instance.flush());
+        }
+
+        // The pages cross the runs (four merged and one) and the blocks.
+        auto const history = read_pages(instance, address(1), 3);
+        REQUIRE(history.size() == 12u);
+        REQUIRE(ordered(history));
+        REQUIRE(history.front().height == 0u);
+        REQUIRE(history.back().height == 5u);
+
+        // The blocks written to runs are not dropped by a truncation.
+        REQUIRE(instance.truncate(5));
+        REQUIRE( ! instance.truncate(4));
+        REQUIRE(instance.size() == 0u);
+    }
+
+    {
+        history_index instance(1, directory, 1);
+        REQUIRE(instance.open());
+        REQUIRE(instance.size() == 0u);
+
+        for (size_t height = 0; height < blocks.size(); ++height) {
+            REQUIRE(instance.push(blocks[height], height));
+            REQUIRE(instance.flush());
+        }
+    }
+
+    // The runs are kept, the block in memory is indexed again.
+    history_index instance(1, directory, 1);
+    REQUIRE(instance.open());
+    REQUIRE(instance.size() == 5u);
+
+    hash_digest top;
+    REQUIRE(instance.block_hash(4, top));
+    REQUIRE(top == blocks[4].hash());
+    REQUIRE(read_pages(instance, address(1), 5).size() == 10u);
+    REQUIRE(instance.push(blocks[5], 5));
+    REQUIRE(read_pages(instance, address(2), 1).size() == 6u);
+}
+
+// End Test Suite
@@ -0,0 +1,84 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <test_helpers.hpp>
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+#include <kth/blockchain.hpp>
+
+using namespace kth::blockchain;
+
+// Start Test Suite: insertion order tests
+
+struct test_entry {
+    size_t sequence;
+};
+
+using test_map = std::unordered_map<int, test_entry>;
+
+static
+std::vector<int> evict_all(insertion_order<int>& order, test_map& entries) {
+    std::vector<int> evicted;
+    order.evict(entries, [&](int oldest) {
+        evicted.push_back(oldest);
+        entries.erase(oldest);
+        return true;
+    });
+
+    return evicted;
+}
+
+TEST_CASE("insertion order  evict  oldest first", "[insertion order tests]") {
+    insertion_order<int> order;
+    test_map entries;
+    for (int key = 1; key <= 3; ++key) {
+        entries.emplace(key, test_entry{ order.push(key) });
+    }
+
+    order.evict(entries, [&](int oldest) {
+        if (entries.size() <= 2) {
+            return false;
+        }
+
+        entries.erase(oldest);
+        return true;
+    });
+
+    REQUIRE(entries.size() == 2u);
+    REQUIRE( ! entries.contains(1));
+    REQUIRE(evict_all(order, entries) == std::vector<int>{ 2, 3 });
+}
+
+TEST_CASE("insertion order  evict  removed and replaced entries  skipped", "[insertion order tests]") {
+    insertion_order<int> order;
+    test_map entries;
+    for (int key = 1; key <= 3; ++key) {
+        entries.emplace(key, test_entry{ order.push(key) });
+    }
+
+    // The first is replaced (now the newest), the second removed.
+    entries[1] = test_entry{ order.push(1) };
+    entries.erase(2);
+
+    REQUIRE(evict_all(order, entries) == std::vector<int>{ 3, 1 });
+}
+
+TEST_CASE("insertion order  compact  keeps current records", "[insertion order tests]") {
+    insertion_order<int> order;
+    test_map entries;
+    for (int key = 1; key <= 4; ++key) {
+        entries.emplace(key, test_entry{ order.push(key) });
+    }
+
+    entries.erase(1);
+    entries.erase(3);
+    order.compact(entries, 0);
+
+    REQUIRE(evict_all(order, entries) == std::vector<int>{ 2, 4 });
+}
+
+// End Test Suite
@@ -0,0 +1,202 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <test_helpers.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include <kth/blockchain.hpp>
+#include <kth/infrastructure/math/sip_hash.hpp>
+
+using namespace kth;
+using namespace kd::chain;
+using namespace kth::blockchain;
+using namespace kth::blockchain::test;
+
+// Start Test Suite: mempool index tests
+
+static
+transaction make_tx(uint32_t locktime) {
+    return transaction{1, locktime, {}, {}};
+}
+
+// A tx spending the outpoint, with one output.
+static
+transaction make_spend(hash_digest const& hash, uint32_t index, uint32_t locktime) {
+    return transaction{1, locktime, { input{ output_point{ hash, index }, script{}, max_uint32 } }, { output{ 1, script{}, {} } }};
+}
+
+static
+block make_block(transaction const& tx) {
+    transaction const coinbase{1, 0, { input{ output_point{ null_hash, max_uint32 }, script{}, max_uint32 } }, {}};
+    return block{ header{}, { coinbase, tx } };
+}
+
+// short ids
+
+TEST_CASE("mempool index  short ids  lanes and remainder  match sip hash", "[mempool index tests]") {
+    uint64_t const k0 = 0x0706050403020100;
+    uint64_t const k1 = 0x0f0e0d0c0b0a0908;
+
+    hash_list hashes;
+    for (uint32_t locktime = 0; locktime < 7; ++locktime) {
+        hashes.push_back(make_tx(locktime).hash());
+    }
+
+    std::vector<uint64_t> ids(hashes.size());
+    short_ids(k0, k1, hashes.data(), hashes.size(), ids.data());
+
+    for (size_t index = 0; index < hashes.size(); ++index) {
+        auto const expected = sip_hash_uint256(k0, k1, hashes[index]) & short_id_mask;
+        REQUIRE(ids[index] == expected);
+        REQUIRE(short_id(k0, k1, hashes[index]) == expected);
+    }
+}
+
+// add
+
+TEST_CASE("mempool index  add  duplicate  indexed once", "[mempool index tests]") {
+    mempool_index instance;
+    auto const tx = make_tx(42);
+    instance.add(tx);
+    instance.add(tx);
+    REQUIRE(instance.size() == 1u);
+    REQUIRE(instance.contains(tx.hash()));
+}
+
+// remove
+
+TEST_CASE("mempool index  remove  first of three  others remain", "[mempool index tests]") {
+    mempool_index instance;
+    auto const tx1 = make_tx(1);
+    auto const tx2 = make_tx(2);
+    auto const tx3 = make_tx(3);
+    instance.add(tx1);
+    instance.add(tx2);
+    instance.add(tx3);
+
+    instance.remove(tx1.hash());
+    REQUIRE(instance.size() == 2u);
+    REQUIRE( ! instance.contains(tx1.hash()));
+    REQUIRE(instance.contains(tx2.hash()));
+    REQUIRE(instance.contains(tx3.hash()));
+}
+
+TEST_CASE("mempool index  remove block  double spent  removed with descendants", "[mempool index tests]") {
+    mempool_index instance;
+    auto const funding = make_hash(1);
+
+    auto const parent = make_spend(funding, 0, 1);
+    auto const child = make_spend(parent.hash(), 0, 2);
+    auto const grandchild = make_spend(child.hash(), 0, 3);
+    auto const unrelated = make_spend(funding, 1, 4);
+    instance.add(parent);
+    instance.add(child);
+    instance.add(grandchild);
+    instance.add(unrelated);
+
+    instance.remove(make_block(make_spend(funding, 0, 5)));
+    REQUIRE(instance.size() == 1u);
+    REQUIRE(instance.contains(unrelated.hash()));
+    REQUIRE( ! instance.contains(parent.hash()));
+    REQUIRE( ! instance.contains(child.hash()));
+    REQUIRE( ! instance.contains(grandchild.hash()));
+}
+
+TEST_CASE("mempool index  remove block  confirmed parent  child remains", "[mempool index tests]") {
+    mempool_index instance;
+    auto const funding = make_hash(1);
+
+    auto const parent = make_spend(funding, 0, 1);
+    auto const child = make_spend(parent.hash(), 0, 2);
+    instance.add(parent);
+    instance.add(child);
+
+    instance.remove(make_block(parent));
+    REQUIRE(instance.size() == 1u);
+    REQUIRE(instance.contains(child.hash()));
+}
+
+// match_short_ids
+
+TEST_CASE("mempool index  match short ids  unique match  returns hash in slot", "[mempool index tests]") {
+    threadpool pool("test", 2);
+    dispatcher dispatch(pool, "test");
+    mempool_index instance;
+
+    auto const tx1 = make_tx(1);
+    auto const tx2 = make_tx(2);
+    instance.add(tx1);
+    instance.add(tx2);
+
+    mempool_index::short_id_map const ids {
+        { short_id(1, 2, tx2.hash()), uint16_t(1) }
+    };
+
+    auto const result = instance.match_short_ids(1, 2, ids, 3, dispatch);
+    REQUIRE(result.size() == 3u);
+    REQUIRE(result[0] == null_hash);
+    REQUIRE(result[1] == tx2.hash());
+    REQUIRE(result[2] == null_hash);
+
+    pool.shutdown();
+    pool.join();
+}
+
+TEST_CASE("mempool index  match short ids  two matches in slot  returns null hash", "[mempool index tests]") {
+    threadpool pool("test", 2);
+    dispatcher dispatch(pool, "test");
+    mempool_index instance;
+
+    auto const tx1 = make_tx(1);
+    auto const tx2 = make_tx(2);
+    instance.add(tx1);
+    instance.add(tx2);
+
+    mempool_index::short_id_map const ids {
+        { short_id(1, 2, tx1.hash()), uint16_t(0) },
+        { short_id(1, 2, tx2.hash()), uint16_t(0) }
+    };
+
+    auto const result = instance.match_short_ids(1, 2, ids, 1, dispatch);
+    REQUIRE(result.size() == 1u);
+    REQUIRE(result[0] == null_hash);
+
+    pool.shutdown();
+    pool.join();
+}
+
+// find
+
+TEST_CASE("mempool index  find  output and populated input  both listed", "[mempool index tests]") {
+    mempool_index instance;
+    script const paid{};
+    auto const key = mempool_index::script_hash(paid);
+
+    output_point const spent{ make_tx(1).hash(), 3 };
+    transaction tx{1, 0, { input{ spent, script{}, 0 } }, { output{ 500, paid } }};
+    tx.inputs()[0].previous_output().validation.cache = output{ 700, paid };
+    instance.add(tx);
+
+    auto const entries = instance.find(key);
+    REQUIRE(entries.size() == 2u);
+    REQUIRE( ! entries[0].input);
+    REQUIRE(entries[0].value == 500u);
+    REQUIRE(entries[1].input);
+    REQUIRE(entries[1].value == 700u);
+    REQUIRE(entries[1].previous_hash == spent.hash());
+    REQUIRE(entries[1].previous_index == 3u);
+}
+
+TEST_CASE("mempool index  find  removed transaction  empty", "[mempool index tests]") {
+    mempool_index instance;
+    script const paid{};
+    transaction const tx{1, 0, {}, { output{ 500, paid } }};
+    instance.add(tx);
+    instance.remove(tx.hash());
+    REQUIRE(instance.find(mempool_index::script_hash(paid)).empty());
+}
+
+// End Test Suite
@@ -0,0 +1,67 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <test_helpers.hpp>
+
+#include <cstdint>
+
+#include <kth/blockchain.hpp>
+
+using namespace kth;
+using namespace kth::blockchain;
+
+// Start Test Suite: muhash tests
+
+static
+data_chunk make_element(uint8_t value) {
+    data_chunk element(32, 0x00);
+    element[0] = value;
+    return element;
+}
+
+// Bitcoin Core crypto_tests (muhash_tests).
+TEST_CASE("muhash  digest  insert insert remove  expected", "[muhash tests]") {
+    muhash instance;
+    instance.insert(make_element(0));
+    instance.insert(make_element(1));
+    instance.remove(make_element(2));
+    REQUIRE(encode_hash(instance.digest()) == "10d312b100cbd32ada024a6646e40d3482fcff103668d2625f10002a607d5863");
+}
+
+TEST_CASE("muhash  digest  update order  same", "[muhash tests]") {
+    muhash instance1;
+    instance1.insert(make_element(1));
+    instance1.insert(make_element(2));
+    instance1.remove(make_element(3));
+
+    muhash instance2;
+    instance2.remove(make_element(3));
+    instance2.insert(make_element(2));
+    instance2.insert(make_element(1));
+
+    REQUIRE(instance1.digest() == instance2.digest());
+}
+
+TEST_CASE("muhash  digest  removed element  empty set", "[muhash tests]") {
+    muhash instance;
+    instance.insert(make_element(1));
+    instance.remove(make_element(1));
+    REQUIRE(instance.digest() == muhash{}.digest());
+}
+
+TEST_CASE("muhash  combine  updates  same as applied", "[muhash tests]") {
+    muhash updates;
+    updates.insert(make_element(2));
+    updates.remove(make_element(1));
+
+    muhash instance1;
+    instance1.insert(make_element(1));
+    instance1.combine(updates);
+
+    muhash instance2;
+    instance2.insert(make_element(2));
+    REQUIRE(instance1.digest() == instance2.digest());
+}
+
+// End Test Suite
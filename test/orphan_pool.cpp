@@ -0,0 +1,77 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <test_helpers.hpp>
+
+#include <chrono>
+#include <cstdint>
+
+#include <kth/blockchain.hpp>
+
+using namespace kth;
+using namespace kd::chain;
+using namespace kth::blockchain;
+using namespace kth::blockchain::test;
+
+// Start Test Suite: orphan pool tests
+
+// Prevouts are not populated, so all are missing.
+static
+transaction_const_ptr make_orphan(uint8_t parent, uint32_t id) {
+    return std::make_shared<transaction const>(transaction{ 1, id, { input{ output_point{ make_hash(parent), 0 }, script{}, max_uint32 } }, { output{ 1, script{}, {} } } });
+}
+
+TEST_CASE("orphan pool  take  waiting children  removed", "[orphan pool tests]") {
+    orphan_pool instance(10, 100000, std::chrono::minutes(20));
+    auto const orphan1 = make_orphan(1, 1);
+    auto const orphan2 = make_orphan(1, 2);
+    REQUIRE(instance.add(orphan1));
+    REQUIRE(instance.add(orphan2));
+    REQUIRE(instance.add(make_orphan(2, 3)));
+    REQUIRE( ! instance.add(orphan1));
+    REQUIRE(instance.size() == 3u);
+
+    auto const children = instance.take(make_hash(1));
+    REQUIRE(children.size() == 2u);
+    REQUIRE(instance.size() == 1u);
+    REQUIRE(instance.take(make_hash(1)).empty());
+    REQUIRE(instance.bytes() == make_orphan(2, 3)->serialized_size(true));
+}
+
+TEST_CASE("orphan pool  add  populated prevouts  false", "[orphan pool tests]") {
+    orphan_pool instance(10, 100000, std::chrono::minutes(20));
+    auto const tx = make_orphan(1, 1);
+    tx->inputs()[0].previous_output().validation.cache = output{ 1, script{}, {} };
+    REQUIRE( ! instance.add(tx));
+}
+
+TEST_CASE("orphan pool  add  over count  evicts oldest", "[orphan pool tests]") {
+    orphan_pool instance(2, 100000, std::chrono::minutes(20));
+    REQUIRE(instance.add(make_orphan(1, 1)));
+    REQUIRE(instance.add(make_orphan(2, 2)));
+    REQUIRE(instance.add(make_orphan(3, 3)));
+    REQUIRE(instance.size() == 2u);
+    REQUIRE(instance.take(make_hash(1)).empty());
+    REQUIRE(instance.take(make_hash(3)).size() == 1u);
+}
+
+TEST_CASE("orphan pool  add  over bytes  evicts oldest", "[orphan pool tests]") {
+    auto const size = make_orphan(1, 1)->serialized_size(true);
+    orphan_pool instance(10, 2 * size, std::chrono::minutes(20));
+    REQUIRE(instance.add(make_orphan(1, 1)));
+    REQUIRE(instance.add(make_orphan(2, 2)));
+    REQUIRE(instance.add(make_orphan(3, 3)));
+    REQUIRE(instance.bytes() == 2 * size);
+    REQUIRE(instance.take(make_hash(1)).empty());
+}
+
+TEST_CASE("orphan pool  expire  zero expiration  empty", "[orphan pool tests]") {
+    orphan_pool instance(10, 100000, std::chrono::seconds(0));
+    REQUIRE(instance.add(make_orphan(1, 1)));
+    instance.expire();
+    REQUIRE(instance.size() == 0u);
+    REQUIRE(instance.bytes() == 0u);
+}
+
+// End Test Suite
@@ -0,0 +1,109 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <test_helpers.hpp>
+
+#include <filesystem>
+#include <fstream>
+
+#include <kth/blockchain.hpp>
+
+using namespace kth;
+using namespace kth::blockchain;
+using namespace std::filesystem;
+
+// Start Test Suite: record file tests
+
+static
+path fresh_file(std::string const& name) {
+    std::error_code ec;
+    remove(name, ec);
+    return name;
+}
+
+TEST_CASE("record file  push  get  round trip", "[record file tests]") {
+    record_file instance(fresh_file("record_file_push"));
+    REQUIRE(instance.open());
+    REQUIRE(instance.size() == 0u);
+
+    REQUIRE(instance.push(0, data_chunk{ 1, 2, 3 }));
+    REQUIRE(instance.push(1, data_chunk{}));
+    REQUIRE(instance.push(2, data_chunk{ 4 }));
+    REQUIRE( ! instance.push(4, data_chunk{ 5 }));
+    REQUIRE(instance.size() == 3u);
+
+    data_chunk out;
+    REQUIRE(instance.get(0, out));
+    REQUIRE(out == data_chunk{ 1, 2, 3 });
+    REQUIRE(instance.get(1, out));
+    REQUIRE(out.empty());
+    REQUIRE(instance.get(2, out));
+    REQUIRE(out == data_chunk{ 4 });
+    REQUIRE( ! instance.get(3, out));
+}
+
+TEST_CASE("record file  truncate  drops top records", "[record file tests]") {
+    record_file instance(fresh_file("record_file_truncate"));
+    REQUIRE(instance.open());
+    REQUIRE(instance.push(0, data_chunk{ 1 }));
+    REQUIRE(instance.push(1, data_chunk{ 2 }));
+    REQUIRE(instance.push(2, data_chunk{ 3 }));
+
+    REQUIRE(instance.truncate(1));
+    REQUIRE(instance.size() == 1u);
+
+    data_chunk out;
+    REQUIRE( ! instance.get(1, out));
+    REQUIRE(instance.push(1, data_chunk{ 4 }));
+    REQUIRE(instance.get(1, out));
+    REQUIRE(out == data_chunk{ 4 });
+}
+
+TEST_CASE("record file  open  existing  reads records", "[record file tests]") {
+    auto const file = fresh_file("record_file_reopen");
+
+    {
+        record_file instance(file);
+        REQUIRE(instance.open());
+        REQUIRE(instance.push(0, data_chunk{ 1 }));
+        REQUIRE(instance.push(1, data_chunk{ 2, 3 }));
+        instance.close();
+    }
+
+    record_file instance(file);
+    std::vector<data_chunk> records;
+    REQUIRE(instance.open([&](size_t height, data_chunk&& data) {
+        REQUIRE(height == records.size());
+        records.push_back(std::move(data));
+    }));
+
+    REQUIRE(instance.size() == 2u);
+    REQUIRE(records.size() == 2u);
+    REQUIRE(records[1] == data_chunk{ 2, 3 });
+}
+
+TEST_CASE("record file  open  partial last record  dropped", "[record file tests]") {
+    auto const file = fresh_file("record_file_partial");
+
+    {
+        record_file instance(file);
+        REQUIRE(instance.open());
+        REQUIRE(instance.push(0, data_chunk{ 1 }));
+        instance.close();
+    }
+
+    // A size prefix claiming more data than was written.
+    {
+        std::ofstream stream(file, std::ios::app | std::ios::binary);
+        stream.put(char(9)).put(0).put(0).put(0).put(char(1));
+    }
+
+    record_file instance(file);
+    REQUIRE(instance.open());
+    REQUIRE(instance.size() == 1u);
+    REQUIRE(file_size(file) == sizeof(uint32_t) + 1);
+    REQUIRE(instance.push(1, data_chunk{ 2 }));
+}
+
+// End Test Suite
@@ -0,0 +1,72 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <test_helpers.hpp>
+
+#include <cstdint>
+
+#include <kth/blockchain.hpp>
+
+using namespace kth;
+using namespace kth::blockchain;
+using namespace kth::blockchain::test;
+
+// Start Test Suite: rolling bloom filter tests
+
+TEST_CASE("rolling bloom filter  contains  inserted  true", "[rolling bloom filter tests]") {
+    rolling_bloom_filter instance(100, 0.000001);
+    REQUIRE( ! instance.contains(make_uniform_hash(1)));
+
+    instance.insert(make_uniform_hash(1));
+    REQUIRE(instance.contains(make_uniform_hash(1)));
+    REQUIRE( ! instance.contains(make_uniform_hash(2)));
+}
+
+TEST_CASE("rolling bloom filter  contains  most recent elements  true", "[rolling bloom filter tests]") {
+    rolling_bloom_filter instance(100, 0.000001);
+    for (uint32_t value = 0; value < 1000; ++value) {
+        instance.insert(make_uniform_hash(value));
+    }
+
+    for (uint32_t value = 900; value < 1000; ++value) {
+        REQUIRE(instance.contains(make_uniform_hash(value)));
+    }
+
+    // Older generations are dropped.
+    size_t remembered = 0;
+    for (uint32_t value = 0; value < 700; ++value) {
+        remembered += instance.contains(make_uniform_hash(value)) ? 1 : 0;
+    }
+
+    REQUIRE(remembered == 0u);
+}
+
+TEST_CASE("rolling bloom filter  contains  not inserted  rarely true", "[rolling bloom filter tests]") {
+    rolling_bloom_filter instance(1000, 0.000001);
+    for (uint32_t value = 0; value < 1000; ++value) {
+        instance.insert(make_uniform_hash(value));
+    }
+
+    size_t false_positives = 0;
+    for (uint32_t value = 1000; value < 101000; ++value) {
+        false_positives += instance.contains(make_uniform_hash(value)) ? 1 : 0;
+    }
+
+    REQUIRE(false_positives <= 1u);
+}
+
+TEST_CASE("rolling bloom filter  reset  inserted  false", "[rolling bloom filter tests]") {
+    rolling_bloom_filter instance(100, 0.000001);
+    instance.insert(make_uniform_hash(1));
+    instance.reset();
+    REQUIRE( ! instance.contains(make_uniform_hash(1)));
+}
+
+TEST_CASE("rolling bloom filter  insert  zero elements  disabled", "[rolling bloom filter tests]") {
+    rolling_bloom_filter instance(0, 0.000001);
+    instance.insert(make_uniform_hash(1));
+    REQUIRE( ! instance.contains(make_uniform_hash(1)));
+}
+
+// End Test Suite
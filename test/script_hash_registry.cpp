@@ -0,0 +1,90 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <test_helpers.hpp>
+
+#include <kth/blockchain.hpp>
+
+using namespace kth;
+using namespace kd::chain;
+using namespace kth::blockchain;
+
+// Start Test Suite: script hash registry tests
+
+// subscribe
+
+TEST_CASE("script hash registry  subscribe  stopped  service stopped", "[script hash registry tests]") {
+    script_hash_registry instance;
+    code result;
+    auto const id = instance.subscribe([&](code ec, script_hash_registry::notifications const&) {
+        result = ec;
+        return true;
+    });
+
+    REQUIRE(id == 0u);
+    REQUIRE(result == error::service_stopped);
+}
+
+// notify_transaction
+
+TEST_CASE("script hash registry  notify transaction  watched output  notified once", "[script hash registry tests]") {
+    script_hash_registry instance;
+    instance.start();
+
+    script_hash_registry::notifications received;
+    auto const id = instance.subscribe([&](code ec, script_hash_registry::notifications const& notes) {
+        received.insert(received.end(), notes.begin(), notes.end());
+        return true;
+    });
+
+    script const paid{};
+    auto const key = mempool_index::script_hash(paid);
+    REQUIRE(instance.watch(id, { key }));
+
+    transaction const tx{1, 0, {}, { output{ 1, paid }, output{ 2, paid } }};
+    instance.notify_transaction(tx);
+
+    REQUIRE(received.size() == 1u);
+    REQUIRE(received[0].script_hash == key);
+    REQUIRE(received[0].tx_hash == tx.hash());
+    REQUIRE(received[0].kind == script_hash_registry::change::unconfirmed);
+    instance.stop();
+}
+
+TEST_CASE("script hash registry  notify transaction  unwatched  not notified", "[script hash registry tests]") {
+    script_hash_registry instance;
+    instance.start();
+
+    size_t calls = 0;
+    auto const id = instance.subscribe([&](code, script_hash_registry::notifications const&) {
+        ++calls;
+        return true;
+    });
+
+    script const paid{};
+    REQUIRE(instance.watch(id, { mempool_index::script_hash(paid) }));
+    REQUIRE(instance.unwatch(id, { mempool_index::script_hash(paid) }));
+
+    instance.notify_transaction(transaction{1, 0, {}, { output{ 1, paid } }});
+    REQUIRE(calls == 0u);
+    instance.stop();
+}
+
+// stop
+
+TEST_CASE("script hash registry  stop  subscribed  service stopped", "[script hash registry tests]") {
+    script_hash_registry instance;
+    instance.start();
+
+    code result;
+    instance.subscribe([&](code ec, script_hash_registry::notifications const&) {
+        result = ec;
+        return true;
+    });
+
+    instance.stop();
+    REQUIRE(result == error::service_stopped);
+}
+
+// End Test Suite
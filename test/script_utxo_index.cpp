@@ -0,0 +1,55 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <test_helpers.hpp>
+
+#include <cstdint>
+
+#include <kth/blockchain.hpp>
+
+using namespace kth;
+using namespace kd::chain;
+using namespace kth::blockchain;
+using namespace kth::blockchain::test;
+
+// Start Test Suite: script utxo index tests
+
+static
+script make_script(uint8_t opcode) {
+    return script{ data_chunk{ opcode }, false };
+}
+
+TEST_CASE("script utxo index  connect  outputs  indexed by script hash", "[script utxo index tests]") {
+    script_utxo_index instance(10);
+    auto const script1 = make_script(0x51);
+    auto const script2 = make_script(0x52);
+    transaction const tx{ 1, 0, {}, { output{ 10, script1, {} }, output{ 20, script2, {} }, output{ 30, script1, {} } } };
+
+    REQUIRE(instance.connect(make_block(null_hash, 0, { tx }), 0));
+
+    auto const found = instance.find(mempool_index::script_hash(script1));
+    REQUIRE(found.size() == 2u);
+    REQUIRE(found[0].output.value() + found[1].output.value() == 40u);
+    REQUIRE(instance.find(mempool_index::script_hash(script2)).size() == 1u);
+}
+
+TEST_CASE("script utxo index  disconnect  spending block  restores outputs", "[script utxo index tests]") {
+    script_utxo_index instance(10);
+    auto const script1 = make_script(0x51);
+    auto const script2 = make_script(0x52);
+    transaction const tx1{ 1, 0, {}, { output{ 10, script1, {} } } };
+    transaction const tx2{ 1, 0, { input{ output_point{ tx1.hash(), 0 }, script{}, max_uint32 } }, { output{ 9, script2, {} } } };
+    auto const block0 = make_block(null_hash, 0, { tx1 });
+    auto const block1 = make_block(block0.hash(), 1, { tx2 });
+
+    REQUIRE(instance.connect(block0, 0));
+    REQUIRE(instance.connect(block1, 1));
+    REQUIRE(instance.find(mempool_index::script_hash(script1)).empty());
+
+    REQUIRE(instance.disconnect(block1));
+    REQUIRE(instance.find(mempool_index::script_hash(script1)).size() == 1u);
+    REQUIRE(instance.find(mempool_index::script_hash(script2)).empty());
+}
+
+// End Test Suite
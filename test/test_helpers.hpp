@@ -7,12 +7,46 @@
 #ifndef KTH_BLOCKCHAIN_TEST_HELPERS_HPP
 #define KTH_BLOCKCHAIN_TEST_HELPERS_HPP
 
+#include <cstdint>
+#include <utility>
+
 #include <catch2/catch_test_macros.hpp>
 
 // #define CHECK_MESSAGE(cond, msg) do { INFO(msg); CHECK(cond); } while((void)0, 0)
 // #define REQUIRE_MESSAGE(cond, msg) do { INFO(msg); REQUIRE(cond); } while((void)0, 0)
 
 // #include <kth/infrastructure.hpp>
-// #include <kth/domain.hpp>
+#include <kth/domain.hpp>
+
+namespace kth::blockchain::test {
+
+// A hash distinct by value (its first byte).
+inline
+hash_digest make_hash(uint8_t value) {
+    hash_digest hash = null_hash;
+    hash[0] = value;
+    return hash;
+}
+
+// A hash distinct by value, with uniform words (as hashed keys are).
+inline
+hash_digest make_uniform_hash(uint32_t value) {
+    return sha256_hash(to_little_endian(value));
+}
+
+// A block with the header of the id (version) on the previous block.
+inline
+domain::chain::block make_block(hash_digest const& previous, uint32_t id, domain::chain::transaction::list&& txs) {
+    return domain::chain::block{ domain::chain::header{ id, previous, null_hash, 0, 0, 0 }, std::move(txs) };
+}
+
+// A coinbase paying 50 to an empty script, distinct by id (locktime).
+inline
+domain::chain::transaction make_coinbase(uint32_t id) {
+    using namespace domain::chain;
+    return transaction{ 1, id, { input{ output_point{ null_hash, max_uint32 }, script{}, max_uint32 } }, { output{ 50, script{}, {} } } };
+}
+
+} // namespace kth::blockchain::test
 
 #endif // KTH_BLOCKCHAIN_TEST_HELPERS_HPP
@@ -0,0 +1,210 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <test_helpers.hpp>
+
+#include <cstdint>
+#include <filesystem>
+
+#include <kth/blockchain.hpp>
+
+using namespace kth;
+using namespace kd::chain;
+using namespace kth::blockchain;
+using namespace kth::blockchain::test;
+
+// Start Test Suite: token index tests
+
+static
+hash_digest make_category(uint8_t value) {
+    hash_digest hash = null_hash;
+    hash[0] = value;
+    return hash;
+}
+
+static
+output make_fungible(hash_digest const& category, int64_t amount) {
+    return output{ 1000, script{}, token_data_t{ category, fungible{ amount_t{ amount } } } };
+}
+
+static
+output make_nft(hash_digest const& category, data_chunk const& commitment) {
+    return output{ 1000, script{}, token_data_t{ category, non_fungible{ capability_t::none, commitment } } };
+}
+
+static
+input make_spend(hash_digest const& hash, uint32_t index) {
+    return input{ output_point{ hash, index }, script{}, max_uint32 };
+}
+
+// connect
+
+TEST_CASE("token index  connect  token outputs  indexed by category", "[token index tests]") {
+    token_index instance(10);
+    auto const category = make_category(1);
+    transaction const tx{ 1, 0, {}, { make_fungible(category, 100), output{ 500, script{}, {} }, make_fungible(make_category(2), 5) } };
+    auto const block0 = make_block(null_hash, 0, { tx });
+
+    REQUIRE(instance.connect(block0, 0));
+    REQUIRE(instance.size() == 1u);
+
+    auto const found = instance.find(category);
+    REQUIRE(found.size() == 1u);
+    REQUIRE(found[0].point == output_point{ tx.hash(), 0 });
+    REQUIRE(found[0].height == 0u);
+    REQUIRE(instance.find(make_category(2)).size() == 1u);
+    REQUIRE(instance.find(make_category(3)).empty());
+}
+
+TEST_CASE("token index  connect  not extending top  false", "[token index tests]") {
+    token_index instance(10);
+    auto const block0 = make_block(null_hash, 0, {});
+    REQUIRE(instance.connect(block0, 0));
+    REQUIRE( ! instance.connect(make_block(make_category(9), 1, {}), 1));
+    REQUIRE( ! instance.connect(make_block(block0.hash(), 1, {}), 2));
+    REQUIRE(instance.size() == 1u);
+}
+
+TEST_CASE("token index  connect  spend  removes output", "[token index tests]") {
+    token_index instance(10);
+    auto const category = make_category(1);
+    transaction const tx1{ 1, 0, {}, { make_fungible(category, 100) } };
+    transaction const tx2{ 1, 0, { make_spend(tx1.hash(), 0) }, {} };
+    auto const block0 = make_block(null_hash, 0, { tx1 });
+    auto const block1 = make_block(block0.hash(), 1, { tx2 });
+
+    REQUIRE(instance.connect(block0, 0));
+    REQUIRE(instance.connect(block1, 1));
+    REQUIRE(instance.find(category).empty());
+}
+
+// disconnect
+
+TEST_CASE("token index  disconnect  top block  restores spent outputs", "[token index tests]") {
+    token_index instance(10);
+    auto const category = make_category(1);
+    transaction const tx1{ 1, 0, {}, { make_fungible(category, 100) } };
+    transaction const tx2{ 1, 0, { make_spend(tx1.hash(), 0) }, { make_fungible(category, 60), make_fungible(category, 40) } };
+    auto const block0 = make_block(null_hash, 0, { tx1 });
+    auto const block1 = make_block(block0.hash(), 1, { tx2 });
+
+    REQUIRE(instance.connect(block0, 0));
+    REQUIRE(instance.connect(block1, 1));
+    REQUIRE(instance.find(category).size() == 2u);
+
+    REQUIRE(instance.disconnect(block1));
+    REQUIRE(instance.size() == 1u);
+
+    auto const found = instance.find(category);
+    REQUIRE(found.size() == 1u);
+    REQUIRE(found[0].point == output_point{ tx1.hash(), 0 });
+}
+
+TEST_CASE("token index  disconnect  spent within block  not restored", "[token index tests]") {
+    token_index instance(10);
+    auto const category = make_category(1);
+    transaction const tx1{ 1, 0, {}, { make_fungible(category, 100) } };
+    transaction const tx2{ 1, 0, { make_spend(tx1.hash(), 0) }, {} };
+    auto const block0 = make_block(null_hash, 0, {});
+    auto const block1 = make_block(block0.hash(), 1, { tx1, tx2 });
+
+    REQUIRE(instance.connect(block0, 0));
+    REQUIRE(instance.connect(block1, 1));
+    REQUIRE(instance.disconnect(block1));
+    REQUIRE(instance.find(category).empty());
+}
+
+TEST_CASE("token index  disconnect  beyond undo depth  false", "[token index tests]") {
+    token_index instance(1);
+    auto const block0 = make_block(null_hash, 0, {});
+    auto const block1 = make_block(block0.hash(), 1, {});
+
+    REQUIRE(instance.connect(block0, 0));
+    REQUIRE(instance.connect(block1, 1));
+    REQUIRE(instance.disconnect(block1));
+    REQUIRE( ! instance.disconnect(block0));
+}
+
+TEST_CASE("token index  disconnect  not top block  false", "[token index tests]") {
+    token_index instance(10);
+    auto const block0 = make_block(null_hash, 0, {});
+    REQUIRE(instance.connect(block0, 0));
+    REQUIRE( ! instance.disconnect(make_block(block0.hash(), 1, {})));
+}
+
+// find
+
+TEST_CASE("token index  find  commitment  matching nfts only", "[token index tests]") {
+    token_index instance(10);
+    auto const category = make_category(1);
+    transaction const tx{ 1, 0, {}, { make_nft(category, { 0x01 }), make_nft(category, { 0x02 }), make_fungible(category, 7) } };
+    REQUIRE(instance.connect(make_block(null_hash, 0, { tx }), 0));
+
+    auto const found = instance.find(category, { 0x02 });
+    REQUIRE(found.size() == 1u);
+    REQUIRE(found[0].point == output_point{ tx.hash(), 1 });
+    REQUIRE(instance.find(category).size() == 3u);
+}
+
+// reset
+
+TEST_CASE("token index  reset  start height  connects above", "[token index tests]") {
+    token_index instance(10);
+    auto const previous = make_category(9);
+    instance.reset(100, previous);
+
+    REQUIRE(instance.size() == 100u);
+    REQUIRE( ! instance.connect(make_block(null_hash, 0, {}), 100));
+    REQUIRE(instance.connect(make_block(previous, 0, {}), 100));
+}
+
+TEST_CASE("token index  reset  synced  cleared", "[token index tests]") {
+    token_index instance(10);
+    REQUIRE( ! instance.synced());
+    instance.set_synced();
+    REQUIRE(instance.synced());
+    instance.reset(100, null_hash);
+    REQUIRE( ! instance.synced());
+}
+
+// save
+
+TEST_CASE("token index  load  saved  restores outputs and spends", "[token index tests]") {
+    std::filesystem::path const file = "token_index_load_saved";
+    auto const category = make_category(1);
+    transaction const tx1{ 1, 0, {}, { make_fungible(category, 100), make_nft(category, { 0x01 }) } };
+    transaction const tx2{ 1, 0, { make_spend(tx1.hash(), 0) }, {} };
+    auto const block0 = make_block(null_hash, 0, { tx1 });
+    auto const block1 = make_block(block0.hash(), 1, { tx2 });
+
+    token_index saved(10);
+    REQUIRE(saved.connect(block0, 0));
+    REQUIRE(saved.connect(block1, 1));
+    REQUIRE(saved.save(file));
+
+    token_index instance(10);
+    REQUIRE(instance.load(file));
+    REQUIRE(instance.size() == 2u);
+    REQUIRE(instance.top_hash() == block1.hash());
+    REQUIRE( ! instance.synced());
+    REQUIRE(instance.find(category).size() == 1u);
+    REQUIRE(instance.find(category, { 0x01 }).size() == 1u);
+
+    // The kept spends are loaded, so the top block is disconnected.
+    REQUIRE(instance.disconnect(block1));
+    REQUIRE(instance.find(category).size() == 2u);
+}
+
+TEST_CASE("token index  load  missing file  false", "[token index tests]") {
+    std::filesystem::path const file = "token_index_load_missing";
+    std::error_code ec;
+    std::filesystem::remove(file, ec);
+
+    token_index instance(10);
+    REQUIRE(instance.connect(make_block(null_hash, 0, {}), 0));
+    REQUIRE( ! instance.load(file));
+    REQUIRE(instance.size() == 0u);
+}
+
+// End Test Suite
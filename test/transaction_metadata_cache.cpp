@@ -0,0 +1,80 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <test_helpers.hpp>
+
+#include <cstdint>
+
+#include <kth/blockchain.hpp>
+
+using namespace kth;
+using namespace kd::chain;
+using namespace kth::blockchain;
+using namespace kth::blockchain::test;
+
+// Start Test Suite: transaction metadata cache tests
+
+static
+transaction_metadata::ptr make_metadata(size_t sigops) {
+    return std::make_shared<transaction_metadata const>(transaction_metadata{ 100, sigops, 0, true, false, {} });
+}
+
+// transaction_metadata
+
+TEST_CASE("transaction metadata  compute  populated prevouts  measures", "[transaction metadata cache tests]") {
+    transaction const tx{ 1, 0, { input{ output_point{ make_hash(1), 0 }, script{}, max_uint32 } }, { output{ 700, script{}, {} } } };
+    tx.inputs()[0].previous_output().validation.cache = output{ 1000, script{}, {} };
+
+    auto const metadata = transaction_metadata::compute(tx, true, false);
+    REQUIRE(metadata->serialized_size == tx.serialized_size(true));
+    REQUIRE(metadata->sigops == tx.signature_operations(true, false));
+    REQUIRE(metadata->fees == 300u);
+    REQUIRE(metadata->counted(true, false));
+    REQUIRE( ! metadata->counted(false, false));
+    REQUIRE( ! metadata->counted(true, true));
+    REQUIRE( ! metadata->sigchecks);
+}
+
+// transaction_metadata_cache
+
+TEST_CASE("transaction metadata cache  get  added  returns", "[transaction metadata cache tests]") {
+    transaction_metadata_cache instance(10);
+    REQUIRE( ! instance.get(make_hash(1)));
+
+    instance.add(make_hash(1), make_metadata(1));
+    instance.add(make_hash(1), make_metadata(2));
+    REQUIRE(instance.size() == 1u);
+    REQUIRE(instance.get(make_hash(1))->sigops == 2u);
+}
+
+TEST_CASE("transaction metadata cache  add  over capacity  evicts oldest", "[transaction metadata cache tests]") {
+    transaction_metadata_cache instance(2);
+    instance.add(make_hash(1), make_metadata(1));
+    instance.add(make_hash(2), make_metadata(2));
+    instance.add(make_hash(3), make_metadata(3));
+    REQUIRE(instance.size() == 2u);
+    REQUIRE( ! instance.get(make_hash(1)));
+    REQUIRE(instance.get(make_hash(3)));
+}
+
+TEST_CASE("transaction metadata cache  add  zero capacity  disabled", "[transaction metadata cache tests]") {
+    transaction_metadata_cache instance(0);
+    instance.add(make_hash(1), make_metadata(1));
+    REQUIRE(instance.size() == 0u);
+}
+
+TEST_CASE("transaction metadata cache  remove  added  forgotten", "[transaction metadata cache tests]") {
+    transaction_metadata_cache instance(10);
+    instance.add(make_hash(1), make_metadata(1));
+    instance.remove(make_hash(1));
+    REQUIRE(instance.size() == 0u);
+    REQUIRE( ! instance.get(make_hash(1)));
+}
+
+TEST_CASE("relay hash  without witness  txid", "[transaction metadata cache tests]") {
+    transaction const tx{ 1, 0, { input{ output_point{ make_hash(1), 0 }, script{}, max_uint32 } }, { output{ 700, script{}, {} } } };
+    REQUIRE(relay_hash(tx) == tx.hash());
+}
+
+// End Test Suite
@@ -0,0 +1,139 @@
+// Copyright (c) 2016-2024 Knuth Project developers.
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <test_helpers.hpp>
+
+#include <cstdint>
+#include <filesystem>
+
+#include <kth/blockchain.hpp>
+
+using namespace kth;
+using namespace kd::chain;
+using namespace kth::blockchain;
+using namespace kth::blockchain::test;
+
+// Start Test Suite: utxo commitment index tests
+
+static
+data_chunk element(output_point const& point, output const& output) {
+    auto data = point.to_data();
+    extend_data(data, output.to_data());
+    return data;
+}
+
+static
+hash_digest digest(utxo_commitment_index const& instance, size_t height) {
+    hash_digest block_hash;
+    hash_digest result = null_hash;
+    instance.digest(height, block_hash, result);
+    return result;
+}
+
+TEST_CASE("utxo commitment index  push  spend  removes output", "[utxo commitment index tests]") {
+    utxo_commitment_index instance(10);
+    auto const coinbase0 = make_coinbase(0);
+    auto const block0 = make_block(null_hash, 0, { coinbase0 });
+    REQUIRE(instance.push(block0, 0));
+
+    transaction const spend{ 1, 0, { input{ output_point{ coinbase0.hash(), 0 }, script{}, max_uint32 } }, { output{ 40, script{}, {} } } };
+    auto const block1 = make_block(block0.hash(), 1, { make_coinbase(1), spend });
+    REQUIRE( ! instance.push(block1, 1));
+
+    block1.transactions()[1].inputs()[0].previous_output().validation.cache = coinbase0.outputs()[0];
+    REQUIRE(instance.push(block1, 1));
+    REQUIRE(instance.size() == 2u);
+
+    // The set holds the second coinbase output and the spend output.
+    muhash expected;
+    expected.insert(element(output_point{ block1.transactions()[0].hash(), 0 }, block1.transactions()[0].outputs()[0]));
+    expected.insert(element(output_point{ spend.hash(), 0 }, spend.outputs()[0]));
+
+    hash_digest block_hash;
+    hash_digest result;
+    REQUIRE(instance.digest(1, block_hash, result));
+    REQUIRE(block_hash == block1.hash());
+    REQUIRE(result == expected.digest());
+}
+
+TEST_CASE("utxo commitment index  truncate  restores state", "[utxo commitment index tests]") {
+    utxo_commitment_index instance(10);
+    auto const block0 = make_block(null_hash, 0, { make_coinbase(0) });
+    auto const block1 = make_block(block0.hash(), 1, { make_coinbase(1) });
+    REQUIRE(instance.push(block0, 0));
+    auto const before = digest(instance, 0);
+    REQUIRE(instance.push(block1, 1));
+
+    REQUIRE(instance.truncate(1));
+    REQUIRE(instance.size() == 1u);
+    REQUIRE(digest(instance, 0) == before);
+    REQUIRE(instance.push(block1, 1));
+}
+
+TEST_CASE("utxo commitment index  truncate  below window  cleared", "[utxo commitment index tests]") {
+    utxo_commitment_index instance(1);
+    auto const block0 = make_block(null_hash, 0, { make_coinbase(0) });
+    auto const block1 = make_block(block0.hash(), 1, { make_coinbase(1) });
+    auto const block2 = make_block(block1.hash(), 2, { make_coinbase(2) });
+    REQUIRE(instance.push(block0, 0));
+    REQUIRE(instance.push(block1, 1));
+    REQUIRE(instance.push(block2, 2));
+
+    hash_digest block_hash;
+    hash_digest result;
+    REQUIRE( ! instance.digest(1, block_hash, result));
+    REQUIRE( ! instance.truncate(2));
+    REQUIRE(instance.size() == 0u);
+}
+
+TEST_CASE("utxo commitment index  push  not extending top  false", "[utxo commitment index tests]") {
+    utxo_commitment_index instance(10);
+    REQUIRE(instance.push(make_block(null_hash, 0, { make_coinbase(0) }), 0));
+    REQUIRE( ! instance.push(make_block(null_hash, 1, { make_coinbase(1) }), 1));
+    REQUIRE( ! instance.push(make_block(null_hash, 1, { make_coinbase(1) }), 2));
+}
+
+TEST_CASE("utxo commitment index  open  existing file  restores states", "[utxo commitment index tests]") {
+    std::filesystem::path const file = "utxo_commitment_index_open";
+    std::error_code ec;
+    std::filesystem::remove(file, ec);
+
+    auto const block0 = make_block(null_hash, 0, { make_coinbase(0) });
+    auto const block1 = make_block(block0.hash(), 1, { make_coinbase(1) });
+    auto const block2 = make_block(block1.hash(), 2, { make_coinbase(2) });
+
+    hash_digest expected;
+    hash_digest below;
+
+    {
+        utxo_commitment_index instance(1, file);
+        REQUIRE(instance.open());
+        REQUIRE(instance.push(block0, 0));
+        below = digest(instance, 0);
+        REQUIRE(instance.push(block1, 1));
+        expected = digest(instance, 1);
+        instance.close();
+    }
+
+    utxo_commitment_index instance(1, file);
+    REQUIRE(instance.open());
+    REQUIRE(instance.size() == 2u);
+    REQUIRE(digest(instance, 1) == expected);
+
+    // Heights below the window are read from the file.
+    REQUIRE(digest(instance, 0) == below);
+
+    hash_digest block_hash;
+    REQUIRE(instance.block_hash(1, block_hash));
+    REQUIRE(block_hash == block1.hash());
+    REQUIRE(instance.push(block2, 2));
+
+    // Truncating below the window reloads the top state from the file.
+    REQUIRE(instance.truncate(1));
+    REQUIRE(digest(instance, 0) == below);
+    REQUIRE(instance.push(block1, 1));
+    REQUIRE(digest(instance, 1) == expected);
+}
+
+// End Test Suite